@@ -1915,6 +1915,23 @@ std::vector<fragment_stats> compute_fragment_stats(geometric_object_list geom,
   return fragments;
 }
 
+meep::cost_map fragment_stats_cost_map(const std::vector<fragment_stats> &stats) {
+  meep::cost_map costs;
+  const meep::chunk_cost_model &m = costs.model;
+  for (size_t i = 0; i < stats.size(); ++i) {
+    const fragment_stats &fs = stats[i];
+    if (fs.num_pixels_in_box == 0) continue;
+    double extra = m.anisotropic * (fs.num_anisotropic_eps_pixels + fs.num_anisotropic_mu_pixels)
+                   + m.nonlinear * fs.num_nonlinear_pixels
+                   + m.susceptibility * fs.num_susceptibility_pixels
+                   + m.conductivity * fs.num_nonzero_conductivity_pixels
+                   + m.dft * fs.num_dft_pixels;
+    costs.add(meep::volume(vector3_to_vec(fs.box.low), vector3_to_vec(fs.box.high)),
+              extra / fs.num_pixels_in_box);
+  }
+  return costs;
+}
+
 fragment_stats::fragment_stats(geom_box& bx, size_t pixels):
   num_anisotropic_eps_pixels(0),
   num_anisotropic_mu_pixels(0),
@@ -116,6 +116,12 @@ std::vector<fragment_stats> compute_fragment_stats(geometric_object_list geom,
                                                    bool ensure_per,
                                                    double box_size=10);
 
+/* The cost_map (for the meep::structure constructor) with the extra
+   cost per pixel of each fragment, averaged over the fragment.  The
+   PML costs are not included, since they are added by the structure.
+   Must be called after compute_fragment_stats. */
+meep::cost_map fragment_stats_cost_map(const std::vector<fragment_stats> &stats);
+
 /***************************************************************/
 /* these routines create and append absorbing layers to an     */
 /* optional list of absorbing layers which is added to the     */
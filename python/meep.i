@@ -299,6 +299,35 @@ PyObject *_get_farfield(meep::dft_near2far *f, const meep::vec & v) {
     return res;
 }
 
+// Wrapper around meep::dft_near2far::farfields for an n x 3 array of points
+PyObject *_get_farfields(meep::dft_near2far *f, PyObject *pts, int dims) {
+    PyArrayObject *arr = (PyArrayObject *)PyArray_FROMANY(pts, NPY_DOUBLE, 2, 2,
+                                                          NPY_ARRAY_IN_ARRAY);
+    if (!arr) return NULL;
+    if (PyArray_DIM(arr, 1) != 3) {
+        Py_DECREF(arr);
+        PyErr_SetString(PyExc_ValueError, "expected an n x 3 array of points");
+        return NULL;
+    }
+
+    npy_intp n = PyArray_DIM(arr, 0);
+    double *x = (double *)PyArray_DATA(arr);
+    meep::vec *v = new meep::vec[n];
+    for (npy_intp i = 0; i < n; ++i)
+        v[i] = dims == 2 ? meep::vec(x[3*i], x[3*i+1]) : meep::vec(x[3*i], x[3*i+1], x[3*i+2]);
+    Py_DECREF(arr);
+
+    std::complex<double> *ff_arr = f->farfields(v, n);
+    delete[] v;
+
+    npy_intp arr_dims[3] = {n, f->Nfreq, 6};
+    PyObject *res = PyArray_SimpleNew(3, arr_dims, NPY_CDOUBLE);
+    memcpy(PyArray_DATA((PyArrayObject*)res), ff_arr, sizeof(std::complex<double>) * n * f->Nfreq * 6);
+    delete[] ff_arr;
+
+    return res;
+}
+
 // Wrapper around meep::dft_ldos::ldos
 PyObject *_dft_ldos_ldos(meep::dft_ldos *f) {
     Py_ssize_t len = f->Nomega;
@@ -360,27 +389,99 @@ meep::volume_list *make_volume_list(const meep::volume &v, int c,
     return new meep::volume_list(v, c, weight, next);
 }
 
+// frees the data of a NumPy array created from a new[]-allocated array
+void _delete_cdouble_array(PyObject *capsule) {
+    delete[] (std::complex<double> *)PyCapsule_GetPointer(capsule, NULL);
+}
+
+// if arr is not None, it is filled in place (and returned) instead of
+// creating a new array; otherwise the array returned by get_dft_array is
+// handed over to NumPy without a copy
 template<typename dft_type>
-PyObject *_get_dft_array(meep::fields *f, dft_type dft, meep::component c, int num_freq) {
+PyObject *_get_dft_array(meep::fields *f, dft_type dft, meep::component c, int num_freq,
+                         PyObject *arr) {
     int rank;
     int dims[3];
     std::complex<double> *dft_arr = f->get_dft_array(dft, c, num_freq, &rank, dims);
 
-    size_t length = 1;
-    npy_intp *arr_dims = new npy_intp[rank];
+    size_t length = dft_arr ? 1 : 0;
+    npy_intp arr_dims[3] = {0, 0, 0};
     for (int i = 0; i < rank; ++i) {
         arr_dims[i] = dims[i];
         length *= dims[i];
     }
+    if (!dft_arr) rank = 1; // no data: an empty array
+
+    if (arr != Py_None) {
+        if (!PyArray_Check(arr) || PyArray_TYPE((PyArrayObject*)arr) != NPY_CDOUBLE ||
+            !PyArray_ISCARRAY((PyArrayObject*)arr) ||
+            (size_t)PyArray_SIZE((PyArrayObject*)arr) != length) {
+            delete[] dft_arr;
+            PyErr_SetString(PyExc_ValueError, "arr must be a writeable, contiguous complex "
+                            "array with the size of the DFT array");
+            return NULL;
+        }
+        if (length)
+            memcpy(PyArray_DATA((PyArrayObject*)arr), dft_arr, sizeof(std::complex<double>) * length);
+        delete[] dft_arr;
+        Py_INCREF(arr);
+        return arr;
+    }
 
-    PyObject *py_arr = PyArray_SimpleNew(rank, arr_dims, NPY_CDOUBLE);
-    memcpy(PyArray_DATA((PyArrayObject*)py_arr), dft_arr, sizeof(std::complex<double>) * length);
-    delete[] dft_arr;
-    delete[] arr_dims;
-
+    if (!dft_arr) return PyArray_SimpleNew(rank, arr_dims, NPY_CDOUBLE);
+    PyObject *py_arr = PyArray_SimpleNewFromData(rank, arr_dims, NPY_CDOUBLE, dft_arr);
+    PyArray_SetBaseObject((PyArrayObject*)py_arr, PyCapsule_New(dft_arr, NULL, _delete_cdouble_array));
     return py_arr;
 }
 
+// read-only NumPy views, without copies, of the process-local arrays of the
+// chunks; they are only valid as long as the arrays exist (e.g. until the
+// fields or the DFT object are deleted, or the chunks are changed)
+PyObject *_readonly_array_view(int nd, npy_intp *dims, npy_intp *strides, int type, void *data) {
+    PyObject *arr = PyArray_New(&PyArray_Type, nd, dims, type, strides, data, 0, 0, NULL);
+    if (arr) PyArray_CLEARFLAGS((PyArrayObject*)arr, NPY_ARRAY_WRITEABLE);
+    return arr;
+}
+
+// list of (position of the first point, array) for the chunks of this process
+// with the real (cmp=0) or imaginary (cmp=1) part of component c, where the
+// array has one axis per direction (as get_array_slice) and includes the
+// boundary points of the chunk
+PyObject *_get_chunk_field_arrays(meep::fields *f, meep::component c, int cmp) {
+    const int type = sizeof(meep::realnum) == sizeof(float) ? NPY_FLOAT : NPY_DOUBLE;
+    PyObject *res = PyList_New(0);
+    for (int i = 0; i < f->num_chunks; ++i) {
+        meep::fields_chunk *fc = f->chunks[i];
+        if (!fc->is_mine() || !fc->f[c][cmp]) continue;
+        npy_intp dims[3], strides[3];
+        int nd = 0;
+        LOOP_OVER_DIRECTIONS(fc->gv.dim, d) {
+            dims[nd] = fc->gv.num_direction(d) + 1;
+            strides[nd++] = fc->gv.stride(d) * sizeof(meep::realnum);
+        }
+        PyObject *arr = _readonly_array_view(nd, dims, strides, type, fc->f[c][cmp]);
+        PyObject *item = Py_BuildValue("(NN)", vec2py(fc->gv.loc(c, 0), true), arr);
+        PyList_Append(res, item);
+        Py_DECREF(item);
+    }
+    return res;
+}
+
+// list of N x Nomega arrays of the DFT chunks of this process in the chunk
+// list dc (as dft_chunk::dft)
+PyObject *_get_dft_chunk_arrays(meep::dft_chunk *dc) {
+    const int type = sizeof(meep::realnum) == sizeof(float) ? NPY_CFLOAT : NPY_CDOUBLE;
+    PyObject *res = PyList_New(0);
+    for (meep::dft_chunk *cur = dc; cur; cur = cur->next_in_dft) {
+        cur->flush_dft();
+        npy_intp dims[2] = {(npy_intp)cur->N, (npy_intp)cur->Nomega};
+        PyObject *arr = _readonly_array_view(2, dims, NULL, type, cur->dft);
+        PyList_Append(res, arr);
+        Py_DECREF(arr);
+    }
+    return res;
+}
+
 size_t _get_dft_data_size(meep::dft_chunk *dc) {
     size_t istart;
     return meep::dft_chunks_Ntotal(dc, &istart) / 2;
@@ -397,6 +498,7 @@ void _get_dft_data(meep::dft_chunk *dc, std::complex<meep::realnum> *cdata, int
 
     for (meep::dft_chunk *cur = dc; cur; cur = cur->next_in_dft) {
         size_t Nchunk = cur->N * cur->Nomega;
+        cur->flush_dft();
         for (size_t i = 0; i < Nchunk; ++i) {
             cdata[i + istart] = cur->dft[i];
         }
@@ -415,6 +517,7 @@ void _load_dft_data(meep::dft_chunk *dc, std::complex<meep::realnum> *cdata, int
 
     for (meep::dft_chunk *cur = dc; cur; cur = cur->next_in_dft) {
         size_t Nchunk = cur->N * cur->Nomega;
+        cur->flush_dft();
         for (size_t i = 0; i < Nchunk; ++i) {
             cur->dft[i] = cdata[i + istart];
         }
@@ -500,11 +603,15 @@ PyObject *py_do_harminv(PyObject *vals, double dt, double f_min, double f_max, i
                      double err_thresh, double rel_amp_thresh, double amp_thresh);
 
 PyObject *_get_farfield(meep::dft_near2far *f, const meep::vec & v);
+PyObject *_get_farfields(meep::dft_near2far *f, PyObject *pts, int dims);
 PyObject *_dft_ldos_ldos(meep::dft_ldos *f);
 PyObject *_dft_ldos_F(meep::dft_ldos *f);
 PyObject *_dft_ldos_J(meep::dft_ldos *f);
 template<typename dft_type>
-PyObject *_get_dft_array(meep::fields *f, dft_type dft, meep::component c, int num_freq);
+PyObject *_get_dft_array(meep::fields *f, dft_type dft, meep::component c, int num_freq,
+                         PyObject *arr);
+PyObject *_get_chunk_field_arrays(meep::fields *f, meep::component c, int cmp);
+PyObject *_get_dft_chunk_arrays(meep::dft_chunk *dc);
 size_t _get_dft_data_size(meep::dft_chunk *dc);
 void _get_dft_data(meep::dft_chunk *dc, std::complex<meep::realnum> *cdata, int size);
 void _load_dft_data(meep::dft_chunk *dc, std::complex<meep::realnum> *cdata, int size);
@@ -860,10 +967,35 @@ meep::volume_list *make_volume_list(const meep::volume &v, int c,
 %typemap(freearg) (meep::component *components, int num_components) {
     delete[] $1;
 }
+
+%typecheck(SWIG_TYPECHECK_POINTER) (meep::component *components, int num_components) {
+    $1 = PyList_Check($input);
+}
 //--------------------------------------------------
 // end typemaps for add_dft_fields
 //--------------------------------------------------
 
+//--------------------------------------------------
+// typemaps needed for get_reduced_array_slice and field_accumulator
+//--------------------------------------------------
+%typemap(in) const std::vector<meep::component> &components (std::vector<meep::component> tmp) {
+    if (!PyList_Check($input)) {
+        PyErr_SetString(PyExc_ValueError, "Expected a list");
+        SWIG_fail;
+    }
+    for (Py_ssize_t i = 0; i < PyList_Size($input); i++) {
+        tmp.push_back((meep::component)PyInteger_AsLong(PyList_GetItem($input, i)));
+    }
+    $1 = &tmp;
+}
+
+%typecheck(SWIG_TYPECHECK_POINTER) const std::vector<meep::component> &components {
+    $1 = PyList_Check($input);
+}
+//--------------------------------------------------
+// end typemaps for get_reduced_array_slice and field_accumulator
+//--------------------------------------------------
+
 // typemap suite for field functions
 
 %typecheck(SWIG_TYPECHECK_POINTER) (int num_fields, const meep::component *components,
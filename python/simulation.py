@@ -32,7 +32,7 @@ NearToFarData = namedtuple('NearToFarData', ['F'])
 
 
 def get_num_args(func):
-    if isinstance(func, Harminv):
+    if isinstance(func, (Harminv, FieldAccumulator)):
         return 2
     return func.__code__.co_argcount
 
@@ -218,6 +218,10 @@ class DftObj(object):
     def remove(self):
         return self.swigobj_attr('remove')
 
+    @property
+    def freq(self):
+        return self.swigobj_attr('freq')
+
     @property
     def freq_min(self):
         return self.swigobj_attr('freq_min')
@@ -424,6 +428,13 @@ class Harminv(object):
 
         return modes
 
+    def adaptive_freqs(self, nfreq, uniform_fraction=0.25):
+        """Return nfreq frequencies from fcen - df/2 to fcen + df/2 that are concentrated
+        near the modes found by harminv (in a short run), for use with add_flux etc."""
+        return list(mp.adaptive_dft_freqs(self.fcen - self.df / 2, self.fcen + self.df / 2, nfreq,
+                                          [m.freq for m in self.modes], [abs(m.decay) for m in self.modes],
+                                          uniform_fraction))
+
     def _harminv(self):
 
         def _harm(sim):
@@ -439,6 +450,52 @@ class Harminv(object):
         return _combine_step_funcs(at_end(_harm), f1(self.c, self.pt))
 
 
+class FieldAccumulator(object):
+
+    def __init__(self, components, vol=None, center=None, size=None, op=mp.ReduceMean,
+                 stride=1, space_op=mp.ReduceSample):
+        self.components = components if isinstance(components, Sequence) else [components]
+        self.vol = vol
+        self.center = center
+        self.size = size
+        self.op = op
+        self.stride = stride
+        self.space_op = space_op
+        self.swigobj = None
+
+    def __call__(self, sim, todo):
+        if todo == 'step':
+            if self.swigobj is None:
+                if self.vol is None and self.center is None and self.size is None:
+                    v = sim.fields.total_volume()
+                else:
+                    v = sim._volume_from_kwargs(self.vol, self.center, self.size)
+                r = sim._field_reduction(self.space_op, self.stride)
+                dim_sizes = np.zeros(3, dtype=np.uintp)
+                sim.fields.get_reduced_array_slice_dimensions(v, r, dim_sizes)
+                self.dims = [s for s in dim_sizes if s != 0]
+                self.swigobj = mp.field_accumulator(sim.fields, v, self.components, r, self.op)
+            self.swigobj.update()
+
+    def get(self):
+        if self.swigobj is None:
+            raise ValueError("FieldAccumulator has not been updated")
+        arr = np.zeros(self.dims, dtype=np.float64)
+        self.swigobj.get(arr)
+        return arr
+
+    def reset(self):
+        if self.swigobj is not None:
+            self.swigobj.reset()
+
+    def output(self, sim, fname, dataname='accumulated', single_precision=False):
+        if self.swigobj is None:
+            raise ValueError("FieldAccumulator has not been updated")
+        h5 = sim.fields.open_h5file(fname, mp.h5file.WRITE, sim.get_filename_prefix())
+        self.swigobj.output_hdf5(h5, dataname, single_precision)
+        del h5
+
+
 class Simulation(object):
 
     def __init__(self,
@@ -574,8 +631,10 @@ class Simulation(object):
 
         dft_freqs = []
         for dftf in self.dft_objects:
-            dft_freqs.append(dftf.freq_min)
-            dft_freqs.append(dftf.freq_min + dftf.Nfreq * dftf.dfreq)
+            freqs = list(dftf.freq)
+            if freqs:
+                dft_freqs.append(min(freqs))
+                dft_freqs.append(max(freqs))
 
         warn_src = ('Note: your sources include frequencies outside the range of validity of the ' +
                     'material models. This is fine as long as you eventually only look at outputs ' +
@@ -895,9 +954,11 @@ class Simulation(object):
             self.default_material = self.epsilon_input_file
 
         self.fragment_stats = self._compute_fragment_stats(gv)
+        costs = mp.fragment_stats_cost_map(self.fragment_stats)
 
         self.structure = mp.structure(gv, None, br, sym, self.num_chunks, self.Courant,
-                                      self.eps_averaging, self.subpixel_tol, self.subpixel_maxeval)
+                                      self.eps_averaging, self.subpixel_tol, self.subpixel_maxeval,
+                                      costs)
         self.structure.shared_chunks = True
 
         mp.set_materials_from_geometry(self.structure, self.geometry, self.eps_averaging, self.subpixel_tol,
@@ -935,6 +996,35 @@ class Simulation(object):
             raise ValueError("Fields must be initialized before calling dump_structure")
         self.structure.dump(fname)
 
+    def dump_fields(self, fname):
+        if self.fields is None:
+            raise ValueError("Fields must be initialized before calling dump_fields")
+        self._evaluate_dft_objects()
+        self.fields.dump(fname)
+
+    def load_fields(self, fname):
+        if self.fields is None:
+            self.init_sim()
+        self._evaluate_dft_objects()
+        self.fields.load(fname)
+
+    def use_async_output(self, async_output=True, max_bytes=0):
+        if self.fields is None:
+            self.init_sim()
+        self.fields.use_async_output(async_output, max_bytes)
+
+    def flush_output(self):
+        if self.fields is not None:
+            self.fields.flush_output()
+
+    def use_output_compression(self, deflate_level=6, shuffle=True, max_error=0, chunks=None):
+        if self.fields is None:
+            self.init_sim()
+        storage = mp.h5_storage(deflate_level, shuffle, max_error)
+        for i, n in enumerate(chunks or []):
+            storage.set_chunk_dim(i, n)
+        self.fields.set_output_storage(storage)
+
     def init_sim(self):
         if self._is_initialized:
             return
@@ -1082,6 +1172,7 @@ class Simulation(object):
         for func in step_funcs:
             _eval_step_func(self, func, 'finish')
 
+        self.fields.flush_output()
         print("run {} finished at t = {} ({} timesteps)".format(self.run_index, self.meep_time(), self.fields.t))
         self.run_index += 1
 
@@ -1216,7 +1307,9 @@ class Simulation(object):
             if dft.swigobj is None:
                 dft.swigobj = dft.func(*dft.args)
 
-    def add_dft_fields(self, components, freq_min, freq_max, nfreq, where=None, center=None, size=None):
+    def add_dft_fields(self, components, freq_min, freq_max=None, nfreq=None, where=None, center=None, size=None):
+        if freq_max is None:  # freq_min is a list of frequencies
+            nfreq = len(freq_min)
         dftf = DftFields(self._add_dft_fields, [components, where, center, size, freq_min, freq_max, nfreq])
         self.dft_objects.append(dftf)
         return dftf
@@ -1229,6 +1322,8 @@ class Simulation(object):
         except ValueError:
             where = self.fields.total_volume()
 
+        if freq_max is None:
+            return self.fields.add_dft_fields(components, where, list(freq_min))
         return self.fields.add_dft_fields(components, where, freq_min, freq_max, nfreq)
 
     def output_dft(self, dft_fields, fname):
@@ -1248,7 +1343,8 @@ class Simulation(object):
         mp._get_dft_data(dft_chunk, arr)
         return arr
 
-    def add_near2far(self, fcen, df, nfreq, *near2fars):
+    def add_near2far(self, *args):
+        fcen, df, nfreq, near2fars = _dft_freq_args(args)
         n2f = DftNear2Far(self._add_near2far, [fcen, df, nfreq, near2fars])
         self.dft_objects.append(n2f)
         return n2f
@@ -1261,9 +1357,17 @@ class Simulation(object):
     def get_farfield(self, f, v):
         return mp._get_farfield(f.swigobj, py_v3_to_vec(self.dimensions, v, is_cylindrical=self.is_cylindrical))
 
-    def output_farfields(self, near2far, fname, resolution, where=None, center=None, size=None):
+    def get_farfields(self, f, pts):
+        if self.dimensions not in (2, 3) or self.is_cylindrical:
+            raise ValueError("far fields are only supported in 2d and 3d")
+        if len(pts) and isinstance(pts[0], Vector3):
+            pts = [[p.x, p.y, p.z] for p in pts]
+        pts = np.asarray(pts, dtype=np.float64).reshape(-1, 3)
+        return mp._get_farfields(f.swigobj, pts, self.dimensions)
+
+    def output_farfields(self, near2far, fname, resolution, where=None, center=None, size=None, tol=0):
         vol = self._volume_from_kwargs(where, center, size)
-        near2far.save_farfields(fname, self.get_filename_prefix(), vol, resolution)
+        near2far.save_farfields(fname, self.get_filename_prefix(), vol, resolution, tol)
 
     def load_near2far(self, fname, n2f):
         if self.fields is None:
@@ -1289,7 +1393,8 @@ class Simulation(object):
         self.load_near2far_data(n2f, n2fdata)
         n2f.scale_dfts(complex(1.0))
 
-    def add_force(self, fcen, df, nfreq, *forces):
+    def add_force(self, *args):
+        fcen, df, nfreq, forces = _dft_freq_args(args)
         force = DftForce(self._add_force, [fcen, df, nfreq, forces])
         self.dft_objects.append(force)
         return force
@@ -1331,7 +1436,8 @@ class Simulation(object):
         self.load_force_data(force, fdata)
         force.scale_dfts(complex(-1.0))
 
-    def add_flux(self, fcen, df, nfreq, *fluxes):
+    def add_flux(self, *args):
+        fcen, df, nfreq, fluxes = _dft_freq_args(args)
         flux = DftFlux(self._add_flux, [fcen, df, nfreq, fluxes])
         self.dft_objects.append(flux)
         return flux
@@ -1341,7 +1447,8 @@ class Simulation(object):
             self.init_sim()
         return self._add_fluxish_stuff(self.fields.add_dft_flux, fcen, df, nfreq, fluxes)
 
-    def add_mode_monitor(self, fcen, df, nfreq, *fluxes):
+    def add_mode_monitor(self, *args):
+        fcen, df, nfreq, fluxes = _dft_freq_args(args)
         flux = DftFlux(self._add_mode_monitor, [fcen, df, nfreq, fluxes])
         self.dft_objects.append(flux)
         return flux
@@ -1358,11 +1465,13 @@ class Simulation(object):
         d0 = region.direction
         d = self.fields.normal_direction(v.swigobj) if d0 < 0 else d0
 
+        if df is None:
+            return self.fields.add_mode_monitor(d, v.swigobj, fcen)
         return self.fields.add_mode_monitor(d, v.swigobj, fcen - df / 2, fcen + df / 2, nfreq)
 
-    def add_eigenmode(self, fcen, df, nfreq, *fluxes):
+    def add_eigenmode(self, *args):
         warnings.warn('add_eigenmode is deprecated. Please use add_mode_monitor instead.', DeprecationWarning)
-        return self.add_mode_monitor(fcen, df, nfreq, *fluxes)
+        return self.add_mode_monitor(*args)
 
     def display_fluxes(self, *fluxes):
         display_csv(self, 'flux', zip(get_flux_freqs(fluxes[0]), *[get_fluxes(f) for f in fluxes]))
@@ -1468,7 +1577,10 @@ class Simulation(object):
                         is_cylindrical=self.is_cylindrical).swigobj
             vol_list = mp.make_volume_list(v2, c, s.weight, vol_list)
 
-        stuff = add_dft_stuff(vol_list, fcen - df / 2, fcen + df / 2, nfreq)
+        if df is None:  # fcen is a list of frequencies
+            stuff = add_dft_stuff(vol_list, fcen)
+        else:
+            stuff = add_dft_stuff(vol_list, fcen - df / 2, fcen + df / 2, nfreq)
         vol_list.__swig_destroy__(vol_list)
 
         return stuff
@@ -1547,23 +1659,75 @@ class Simulation(object):
 
         return arr
 
-    def get_dft_array(self, dft_obj, component, num_freq):
+    def _field_reduction(self, op, stride):
+        if isinstance(stride, numbers.Number):
+            return mp.field_reduction(op, int(stride))
+        r = mp.field_reduction(op)
+        dirs = [mp.R, mp.P, mp.Z] if self.is_cylindrical else [mp.X, mp.Y, mp.Z]
+        for d, s in zip(dirs, [stride.x, stride.y, stride.z]):
+            r.set_stride(d, int(s))
+        return r
+
+    def get_reduced_array(self, vol=None, center=None, size=None, component=mp.Ez,
+                          op=mp.ReduceMean, stride=1):
+        if self.fields is None:
+            raise ValueError("Fields must be initialized before calling get_reduced_array")
+
+        if vol is None and center is None and size is None:
+            v = self.fields.total_volume()
+        else:
+            v = self._volume_from_kwargs(vol, center, size)
+
+        r = self._field_reduction(op, stride)
+        dim_sizes = np.zeros(3, dtype=np.uintp)
+        self.fields.get_reduced_array_slice_dimensions(v, r, dim_sizes)
+        arr = np.zeros([s for s in dim_sizes if s != 0], dtype=np.float64)
+
+        if isinstance(component, Sequence):
+            self.fields.get_reduced_array_slice(v, list(component), None, None, r, arr)
+        else:
+            self.fields.get_reduced_array_slice(v, component, r, arr)
+
+        return arr
+
+    def get_dft_array(self, dft_obj, component, num_freq, arr=None):
         if hasattr(dft_obj, 'swigobj'):
             dft_swigobj = dft_obj.swigobj
         else:
             dft_swigobj = dft_obj
 
         if type(dft_swigobj) is mp.dft_fields:
-            return mp.get_dft_fields_array(self.fields, dft_swigobj, component, num_freq)
+            return mp.get_dft_fields_array(self.fields, dft_swigobj, component, num_freq, arr)
         elif type(dft_swigobj) is mp.dft_flux:
-            return mp.get_dft_flux_array(self.fields, dft_swigobj, component, num_freq)
+            return mp.get_dft_flux_array(self.fields, dft_swigobj, component, num_freq, arr)
         elif type(dft_swigobj) is mp.dft_force:
-            return mp.get_dft_force_array(self.fields, dft_swigobj, component, num_freq)
+            return mp.get_dft_force_array(self.fields, dft_swigobj, component, num_freq, arr)
         elif type(dft_swigobj) is mp.dft_near2far:
-            return mp.get_dft_near2far_array(self.fields, dft_swigobj, component, num_freq)
+            return mp.get_dft_near2far_array(self.fields, dft_swigobj, component, num_freq, arr)
         else:
             raise ValueError("Invalid type of dft object: {}".format(dft_swigobj))
 
+    def get_local_field_arrays(self, component=mp.Ez, imag=False):
+        if self.fields is None:
+            raise ValueError("Fields must be initialized before calling get_local_field_arrays")
+        return mp._get_chunk_field_arrays(self.fields, component, 1 if imag else 0)
+
+    def get_local_dft_arrays(self, dft_obj):
+        dft_swigobj = dft_obj.swigobj if hasattr(dft_obj, 'swigobj') else dft_obj
+
+        if type(dft_swigobj) is mp.dft_fields:
+            chunklists = [dft_swigobj.chunks]
+        elif type(dft_swigobj) is mp.dft_flux:
+            chunklists = [dft_swigobj.E, dft_swigobj.H]
+        elif type(dft_swigobj) is mp.dft_force:
+            chunklists = [dft_swigobj.offdiag1, dft_swigobj.offdiag2, dft_swigobj.diag]
+        elif type(dft_swigobj) is mp.dft_near2far:
+            chunklists = [dft_swigobj.F]
+        else:
+            raise ValueError("Invalid type of dft object: {}".format(dft_swigobj))
+
+        return [a for dc in chunklists for a in mp._get_dft_chunk_arrays(dc)]
+
     def get_eigenmode_coefficients(self, flux, bands, eig_parity=mp.NO_PARITY,
                                    eig_vol=None, eig_resolution=0, eig_tolerance=1e-12, kpoint_func=None):
         if self.fields is None:
@@ -2155,7 +2319,8 @@ def display_run_data(sim, data_name, data):
 
 def convert_h5(rm_h5, convert_cmd, *step_funcs):
 
-    def convert(fname):
+    def convert(sim, fname):
+        sim.flush_output() # the file must be complete before converting it
         if mp.my_rank() == 0:
             cmd = convert_cmd.split()
             cmd.append(fname)
@@ -2165,7 +2330,7 @@ def convert_h5(rm_h5, convert_cmd, *step_funcs):
 
     def _convert_h5(sim, todo):
         hooksave = sim.output_h5_hook
-        sim.output_h5_hook = convert
+        sim.output_h5_hook = lambda fname: convert(sim, fname)
 
         for f in step_funcs:
             _eval_step_func(sim, f, todo)
@@ -2383,8 +2548,18 @@ def scale_flux_fields(s, flux):
     flux.scale_dfts(s)
 
 
+def _dft_freq_args(args):
+    """Split the arguments of add_flux etc., which start with either fcen, df, nfreq
+    or a list of frequencies, into fcen, df, nfreq and the list of regions.  For a
+    list of frequencies, fcen is the list and df is None."""
+    if isinstance(args[0], (list, tuple, np.ndarray)):
+        freq = [float(f) for f in args[0]]
+        return freq, None, len(freq), args[1:]
+    return args[0], args[1], args[2], args[3:]
+
+
 def get_flux_freqs(f):
-    return np.linspace(f.freq_min, f.freq_min + f.dfreq * f.Nfreq, num=f.Nfreq, endpoint=False).tolist()
+    return list(f.freq)
 
 
 def get_fluxes(f):
@@ -2396,11 +2571,11 @@ def scale_force_fields(s, force):
 
 
 def get_eigenmode_freqs(f):
-    return np.linspace(f.freq_min, f.freq_min + f.dfreq * f.Nfreq, num=f.Nfreq, endpoint=False).tolist()
+    return list(f.freq)
 
 
 def get_force_freqs(f):
-    return np.linspace(f.freq_min, f.freq_min + f.dfreq * f.Nfreq, num=f.Nfreq, endpoint=False).tolist()
+    return list(f.freq)
 
 
 def get_forces(f):
@@ -2412,7 +2587,7 @@ def scale_near2far_fields(s, n2f):
 
 
 def get_near2far_freqs(f):
-    return np.linspace(f.freq_min, f.freq_min + f.dfreq * f.Nfreq, num=f.Nfreq, endpoint=False).tolist()
+    return list(f.freq)
 
 
 def interpolate(n, nums):
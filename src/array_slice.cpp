@@ -43,6 +43,9 @@ typedef struct {
   // if the data parameter is non-null
   ivec min_corner, max_corner;
   int num_chunks;
+  // the same for the chunks of this process only
+  ivec local_min_corner, local_max_corner;
+  int local_num_chunks;
   int rank;
   direction ds[3];
   size_t slice_size;
@@ -70,6 +73,12 @@ typedef struct {
   component invmu_cs[3];
   direction invmu_ds[3];
 
+  // reduction (get_reduced_array_slice), if any: the dims of the
+  // slice (1 beyond its rank), the size of the blocks in each
+  // dimension, and the dimensions of the reduced data
+  const field_reduction *reduce;
+  size_t dims[3], block[3], rdims[3];
+
 } array_slice_data;
 
 #define UNUSED(x) (void) x // silence compiler warnings
@@ -91,6 +100,64 @@ static double default_field_rfunc(const cdouble *fields,
   return real(fields[0]);
 }
 
+/* default field function of the reductions: sum of |f|^2 */
+static double sum_of_squares(const cdouble *fields,
+			     const vec &loc, void *data_)
+{
+  (void) loc; // unused
+  const int n = *(const int *) data_;
+  double sum = 0;
+  for (int i = 0; i < n; ++i) sum += norm(fields[i]);
+  return sum;
+}
+
+/* set up the reduction r of the slice of the given rank and dims
+   in data, and return the number of reduced values */
+static size_t init_reduction(array_slice_data *data, int rank,
+			     const size_t *dims, const field_reduction *r)
+{
+  data->reduce = r;
+  size_t n = 1;
+  for (int i = 0; i < 3; ++i) {
+    data->dims[i] = i < rank ? dims[i] : 1;
+    int s = i < rank ? r->stride[data->ds[i]] : 1;
+    data->block[i] = (s <= 0 || size_t(s) > data->dims[i]) ?
+      data->dims[i] : size_t(s);
+    data->rdims[i] = (data->dims[i] + data->block[i] - 1) / data->block[i];
+    n *= data->rdims[i];
+  }
+  return n;
+}
+
+/* combine the value v at index idx of the slice into the reduced data */
+static inline void reduce_value(array_slice_data *data, ptrdiff_t idx,
+				double v)
+{
+  size_t j[3], b = 0;
+  bool first = true; // first point of its block
+  j[2] = idx % data->dims[2]; idx /= data->dims[2];
+  j[1] = idx % data->dims[1];
+  j[0] = idx / data->dims[1];
+  for (int i = 0; i < 3; ++i) {
+    b = b * data->rdims[i] + j[i] / data->block[i];
+    first = first && j[i] % data->block[i] == 0;
+  }
+  double *r = (double *) data->vslice;
+  switch (data->reduce->op) {
+  case ReduceSample: if (first) r[b] = v; break;
+  case ReduceSum: case ReduceMean: r[b] += v; break;
+  case ReduceRMS: r[b] += v * v; break;
+  case ReduceMin: if (v < r[b]) r[b] = v; break;
+  case ReduceMax: if (v > r[b]) r[b] = v; break;
+  }
+}
+
+/* initial value of the reduced data for the reduction op */
+static double reduction_init(reduction_op op)
+{
+  return op == ReduceMin ? infinity : (op == ReduceMax ? -infinity : 0.0);
+}
+
 /***************************************************************/
 /* callback function passed to loop_in_chunks to compute       */
 /* dimensions of array slice                                   */
@@ -255,7 +322,9 @@ static void get_array_slice_chunkloop(fields_chunk *fc, int ichnk, component cgr
                          + loop_i2 * stride[1])
                          + loop_i3 * stride[2]);
 
-    if (complex_data)
+    if (data->reduce)
+     reduce_value(data, idx2, data->rfun(fields, loc, data->fun_data));
+    else if (complex_data)
      zslice[idx2] = data->fun(fields, loc, data->fun_data);
     else
      slice[idx2]  = data->rfun(fields, loc, data->fun_data);
@@ -289,10 +358,15 @@ int fields::get_array_slice_dimensions(const volume &where, size_t dims[3], void
   data->min_corner = gv.round_vec(where.get_max_corner()) + one_ivec(gv.dim);
   data->max_corner = gv.round_vec(where.get_min_corner()) - one_ivec(gv.dim);
   data->num_chunks = 0;
+  data->rank = 0;
+  data->slice_size = 0;
 
   loop_in_chunks(get_array_slice_dimensions_chunkloop,
                  (void *) data, where, Centered, true, true);
 
+  data->local_min_corner = data->min_corner;
+  data->local_max_corner = data->max_corner;
+  data->local_num_chunks = data->num_chunks;
   data->max_corner = max_to_all(data->max_corner);
   data->min_corner = -max_to_all(-data->min_corner); // i.e., min_to_all
   data->num_chunks = sum_to_all(data->num_chunks);
@@ -318,6 +392,73 @@ int fields::get_array_slice_dimensions(const volume &where, size_t dims[3], void
   return rank;
 }
 
+/* the sub-block of the slice covering the chunks of this process, given
+   the data of get_array_slice_dimensions; returns its size (0 if none) */
+static size_t local_slice_block(const array_slice_data *data,
+                                size_t start[3], size_t count[3])
+{
+  size_t n = data->local_num_chunks ? 1 : 0;
+  for (int i = 0; i < 3; ++i) {
+    start[i] = 0;
+    count[i] = n;
+  }
+  if (n == 0) return 0;
+  for (int i = 0; i < data->rank; ++i) {
+    direction d = data->ds[i];
+    start[i] = (data->local_min_corner.in_direction(d)
+                - data->min_corner.in_direction(d)) / 2;
+    count[i] = (data->local_max_corner.in_direction(d)
+                - data->local_min_corner.in_direction(d)) / 2 + 1;
+    n *= count[i];
+  }
+  return n;
+}
+
+int fields::get_local_array_slice_dimensions(const volume &where,
+                                             size_t start[3],
+                                             size_t count[3])
+{
+  size_t dims[3];
+  array_slice_data data;
+  int rank = get_array_slice_dimensions(where, dims, &data);
+  if (data.slice_size == 0) data.local_num_chunks = 0;
+  local_slice_block(&data, start, count);
+  return rank;
+}
+
+/* send the sub-blocks (start, count) of the slice computed by the other
+   processes to the master, which adds them into its full slice (with the
+   given dims); nd is the number of doubles per value */
+#define BUFSIZE 1<<16 // communicate 64k values at a time
+static void gather_slice_blocks(void *vslice, int nd, const size_t dims[3],
+                                const size_t start[3], const size_t count[3])
+{
+  for (int p = 1; p < count_processors(); ++p) {
+    size_t block[6];
+    for (int i = 0; i < 3; ++i) {
+      block[i] = start[i];
+      block[3+i] = count[i];
+    }
+    send(p, 0, block, 6);
+    size_t n = nd * block[3] * block[4] * block[5];
+    if (n == 0) continue;
+    double *buf = am_master() ? new double[n] : (double *) vslice;
+    for (size_t offset = 0; offset < n; offset += BUFSIZE)
+      send(p, 0, buf + offset, (n - offset > BUFSIZE ? BUFSIZE : n - offset));
+    if (am_master()) {
+      double *slice = (double *) vslice;
+      size_t idx = 0;
+      for (size_t j0 = 0; j0 < block[3]; ++j0)
+        for (size_t j1 = 0; j1 < block[4]; ++j1)
+          for (size_t j2 = 0; j2 < block[5]; ++j2)
+            for (int k = 0; k < nd; ++k)
+              slice[nd * (((block[0] + j0) * dims[1] + block[1] + j1) * dims[2]
+                          + block[2] + j2) + k] += buf[idx++];
+      delete[] buf;
+    }
+  }
+}
+
 /***************************************************************/
 /* precisely one of fun, rfun should be non-NULL               */
 /***************************************************************/
@@ -326,7 +467,9 @@ void *fields::do_get_array_slice(const volume &where,
                                  field_function fun,
                                  field_rfunction rfun,
                                  void *fun_data,
-                                 void *vslice) {
+                                 void *vslice,
+                                 const field_reduction *reduce,
+                                 slice_gather gather) {
 
   am_now_working_on(FieldOutput);
 
@@ -338,23 +481,49 @@ void *fields::do_get_array_slice(const volume &where,
   array_slice_data data;
   int rank=get_array_slice_dimensions(where, dims, &data);
   size_t slice_size=data.slice_size;
-  if (rank==0 || slice_size==0) return 0; // no data to write
+  data.reduce = 0;
+  if (reduce && slice_size) {
+    if (!rfun) abort("reduced array slices require a real-valued function");
+    slice_size = init_reduction(&data, rank, dims, reduce);
+  }
+  if ((rank==0 && !reduce) || slice_size==0) return 0; // no data to write
+  if (reduce && gather != GatherToAll)
+    abort("reduced array slices are always gathered to all processes");
+
+  /* without GatherToAll, the processes other than the master only
+     compute the sub-block of the slice covering their own chunks */
+  size_t start[3], count[3];
+  size_t local_size = local_slice_block(&data, start, count);
+  bool local_block = gather == GatherNone
+                     || (gather == GatherToMaster && !am_master());
+  if (local_block) {
+    data.min_corner = data.local_min_corner;
+    data.max_corner = data.local_max_corner;
+    if (gather == GatherNone && local_size == 0) return 0;
+  }
+  size_t fill_size = local_block ? local_size : slice_size;
 
   bool complex_data = (rfun==0);
-  cdouble *zslice;
-  double *slice;
-  if (vslice==0)
+  // the array filled by this process: vslice, or a temporary for the
+  // local block that is sent to the master
+  bool temporary = gather == GatherToMaster && !am_master();
+  void *fill = temporary ? 0 : vslice;
+  if (fill==0 && fill_size)
    { if (complex_data)
-      { zslice = new cdouble[slice_size];
-        vslice = (void *)zslice;
-      }
+      fill = (void *) new cdouble[fill_size];
      else
-      { slice  = new double[slice_size];
-        vslice = (void *)slice;
-      };
+      fill = (void *) new double[fill_size];
    };
 
-  data.vslice     = vslice;
+  /* each process only fills in the points of its own chunks, so the
+     rest must be initialized for the sum_to_all (max_to_all) below */
+  if (complex_data)
+    for (size_t i = 0; i < fill_size; ++i) ((cdouble *) fill)[i] = 0;
+  else
+    for (size_t i = 0; i < fill_size; ++i)
+      ((double *) fill)[i] = reduce ? reduction_init(reduce->op) : 0.0;
+
+  data.vslice     = fill;
   data.fun        = fun;
   data.rfun       = rfun;
   data.fun_data   = fun_data;
@@ -396,51 +565,74 @@ void *fields::do_get_array_slice(const volume &where,
       ++data.ninvmu;
     }
 
-  loop_in_chunks(get_array_slice_chunkloop, (void *) &data,
-		 where, Centered, true, true);
+  if (fill_size)
+    loop_in_chunks(get_array_slice_chunkloop, (void *) &data,
+                   where, Centered, true, true);
+
+  if (gather == GatherToMaster)
+   { size_t gdims[3] = {1, 1, 1};
+     for (int i = 0; i < rank; ++i) gdims[i] = dims[i];
+     gather_slice_blocks(fill, complex_data ? 2 : 1, gdims, start, count);
+     if (temporary)
+      { if (complex_data) delete[] (cdouble *) fill;
+        else delete[] (double *) fill;
+        fill = 0;
+      }
+   }
 
   /***************************************************************/
-  /* repeatedly call sum_to_all to consolidate full array slice  */
-  /* on all cores                                                */
+  /* repeatedly call sum_to_all (in place, without a copy) to    */
+  /* consolidate full array slice on all cores                   */
   /***************************************************************/
-#define BUFSIZE 1<<16 // use 64k buffer
-  if (complex_data)
-   { cdouble *buffer = new cdouble[BUFSIZE];
-     cdouble *slice = (cdouble *)vslice;
-     ptrdiff_t offset=0;
-     size_t remaining=slice_size;
-     while(remaining!=0)
-      {
-        size_t size = (remaining > BUFSIZE ? BUFSIZE : remaining);
-        sum_to_all(slice + offset, buffer, size);
-        memcpy(slice+offset, buffer, size*sizeof(cdouble));
-        remaining-=size;
-        offset+=size;
-      };
-     delete[] buffer;
-   }
-  else
-   { double *buffer = new double[BUFSIZE];
-     double *slice = (double *)vslice;
-     ptrdiff_t offset=0;
-     size_t remaining=slice_size;
-     while(remaining!=0)
-      { size_t size = (remaining > BUFSIZE ? BUFSIZE : remaining);
-        sum_to_all(slice + offset, buffer, size);
-        memcpy(slice+offset, buffer, size*sizeof(double));
-        remaining-=size;
-        offset+=size;
-      };
-     delete[] buffer;
+  // reduced minima/maxima are combined with max_to_all (of -min)
+  bool use_max = reduce && (reduce->op == ReduceMin
+                            || reduce->op == ReduceMax);
+  double sign = reduce && reduce->op == ReduceMin ? -1 : 1;
+  ptrdiff_t offset=0;
+  size_t remaining = gather == GatherToAll ? slice_size : 0;
+  while(remaining!=0)
+   { size_t size = (remaining > BUFSIZE ? BUFSIZE : remaining);
+     if (complex_data)
+      { cdouble *slice = (cdouble *)fill + offset;
+        sum_to_all(slice, slice, size);
+      }
+     else if (use_max)
+      { double *slice = (double *)fill + offset;
+        for (size_t i = 0; i < size; ++i) slice[i] *= sign;
+        max_to_all(slice, slice, size);
+        for (size_t i = 0; i < size; ++i) slice[i] *= sign;
+      }
+     else
+      { double *slice = (double *)fill + offset;
+        sum_to_all(slice, slice, size);
+      }
+     remaining-=size;
+     offset+=size;
    };
 
+  /* divide the reduced sums by the number of points of each block */
+  if (reduce && (reduce->op == ReduceMean || reduce->op == ReduceRMS)) {
+    double *slice = (double *)fill;
+    for (size_t b0 = 0, b = 0; b0 < data.rdims[0]; ++b0)
+      for (size_t b1 = 0; b1 < data.rdims[1]; ++b1)
+        for (size_t b2 = 0; b2 < data.rdims[2]; ++b2, ++b) {
+          size_t bs[3] = {b0, b1, b2}, npts = 1;
+          for (int i = 0; i < 3; ++i) {
+            size_t bstart = bs[i] * data.block[i];
+            npts *= std::min(data.block[i], data.dims[i] - bstart);
+          }
+          slice[b] /= npts;
+          if (reduce->op == ReduceRMS) slice[b] = sqrt(slice[b]);
+        }
+  }
+
   delete[] data.offsets;
   delete[] data.fields;
   delete[] data.ph;
   delete[] data.cS;
   finished_working();
 
-  return vslice;
+  return fill;
 }
 
 /***************************************************************/
@@ -449,36 +641,36 @@ void *fields::do_get_array_slice(const volume &where,
 double *fields::get_array_slice(const volume &where,
                                 std::vector<component> components,
                                 field_rfunction rfun, void *fun_data,
-                                double *slice)
+                                double *slice, slice_gather gather)
 {
   return (double *)do_get_array_slice(where, components,
                                       0, rfun, fun_data,
-                                      (void *)slice);
+                                      (void *)slice, 0, gather);
 }
 
 cdouble *fields::get_complex_array_slice(const volume &where,
                                          std::vector<component> components,
                                          field_function fun, void *fun_data,
-                                         cdouble *slice)
+                                         cdouble *slice, slice_gather gather)
 {
   return (cdouble *)do_get_array_slice(where, components,
                                        fun, 0, fun_data,
-                                       (void *)slice);
+                                       (void *)slice, 0, gather);
 }
 
 double *fields::get_array_slice(const volume &where, component c,
-                                double *slice)
+                                double *slice, slice_gather gather)
 {
   std::vector<component> components(1);
   components[0]=c;
   return (double *)do_get_array_slice(where, components,
                                       0, default_field_rfunc, 0,
-                                      (void *)slice);
+                                      (void *)slice, 0, gather);
 }
 
 double *fields::get_array_slice(const volume &where,
                                 derived_component c,
-                                double *slice)
+                                double *slice, slice_gather gather)
 {
   int nfields;
   component carray[12];
@@ -486,17 +678,144 @@ double *fields::get_array_slice(const volume &where,
   std::vector<component> cs(carray, carray+nfields);
   return (double *)do_get_array_slice(where, cs,
                                       0, rfun, &nfields,
-                                      (void *)slice);
+                                      (void *)slice, 0, gather);
 }
 
 cdouble *fields::get_complex_array_slice(const volume &where, component c,
-                                         cdouble *slice)
+                                         cdouble *slice, slice_gather gather)
 {
   std::vector<component> components(1);
   components[0]=c;
   return (cdouble *)do_get_array_slice(where, components,
                                        default_field_func, 0, 0,
-                                       (void *)slice);
+                                       (void *)slice, 0, gather);
+}
+
+/***************************************************************/
+/* entry points to get_reduced_array_slice                     */
+/***************************************************************/
+int fields::get_reduced_array_slice_dimensions(const volume &where,
+                                               const field_reduction &r,
+                                               size_t dims[3])
+{
+  size_t sdims[3];
+  array_slice_data data;
+  int srank = get_array_slice_dimensions(where, sdims, &data);
+  if (data.slice_size == 0) return 0;
+  init_reduction(&data, srank, sdims, &r);
+  int rank = 0;
+  for (int i = 0; i < 3; ++i)
+    if (data.rdims[i] > 1) dims[rank++] = data.rdims[i];
+  return rank;
+}
+
+double *fields::get_reduced_array_slice(const volume &where,
+                                        const std::vector<component> &components,
+                                        field_rfunction rfun, void *fun_data,
+                                        const field_reduction &r,
+                                        double *slice)
+{
+  int nfields = components.size();
+  if (!rfun) { rfun = sum_of_squares; fun_data = &nfields; }
+  return (double *)do_get_array_slice(where, components,
+                                      0, rfun, fun_data,
+                                      (void *)slice, &r);
+}
+
+double *fields::get_reduced_array_slice(const volume &where, component c,
+                                        const field_reduction &r,
+                                        double *slice)
+{
+  std::vector<component> components(1);
+  components[0]=c;
+  return (double *)do_get_array_slice(where, components,
+                                      0, default_field_rfunc, 0,
+                                      (void *)slice, &r);
+}
+
+double *fields::get_reduced_array_slice(const volume &where,
+                                        derived_component c,
+                                        const field_reduction &r,
+                                        double *slice)
+{
+  int nfields;
+  component carray[12];
+  field_rfunction rfun = derived_component_func(c, gv, nfields, carray);
+  std::vector<component> cs(carray, carray+nfields);
+  return (double *)do_get_array_slice(where, cs,
+                                      0, rfun, &nfields,
+                                      (void *)slice, &r);
+}
+
+/***************************************************************/
+/* field_accumulator: time reduction of reduced array slices   */
+/***************************************************************/
+field_accumulator::field_accumulator(fields *f_, const volume &where_,
+                                     const std::vector<component> &components_,
+                                     const field_reduction &r_,
+                                     reduction_op time_op_,
+                                     field_rfunction rfun_, void *fun_data_)
+  : where(where_), components(components_), r(r_)
+{
+  if (time_op_ == ReduceSample)
+    abort("ReduceSample is not a valid time reduction for field_accumulator");
+  f = f_; time_op = time_op_; rfun = rfun_; fun_data = fun_data_;
+  dims[0] = dims[1] = dims[2] = 1;
+  rank = f->get_reduced_array_slice_dimensions(where, r, dims);
+  n = 1;
+  for (int i = 0; i < rank; ++i) n *= dims[i];
+  cur = new double[n];
+  acc = new double[n];
+  reset();
+}
+
+field_accumulator::~field_accumulator() {
+  delete[] cur;
+  delete[] acc;
+}
+
+void field_accumulator::reset() {
+  for (size_t i = 0; i < n; ++i) acc[i] = reduction_init(time_op);
+  num_updates = 0;
+}
+
+void field_accumulator::update() {
+  if (!f->get_reduced_array_slice(where, components, rfun, fun_data, r, cur))
+    return; // empty volume
+  for (size_t i = 0; i < n; ++i)
+    switch (time_op) {
+    case ReduceSample: break; // excluded by the constructor
+    case ReduceSum: case ReduceMean: acc[i] += cur[i]; break;
+    case ReduceRMS: acc[i] += cur[i] * cur[i]; break;
+    case ReduceMin: if (cur[i] < acc[i]) acc[i] = cur[i]; break;
+    case ReduceMax: if (cur[i] > acc[i]) acc[i] = cur[i]; break;
+    }
+  ++num_updates;
+}
+
+double *field_accumulator::get(double *slice) {
+  if (!slice) slice = new double[n];
+  for (size_t i = 0; i < n; ++i)
+    if (num_updates == 0)
+      slice[i] = 0;
+    else if (time_op == ReduceMean)
+      slice[i] = acc[i] / num_updates;
+    else if (time_op == ReduceRMS)
+      slice[i] = sqrt(acc[i] / num_updates);
+    else
+      slice[i] = acc[i];
+  return slice;
+}
+
+void field_accumulator::output_hdf5(h5file *file, const char *dataname,
+                                    bool single_precision) {
+  double *result = get();
+  realnum *buf = new realnum[n];
+  for (size_t i = 0; i < n; ++i) buf[i] = result[i];
+  delete[] result;
+  // a single value is written as a 1-element 1d dataset
+  file->write(dataname, rank ? rank : 1, dims, buf, single_precision);
+  delete[] buf;
 }
 
 } // namespace meep
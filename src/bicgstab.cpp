@@ -107,15 +107,59 @@ static void xpay(size_t n, realnum *x, double a, const realnum *y) {
 
 typedef realnum *prealnum; // grr, ISO C++ forbids new (double*)[...]
 
-/* BiCGSTAB(L) algorithm for the n-by-n problem Ax = b */
-ptrdiff_t bicgstabL(const int L, const size_t n, realnum *x,
-	      bicgstab_op A, void *Adata, const realnum *b,
-	      const double tol,
-	      int *iters,
-	      realnum *work,
-	      const bool quiet)
+/* State of a shifted problem (A + shift) xs = b in bicgstabL_shifted.
+   Its residual is kept collinear with the residual r of Ax = b, as
+   r * zeta / psi: zeta (zeta_p for the previous step) is the ratio of
+   the shifted and unshifted BiCG residual polynomials, and psi is the
+   product of psi(-shift) over the stabilizing polynomials psi(t) of
+   the MR steps so far, which are shifted to psi(t - shift) / psi(-shift)
+   for the shifted problem (Frommer, "BiCGStab(l) for families of
+   shifted linear systems," Computing 70, 87-109 (2003)). */
+typedef struct {
+  complex<double> shift, zeta, zeta_p, psi;
+  double resid; // last residual norm
+  bool done;
+} shifted_problem;
+
+/* y = A P x, or just A x if there is no preconditioner P (using tmp) */
+static void apply_AP(bicgstab_op A, void *Adata, bicgstab_op P, void *Pdata,
+		     const realnum *x, realnum *y, realnum *tmp) {
+  if (P) {
+    P(x, tmp, Pdata);
+    A(tmp, y, Adata);
+  }
+  else
+    A(x, y, Adata);
+}
+
+/* BiCGSTAB(L) algorithm for the n-by-n problem Ax = b, and at the same
+   time for the nshift problems (A + shifts[k]) xshift[k] = b.  The
+   shifted problems use the same applications of A (the same Krylov
+   space) as the unshifted one, so they cost only some extra vector
+   operations.  With nshift > 0, the shifts are complex: the vectors
+   hold n/2 complex numbers (as interleaved real and imaginary parts)
+   and A must be complex-linear, and x and the xshift[k] start from
+   zero (so that the residuals start out collinear).  The iteration
+   continues until all of the problems converge: once Ax = b has
+   converged, x is no longer updated, and r and u are rescaled as
+   needed to keep the iteration from underflowing.
+
+   If P is not NULL (only for nshift == 0), the iteration is right
+   preconditioned: it solves A P y = b - A x0 for the initial guess x0
+   and then sets x = x0 + P y, so that r is still the true residual
+   b - Ax and the convergence test is unchanged. */
+static ptrdiff_t bicgstabL_core(const int L, const size_t n, realnum *x,
+				bicgstab_op A, void *Adata, const realnum *b,
+				const int nshift, const complex<double> *shifts,
+				realnum **xshift,
+				bicgstab_op P, void *Pdata,
+				const double tol,
+				int *iters,
+				realnum *work,
+				const bool quiet)
 {
-  if (!work) return (2*L+3)*n; // required workspace
+  if (!work) // required workspace
+    return (2*L+3 + nshift)*n + (P ? 2*n : 0);
 
   prealnum *r = new prealnum[L+1];
   prealnum *u = new prealnum[L+1];
@@ -124,6 +168,28 @@ ptrdiff_t bicgstabL(const int L, const size_t n, realnum *x,
     u[i] = work + (L+1 + i) * n;
   }
 
+  // shifted solutions and search directions
+  prealnum *xs = new prealnum[nshift + 1];
+  prealnum *us = new prealnum[nshift + 1];
+  shifted_problem *sp = new shifted_problem[nshift + 1];
+  for (int k = 0; k < nshift; ++k) {
+    xs[k] = xshift[k];
+    us[k] = work + (2*L+3 + k) * n;
+    memset(xs[k], 0, sizeof(realnum) * n);
+    memset(us[k], 0, sizeof(realnum) * n);
+    sp[k].shift = shifts[k];
+    sp[k].zeta = sp[k].zeta_p = sp[k].psi = 1.0;
+    sp[k].resid = HUGE_VAL;
+    sp[k].done = false;
+  }
+  if (nshift > 0) memset(x, 0, sizeof(realnum) * n);
+
+  /* with a preconditioner, the updates of x go to y (x = x0 + P y),
+     and Ptmp holds P applied to a vector */
+  realnum *y = P ? work + (2*L+3 + nshift) * n : x;
+  realnum *Ptmp = P ? y + n : NULL;
+  if (P) memset(y, 0, sizeof(realnum) * n);
+
   double bnrm = norm2(n, b);
   if (bnrm == 0.0) bnrm = 1.0;
 
@@ -137,6 +203,20 @@ ptrdiff_t bicgstabL(const int L, const size_t n, realnum *x,
   double *tau = new double[L * L];
   double *sigma = new double[L + 1];
 
+  // coefficients of the shifted MR updates (see below)
+  complex<double> *gs = new complex<double>[L + 1];
+  complex<double> *g = new complex<double>[L + 1];
+  complex<double> *cx = new complex<double>[L + 1];
+  complex<double> *cr = new complex<double>[L + 1];
+  complex<double> *cu = new complex<double>[L + 1];
+  double *binom = new double[(L + 1) * (L + 1)]; // binom[i*(L+1)+m] = C(i,m)
+  for (int i = 0; i <= L; ++i)
+    for (int m = 0; m <= L; ++m) {
+      if (m > i) binom[i*(L+1) + m] = 0;
+      else if (m == 0 || m == i) binom[i*(L+1) + m] = 1;
+      else binom[i*(L+1) + m] = binom[(i-1)*(L+1) + m-1] + binom[(i-1)*(L+1) + m];
+    }
+
   int ierr = 0; // error code to return, if any
   const double breaktol = 1e-30;
 
@@ -156,11 +236,38 @@ ptrdiff_t bicgstabL(const int L, const size_t n, realnum *x,
 
   double rho = 1.0, alpha = 0, omega = 1;
 
-  double resid;
-  while ((resid = norm2(n, r[0])) > tol * bnrm) {
+  double resid, resid_max, resid_x = 0;
+  bool x_done = false; // whether Ax = b has converged (for nshift > 0)
+  while ((resid_max = resid = norm2(n, r[0])) > tol * bnrm || nshift > 0) {
+    if (!x_done && resid <= tol * bnrm) {
+      x_done = true;
+      resid_x = resid;
+    }
+    if (x_done) resid_max = resid_x;
+
+    // the residuals of the shifted problems are |zeta/psi| * resid
+    bool done = x_done;
+    for (int k = 0; k < nshift; ++k) if (!sp[k].done) {
+      sp[k].resid = abs(sp[k].zeta / sp[k].psi) * resid;
+      sp[k].done = sp[k].resid <= tol * bnrm;
+      done = done && sp[k].done;
+      if (sp[k].resid > resid_max) resid_max = sp[k].resid;
+    }
+    if (done) break;
+
+    if (x_done && resid <= tol * bnrm) { // rescale r and u (and rho) by c
+      const double c = bnrm / resid;
+      for (size_t m = 0; m < n; ++m) {
+	r[0][m] *= c;
+	u[0][m] *= c;
+      }
+      rho *= c;
+      for (int k = 0; k < nshift; ++k) sp[k].psi *= c;
+    }
+
     ++iter;
     if (!quiet && wall_time() > last_output_wall_time + MIN_OUTPUT_TIME) {
-      master_printf("residual[%d] = %g\n", iter, resid / bnrm);
+      master_printf("residual[%d] = %g\n", iter, resid_max / bnrm);
       last_output_wall_time = wall_time();
     }
 
@@ -172,12 +279,43 @@ ptrdiff_t bicgstabL(const int L, const size_t n, realnum *x,
       rho = rho1;
       for (int i = 0; i <= j; ++i)
       	for (size_t m = 0; m < n; ++m) u[i][m] = r[i][m] - beta * u[i][m];
-      A(u[j], u[j+1], Adata);
+      apply_AP(A, Adata, P, Pdata, u[j], u[j+1], Ptmp);
+      const double alpha_p = alpha;
       alpha = rho / dot(n, u[j+1], rtilde);
+
+      /* shifted BiCG step, from the recurrence for the ratio zeta of
+	 the shifted and unshifted BiCG residual polynomials */
+      for (int k = 0; k < nshift; ++k) if (!sp[k].done) {
+	shifted_problem &p = sp[k];
+	complex<double> den = 1.0 + alpha * p.shift;
+	if (beta != 0) den += (alpha * beta / alpha_p) * (p.zeta / p.zeta_p - 1.0);
+	if (abs(den) < breaktol) { ierr = -1; goto finish; }
+	const complex<double> zeta = p.zeta / den;
+	const complex<double> beta_s = beta * (p.zeta / p.zeta_p) * (p.zeta / p.zeta_p);
+	const complex<double> alpha_s = alpha * zeta / p.zeta;
+	const complex<double> kappa = p.zeta / p.psi;
+	const realnum kr = real(kappa), ki = imag(kappa);
+	const realnum br = real(beta_s), bi = imag(beta_s);
+	const realnum ar = real(alpha_s), ai = imag(alpha_s);
+	const realnum *r0 = r[0];
+	realnum *usk = us[k], *xsk = xs[k];
+	for (size_t m = 0; m < n; m += 2) { // complex arithmetic, written out
+	  const realnum ur = kr * r0[m] - ki * r0[m+1]
+	    - (br * usk[m] - bi * usk[m+1]);
+	  const realnum ui = kr * r0[m+1] + ki * r0[m]
+	    - (br * usk[m+1] + bi * usk[m]);
+	  usk[m] = ur; usk[m+1] = ui;
+	  xsk[m] += ar * ur - ai * ui;
+	  xsk[m+1] += ar * ui + ai * ur;
+	}
+	p.zeta_p = p.zeta;
+	p.zeta = zeta;
+      }
+
       for (int i = 0; i <= j; ++i)
       	xpay(n, r[i], -alpha, u[i+1]);
-      A(r[j], r[j+1], Adata);
-      xpay(n, x, alpha, u[0]);
+      apply_AP(A, Adata, P, Pdata, r[j], r[j+1], Ptmp);
+      if (!x_done) xpay(n, y, alpha, u[0]);
     }
 
     for (int j = 1; j <= L; ++j) {
@@ -202,11 +340,81 @@ ptrdiff_t bicgstabL(const int L, const size_t n, realnum *x,
       	gamma_pp[j] += tau[(i-1)*L + (j-1)] * gamma[i+1];
     }
 
-    xpay(n, x, gamma[1], r[0]);
+    /* shifted MR step, before r[0] and u[0] are updated: the MR
+       polynomial psi(t) = 1 - sum_j gamma[j] t^j becomes
+       1 - sum_j gs[j] t^j = psi(t - shift) / psi(-shift), so that
+       with T = A + shift and the current shifted residual
+       rs = kappa r[0] = kappa A^0 r[0],
+         xs += sum_j gs[j] T^(j-1) rs = sum_m kappa g[m] A^m r[0]
+	 us -= sum_j gs[j] T^j us,
+       where g[m] = sum_{j>m} gs[j] C(j-1,m) shift^(j-1-m), and where
+       T us = (kappa_p r_p - kappa r[0]) / alpha_s in terms of the residual
+       r_p = r[0] + alpha u[1] before the last BiCG step, so that
+         T^j us = sum_m C(j-1,m) shift^(j-1-m)
+	          ((kappa_p - kappa) A^m r[0] + kappa_p alpha u[m+1]) / alpha_s.
+       The A^m r[0] are the r[m] before they were orthogonalized above,
+       i.e. r[m] + sum_{i<m} tau_im r[i], which we substitute. */
+    for (int k = 0; k < nshift; ++k) if (!sp[k].done) {
+      shifted_problem &p = sp[k];
+      const complex<double> s = p.shift;
+      complex<double> psi_s = 1.0, smj = 1.0; // psi(-shift), (-shift)^j
+      for (int j = 1; j <= L; ++j) {
+	smj *= -s;
+	psi_s -= gamma[j] * smj;
+      }
+      if (abs(psi_s) < breaktol) { ierr = -1; goto finish; }
+      for (int m = 1; m <= L; ++m) {
+	complex<double> c = 0, smjm = 1.0; // (-shift)^(j-m)
+	for (int j = m; j <= L; ++j) {
+	  c += gamma[j] * binom[j*(L+1) + m] * smjm;
+	  smjm *= -s;
+	}
+	gs[m] = c / psi_s;
+      }
+      for (int m = 0; m < L; ++m) {
+	complex<double> c = 0, sjm = 1.0; // shift^(j-1-m)
+	for (int j = m+1; j <= L; ++j) {
+	  c += gs[j] * binom[(j-1)*(L+1) + m] * sjm;
+	  sjm *= s;
+	}
+	g[m] = c;
+      }
+      const complex<double> kappa = p.zeta / p.psi, kappa_p = p.zeta_p / p.psi;
+      const complex<double> alpha_s = alpha * p.zeta / p.zeta_p;
+      for (int m = 0; m < L; ++m) {
+	cx[m] = kappa * g[m];
+	cr[m] = -(kappa_p - kappa) / alpha_s * g[m];
+	cu[m+1] = -(kappa_p * alpha / alpha_s) * g[m];
+      }
+      for (int i = 1; i < L; ++i) // substitute the orthogonalized r[i]
+	for (int m = i+1; m < L; ++m) {
+	  cx[i] += tau[(m-1)*L + (i-1)] * cx[m];
+	  cr[i] += tau[(m-1)*L + (i-1)] * cr[m];
+	}
+      realnum *usk = us[k], *xsk = xs[k];
+      for (size_t i = 0; i < n; i += 2) { // one pass, complex arithmetic
+	realnum xr = 0, xi = 0, ur = 0, ui = 0;
+	for (int m = 0; m < L; ++m) {
+	  const realnum rr = r[m][i], ri = r[m][i+1];
+	  const realnum vr = u[m+1][i], vi = u[m+1][i+1];
+	  xr += real(cx[m]) * rr - imag(cx[m]) * ri;
+	  xi += real(cx[m]) * ri + imag(cx[m]) * rr;
+	  ur += real(cr[m]) * rr - imag(cr[m]) * ri
+	    + real(cu[m+1]) * vr - imag(cu[m+1]) * vi;
+	  ui += real(cr[m]) * ri + imag(cr[m]) * rr
+	    + real(cu[m+1]) * vi + imag(cu[m+1]) * vr;
+	}
+	xsk[i] += xr; xsk[i+1] += xi;
+	usk[i] += ur; usk[i+1] += ui;
+      }
+      p.psi *= psi_s;
+    }
+
+    if (!x_done) xpay(n, y, gamma[1], r[0]);
     xpay(n, r[0], -gamma_p[L], r[L]);
     xpay(n, u[0], -gamma[L], u[L]);
     for (int j = 1; j < L; ++j) { /* TODO: use blas DGEMV (for L > 2) */
-      xpay(n, x, gamma_pp[j], r[j]);
+      if (!x_done) xpay(n, y, gamma_pp[j], r[j]);
       xpay(n, r[0], -gamma_p[j], r[j]);
       xpay(n, u[0], -gamma[j], u[j]);
     }
@@ -214,14 +422,36 @@ ptrdiff_t bicgstabL(const int L, const size_t n, realnum *x,
     if (iter == *iters) { ierr = 1; break; }
   }
 
-  if (!quiet) master_printf("final residual = %g\n", norm2(n, r[0]) / bnrm);
+  if (!quiet) {
+    resid = norm2(n, r[0]);
+    resid_max = x_done ? resid_x : resid;
+    for (int k = 0; k < nshift; ++k) {
+      if (!sp[k].done) sp[k].resid = abs(sp[k].zeta / sp[k].psi) * resid;
+      if (sp[k].resid > resid_max) resid_max = sp[k].resid;
+    }
+    master_printf("final residual = %g\n", resid_max / bnrm);
+  }
 
  finish:
+  if (P && iter > 0) { // x = x0 + P y
+    P(y, Ptmp, Pdata);
+    xpay(n, x, 1.0, Ptmp);
+  }
+
+  delete[] binom;
+  delete[] cu;
+  delete[] cr;
+  delete[] cx;
+  delete[] g;
+  delete[] gs;
   delete[] sigma;
   delete[] tau;
   delete[] gamma_pp;
   delete[] gamma_p;
   delete[] gamma;
+  delete[] sp;
+  delete[] us;
+  delete[] xs;
   delete[] u;
   delete[] r;
 
@@ -229,4 +459,31 @@ ptrdiff_t bicgstabL(const int L, const size_t n, realnum *x,
   return ierr;
 }
 
+ptrdiff_t bicgstabL_shifted(const int L, const size_t n, realnum *x,
+			    bicgstab_op A, void *Adata, const realnum *b,
+			    const int nshift, const complex<double> *shifts,
+			    realnum **xshift,
+			    const double tol,
+			    int *iters,
+			    realnum *work,
+			    const bool quiet)
+{
+  return bicgstabL_core(L, n, x, A, Adata, b, nshift, shifts, xshift,
+			NULL, NULL, tol, iters, work, quiet);
+}
+
+/* BiCGSTAB(L) algorithm for the n-by-n problem Ax = b, optionally
+   right-preconditioned by P (if P is not NULL) */
+ptrdiff_t bicgstabL(const int L, const size_t n, realnum *x,
+	      bicgstab_op A, void *Adata, const realnum *b,
+	      const double tol,
+	      int *iters,
+	      realnum *work,
+	      const bool quiet,
+	      bicgstab_op P, void *Pdata)
+{
+  return bicgstabL_core(L, n, x, A, Adata, b, 0, NULL, NULL, P, Pdata,
+			tol, iters, work, quiet);
+}
+
 } // namespace meep
@@ -30,6 +30,19 @@ ptrdiff_t bicgstabL(const int L,
               const double tol,
               int *iters, // input *iters = max iters, output = actual iters
               realnum *work, // if you pass work=NULL, bicgstab returns nwork
+              const bool quiet,
+              // optional right preconditioner: P x ~ A^{-1} x
+              bicgstab_op P = NULL, void *Pdata = NULL);
+
+// also solves (A + shifts[k]) xshift[k] = b for k < nshift (complex shifts)
+ptrdiff_t bicgstabL_shifted(const int L,
+              const size_t n, realnum *x,
+              bicgstab_op A, void *Adata, const realnum *b,
+              const int nshift, const std::complex<double> *shifts,
+              realnum **xshift,
+              const double tol,
+              int *iters, // input *iters = max iters, output = actual iters
+              realnum *work, // if you pass work=NULL, bicgstab returns nwork
               const bool quiet);
 
 } // namespace meep
@@ -88,6 +88,10 @@ vec fields::lattice_vector(direction d) const {
 
 void fields::disconnect_chunks() {
   chunk_connections_valid = false;
+  free_boundary_communications();
+  FOR_FIELD_TYPES(ft)
+    for (int io=0;io<2;io++)
+      comm_pairs[ft][io].clear();
   for (int i=0;i<num_chunks;i++) {
     DOCMP {
       FOR_FIELD_TYPES(f)
@@ -120,11 +124,36 @@ void fields::connect_chunks() {
     disconnect_chunks();
     find_metals();
     connect_the_chunks();
+    find_comm_pairs();
+    init_boundary_communications();
     finished_working();
     chunk_connections_valid = true;
   }
 }
 
+/* Make the lists of the chunk pairs that actually communicate, so that
+   step_boundaries only has to look at the neighbors of our chunks
+   rather than at all num_chunks*num_chunks pairs.  The pairs of each
+   chunk are in the same order as the connections arrays, i.e. in
+   order of increasing i for Outgoing and increasing j for Incoming. */
+void fields::find_comm_pairs() {
+  FOR_FIELD_TYPES(ft)
+    for (int io=0;io<2;io++) {
+      comm_pairs[ft][io].clear();
+      for (int a=0;a<num_chunks;a++)
+      	if (chunks[a]->is_mine()) {
+      	  comm_pair p;
+      	  p.chunk = a;
+      	  for (int ip=0;ip<3;ip++) p.start[ip] = 0;
+      	  for (int b=0;b<num_chunks;b++) {
+      	    p.pair = io == Incoming ? b+a*num_chunks : a+b*num_chunks;
+      	    if (comm_size_tot(ft, p.pair) > 0) comm_pairs[ft][io].push_back(p);
+      	    for (int ip=0;ip<3;ip++) p.start[ip] += comm_sizes[ft][ip][p.pair];
+      	  }
+      	}
+    }
+}
+
 inline bool fields::on_metal_boundary(const ivec &here) {
   LOOP_OVER_DIRECTIONS(gv.dim, d) {
     if (user_volume.has_boundary(High, d) &&
@@ -83,7 +83,6 @@ typedef struct {
   size_t n;
   fields *f;
   complex<double> iomega;
-  int iters;
 } fieldop_data;
 
 static void fieldop(const realnum *xr, realnum *yr, void *data_)
@@ -99,34 +98,31 @@ static void fieldop(const realnum *xr, realnum *yr, void *data_)
   complex<realnum> iomega = complex<realnum>(real(data->iomega),
 					     imag(data->iomega));
   for (size_t i = 0; i < n; ++i) y[i] = (y[i] - x[i]) * dt_inv + iomega * x[i];
-  data->iters++;
 }
 
-/* Solve for the CW (constant frequency) field response at the given
-   frequency to the sources (with amplitude given by the current sources
-   at the current time).  The solver halts at a fractional convergence
-   of tol, or when maxiters is reached, or when convergence fails;
-   returns true if convergence succeeds and false if it fails.
-
-   The parameter L determines the order of the iterative algorithm
-   that is used.  L should always be positive and should normally be
-   >= 2.  Larger values of L will often lead to faster convergence, at
-   the expense of more memory and more work per iteration. */
-bool fields::solve_cw(double tol, int maxiters, complex<double> frequency,
-		      int L) {
-  if (is_real) abort("solve_cw is incompatible with use_real_fields()");
-  if (L < 1) abort("solve_cw called with L = %d < 1", L);
-  int tsave = t; // save time (gets incremented by iterations)
-
-  set_solve_cw_omega(2*pi*frequency);
+typedef struct {
+  fields *f;
+  complex<double> frequency;
+  solve_cw_precond precond;
+  void *precond_data;
+} precondop_data;
 
-  step(); // step once to make sure everything is allocated
+static void precondop(const realnum *xr, realnum *yr, void *data_)
+{
+  precondop_data *data = (precondop_data *) data_;
+  array_to_fields(reinterpret_cast<const complex<realnum>*>(xr), *data->f);
+  data->precond(*data->f, data->frequency, data->precond_data);
+  fields_to_array(*data->f, reinterpret_cast<complex<realnum>*>(yr));
+}
 
-  size_t N = 0; // size of linear system (on this processor, at least)
-  for (int i=0;i<num_chunks;i++)
-    if (chunks[i]->is_mine()) {
+/* size of the arrays of fields_to_array (in realnums) */
+static size_t fields_array_size(const fields &f)
+{
+  size_t N = 0;
+  for (int i=0;i<f.num_chunks;i++)
+    if (f.chunks[i]->is_mine()) {
       FOR_COMPONENTS(c)
-	if (chunks[i]->f[c][0] && (is_D(c) || is_B(c))) {
+	if (f.chunks[i]->f[c][0] && (is_D(c) || is_B(c))) {
 	  component c2 = field_type_component(is_D(c) ? E_stuff : H_stuff, c);
 	  /* unknowns are just D and B in non-PML regions, but in PML
 	     regions the E, U, W, and C fields are also unknowns (in
@@ -134,19 +130,131 @@ bool fields::solve_cw(double tol, int maxiters, complex<double> frequency,
 	     in frequency domain via scalinb by the appropriate s
 	     factors, rather than storing them, but I had some
 	     problems getting that working) */
-	  N += 2 * chunks[i]->gv.nowned(c) *
-	    (1 + (chunks[i]->f_u[c][0] != NULL)
-	     + (chunks[i]->f_w[c2][0] != NULL) * 2
-	     + (chunks[i]->f_cond[c][0] != NULL));
+	  N += 2 * f.chunks[i]->gv.nowned(c) *
+	    (1 + (f.chunks[i]->f_u[c][0] != NULL)
+	     + (f.chunks[i]->f_w[c2][0] != NULL) * 2
+	     + (f.chunks[i]->f_cond[c][0] != NULL));
 	}
     }
+  return N;
+}
 
-  size_t nwork = (size_t) bicgstabL(L, N, 0, 0, 0, 0, tol, &maxiters, 0, true);
-  realnum *work = new realnum[nwork + 2*N];
-  complex<realnum> *x = reinterpret_cast<complex<realnum>*>(work + nwork);
-  complex<realnum> *b = reinterpret_cast<complex<realnum>*>(work + nwork + N);
+/* Built-in preconditioner for solve_cw, filtering the fields in time
+   by *(int *) nsteps time steps.  In terms of the timestep operator
+   T, solve_cw solves (T - z) x / dt = r for z = exp(-i omega dt).
+   With an artificial loss rate g, i.e. z replaced by zg = z exp(g dt)
+   with |zg| > 1, the inverse is a convergent series
+        x = -(dt/zg) sum_{k>=0} (T/zg)^k r,
+   i.e. the exponentially windowed time evolution of r demodulated at
+   omega, which we truncate after nsteps terms with g nsteps dt = 1.
+   This damps the components far from omega, leaving mainly the ones
+   near omega to the outer iteration, which then needs far fewer
+   iterations (and global reductions) for about the same number of
+   time steps. */
+void solve_cw_filter(fields &f, complex<double> frequency, void *nsteps_)
+{
+  const int nsteps = *(int *) nsteps_;
+  if (nsteps < 1) abort("solve_cw_filter called with nsteps = %d < 1", nsteps);
+  const size_t n = fields_array_size(f) / 2;
+  complex<realnum> *r = new complex<realnum>[2*n];
+  complex<realnum> *x = r + n;
+  fields_to_array(f, r);
+  const complex<double> zg = exp(1.0 / nsteps
+				 - complex<double>(0, 2*pi*f.dt) * frequency);
+  const complex<realnum> zginv = complex<realnum>(real(1.0 / zg),
+						  imag(1.0 / zg));
+  memcpy(x, r, sizeof(complex<realnum>) * n);
+  for (int k = 1; k < nsteps; ++k) { // x = r + T x / zg
+    f.step();
+    fields_to_array(f, x);
+    for (size_t i = 0; i < n; ++i) x[i] = r[i] + zginv * x[i];
+    array_to_fields(x, f);
+  }
+  const complex<realnum> c = -f.dt * zginv;
+  for (size_t i = 0; i < n; ++i) x[i] *= c;
+  array_to_fields(x, f);
+  delete[] r;
+}
 
-  fields_to_array(*this, x); // initial guess = initial fields
+/* the shift iomega, in fieldop, of the timestep operator for frequency */
+static complex<double> cw_iomega(complex<double> frequency, double dt) {
+  return (1.0 - exp(complex<double>(0.,-1.) * (2*pi*frequency) * dt)) / dt;
+}
+
+/* Solve for the CW (constant frequency) field response at each of the
+   nfreq given frequencies to the sources (with amplitude given by the
+   current sources at the current time), calling solved(*this, ifreq,
+   converged, solved_data) with the fields set to the solution for
+   frequencies[ifreq] (if solved is not NULL).  Each solve halts at a
+   fractional convergence of tol, or when maxiters is reached, or when
+   convergence fails; returns true if all solves converge and false if
+   any fail.  (Unlike solve_cw, the DFTs are not updated.)
+
+   Since the frequency only shifts the timestep operator in fieldop by
+   a multiple of the identity, the frequencies are solved (in order of
+   increasing real part) in batches of up to batch frequencies by a
+   single shifted BiCGSTAB(L) iteration, which costs about as many
+   timesteps as the slowest-converging frequency of the batch alone
+   (but needs memory for 2 more copies of the fields per frequency).
+   Each solution is then checked, and refined if necessary, by the
+   ordinary iteration, which also takes care of any frequencies for
+   which the shifted iteration fails.
+
+   The parameter L determines the order of the iterative algorithm
+   that is used.  L should always be positive and should normally be
+   >= 2.  Larger values of L will often lead to faster convergence, at
+   the expense of more memory and more work per iteration.
+
+   If precond is not NULL, the ordinary iterations are preconditioned
+   by precond(fields, frequency, precond_data) (e.g. solve_cw_filter),
+   which needs memory for 2 more copies of the fields (4 with
+   solve_cw_filter).  Steps taken by
+   precond are included in the reported number of steps. */
+bool fields::solve_cw_sweep(double tol, int maxiters,
+			    const complex<double> *frequencies, int nfreq,
+			    solve_cw_callback solved, void *solved_data,
+			    int L, int batch,
+			    solve_cw_precond precond, void *precond_data) {
+  if (is_real) abort("solve_cw is incompatible with use_real_fields()");
+  if (L < 1) abort("solve_cw called with L = %d < 1", L);
+  if (nfreq < 1) return true;
+  if (batch < 1) batch = 1;
+  if (batch > nfreq) batch = nfreq;
+  int tsave = t; // save time (gets incremented by iterations)
+
+  // solve in order of increasing frequency (insertion sort)
+  vector<int> order(nfreq);
+  for (int k = 0; k < nfreq; ++k) {
+    int i = k;
+    for (; i > 0 && real(frequencies[order[i-1]]) > real(frequencies[k]); --i)
+      order[i] = order[i-1];
+    order[i] = k;
+  }
+
+  set_solve_cw_omega(2*pi*frequencies[order[0]]);
+
+  step(); // step once to make sure everything is allocated
+
+  // size of linear system (on this processor, at least)
+  const size_t N = fields_array_size(*this);
+
+  precondop_data pdata;
+  pdata.f = this;
+  pdata.precond = precond;
+  pdata.precond_data = precond_data;
+  bicgstab_op P = precond ? precondop : NULL;
+
+  size_t nwork = (size_t) bicgstabL_shifted(L, N, 0, 0, 0, 0, batch - 1, 0, 0,
+					    tol, &maxiters, 0, true);
+  nwork = max(nwork, (size_t) bicgstabL(L, N, 0, 0, 0, 0, tol, &maxiters, 0,
+					true, P, &pdata));
+  realnum *work = new realnum[nwork + (1 + batch)*N];
+  complex<realnum> *b = reinterpret_cast<complex<realnum>*>(work + nwork);
+  vector<realnum *> x(batch); // solutions for the current batch
+  for (int j = 0; j < batch; ++j) x[j] = work + nwork + (1 + j)*N;
+
+  // initial guess = initial fields, for a single frequency
+  fields_to_array(*this, reinterpret_cast<complex<realnum>*>(x[0]));
 
   // get J amplitudes from current time step
   zero_fields(); // note that we've saved the fields in x above
@@ -173,31 +281,91 @@ bool fields::solve_cw(double tol, int maxiters, complex<double> frequency,
   fieldop_data data;
   data.f = this;
   data.n = N / 2;
-  data.iomega = ((1.0 - exp(complex<double>(0.,-1.) * (2*pi*frequency) * dt))
-		 * (1.0 / dt));
-  data.iters = 0;
-
-  int ierr = (int) bicgstabL(L, N, reinterpret_cast<realnum*>(x),
-		       fieldop, &data, reinterpret_cast<realnum*>(b),
-		       tol, &maxiters, work, quiet);
-
-  if (!quiet) {
-    master_printf("Finished solve_cw after %d steps and %d CG iters.\n",
-		  data.iters, maxiters);
-    if (ierr)
-      master_printf(" -- CONVERGENCE FAILURE (%d) in solve_cw!\n", ierr);
-  }
 
-  array_to_fields(x, *this);
-  step(); // ensure H/B are updated and synced with E/D
+  bool converged = true;
+  vector<complex<double> > shifts(batch);
+  for (int k0 = 0; k0 < nfreq; k0 += batch) {
+    const int nb = min(batch, nfreq - k0);
+
+    /* solve for the whole batch by one shifted iteration, with the
+       middle frequency unshifted (in x[0]) */
+    if (nb > 1) {
+      const complex<double> frequency = frequencies[order[k0 + nb/2]];
+      set_solve_cw_omega(2*pi*frequency);
+      data.iomega = cw_iomega(frequency, dt);
+      const int t0 = t;
+      vector<realnum *> xs;
+      for (int j = 0, ks = 0; j < nb; ++j)
+	if (j != nb/2) {
+	  shifts[ks++] = cw_iomega(frequencies[order[k0 + j]], dt) - data.iomega;
+	  xs.push_back(x[j ? j : nb/2]);
+	}
+      int iters = maxiters;
+      int ierr = (int) bicgstabL_shifted(L, N, x[0], fieldop, &data,
+					 reinterpret_cast<realnum*>(b),
+					 nb - 1, &shifts[0], &xs[0],
+					 tol, &iters, work, quiet);
+      swap(x[0], x[nb/2]); // x[j] = solution for order[k0 + j]
+      if (!quiet)
+	master_printf("Finished solve_cw for %d frequencies after %d steps "
+		      "and %d CG iters%s.\n", nb, t - t0, iters,
+		      ierr ? " (failed)" : "");
+    }
+    else if (k0 > 0 && batch > 1) // warm-start from the previous frequency
+      memcpy(x[0], x[batch - 1], sizeof(realnum) * N);
+
+    for (int j = 0; j < nb; ++j) {
+      const int ifreq = order[k0 + j];
+      const complex<double> frequency = frequencies[ifreq];
+      set_solve_cw_omega(2*pi*frequency);
+      data.iomega = cw_iomega(frequency, dt);
+      pdata.frequency = frequency;
+      const int t0 = t;
+
+      int iters = maxiters;
+      int ierr = (int) bicgstabL(L, N, x[j], fieldop, &data,
+				 reinterpret_cast<realnum*>(b),
+				 tol, &iters, work, quiet, P, &pdata);
+
+      if (!quiet) {
+	if (nfreq > 1)
+	  master_printf("solve_cw at frequency %g+%gi:\n",
+			real(frequency), imag(frequency));
+	master_printf("Finished solve_cw after %d steps and %d CG iters.\n",
+		      t - t0, iters);
+	if (ierr)
+	  master_printf(" -- CONVERGENCE FAILURE (%d) in solve_cw!\n", ierr);
+      }
+      if (ierr) converged = false;
+
+      array_to_fields(reinterpret_cast<complex<realnum>*>(x[j]), *this);
+      step(); // ensure H/B are updated and synced with E/D
+      t = tsave;
+
+      if (solved) solved(*this, ifreq, !ierr, solved_data);
+    }
+  }
 
   delete[] work;
-  t = tsave;
 
   unset_solve_cw_omega();
-  update_dfts();
 
-  return !ierr;
+  return converged;
+}
+
+/* Solve for the CW (constant frequency) field response at the given
+   frequency to the sources (with amplitude given by the current sources
+   at the current time).  The solver halts at a fractional convergence
+   of tol, or when maxiters is reached, or when convergence fails;
+   returns true if convergence succeeds and false if it fails.
+
+   The parameters L, precond, and precond_data are as for solve_cw_sweep. */
+bool fields::solve_cw(double tol, int maxiters, complex<double> frequency,
+		      int L, solve_cw_precond precond, void *precond_data) {
+  bool converged = solve_cw_sweep(tol, maxiters, &frequency, 1, NULL, NULL, L,
+				  1, precond, precond_data);
+  update_dfts();
+  return converged;
 }
 
 /* as solve_cw, but infers frequency from sources */
@@ -33,12 +33,12 @@ namespace meep {
 struct dft_chunk_data { // for passing to field::loop_in_chunks as void*
   component c;
   int vc;
-  double omega_min, domega;
-  int Nomega;
+  std::vector<double> omega;
   complex<double> stored_weight, extra_weight;
-  double dt_factor;
+  double dt, dt_factor;
   bool include_dV_and_interp_weights;
   bool sqrt_dV_and_interp_weights;
+  int dft_index;
   dft_chunk *dft_chunks;
 };
 
@@ -86,11 +86,10 @@ dft_chunk::dft_chunk(fields_chunk *fc_,
   shift = shift_;
   S = S_; sn = sn_;
   vc = data->vc;
+  dft_index = data->dft_index;
 
-  omega_min = data->omega_min;
-  domega = data->domega;
-  Nomega = data->Nomega;
-  dft_phase = new complex<realnum>[Nomega];
+  omega = data->omega;
+  Nomega = omega.size();
 
   N = 1;
   LOOP_OVER_DIRECTIONS(is.dim, d)
@@ -99,6 +98,28 @@ dft_chunk::dft_chunk(fields_chunk *fc_,
   for (size_t i = 0; i < N * Nomega; ++i)
     dft[i] = 0.0;
 
+  Nbatch = min(Nomega, DFT_BATCH);
+  nbuf = 0;
+  nbuf_cmp = 1;
+  dft_phase = new realnum[Nbatch * 2*Nomega];
+  dft_phase_swapped = new realnum[Nbatch * 2*Nomega];
+  fbuf = new realnum[N * Nbatch * 2];
+
+  dt = data->dt;
+  phase_cur = new complex<double>[Nomega];
+  phase_step = new complex<double>[Nomega];
+  for (int i = 0; i < Nomega; ++i)
+    phase_step[i] = polar(1.0, omega[i] * dt);
+  phase_time = 0;
+  phase_count = -1; // phase_cur not yet computed
+
+  dec_stride = 1;
+  dec_filter = false;
+  phase_scale = new complex<double>[Nomega];
+  for (int i = 0; i < Nomega; ++i)
+    phase_scale[i] = scale;
+  fsum = NULL;
+
   next_in_chunk = fc->dft_chunks;
   fc->dft_chunks = this;
   next_in_dft = data->dft_chunks;
@@ -107,6 +128,12 @@ dft_chunk::dft_chunk(fields_chunk *fc_,
 dft_chunk::~dft_chunk() {
   delete[] dft;
   delete[] dft_phase;
+  delete[] dft_phase_swapped;
+  delete[] fbuf;
+  delete[] phase_cur;
+  delete[] phase_step;
+  delete[] phase_scale;
+  delete[] fsum;
 
   // delete from fields_chunk list
   dft_chunk *cur = fc->dft_chunks;
@@ -155,6 +182,87 @@ static void add_dft_chunkloop(fields_chunk *fc, int ichunk, component cgrid,
                                    shift, S, sn, chunkloop_data);
 }
 
+vector<double> dft_freqs(double freq_min, double freq_max, int Nfreq) {
+  vector<double> freq(max(Nfreq, 0));
+  if (Nfreq <= 1) freq_min = freq_max = (freq_min + freq_max) * 0.5;
+  const double dfreq = Nfreq <= 1 ? 0.0 : (freq_max - freq_min) / (Nfreq - 1);
+  for (int i = 0; i < Nfreq; ++i)
+    freq[i] = freq_min + i * dfreq;
+  return freq;
+}
+
+double dft_freqs_spacing(const vector<double> &freq) {
+  const size_t Nfreq = freq.size();
+  if (Nfreq <= 1) return 0.0;
+  const double dfreq = (freq[Nfreq-1] - freq[0]) / (Nfreq - 1);
+  const double tol = 1e-12 * max(fabs(freq[0]), fabs(freq[Nfreq-1]));
+  for (size_t i = 1; i < Nfreq - 1; ++i)
+    if (fabs(freq[i] - (freq[0] + i * dfreq)) > tol)
+      return 0.0;
+  return dfreq;
+}
+
+/* The adaptive frequencies are the quantiles F^{-1}(i/(Nfreq-1)) of the
+   density u/(fmax-fmin) + (1-u)/npeaks * sum_p L_p(f), where L_p is the
+   Lorentzian of resonance p normalized to 1 over [fmin,fmax], so that
+   the endpoints are always included.  F is monotonic, so it is simply
+   inverted by bisection. */
+struct adaptive_density {
+  double fmin, fmax, u;
+  vector<double> f0, gamma, norm;
+
+  double cdf(double f) const {
+    double F = u * (f - fmin) / (fmax - fmin);
+    for (size_t p = 0; p < f0.size(); ++p)
+      F += (1 - u) / f0.size() * norm[p]
+	* (atan((f - f0[p]) / gamma[p]) - atan((fmin - f0[p]) / gamma[p]));
+    return F;
+  }
+};
+
+vector<double> adaptive_dft_freqs(double freq_min, double freq_max, int Nfreq,
+				  const vector<double> &peak_freqs,
+				  const vector<double> &peak_widths,
+				  double uniform_fraction) {
+  if (peak_freqs.size() != peak_widths.size())
+    abort("mismatched peak_freqs and peak_widths in adaptive_dft_freqs");
+  if (uniform_fraction < 0 || uniform_fraction > 1)
+    abort("uniform_fraction must be in [0,1] in adaptive_dft_freqs");
+  if (Nfreq <= 2 || freq_max <= freq_min)
+    return dft_freqs(freq_min, freq_max, Nfreq);
+
+  adaptive_density rho;
+  rho.fmin = freq_min; rho.fmax = freq_max;
+  /* resonances narrower than the minimum width would just get all of
+     their points at the same frequency (to roundoff) */
+  const double min_width = 1e-9 * (freq_max - freq_min);
+  for (size_t p = 0; p < peak_freqs.size(); ++p)
+    if (peak_freqs[p] >= freq_min && peak_freqs[p] <= freq_max) {
+      const double gamma = max(fabs(peak_widths[p]), min_width);
+      rho.f0.push_back(peak_freqs[p]);
+      rho.gamma.push_back(gamma);
+      rho.norm.push_back(1 / (atan((freq_max - peak_freqs[p]) / gamma)
+			      - atan((freq_min - peak_freqs[p]) / gamma)));
+    }
+  rho.u = rho.f0.empty() ? 1.0 : uniform_fraction;
+  if (rho.u == 1.0)
+    return dft_freqs(freq_min, freq_max, Nfreq);
+
+  vector<double> freq(Nfreq);
+  freq[0] = freq_min;
+  freq[Nfreq-1] = freq_max;
+  for (int i = 1; i < Nfreq - 1; ++i) {
+    const double F = double(i) / (Nfreq - 1);
+    double a = freq[i-1], b = freq_max; // F^{-1} is increasing
+    for (int iter = 0; iter < 100 && b - a > 1e-15 * (fabs(a) + fabs(b)); ++iter) {
+      const double f = 0.5 * (a + b);
+      if (rho.cdf(f) < F) a = f; else b = f;
+    }
+    freq[i] = 0.5 * (a + b);
+  }
+  return freq;
+}
+
 dft_chunk *fields::add_dft(component c, const volume &where,
 			   double freq_min, double freq_max, int Nfreq,
 			   bool include_dV_and_interp_weights,
@@ -162,6 +270,18 @@ dft_chunk *fields::add_dft(component c, const volume &where,
 			   bool sqrt_dV_and_interp_weights,
 			   complex<double> extra_weight,
 			   bool use_centered_grid, int vc) {
+  return add_dft(c, where, dft_freqs(freq_min, freq_max, Nfreq),
+		 include_dV_and_interp_weights, stored_weight, chunk_next,
+		 sqrt_dV_and_interp_weights, extra_weight, use_centered_grid, vc);
+}
+
+dft_chunk *fields::add_dft(component c, const volume &where,
+			   const vector<double> &freq,
+			   bool include_dV_and_interp_weights,
+			   complex<double> stored_weight, dft_chunk *chunk_next,
+			   bool sqrt_dV_and_interp_weights,
+			   complex<double> extra_weight,
+			   bool use_centered_grid, int vc) {
   if (coordinate_mismatch(gv.dim, c))
     return NULL;
 
@@ -176,19 +296,20 @@ dft_chunk *fields::add_dft(component c, const volume &where,
   dft_chunk_data data;
   data.c = c;
   data.vc = vc;
-  if (Nfreq <= 1) freq_min = freq_max = (freq_min + freq_max) * 0.5;
-  data.omega_min = freq_min * 2*pi;
-  data.domega = Nfreq <= 1 ? 0.0 :
-    (freq_max * 2*pi - data.omega_min) / (Nfreq - 1);
-  data.Nomega = Nfreq;
+  data.omega.resize(freq.size());
+  for (size_t i = 0; i < freq.size(); ++i)
+    data.omega[i] = freq[i] * 2*pi;
   data.stored_weight = stored_weight;
   data.extra_weight  = extra_weight;
+  data.dt           = dt;
   data.dt_factor     = dt/sqrt(2.0*pi);
   data.include_dV_and_interp_weights = include_dV_and_interp_weights;
   data.sqrt_dV_and_interp_weights    = sqrt_dV_and_interp_weights;
+  data.dft_index = dft_count++;
   data.dft_chunks = chunk_next;
   loop_in_chunks(add_dft_chunkloop, (void *) &data, where,
 		 use_centered_grid ? Centered : c);
+  dft_stride = 0; // the DFT decimation may depend on the new frequencies
 
   return data.dft_chunks;
 }
@@ -196,12 +317,18 @@ dft_chunk *fields::add_dft(component c, const volume &where,
 dft_chunk *fields::add_dft(const volume_list *where,
 			   double freq_min, double freq_max, int Nfreq,
 			   bool include_dV_and_interp_weights) {
+  return add_dft(where, dft_freqs(freq_min, freq_max, Nfreq),
+		 include_dV_and_interp_weights);
+}
+
+dft_chunk *fields::add_dft(const volume_list *where, const vector<double> &freq,
+			   bool include_dV_and_interp_weights) {
   dft_chunk *chunks = 0;
   while (where) {
     if (is_derived(where->c)) abort("derived_component invalid for dft");
     cdouble stored_weight = where->weight;
     chunks = add_dft(component(where->c), where->v,
-		     freq_min, freq_max, Nfreq, include_dV_and_interp_weights,
+		     freq, include_dV_and_interp_weights,
 		     stored_weight, chunks);
     where = where->next;
   }
@@ -213,29 +340,183 @@ dft_chunk *fields::add_dft_pt(component c, const vec &where,
   return add_dft(c, where, freq_min, freq_max, Nfreq, false);
 }
 
+// recompute the DFT decimation stride if needed (collective)
+void fields::update_dft_decimation() {
+  if (decimate_dfts && dft_stride == 0) {
+    dft_stride = dft_decimation_stride();
+    for (int i = 0; i < num_chunks; i++)
+      if (chunks[i]->is_mine())
+	for (dft_chunk *cur = chunks[i]->dft_chunks; cur; cur = cur->next_in_chunk)
+	  cur->set_decimation(dft_stride, dft_anti_alias);
+  }
+}
+
 void fields::update_dfts() {
+  update_dft_decimation();
+  const int stride = decimate_dfts ? dft_stride : 1;
+  const bool sample = t % stride == 0;
+  if (!sample && !(dft_anti_alias && stride > 1)) return;
+
   am_now_working_on(FourierTransforming);
   for (int i = 0; i < num_chunks; i++)
     if (chunks[i]->is_mine())
-      chunks[i]->update_dfts(time(), time() - 0.5 * dt);
+      chunks[i]->update_dfts(time(), time() - 0.5 * dt, sample);
   finished_working();
 }
 
-void fields_chunk::update_dfts(double timeE, double timeH) {
+/* Opt-in decimation of the DFTs: if all of the sources are band-limited
+   (Gaussian pulses) and the materials are linear, then the fields are
+   band-limited too, and the DFTs only need to be updated every few
+   timesteps (see dft_decimation_stride).  Optionally, the fields are
+   box-averaged between the updates as an anti-aliasing filter, which
+   costs an extra sum per point per timestep but protects against
+   stray out-of-band fields. */
+void fields::use_dft_decimation(bool decimate, bool anti_alias) {
+  decimate_dfts = decimate;
+  dft_anti_alias = anti_alias;
+  dft_stride = 0;
+  if (!decimate)
+    for (int i = 0; i < num_chunks; i++)
+      if (chunks[i]->is_mine())
+	for (dft_chunk *cur = chunks[i]->dft_chunks; cur; cur = cur->next_in_chunk)
+	  cur->set_decimation(1, false);
+}
+
+static bool is_nonlinear(const structure_chunk *s) {
+  FOR_COMPONENTS(c) if (s->chi2[c] || s->chi3[c]) return true;
+  FOR_FIELD_TYPES(ft)
+    for (const susceptibility *sus = s->chiP[ft]; sus; sus = sus->next)
+      if (dynamic_cast<const multilevel_susceptibility *>(sus)) return true;
+  return false;
+}
+
+/* The largest stride for which the DFTs are not aliased: for fields
+   with frequencies |f| < fsrc (the largest max_frequency of the
+   sources) and DFT frequencies |f| <= fdft, the frequencies
+   f + k/(stride*dt) that are aliased onto the DFT frequencies for
+   k != 0 are all outside the band as long as 1/(stride*dt) > fsrc+fdft.
+   Returns 1 if decimation is not enabled, if there are no sources or
+   they are not band-limited, or if there are nonlinearities (which
+   generate new frequencies). */
+int fields::dft_decimation_stride() {
+  if (!decimate_dfts) return 1;
+  double fsrc = 0;
+  for (src_time *s = sources; s; s = s->next)
+    fsrc = max(fsrc, s->max_frequency());
+  bool nonlinear = false;
+  double fdft = 0;
+  for (int i = 0; i < num_chunks; i++)
+    if (chunks[i]->is_mine()) {
+      nonlinear = nonlinear || is_nonlinear(chunks[i]->s);
+      for (dft_chunk *cur = chunks[i]->dft_chunks; cur; cur = cur->next_in_chunk)
+	for (int j = 0; j < cur->Nomega; ++j)
+	  fdft = max(fdft, fabs(cur->omega[j]) / (2*pi));
+    }
+  nonlinear = or_to_all(nonlinear);
+  fdft = max_to_all(fdft);
+  if (!sources || nonlinear || fsrc == infinity) return 1;
+
+  const double fmax = fsrc + fdft;
+  int stride = int(1 / (dt * fmax));
+  while (stride > 1 && stride * dt * fmax >= 1) --stride;
+  return max(stride, 1);
+}
+
+void fields_chunk::update_dfts(double timeE, double timeH, bool sample) {
   if (doing_solve_cw) return;
   for (dft_chunk *cur = dft_chunks; cur; cur = cur->next_in_chunk) {
-    cur->update_dft(is_magnetic(cur->c) ? timeH : timeE);
+    cur->update_dft(is_magnetic(cur->c) ? timeH : timeE, sample);
   }
 }
 
-void dft_chunk::update_dft(double time) {
-  if (!fc->f[c][0]) return;
+/* Decimate the DFTs by the given stride, i.e. only add the fields
+   every stride timesteps, and the right weights for the DFT sums.
+   For real fields with frequencies below fmax, there is no aliasing
+   of the DFT frequencies f as long as 1/(stride*dt) > fmax + |f|, in
+   which case the decimated sum is as accurate as the full sum.  With
+   filter, the sampled fields are the box average g(t) of the fields
+   over the preceding stride timesteps, which suppresses the aliased
+   frequencies (near multiples of 1/(stride*dt)), and the DFT of g is
+   divided by the response H(w) = sum_j exp(iwj*dt) / stride of the
+   filter to get the DFT of the fields. */
+void dft_chunk::set_decimation(int stride, bool filter) {
+  if (stride < 1) abort("invalid DFT decimation stride %d", stride);
+  filter = filter && stride > 1;
+  if (stride == dec_stride && filter == dec_filter) return;
+
+  flush_dft();
+  dec_stride = stride;
+  dec_filter = filter;
+  for (int i = 0; i < Nomega; ++i) {
+    complex<double> H = 0;
+    if (filter)
+      for (int j = 0; j < stride; ++j)
+	H += polar(1.0, omega[i] * j * dt);
+    else
+      H = 1.0;
+    phase_scale[i] = scale * (double(stride) / H);
+    phase_step[i] = polar(1.0, omega[i] * stride * dt);
+  }
+  phase_count = -1;
 
-  for (int i = 0; i < Nomega; ++i)
-    dft_phase[i] = polar(1.0, (omega_min + i*domega)*time) * scale;
+  delete[] fsum;
+  fsum = NULL;
+  if (filter) {
+    fsum = new realnum[N * 2];
+    for (size_t i = 0; i < N * 2; ++i) fsum[i] = 0;
+  }
+}
+
+/* Buffer the fields (multiplied by the integration weights, and
+   averaged onto the epsilon grid if needed) at the given time, along
+   with the phases exp(iwt) * scale for each frequency, and add the
+   buffered timesteps to dft once Nbatch of them have accumulated.
+   With the decimation filter, the fields are only summed into fsum
+   unless sample is true. */
+void dft_chunk::update_dft(double time, bool sample) {
+  if (!fc->f[c][0]) return;
 
   int numcmp = fc->f[c][1] ? 2 : 1;
+  if (numcmp != nbuf_cmp) {
+    flush_dft();
+    nbuf_cmp = numcmp;
+  }
+  if (!sample && !fsum) return;
+
+  if (sample) {
+    /* compute exp(iwt) by recurrence from the previous sample if
+       possible, recomputing it from scratch every DFT_PHASE_RESYNC
+       samples to prevent the accumulation of roundoff errors */
+    const double dt_sample = dec_stride * dt;
+    if (phase_count >= 0 && phase_count < DFT_PHASE_RESYNC
+	&& fabs(time - (phase_time + dt_sample)) < 1e-8 * dt) {
+      for (int i = 0; i < Nomega; ++i)
+	phase_cur[i] *= phase_step[i];
+      ++phase_count;
+    }
+    else {
+      for (int i = 0; i < Nomega; ++i)
+	phase_cur[i] = polar(1.0, omega[i] * time);
+      phase_count = 0;
+    }
+    phase_time = time;
 
+    realnum *phase = dft_phase + nbuf * 2*Nomega;
+    for (int i = 0; i < Nomega; ++i) {
+      const complex<double> p = phase_cur[i] * phase_scale[i];
+      phase[2*i] = real(p);
+      phase[2*i+1] = imag(p);
+    }
+    if (numcmp == 2) {
+      realnum *phase_swapped = dft_phase_swapped + nbuf * 2*Nomega;
+      for (int i = 0; i < Nomega; ++i) {
+	phase_swapped[2*i] = -phase[2*i+1];
+	phase_swapped[2*i+1] = phase[2*i];
+      }
+    }
+  }
+
+  realnum *fb = fbuf + nbuf * 2;
   size_t idx_dft = 0;
   LOOP_OVER_IVECS(fc->gv, is, ie, idx) {
     double w;
@@ -258,21 +539,63 @@ void dft_chunk::update_dft(double time) {
       for (int cmp=0; cmp < numcmp; ++cmp)
       	f[cmp] = w * fc->f[c][cmp][idx];
 
-    if (numcmp == 2) {
-      complex<realnum> fc(f[0], f[1]);
-      for (int i = 0; i < Nomega; ++i)
-      	dft[Nomega * idx_dft + i] += dft_phase[i] * fc;
-    }
-    else {
-      realnum fr = f[0];
-      for (int i = 0; i < Nomega; ++i)
-      	dft[Nomega * idx_dft + i] += dft_phase[i] * fr;
+    if (fsum) {
+      for (int cmp=0; cmp < numcmp; ++cmp)
+	fsum[idx_dft * 2 + cmp] += f[cmp];
+      if (sample)
+	for (int cmp=0; cmp < numcmp; ++cmp) {
+	  fb[(idx_dft * Nbatch) * 2 + cmp] = fsum[idx_dft * 2 + cmp];
+	  fsum[idx_dft * 2 + cmp] = 0;
+	}
     }
+    else
+      for (int cmp=0; cmp < numcmp; ++cmp)
+	fb[(idx_dft * Nbatch) * 2 + cmp] = f[cmp];
     idx_dft++;
   }
+
+  if (sample && ++nbuf == Nbatch) flush_dft();
+}
+
+/* Add the buffered timesteps to dft.  For each point, this is a small
+   matrix product of the buffered fields (1 x nbuf) by the phases
+   (nbuf x Nomega), done in the same order as if each timestep were
+   added separately.  Treating the complex arrays as arrays of 2*Nomega
+   realnums, each term is a real multiply-add over the frequencies:
+   for real fields f, dft += phase * f, and for complex fields
+   dft += phase * re(f) + phase_swapped * im(f).  (This loop is
+   explicitly vectorized in step_simd.cpp, if possible.) */
+void dft_chunk::flush_dft() const {
+  if (nbuf == 0) return;
+  const int nb = nbuf, Nb = Nbatch, N2 = 2*Nomega;
+  if (!dft_accumulate_simd((realnum *) dft, fbuf, dft_phase, dft_phase_swapped,
+			   N, Nb, nb, nbuf_cmp == 2, N2)) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (N * N2 * nb >= 131072)
+#endif
+    for (ptrdiff_t idx_dft = 0; idx_dft < ptrdiff_t(N); ++idx_dft) {
+      realnum * __restrict d = (realnum *) (dft + Nomega * idx_dft);
+      const realnum *fb = fbuf + idx_dft * Nb * 2;
+      for (int k = 0; k < nb; ++k) {
+	const realnum fr = fb[2*k];
+	const realnum * __restrict p = dft_phase + k * N2;
+	if (nbuf_cmp == 2) {
+	  const realnum fi = fb[2*k+1];
+	  const realnum * __restrict ps = dft_phase_swapped + k * N2;
+	  for (int j = 0; j < N2; ++j)
+	    d[j] += p[j] * fr + ps[j] * fi;
+	}
+	else
+	  for (int j = 0; j < N2; ++j)
+	    d[j] += p[j] * fr;
+      }
+    }
+  }
+  nbuf = 0;
 }
 
 void dft_chunk::scale_dft(complex<double> scale) {
+  flush_dft();
   for (size_t i = 0; i < N * Nomega; ++i)
     dft[i] *= scale;
   if (next_in_dft)
@@ -282,6 +605,9 @@ void dft_chunk::scale_dft(complex<double> scale) {
 void dft_chunk::operator-=(const dft_chunk &chunk) {
   if (c != chunk.c || N * Nomega != chunk.N * chunk.Nomega) abort("Mismatched chunks in dft_chunk::operator-=");
 
+  flush_dft();
+  chunk.flush_dft();
+
   for (size_t i = 0; i < N * Nomega; ++i)
     dft[i] -= chunk.dft[i];
 
@@ -312,6 +638,7 @@ void save_dft_hdf5(dft_chunk *dft_chunks, const char *name, h5file *file,
 
   for (dft_chunk *cur = dft_chunks; cur; cur = cur->next_in_dft) {
     size_t Nchunk = cur->N * cur->Nomega * 2;
+    cur->flush_dft();
     file->write_chunk(1, &istart, &Nchunk, (realnum *) cur->dft);
     istart += Nchunk;
   }
@@ -339,6 +666,7 @@ void load_dft_hdf5(dft_chunk *dft_chunks, const char *name, h5file *file,
 
   for (dft_chunk *cur = dft_chunks; cur; cur = cur->next_in_dft) {
     size_t Nchunk = cur->N * cur->Nomega * 2;
+    cur->flush_dft();
     file->read_chunk(1, &istart, &Nchunk, (realnum *) cur->dft);
     istart += Nchunk;
   }
@@ -352,16 +680,26 @@ void load_dft_hdf5(dft_chunk *dft_chunks, component c, h5file *file,
 dft_flux::dft_flux(const component cE_, const component cH_, dft_chunk *E_, dft_chunk *H_,
 		   double fmin, double fmax, int Nf, const volume &where_,
                    direction normal_direction_, bool use_symmetry_) :
- Nfreq(Nf), E(E_), H(H_), cE(cE_), cH(cH_), where(where_),
- normal_direction(normal_direction_), use_symmetry(use_symmetry_)
+ freq(dft_freqs(fmin, fmax, Nf)), Nfreq(Nf), E(E_), H(H_), cE(cE_), cH(cH_),
+ where(where_), normal_direction(normal_direction_), use_symmetry(use_symmetry_)
 {
   if (Nf <= 1) fmin = fmax = (fmin + fmax) * 0.5;
   freq_min = fmin;
   dfreq = Nf <= 1 ? 0.0 : (fmax - fmin) / (Nf - 1);
 }
 
+dft_flux::dft_flux(const component cE_, const component cH_, dft_chunk *E_, dft_chunk *H_,
+		   const vector<double> &freq_, const volume &where_,
+                   direction normal_direction_, bool use_symmetry_) :
+ freq(freq_), Nfreq(freq_.size()), E(E_), H(H_), cE(cE_), cH(cH_),
+ where(where_), normal_direction(normal_direction_), use_symmetry(use_symmetry_)
+{
+  freq_min = Nfreq > 0 ? freq[0] : 0.0;
+  dfreq = dft_freqs_spacing(freq);
+}
+
 dft_flux::dft_flux(const dft_flux &f) : where(f.where) {
-  freq_min = f.freq_min; Nfreq = f.Nfreq; dfreq = f.dfreq;
+  freq = f.freq; freq_min = f.freq_min; Nfreq = f.Nfreq; dfreq = f.dfreq;
   E = f.E; H = f.H;
   cE = f.cE; cH = f.cH;
   normal_direction = f.normal_direction;
@@ -372,11 +710,14 @@ double *dft_flux::flux() {
   double *F = new double[Nfreq];
   for (int i = 0; i < Nfreq; ++i) F[i] = 0;
   for (dft_chunk *curE = E, *curH = H; curE && curH;
-       curE = curE->next_in_dft, curH = curH->next_in_dft)
+       curE = curE->next_in_dft, curH = curH->next_in_dft) {
+    curE->flush_dft();
+    curH->flush_dft();
     for (size_t k = 0; k < curE->N; ++k)
       for (int i = 0; i < Nfreq; ++i)
 	F[i] += real(curE->dft[k*Nfreq + i]
 		     * conj(curH->dft[k*Nfreq + i]));
+  }
   double *Fsum = new double[Nfreq];
   sum_to_all(F, Fsum, Nfreq);
   delete[] F;
@@ -417,9 +758,16 @@ void dft_flux::scale_dfts(complex<double> scale) {
 dft_flux fields::add_dft_flux(const volume_list *where_,
 			      double freq_min, double freq_max, int Nfreq,
                               bool use_symmetry)
+{
+  return add_dft_flux(where_, dft_freqs(freq_min, freq_max, Nfreq), use_symmetry);
+}
+
+dft_flux fields::add_dft_flux(const volume_list *where_,
+			      const vector<double> &freq,
+                              bool use_symmetry)
 {
   if (!where_) // handle empty list of volumes
-   return dft_flux(Ex, Hy, NULL, NULL, freq_min, freq_max, Nfreq, v, NO_DIRECTION, use_symmetry);
+   return dft_flux(Ex, Hy, NULL, NULL, freq, v, NO_DIRECTION, use_symmetry);
 
   dft_chunk *E = 0, *H = 0;
   component cE[2] = {Ex,Ey}, cH[2] = {Hy,Hx};
@@ -452,9 +800,9 @@ dft_flux fields::add_dft_flux(const volume_list *where_,
     }
 
     for (int i = 0; i < 2; ++i) {
-      E = add_dft(cE[i], where->v, freq_min, freq_max, Nfreq,
+      E = add_dft(cE[i], where->v, freq,
 		  true, where->weight * double(1 - 2*i), E);
-      H = add_dft(cH[i], where->v, freq_min, freq_max, Nfreq,
+      H = add_dft(cH[i], where->v, freq,
 		  false, 1.0, H);
     }
 
@@ -465,7 +813,7 @@ dft_flux fields::add_dft_flux(const volume_list *where_,
   // if the volume list has only one entry, store its component's direction.
   // if the volume list has > 1 entry, store NO_DIRECTION.
   direction flux_dir = (where_->next ? NO_DIRECTION : component_direction(where_->c));
-  return dft_flux(cE[0], cH[0], E, H, freq_min, freq_max, Nfreq, firstvol, flux_dir, use_symmetry);
+  return dft_flux(cE[0], cH[0], E, H, freq, firstvol, flux_dir, use_symmetry);
 }
 
 
@@ -496,10 +844,24 @@ dft_flux fields::add_dft_flux(direction d, const volume &where,
   return flux;
 }
 
+dft_flux fields::add_dft_flux(direction d, const volume &where,
+			      const vector<double> &freq, bool use_symmetry) {
+  if (d == NO_DIRECTION)
+    d = normal_direction(where);
+  volume_list vl(where, direction_component(Sx, d));
+  dft_flux flux=add_dft_flux(&vl, freq, use_symmetry);
+  flux.normal_direction=d;
+  return flux;
+}
+
 dft_flux fields::add_mode_monitor(direction d, const volume &where,
                                   double freq_min, double freq_max, int Nfreq)
 { return add_dft_flux(d,where,freq_min,freq_max,Nfreq, /*use_symmetry=*/false); }
 
+dft_flux fields::add_mode_monitor(direction d, const volume &where,
+                                  const vector<double> &freq)
+{ return add_dft_flux(d,where,freq, /*use_symmetry=*/false); }
+
 dft_flux fields::add_dft_flux_box(const volume &where,
 				  double freq_min, double freq_max, int Nfreq){
   volume_list *faces = 0;
@@ -530,11 +892,22 @@ dft_fields::dft_fields(dft_chunk *chunks_,
                        const volume &where_) : where(where_)
 {
   chunks   = chunks_;
+  freq     = dft_freqs(freq_min_, freq_max_, Nfreq_);
   freq_min = freq_min_;
   dfreq    = Nfreq_ <= 1 ? 0.0 : (freq_max_ - freq_min_) / (Nfreq_ - 1);
   Nfreq    = Nfreq_;
 }
 
+dft_fields::dft_fields(dft_chunk *chunks_, const vector<double> &freq_,
+                       const volume &where_) : where(where_)
+{
+  chunks   = chunks_;
+  freq     = freq_;
+  freq_min = freq.empty() ? 0.0 : freq[0];
+  dfreq    = dft_freqs_spacing(freq);
+  Nfreq    = freq.size();
+}
+
 void dft_fields::scale_dfts(cdouble scale)
 { chunks->scale_dft(scale);
 }
@@ -562,6 +935,19 @@ dft_fields fields::add_dft_fields(component *components, int num_components,
   return dft_fields(chunks, freq_min, freq_max, Nfreq, where);
 }
 
+dft_fields fields::add_dft_fields(component *components, int num_components,
+                                  const volume where, const vector<double> &freq)
+{
+  bool include_dV_and_interp_weights=false;
+  cdouble stored_weight=1.0;
+  dft_chunk *chunks=0;
+  for(int nc=0; nc<num_components; nc++)
+   chunks = add_dft(components[nc], where, freq,
+                    include_dV_and_interp_weights, stored_weight, chunks);
+
+  return dft_fields(chunks, freq, where);
+}
+
 /***************************************************************/
 /* chunk-level processing for fields::process_dft_component.   */
 /***************************************************************/
@@ -573,6 +959,8 @@ cdouble dft_chunk::process_dft_component(int rank, direction *ds,
                                          void *mode1_data, void *mode2_data,
                                          component c_conjugate)
 {
+   flush_dft();
+
    /*****************************************************************/
    /* compute the size of the chunk we own and its strides etc.     */
    /*****************************************************************/
@@ -800,7 +1188,10 @@ cdouble fields::process_dft_component(dft_chunk **chunklists, int num_chunklists
      reim_max = 1;
    }
   else if (pfield_array)
-   *pfield_array = field_array = new cdouble[array_size];
+   { // zero the points of other processes for the sum_to_all below
+     *pfield_array = field_array = new cdouble[array_size];
+     for (size_t i = 0; i < array_size; ++i) field_array[i] = 0.0;
+   }
 
   bool append_data      = false;
   bool single_precision = false;
@@ -832,22 +1223,19 @@ cdouble fields::process_dft_component(dft_chunk **chunklists, int num_chunklists
      else if (field_array)
       {
         /***************************************************************/
-        /* repeatedly call sum_to_all to consolidate full field array  */
-        /* on all cores                                                */
+        /* repeatedly call sum_to_all (in place) to consolidate full   */
+        /* field array on all cores                                    */
         /***************************************************************/
-        #define BUFSIZE 1<<16 // use 64k buffer
-        cdouble *buf = new cdouble[BUFSIZE];
+        #define BUFSIZE 1<<16 // sum 64k values at a time
         ptrdiff_t offset=0;
         size_t remaining=array_size;
         while(remaining!=0)
          {
            size_t size = (remaining > BUFSIZE ? BUFSIZE : remaining);
-           sum_to_all(field_array + offset, buf, size);
-           memcpy(field_array + offset, buf, size*sizeof(cdouble));
+           sum_to_all(field_array + offset, field_array + offset, size);
            remaining-=size;
            offset+=size;
          }
-        delete[] buf;
       }
    } // for(int reim=0; reim<=reim_max; reim++)
 
@@ -937,7 +1325,7 @@ cdouble *fields::get_dft_array(dft_flux flux, component c, int num_freq, int *ra
   dft_chunk *chunklists[2];
   chunklists[0] = flux.E;
   chunklists[1] = flux.H;
-  cdouble *array;
+  cdouble *array = 0;
   process_dft_component(chunklists, 2, num_freq, c, 0, &array, rank, dims);
   return collapse_empty_dimensions(array, rank, dims, flux.where);
 }
@@ -948,7 +1336,7 @@ cdouble *fields::get_dft_array(dft_force force, component c, int num_freq, int *
   chunklists[0] = force.offdiag1;
   chunklists[1] = force.offdiag2;
   chunklists[2] = force.diag;
-  cdouble *array;
+  cdouble *array = 0;
   process_dft_component(chunklists, 3, num_freq, c, 0, &array, rank, dims);
   return collapse_empty_dimensions(array, rank, dims, force.where);
 }
@@ -957,7 +1345,7 @@ cdouble *fields::get_dft_array(dft_near2far n2f, component c, int num_freq, int
 {
   dft_chunk *chunklists[1];
   chunklists[0] = n2f.F;
-  cdouble *array;
+  cdouble *array = 0;
   process_dft_component(chunklists, 1, num_freq, c, 0, &array, rank, dims);
   return collapse_empty_dimensions(array, rank, dims, n2f.where);
 }
@@ -966,7 +1354,7 @@ cdouble *fields::get_dft_array(dft_fields fdft, component c, int num_freq, int *
 {
   dft_chunk *chunklists[1];
   chunklists[0] = fdft.chunks;
-  cdouble *array;
+  cdouble *array = 0;
   process_dft_component(chunklists, 1, num_freq, c, 0, &array, rank, dims);
   return collapse_empty_dimensions(array, rank, dims, fdft.where);
 }
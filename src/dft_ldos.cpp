@@ -92,41 +92,15 @@ void dft_ldos::update(fields &f)
 	component c = direction_component(Ex, component_direction(sv->c));
 	realnum *fr = f.chunks[ic]->f[c][0];
 	realnum *fi = f.chunks[ic]->f[c][1];
-	if (fr && fi) // complex E
-	  for (size_t j=0; j<sv->npts; j++) {
-	    const ptrdiff_t idx = sv->index[j];
-	    const complex<double> A = sv->A[j];
-	    EJ += complex<double>(fr[idx],fi[idx]) * conj(A);
-	    Jsum += abs(A);
-	  }
-	else if (fr) { // E is purely real
-	  for (size_t j=0; j<sv->npts; j++) {
-	    const ptrdiff_t idx = sv->index[j];
-	    const complex<double> A = sv->A[j];
-	    EJ += double(fr[idx]) * conj(A);
-	    Jsum += abs(A);
-	  }
-	}
+	if (fr) // E may be purely real (fi == NULL)
+	  EJ += sv->overlap(fr, fi, Jsum);
       }
       for (src_vol *sv = f.chunks[ic]->sources[B_stuff]; sv; sv = sv->next) {
 	component c = direction_component(Hx, component_direction(sv->c));
 	realnum *fr = f.chunks[ic]->f[c][0];
 	realnum *fi = f.chunks[ic]->f[c][1];
-	if (fr && fi) // complex H
-	  for (size_t j=0; j<sv->npts; j++) {
-	    const ptrdiff_t idx = sv->index[j];
-	    const complex<double> A = sv->A[j];
-	    HJ += complex<double>(fr[idx],fi[idx]) * conj(A);
-	    Jsum += abs(A);
-	  }
-	else if (fr) { // H is purely real
-	  for (size_t j=0; j<sv->npts; j++) {
-	    const ptrdiff_t idx = sv->index[j];
-	    const complex<double> A = sv->A[j];
-	    HJ += double(fr[idx]) * conj(A);
-	    Jsum += abs(A);
-	  }
-	}
+	if (fr) // H may be purely real (fi == NULL)
+	  HJ += sv->overlap(fr, fi, Jsum);
       }
     }
   for (int i = 0; i < Nomega; ++i) {
@@ -34,6 +34,11 @@ fields::fields(structure *s, double m, double beta,
   shared_chunks = s->shared_chunks;
   verbosity = 0;
   components_allocated = false;
+  overlap_communications = true;
+  decimate_dfts = dft_anti_alias = false;
+  dft_stride = 0;
+  dft_count = 0;
+  async_output = false;
   synchronized_magnetic_fields = 0;
   outdir = new char[strlen(s->outdir) + 1]; strcpy(outdir, s->outdir);
   if (gv.dim == Dcyl)
@@ -68,6 +73,8 @@ fields::fields(structure *s, double m, double beta,
     comm_blocks[ft] = new realnum_ptr[num_chunks*num_chunks];
     for (int i=0;i<num_chunks*num_chunks;i++)
       comm_blocks[ft][i] = 0;
+    comm_requests[ft] = NULL;
+    num_comm_requests[ft] = 0;
   }
   for (int b=0;b<2;b++) FOR_DIRECTIONS(d)
     if (gv.has_boundary((boundary_side)b, d)) boundaries[b][d] = Metallic;
@@ -87,6 +94,13 @@ fields::fields(const fields &thef) :
   shared_chunks = thef.shared_chunks;
   verbosity = 0;
   components_allocated = thef.components_allocated;
+  overlap_communications = thef.overlap_communications;
+  decimate_dfts = thef.decimate_dfts;
+  dft_anti_alias = thef.dft_anti_alias;
+  dft_stride = 0;
+  dft_count = thef.dft_count;
+  async_output = thef.async_output;
+  output_storage = thef.output_storage;
   synchronized_magnetic_fields = thef.synchronized_magnetic_fields;
   outdir = new char[strlen(thef.outdir) + 1]; strcpy(outdir, thef.outdir);
   m = thef.m;
@@ -120,6 +134,8 @@ fields::fields(const fields &thef) :
     comm_blocks[ft] = new realnum_ptr[num_chunks*num_chunks];
     for (int i=0;i<num_chunks*num_chunks;i++)
       comm_blocks[ft][i] = 0;
+    comm_requests[ft] = NULL;
+    num_comm_requests[ft] = 0;
   }
   for (int b=0;b<2;b++) FOR_DIRECTIONS(d)
     boundaries[b][d] = thef.boundaries[b][d];
@@ -129,6 +145,7 @@ fields::fields(const fields &thef) :
 fields::~fields() {
   for (int i=0;i<num_chunks;i++) delete chunks[i];
   delete[] chunks;
+  free_boundary_communications();
   FOR_FIELD_TYPES(ft) {
     for (int i=0;i<num_chunks*num_chunks;i++)
       delete[] comm_blocks[ft][i];
@@ -139,6 +156,8 @@ fields::~fields() {
   delete sources;
   delete fluxes;
   delete[] outdir;
+  for (size_t i = 0; i < chunkloop_plans.size(); ++i)
+    delete chunkloop_plans[i];
   if (!quiet) print_times();
 }
 
@@ -502,6 +521,7 @@ void fields_chunk::remove_sources() {
 void fields::remove_sources() {
   delete sources;
   sources = NULL;
+  dft_stride = 0;
   for (int i=0;i<num_chunks;i++)
     chunks[i]->remove_sources();
 }
@@ -0,0 +1,548 @@
+/* Copyright (C) 2005-2015 Massachusetts Institute of Technology
+%
+%  This program is free software; you can redistribute it and/or modify
+%  it under the terms of the GNU General Public License as published by
+%  the Free Software Foundation; either version 2, or (at your option)
+%  any later version.
+%
+%  This program is distributed in the hope that it will be useful,
+%  but WITHOUT ANY WARRANTY; without even the implied warranty of
+%  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+%  GNU General Public License for more details.
+%
+%  You should have received a copy of the GNU General Public License
+%  along with this program; if not, write to the Free Software Foundation,
+%  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+// Dump/load the complete state of the fields to/from an HDF5 file,
+// for checkpointing.  Each array is stored as a single dataset over
+// the whole grid (or the whole DFT region), independent of the chunks,
+// so that a run can be restarted with a different number of
+// processors or chunks.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <vector>
+
+#include "meep.hpp"
+#include "meep_internals.hpp"
+
+using namespace std;
+
+namespace meep {
+
+/* The arrays of the fields_chunk that are saved, for each component
+   and real/imaginary part.  The backups of synchronize_magnetic_fields,
+   f_w_prev, f_minus_p and f_rderiv_int are all recomputed during the
+   timestep, and are not part of the state. */
+#define NUM_FIELD_KINDS 4
+static const char *field_kind_name[NUM_FIELD_KINDS] = { "f", "f_u", "f_w", "f_cond" };
+
+static realnum *&field_kind_array(fields_chunk *fc, int kind, component c, int cmp) {
+  switch (kind) {
+  case 1: return fc->f_u[c][cmp];
+  case 2: return fc->f_w[c][cmp];
+  case 3: return fc->f_cond[c][cmp];
+  default: return fc->f[c][cmp];
+  }
+}
+
+/* The value of an array that is not allocated in a chunk, which is the
+   value it gets when it is lazily allocated during the timestep (see
+   step_db and update_eh): a copy of f, or zero (NULL) for f_cond. */
+static const realnum *field_kind_default(fields_chunk *fc, int kind,
+					 component c, int cmp) {
+  return kind == 3 ? NULL : fc->f[c][cmp];
+}
+
+/* The datasets for the arrays on the grid are rank-3 arrays over the
+   loop directions of LOOP_OVER_IVECS (with size 1 for the directions
+   that are not in the grid), with nvals values per point in the last
+   dimension.  The point iloc of any Yee grid has the index
+   (iloc - corner) / 2 in each direction. */
+static void grid_dims(const grid_volume &gv, int nvals, size_t dims[3]) {
+  for (int j = 0; j < 3; ++j)
+    dims[j] = has_direction(gv.dim, gv.yucky_direction(j)) ? gv.yucky_num(j) + 1 : 1;
+  dims[2] *= nvals;
+}
+
+// the points is..ie of a chunk and their place in a dataset
+struct dataset_slab {
+  ivec is, ie;
+  size_t start[3], count[3];
+  size_t n; // number of values (0 if the slab is empty)
+
+  dataset_slab(const ivec &corner, const ivec &is_, const ivec &ie_, int nvals)
+    : is(is_), ie(ie_) {
+    n = nvals;
+    for (int j = 0; j < 3; ++j) {
+      const int nj = (ie.yucky_val(j) - is.yucky_val(j)) / 2 + 1;
+      start[j] = (is.yucky_val(j) - corner.yucky_val(j)) / 2;
+      count[j] = nj > 0 ? nj : 0;
+      n *= count[j];
+    }
+    start[2] *= nvals;
+    count[2] *= nvals;
+  }
+};
+
+// the owned points of the c grid of the chunk fc, in the dataset for gv
+static dataset_slab owned_slab(const grid_volume &gv, const fields_chunk *fc,
+			       component c, int nvals) {
+  return dataset_slab(gv.little_corner(), fc->gv.little_owned_corner(c),
+		      fc->gv.big_corner(), nvals);
+}
+
+// copy the slab of the array a (or zeros if a is NULL) to buf
+static void gather_slab(const grid_volume &gv, const dataset_slab &s,
+			const realnum *a, int nvals, realnum *buf) {
+  size_t k = 0;
+  LOOP_OVER_IVECS(gv, s.is, s.ie, idx)
+    for (int v = 0; v < nvals; ++v) buf[k++] = a ? a[idx*nvals + v] : 0;
+}
+
+static void scatter_slab(const grid_volume &gv, const dataset_slab &s,
+			 const realnum *buf, int nvals, realnum *a) {
+  size_t k = 0;
+  LOOP_OVER_IVECS(gv, s.is, s.ie, idx)
+    for (int v = 0; v < nvals; ++v) a[idx*nvals + v] = buf[k++];
+}
+
+// whether buf differs from the slab of the array a (zero if a is NULL)
+static bool slab_differs(const grid_volume &gv, const dataset_slab &s,
+			 const realnum *buf, const realnum *a) {
+  size_t k = 0;
+  LOOP_OVER_IVECS(gv, s.is, s.ie, idx)
+    if (buf[k++] != (a ? a[idx] : 0)) return true;
+  return false;
+}
+
+/* The DFT of each add_dft call (dft_index) is stored as a dataset over
+   the bounding box (in the coordinates of the whole cell, i.e. after
+   the symmetry transformations and lattice shifts) of the points of all
+   of its dft_chunks, which do not overlap.  The DFT values at each
+   point include the phase factor of the symmetry transformation and
+   the lattice shift (the dft_chunk::scale), so they do not depend on
+   which chunk has the point. */
+static void dft_chunk_box(const dft_chunk *cur, ivec &lo, ivec &hi) {
+  const ivec isS = cur->S.transform(cur->is, cur->sn) + cur->shift;
+  const ivec ieS = cur->S.transform(cur->ie, cur->sn) + cur->shift;
+  lo = min(isS, ieS);
+  hi = max(isS, ieS);
+}
+
+/* copy the nvals values per point of the array a of cur (in the order
+   of its loop) to or from buf, which holds the points of its box in
+   the order of the datasets: the loop directions may be reversed or
+   permuted by the symmetry transformation */
+static void dft_chunk_copy(const dft_chunk *cur, realnum *a, int nvals,
+			   realnum *buf, bool to_buf) {
+  const grid_volume &gv = cur->fc->gv;
+  ivec lo, hi;
+  dft_chunk_box(cur, lo, hi);
+  const int n2 = (hi.yucky_val(1) - lo.yucky_val(1)) / 2 + 1;
+  const int n3 = (hi.yucky_val(2) - lo.yucky_val(2)) / 2 + 1;
+  size_t k = 0;
+  LOOP_OVER_IVECS(gv, cur->is, cur->ie, idx) {
+    IVEC_LOOP_ILOC(gv, iloc);
+    const ivec u = cur->S.transform(iloc, cur->sn) + cur->shift - lo;
+    const size_t ib = ((size_t(u.yucky_val(0) / 2) * n2 + u.yucky_val(1) / 2) * n3
+		       + u.yucky_val(2) / 2) * nvals;
+    for (int v = 0; v < nvals; ++v, ++k)
+      if (to_buf) buf[ib + v] = a[k];
+      else a[k] = buf[ib + v];
+  }
+}
+
+/* The anti-aliasing sums fsum of the DFT decimation hold the fields
+   without the phase factor, so they are multiplied by the scale of the
+   dft_chunk to get the value in the cell (as complex numbers). */
+static void dft_fsum_scale(dft_chunk *cur, realnum *tmp, bool to_cell) {
+  const complex<double> scale = cur->scale;
+  if (scale == 0.0) return;
+  for (size_t i = 0; i < cur->N; ++i) {
+    if (to_cell) {
+      const complex<double> v =
+	complex<double>(cur->fsum[2*i], cur->fsum[2*i+1]) * scale;
+      tmp[2*i] = real(v); tmp[2*i+1] = imag(v);
+    }
+    else {
+      const complex<double> v = complex<double>(tmp[2*i], tmp[2*i+1]) / scale;
+      cur->fsum[2*i] = real(v); cur->fsum[2*i+1] = imag(v);
+    }
+  }
+}
+
+// the dataset slab of the box of cur, for the DFT box lo..hi
+static dataset_slab dft_slab(const dft_chunk *cur, const ivec &lo, int nvals) {
+  ivec clo, chi;
+  dft_chunk_box(cur, clo, chi);
+  return dataset_slab(lo, clo, chi, nvals);
+}
+
+static polarization_state *nth_pol(fields_chunk *fc, int ft, int j) {
+  polarization_state *p = fc->pol[ft];
+  for (; p && j > 0; --j) p = p->next;
+  return p;
+}
+
+static void write_scalar(h5file &file, const char *dataname, size_t val) {
+  size_t start = 0, count = 1;
+  file.create_data(dataname, 1, &count, false, false);
+  if (am_master()) file.write_chunk(1, &start, &count, &val);
+}
+
+static size_t read_scalar(h5file &file, const char *dataname) {
+  int rank;
+  size_t dims[1], start = 0, count = 1, val = 0;
+  file.read_size(dataname, &rank, dims, 1);
+  if (rank != 1 || dims[0] != 1)
+    abort("invalid %s dataset in fields file", dataname);
+  file.read_chunk(1, &start, &count, &val);
+  return val;
+}
+
+static void check_dims(h5file &file, const char *dataname, const size_t dims[3]) {
+  int rank;
+  size_t fdims[3];
+  file.read_size(dataname, &rank, fdims, 3);
+  if (rank != 3 || fdims[0] != dims[0] || fdims[1] != dims[1] || fdims[2] != dims[2])
+    abort("dataset %s in %s does not match the fields", dataname, file.file_name());
+}
+
+static void dft_dataname(char *dataname, int index, const char *suffix) {
+  snprintf(dataname, 64, "dft.%d%s", index, suffix);
+}
+
+void fields::dump(const char *filename) {
+  if (synchronized_magnetic_fields)
+    abort("fields::dump is not supported with synchronized magnetic fields");
+  if (!quiet)
+    master_printf("creating fields output file \"%s\"...\n", filename);
+
+  /* First, figure out which arrays are allocated in any chunk, and the
+     extent of each DFT: with a serial HDF5 library, the processes take
+     turns accessing the file, so there can be no communication while
+     the file is open. */
+  const int nhave = NUM_FIELD_KINDS * NUM_FIELD_COMPONENTS * 2;
+  int have_[nhave], have[nhave];
+  for (int kind = 0; kind < NUM_FIELD_KINDS; ++kind)
+    FOR_COMPONENTS(c) DOCMP2 {
+      int &h = have_[(kind * NUM_FIELD_COMPONENTS + c) * 2 + cmp];
+      h = 0;
+      for (int i = 0; i < num_chunks; i++)
+	if (chunks[i]->is_mine() && field_kind_array(chunks[i], kind, c, cmp))
+	  h = 1;
+    }
+  or_to_all(have_, have, nhave);
+
+  vector<int> pol_have_, pol_have;
+  for (int ft = E_stuff; ft <= H_stuff; ++ft) {
+    int j = 0;
+    for (polarization_state *p = chunks[0]->pol[ft]; p; p = p->next, ++j)
+      for (int n = 0; n < p->s->num_internal_arrays(); ++n) {
+	int h = 0;
+	for (int i = 0; i < num_chunks; i++)
+	  if (chunks[i]->is_mine()) {
+	    polarization_state *pi = nth_pol(chunks[i], ft, j);
+	    component c;
+	    int nvals;
+	    if (pi->s->internal_array(n, pi->data, &c, &nvals)
+		|| pi->s->get_internal_array(n, pi->data, NULL)) h = 1;
+	  }
+	pol_have_.push_back(h);
+      }
+  }
+  pol_have.resize(pol_have_.size());
+  if (!pol_have.empty())
+    or_to_all(&pol_have_[0], &pol_have[0], pol_have.size());
+
+  // DFT bounding boxes (-lo and hi), numbers of frequencies, and fsum flags
+  vector<int> dft_box(dft_count * 6, INT_MIN), dft_nomega(dft_count, 0),
+    dft_fsum(dft_count, 0);
+  for (int i = 0; i < num_chunks; i++)
+    if (chunks[i]->is_mine())
+      for (dft_chunk *cur = chunks[i]->dft_chunks; cur; cur = cur->next_in_chunk) {
+	cur->flush_dft();
+	const int k = cur->dft_index;
+	ivec lo, hi;
+	dft_chunk_box(cur, lo, hi);
+	for (int j = 0; j < 3; ++j) {
+	  if (-lo.yucky_val(j) > dft_box[k*6 + j]) dft_box[k*6 + j] = -lo.yucky_val(j);
+	  if (hi.yucky_val(j) > dft_box[k*6 + 3+j]) dft_box[k*6 + 3+j] = hi.yucky_val(j);
+	}
+	dft_nomega[k] = cur->Nomega;
+	if (cur->fsum) dft_fsum[k] = 1;
+      }
+  for (int k = 0; k < dft_count; ++k) {
+    for (int j = 0; j < 6; ++j) dft_box[k*6 + j] = max_to_all(dft_box[k*6 + j]);
+    dft_nomega[k] = max_to_all(dft_nomega[k]);
+    dft_fsum[k] = max_to_all(dft_fsum[k]);
+  }
+
+  h5file file(filename, h5file::WRITE, true);
+  char dataname[64];
+  write_scalar(file, "t", t);
+  write_scalar(file, "is_real", is_real);
+
+  size_t dims[3];
+  grid_dims(gv, 1, dims);
+  for (int kind = 0; kind < NUM_FIELD_KINDS; ++kind)
+    FOR_COMPONENTS(c) DOCMP2
+      if (have[(kind * NUM_FIELD_COMPONENTS + c) * 2 + cmp]) {
+	snprintf(dataname, 64, "%s.%s.%c", field_kind_name[kind],
+		 component_name(c), cmp ? 'i' : 'r');
+	file.create_data(dataname, 3, dims, false, false);
+	for (int i = 0; i < num_chunks; i++)
+	  if (chunks[i]->is_mine()) {
+	    const realnum *a = field_kind_array(chunks[i], kind, c, cmp);
+	    if (!a) a = field_kind_default(chunks[i], kind, c, cmp);
+	    dataset_slab s = owned_slab(gv, chunks[i], c, 1);
+	    if (!s.n) continue;
+	    realnum *buf = new realnum[s.n];
+	    gather_slab(chunks[i]->gv, s, a, 1, buf);
+	    file.write_chunk(3, s.start, s.count, buf);
+	    delete[] buf;
+	  }
+      }
+
+  size_t ipol = 0;
+  for (int ft = E_stuff; ft <= H_stuff; ++ft) {
+    int j = 0;
+    for (polarization_state *p = chunks[0]->pol[ft]; p; p = p->next, ++j)
+      for (int n = 0; n < p->s->num_internal_arrays(); ++n)
+	if (pol_have[ipol++]) {
+	  component c;
+	  int nvals;
+	  p->s->internal_array(n, NULL, &c, &nvals);
+	  snprintf(dataname, 64, "pol.%c.%d.%d", ft == E_stuff ? 'E' : 'H', j, n);
+	  size_t pdims[3];
+	  grid_dims(gv, nvals, pdims);
+	  file.create_data(dataname, 3, pdims, false, false);
+	  for (int i = 0; i < num_chunks; i++)
+	    if (chunks[i]->is_mine()) {
+	      polarization_state *pi = nth_pol(chunks[i], ft, j);
+	      const realnum *a = pi->s->internal_array(n, pi->data, &c, &nvals);
+	      dataset_slab s = owned_slab(gv, chunks[i], c, nvals);
+	      if (!s.n) continue;
+	      realnum *dense = NULL; // copy of an array not stored densely
+	      if (!a && pi->s->get_internal_array(n, pi->data, NULL)) {
+		dense = new realnum[chunks[i]->gv.ntot() * nvals];
+		pi->s->get_internal_array(n, pi->data, dense);
+		a = dense;
+	      }
+	      realnum *buf = new realnum[s.n];
+	      gather_slab(chunks[i]->gv, s, a, nvals, buf);
+	      file.write_chunk(3, s.start, s.count, buf);
+	      delete[] buf;
+	      delete[] dense;
+	    }
+	}
+  }
+
+  for (int k = 0; k < dft_count; ++k) {
+    if (!dft_nomega[k]) continue;
+    ivec lo(gv.dim), hi(gv.dim);
+    size_t start = 0, count = 6;
+    realnum box[6];
+    for (int j = 0; j < 3; ++j) {
+      lo.set_direction(gv.yucky_direction(j), -dft_box[k*6 + j]);
+      hi.set_direction(gv.yucky_direction(j), dft_box[k*6 + 3+j]);
+      box[j] = -dft_box[k*6 + j];
+      box[3+j] = dft_box[k*6 + 3+j];
+    }
+    dft_dataname(dataname, k, ".box");
+    file.create_data(dataname, 1, &count, false, false);
+    if (am_master()) file.write_chunk(1, &start, &count, box);
+
+    for (int fsum = 0; fsum <= dft_fsum[k]; ++fsum) {
+      const int nvals = fsum ? 2 : 2 * dft_nomega[k];
+      dataset_slab sbox(lo, lo, hi, nvals);
+      dft_dataname(dataname, k, fsum ? ".fsum" : "");
+      file.create_data(dataname, 3, sbox.count, false, false);
+      for (int i = 0; i < num_chunks; i++)
+	if (chunks[i]->is_mine())
+	  for (dft_chunk *cur = chunks[i]->dft_chunks; cur; cur = cur->next_in_chunk)
+	    if (cur->dft_index == k) {
+	      dataset_slab s = dft_slab(cur, lo, nvals);
+	      realnum *buf = new realnum[s.n];
+	      if (fsum) {
+		realnum *tmp = new realnum[cur->N * 2];
+		memset(tmp, 0, sizeof(realnum) * cur->N * 2);
+		if (cur->fsum) dft_fsum_scale(cur, tmp, true);
+		dft_chunk_copy(cur, tmp, 2, buf, true);
+		delete[] tmp;
+	      }
+	      else
+		dft_chunk_copy(cur, (realnum *) cur->dft, nvals, buf, true);
+	      file.write_chunk(3, s.start, s.count, buf);
+	      delete[] buf;
+	    }
+    }
+  }
+}
+
+void fields::load(const char *filename) {
+  if (synchronized_magnetic_fields)
+    abort("fields::load is not supported with synchronized magnetic fields");
+  if (!quiet)
+    master_printf("reading fields from file \"%s\"...\n", filename);
+
+  h5file file(filename, h5file::READONLY, true);
+  char dataname[64];
+  const int file_t = int(read_scalar(file, "t"));
+  if (int(read_scalar(file, "is_real")) != is_real)
+    abort("fields::load: real and complex fields do not match in %s", filename);
+  bool need[NUM_FIELD_COMPONENTS];
+  FOR_COMPONENTS(c) {
+    snprintf(dataname, 64, "f.%s.r", component_name(c));
+    need[c] = file.dataset_exists(dataname);
+  }
+  file.prevent_deadlock(); // no communication while the file is open
+
+  FOR_COMPONENTS(c) if (need[c]) require_component(c);
+  update_dft_decimation();
+
+  size_t dims[3];
+  grid_dims(gv, 1, dims);
+  /* The E/H fields may share the arrays of D/B (and f_u etc. may be
+     unallocated) in some chunks, so they are read after D/B, and a
+     separate array is only allocated if the values differ. */
+  for (int kind = 0; kind < NUM_FIELD_KINDS; ++kind)
+    for (int pass = 0; pass < (kind == 0 ? 2 : 1); ++pass)
+      FOR_COMPONENTS(c) DOCMP2 {
+	if (kind == 0 && is_magnetic(c) != (pass == 1)) continue;
+	snprintf(dataname, 64, "%s.%s.%c", field_kind_name[kind],
+		 component_name(c), cmp ? 'i' : 'r');
+	if (!file.dataset_exists(dataname)) continue;
+	check_dims(file, dataname, dims);
+	for (int i = 0; i < num_chunks; i++)
+	  if (chunks[i]->is_mine()) {
+	    fields_chunk *fc = chunks[i];
+	    dataset_slab s = owned_slab(gv, fc, c, 1);
+	    if (!s.n || !fc->f[c][cmp]) continue;
+	    realnum *buf = new realnum[s.n];
+	    file.read_chunk(3, s.start, s.count, buf);
+	    realnum *&a = field_kind_array(fc, kind, c, cmp);
+	    const realnum *a0 = NULL; // array to copy if a must be allocated
+	    bool alloc = false;
+	    if (kind == 0 && is_magnetic(c)) {
+	      a0 = fc->f[direction_component(Bx, component_direction(c))][cmp];
+	      alloc = a == a0 && slab_differs(fc->gv, s, buf, a);
+	    }
+	    else if (kind > 0 && !a) {
+	      a0 = field_kind_default(fc, kind, c, cmp);
+	      alloc = slab_differs(fc->gv, s, buf, a0);
+	    }
+	    if (alloc) {
+	      a = new realnum[fc->gv.ntot()];
+	      if (a0) memcpy(a, a0, fc->gv.ntot() * sizeof(realnum));
+	      else memset(a, 0, fc->gv.ntot() * sizeof(realnum));
+	    }
+	    if (a) scatter_slab(fc->gv, s, buf, 1, a);
+	    delete[] buf;
+	  }
+      }
+
+  for (int ft = E_stuff; ft <= H_stuff; ++ft) {
+    int j = 0;
+    for (polarization_state *p = chunks[0]->pol[ft]; p; p = p->next, ++j)
+      for (int n = 0; n < p->s->num_internal_arrays(); ++n) {
+	snprintf(dataname, 64, "pol.%c.%d.%d", ft == E_stuff ? 'E' : 'H', j, n);
+	if (!file.dataset_exists(dataname)) continue;
+	component c;
+	int nvals;
+	p->s->internal_array(n, NULL, &c, &nvals);
+	size_t pdims[3];
+	grid_dims(gv, nvals, pdims);
+	check_dims(file, dataname, pdims);
+	for (int i = 0; i < num_chunks; i++)
+	  if (chunks[i]->is_mine()) {
+	    fields_chunk *fc = chunks[i];
+	    polarization_state *pi = nth_pol(fc, ft, j);
+	    if (!pi->data) { // as in fields_chunk::update_pols
+	      pi->data = pi->s->new_internal_data(fc->f, fc->gv);
+	      if (pi->data) pi->s->init_internal_data(fc->f, fc->dt, fc->gv, pi->data);
+	    }
+	    realnum *a = pi->s->internal_array(n, pi->data, &c, &nvals);
+	    dataset_slab s = owned_slab(gv, fc, c, nvals);
+	    if (!s.n) continue;
+	    realnum *dense = NULL; // copy of an array not stored densely
+	    if (!a && pi->s->get_internal_array(n, pi->data, NULL)) {
+	      dense = new realnum[fc->gv.ntot() * nvals];
+	      pi->s->get_internal_array(n, pi->data, dense);
+	      a = dense;
+	    }
+	    if (!a) continue;
+	    realnum *buf = new realnum[s.n];
+	    file.read_chunk(3, s.start, s.count, buf);
+	    scatter_slab(fc->gv, s, buf, nvals, a);
+	    delete[] buf;
+	    if (dense) {
+	      pi->s->set_internal_array(n, pi->data, dense);
+	      delete[] dense;
+	    }
+	  }
+      }
+  }
+
+  for (int k = 0; k < dft_count; ++k) {
+    dft_dataname(dataname, k, "");
+    if (!file.dataset_exists(dataname)) continue;
+    int rank;
+    size_t start = 0, count = 6, ddims[3];
+    realnum box[6];
+    dft_dataname(dataname, k, ".box");
+    file.read_size(dataname, &rank, ddims, 1);
+    file.read_chunk(1, &start, &count, box);
+    ivec lo(gv.dim), hi(gv.dim);
+    for (int j = 0; j < 3; ++j) {
+      lo.set_direction(gv.yucky_direction(j), int(box[j]));
+      hi.set_direction(gv.yucky_direction(j), int(box[3+j]));
+    }
+
+    for (int fsum = 0; fsum < 2; ++fsum) {
+      dft_dataname(dataname, k, fsum ? ".fsum" : "");
+      if (!file.dataset_exists(dataname)) continue;
+      file.read_size(dataname, &rank, ddims, 3);
+      for (int i = 0; i < num_chunks; i++)
+	if (chunks[i]->is_mine())
+	  for (dft_chunk *cur = chunks[i]->dft_chunks; cur; cur = cur->next_in_chunk)
+	    if (cur->dft_index == k && (!fsum || cur->fsum)) {
+	      const int nvals = fsum ? 2 : 2 * cur->Nomega;
+	      dataset_slab sbox(lo, lo, hi, nvals);
+	      dataset_slab s = dft_slab(cur, lo, nvals);
+	      for (int j = 0; j < 3; ++j)
+		if (rank != 3 || ddims[j] != sbox.count[j]
+		    || s.start[j] + s.count[j] > sbox.count[j])
+		  abort("DFT %d in %s does not match the fields", k, filename);
+	      realnum *buf = new realnum[s.n];
+	      file.read_chunk(3, s.start, s.count, buf);
+	      if (fsum) {
+		realnum *tmp = new realnum[cur->N * 2];
+		dft_chunk_copy(cur, tmp, 2, buf, false);
+		dft_fsum_scale(cur, tmp, false);
+		delete[] tmp;
+	      }
+	      else {
+		dft_chunk_copy(cur, (realnum *) cur->dft, nvals, buf, false);
+		cur->nbuf = 0; // discard any buffered timesteps
+		cur->phase_count = -1;
+	      }
+	      delete[] buf;
+	    }
+    }
+  }
+  file.prevent_deadlock();
+
+  t = file_t;
+  figure_out_step_plan();
+  chunk_connections_valid = false;
+  FOR_FIELD_TYPES(ft) step_boundaries(ft);
+}
+
+} // namespace meep
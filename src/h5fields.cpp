@@ -43,6 +43,11 @@ typedef struct {
 
   int reim; // whether to output the real or imaginary part
 
+  // with asynchronous output, the chunks (start and count) and their data
+  bool async;
+  vector<size_t> async_chunks;
+  vector<realnum> async_data;
+
   // the function to output and related info (offsets for averaging, etc.)
   int num_fields;
   const component *components;
@@ -207,7 +212,16 @@ static void h5_output_chunkloop(fields_chunk *fc, int ichnk, component cgrid,
 
   //-----------------------------------------------------------------------//
 
-  data->file->write_chunk(data->rank, start, count, data->buf);
+  if (data->async) {
+    const int rank1 = data->rank > 0 ? data->rank : 1;
+    size_t n = 1;
+    for (int i = 0; i < rank1; ++i) n *= count[i];
+    data->async_chunks.insert(data->async_chunks.end(), start, start + rank1);
+    data->async_chunks.insert(data->async_chunks.end(), count, count + rank1);
+    data->async_data.insert(data->async_data.end(), data->buf, data->buf + n);
+  }
+  else
+    data->file->write_chunk(data->rank, start, count, data->buf);
 }
 
 void fields::output_hdf5(h5file *file, const char *dataname,
@@ -225,6 +239,8 @@ void fields::output_hdf5(h5file *file, const char *dataname,
   data.num_chunks = 0;
   data.bufsz = 0;
   data.reim = reim;
+  // (compressed data may also be gathered as for asynchronous output)
+  data.async = async_output || file->gather_chunks();
 
   loop_in_chunks(h5_findsize_chunkloop, (void *) &data,
 	    where, Centered, true, true);
@@ -249,8 +265,9 @@ void fields::output_hdf5(h5file *file, const char *dataname,
   }
   data.rank = rank;
 
-  file->create_or_extend_data(dataname, rank, dims,
-                              append_data, single_precision);
+  if (!data.async)
+    file->create_or_extend_data(dataname, rank, dims,
+				append_data, single_precision);
 
   data.buf = new realnum[data.bufsz];
 
@@ -300,7 +317,17 @@ void fields::output_hdf5(h5file *file, const char *dataname,
   delete[] data.ph;
   delete[] data.cS;
   delete[] data.buf;
-  file->done_writing_chunks();
+  if (data.async) {
+    const int rank1 = rank > 0 ? rank : 1;
+    file->write_chunks_async(dataname, rank, dims, append_data,
+			     single_precision,
+			     int(data.async_chunks.size() / (2 * rank1)),
+			     data.async_chunks.empty() ? NULL : &data.async_chunks[0],
+			     data.async_data.empty() ? NULL : &data.async_data[0]);
+    if (!async_output) file->wait_async_output();
+  }
+  else
+    file->done_writing_chunks();
   finished_working();
 }
 
@@ -335,7 +362,7 @@ void fields::output_hdf5(const char *dataname,
 		1, where, append_data, single_precision);
     delete[] dataname2;
   }
-  if (delete_file) delete file;
+  if (delete_file) delete_h5file_async(file);
 }
 
 /***************************************************************************/
@@ -370,7 +397,7 @@ void fields::output_hdf5(const char *dataname,
   output_hdf5(file, dataname, num_fields, components, rintegrand_fun,
 	      (void *) &data, 0, where, append_data, single_precision);
 
-  if (delete_file) delete file;
+  if (delete_file) delete_h5file_async(file);
 }
 
 /***************************************************************************/
@@ -414,7 +441,7 @@ void fields::output_hdf5(component c,
 		append_data, single_precision);
   }
 
-  if (delete_file) delete file;
+  if (delete_file) delete_h5file_async(file);
 }
 
 /***************************************************************************/
@@ -443,6 +470,19 @@ void fields::output_hdf5(derived_component c,
 
 /***************************************************************************/
 
+void fields::use_async_output(bool enable, size_t max_bytes) {
+  async_output = enable;
+  if (max_bytes) set_async_output_budget(max_bytes);
+}
+
+void fields::flush_output() {
+  am_now_working_on(FieldOutput);
+  flush_async_output();
+  finished_working();
+}
+
+/***************************************************************************/
+
 const char *fields::h5file_name(const char *name,
 				const char *prefix, bool timestamp)
 {
@@ -470,7 +510,13 @@ h5file *fields::open_h5file(const char *name, h5file::access_mode mode,
   const char *filename = h5file_name(name, prefix, timestamp);
   if (!quiet && mode == h5file::WRITE)
     master_printf("creating output file \"%s\"...\n", filename);
-  return new h5file(filename, mode, true);
+  h5file *file = new h5file(filename, mode, true);
+  if (mode != h5file::READONLY) file->set_storage(output_storage);
+  return file;
+}
+
+void fields::set_output_storage(const h5_storage &storage) {
+  output_storage = storage;
 }
 
 } // namespace meep
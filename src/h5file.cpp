@@ -18,6 +18,10 @@
 #include <cstdio>
 #include <cstdlib>
 #include <string.h>
+#include <math.h>
+
+#include <deque>
+#include <vector>
 
 #include "meep.hpp"
 
@@ -50,6 +54,13 @@
 typedef int hid_t;
 #endif
 
+/* The background thread of write_chunks_async; without it, the data is
+   written immediately. */
+#if defined(HAVE_HDF5) && defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#  define HAVE_ASYNC_OUTPUT 1
+#  include <pthread.h>
+#endif
+
 
 #define HID(x) (*((hid_t *) (x)))
 
@@ -97,6 +108,201 @@ using namespace std;
 
 namespace meep {
 
+/*****************************************************************************/
+/* Asynchronous output (write_chunks_async): the datasets are queued on
+   the master process, which gets the chunks of the other processes, and
+   are written in order by a background thread.  While a file has queued
+   datasets (async_pending > 0), it is used only by that thread on the
+   master process, without any communication (parallel = false); the
+   other processes just keep track of its extensible datasets, so that
+   they can use the file again once the master process is done with it.
+   Any other use of the file in the main thread first waits for its
+   queued datasets to be written (or for all of the queued datasets,
+   unless HDF5 is thread-safe, since HDF5 calls cannot overlap). */
+
+struct h5_async_job {
+  h5file *file;
+  char *dataname; // NULL to delete the file
+  int rank;
+  bool append_data, single_precision;
+  vector<size_t> dims, chunks;
+  vector<realnum> data;
+};
+
+static size_t async_budget = size_t(256) << 20;
+
+void set_async_output_budget(size_t max_bytes) { async_budget = max_bytes; }
+
+#ifdef HAVE_ASYNC_OUTPUT
+
+static pthread_mutex_t async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t async_written = PTHREAD_COND_INITIALIZER;
+static pthread_t async_thread;
+static bool async_running = false, async_stop = false;
+static deque<h5_async_job *> async_jobs;
+static size_t async_bytes = 0; // total data in async_jobs
+
+static bool in_async_thread() {
+  return async_running && pthread_equal(pthread_self(), async_thread);
+}
+
+class h5_output_queue {
+public:
+  static int pending(h5file *f) {
+    if (!async_running) return 0;
+    pthread_mutex_lock(&async_mutex);
+    const int n = f->async_pending;
+    pthread_mutex_unlock(&async_mutex);
+    return n;
+  }
+
+  // wait until the queue has room for another bytes of data
+  static void wait_budget(size_t bytes) {
+    pthread_mutex_lock(&async_mutex);
+    while (!async_jobs.empty() && async_bytes + bytes > async_budget)
+      pthread_cond_wait(&async_written, &async_mutex);
+    pthread_mutex_unlock(&async_mutex);
+  }
+
+  static void queue(h5_async_job *job) {
+    pthread_mutex_lock(&async_mutex);
+    if (job->dataname) job->file->async_pending++;
+    async_jobs.push_back(job);
+    async_bytes += job->data.size() * sizeof(realnum);
+    if (!async_running) {
+      async_stop = false;
+      if (pthread_create(&async_thread, NULL, thread, NULL))
+	abort("error creating the asynchronous output thread");
+      async_running = true;
+    }
+    pthread_cond_signal(&async_queued);
+    pthread_mutex_unlock(&async_mutex);
+  }
+
+private:
+  static void write(h5_async_job *job) {
+    h5file *f = job->file;
+    f->parallel = false;
+    if (!job->dataname) { delete f; return; }
+    f->create_or_extend_data(job->dataname, job->rank,
+			     job->dims.empty() ? NULL : &job->dims[0],
+			     job->append_data, job->single_precision);
+    const int rank1 = job->rank > 0 ? job->rank : 1;
+    realnum *data = job->data.empty() ? NULL : &job->data[0];
+    for (size_t i = 0; i < job->chunks.size(); i += 2*rank1) {
+      const size_t *start = &job->chunks[i], *count = start + rank1;
+      f->write_chunk(job->rank, start, count, data);
+      size_t n = 1;
+      for (int j = 0; j < rank1; ++j) n *= count[j];
+      data += n;
+    }
+  }
+
+  // give the file back to the main thread
+  static void release(h5file *f) {
+    f->close_id();
+    f->parallel = true;
+  }
+
+  static void *thread(void *) {
+    pthread_mutex_lock(&async_mutex);
+    for (;;) {
+      while (async_jobs.empty() && !async_stop)
+	pthread_cond_wait(&async_queued, &async_mutex);
+      if (async_jobs.empty()) break;
+      h5_async_job *job = async_jobs.front();
+      pthread_mutex_unlock(&async_mutex);
+      write(job);
+      pthread_mutex_lock(&async_mutex);
+      if (job->dataname) {
+	if (job->file->async_pending == 1) { // no more queued datasets
+	  pthread_mutex_unlock(&async_mutex);
+	  release(job->file);
+	  pthread_mutex_lock(&async_mutex);
+	}
+	job->file->async_pending--;
+      }
+      async_bytes -= job->data.size() * sizeof(realnum);
+      async_jobs.pop_front();
+      pthread_cond_broadcast(&async_written);
+      delete[] job->dataname;
+      delete job;
+    }
+    pthread_mutex_unlock(&async_mutex);
+    return NULL;
+  }
+};
+
+#else // !HAVE_ASYNC_OUTPUT
+
+class h5_output_queue {
+public:
+  static int pending(h5file *f) { (void) f; return 0; }
+};
+
+#endif // HAVE_ASYNC_OUTPUT
+
+/* Wait for the queued datasets of this file to be written, and also
+   (if any HDF5 calls follow and HDF5 is not thread-safe) for all of
+   the queued datasets. */
+void h5file::wait_async_output(bool hdf5_calls) {
+#ifdef HAVE_ASYNC_OUTPUT
+  if (!async_running || in_async_thread()) return;
+  pthread_mutex_lock(&async_mutex);
+  while (async_pending > 0)
+    pthread_cond_wait(&async_written, &async_mutex);
+#  ifdef H5_HAVE_THREADSAFE
+  (void) hdf5_calls; // HDF5 calls from different threads can overlap
+#  else
+  while (hdf5_calls && !async_jobs.empty())
+    pthread_cond_wait(&async_written, &async_mutex);
+#  endif
+  pthread_mutex_unlock(&async_mutex);
+#else
+  (void) hdf5_calls;
+#endif
+}
+
+void flush_async_output() {
+#ifdef HAVE_ASYNC_OUTPUT
+  if (async_running) {
+    pthread_mutex_lock(&async_mutex);
+    while (!async_jobs.empty())
+      pthread_cond_wait(&async_written, &async_mutex);
+    pthread_mutex_unlock(&async_mutex);
+  }
+#endif
+  all_wait();
+}
+
+void delete_h5file_async(h5file *file) {
+#ifdef HAVE_ASYNC_OUTPUT
+  if (h5_output_queue::pending(file)) {
+    h5_async_job *job = new h5_async_job;
+    job->file = file;
+    job->dataname = NULL;
+    h5_output_queue::queue(job);
+    return;
+  }
+#endif
+  delete file;
+}
+
+void stop_async_output() {
+#ifdef HAVE_ASYNC_OUTPUT
+  if (!async_running) return;
+  pthread_mutex_lock(&async_mutex);
+  async_stop = true;
+  pthread_cond_signal(&async_queued);
+  pthread_mutex_unlock(&async_mutex);
+  pthread_join(async_thread, NULL);
+  async_running = false;
+#endif
+}
+
+/*****************************************************************************/
+
 bool h5file::dataset_exists(const char *name) {
 #if HAVE_HDF5
   hid_t data_id;
@@ -111,6 +317,7 @@ bool h5file::dataset_exists(const char *name) {
 
 // lazy file creation & locking
 void *h5file::get_id() {
+  wait_async_output();
   if (HID(id) < 0) {
     if (parallel)
       all_wait();
@@ -143,10 +350,13 @@ void *h5file::get_id() {
 // hackery: in some circumstances, for the exclusive-access mode
 // we must close the id (i.e. the file) in order to prevent deadlock.
 void h5file::prevent_deadlock() {
+  if (h5_output_queue::pending(this)) return; // not open in this thread
   IF_EXCLUSIVE(if (parallel) close_id(), (void) 0);
 }
 
 void h5file::close_id() {
+  wait_async_output(false);
+  if (HID(id) >= 0 || HID(cur_id) >= 0) wait_async_output();
   unset_cur();
   if (HID(id) >= 0)
     if (mode == WRITE) mode = READWRITE; // don't re-create on re-open
@@ -174,6 +384,7 @@ h5file::h5file(const char *filename_, access_mode m, bool parallel_) {
   strcpy(filename, filename_);
   mode = m;
   parallel = parallel_;
+  async_pending = 0;
 }
 
 h5file::~h5file() {
@@ -478,6 +689,59 @@ void h5file::remove_data(const char *dataname)
 #endif
 }
 
+/* The chunk_dims of a dataset of size dims[rank] (plus an unlimited
+   dimension if append_data) stored as in s: the given chunk_dims
+   (at most dims), otherwise the whole dataset, halving its largest
+   dimensions down to at most maxchunk elements, and enough of the
+   unlimited dimension to make at least blocksize elements. */
+#ifdef HAVE_HDF5
+static void get_chunk_dims(const h5_storage &s, int rank, const hsize_t *dims,
+			   bool append_data, hsize_t *chunk_dims)
+{
+  const hsize_t maxchunk = 1 << 18, blocksize = 128;
+  hsize_t N = 1;
+  for (int i = 0; i < rank; ++i) {
+    chunk_dims[i] = dims[i];
+    if (i < 5 && s.chunk_dims[i] && s.chunk_dims[i] < dims[i])
+      chunk_dims[i] = s.chunk_dims[i];
+    N *= chunk_dims[i];
+  }
+  for (;;) {
+    int imax = -1;
+    for (int i = 0; i < rank; ++i)
+      if ((i >= 5 || !s.chunk_dims[i]) && chunk_dims[i] > 1 &&
+	  (imax < 0 || chunk_dims[i] > chunk_dims[imax]))
+	imax = i;
+    if (N <= maxchunk || imax < 0) break;
+    N = N / chunk_dims[imax] * ((chunk_dims[imax] + 1) / 2);
+    chunk_dims[imax] = (chunk_dims[imax] + 1) / 2;
+  }
+  if (append_data) {
+    if (rank < 5 && s.chunk_dims[rank])
+      chunk_dims[rank] = s.chunk_dims[rank];
+    else // make a chunk at least blocksize elements for efficiency
+      chunk_dims[rank] = (blocksize + (N - 1)) / N;
+  }
+}
+
+/* Add the compression filters of s (if available) to the dataset
+   creation properties prop_id. */
+static void set_filters(hid_t prop_id, const h5_storage &s)
+{
+#ifdef HAVE_H5PSET_SCALEOFFSET
+  if (s.max_error > 0 && H5Zfilter_avail(H5Z_FILTER_SCALEOFFSET)) {
+    // round to enough decimal digits for an error of at most max_error
+    const int digits = int(ceil(log10(0.5 / s.max_error)));
+    H5Pset_scaleoffset(prop_id, H5Z_SO_FLOAT_DSCALE, digits);
+  }
+#endif
+  if (s.deflate_level > 0 && H5Zfilter_avail(H5Z_FILTER_DEFLATE)) {
+    if (s.shuffle) H5Pset_shuffle(prop_id);
+    H5Pset_deflate(prop_id, s.deflate_level < 9 ? s.deflate_level : 9);
+  }
+}
+#endif
+
 /* Create a dataset, for writing chunks etc.  Note that, in parallel mode,
    this should be called by *all* processors, even those not writing any
    data. */
@@ -502,9 +766,8 @@ void h5file::create_data(const char *dataname, int rank, const size_t *dims,
   if (IF_EXCLUSIVE(!parallel || am_master(), 1)) {
     hsize_t *dims_copy = new hsize_t[rank1 + append_data];
     hsize_t *maxdims = new hsize_t[rank1 + append_data];
-    hsize_t N = 1;
     for (i = 0; i < rank; ++i)
-      N *= (maxdims[i] = dims_copy[i] = dims[i]);
+      maxdims[i] = dims_copy[i] = dims[i];
     if (!rank)
       maxdims[0] = dims_copy[0] = 1;
     if (append_data) {
@@ -514,15 +777,19 @@ void h5file::create_data(const char *dataname, int rank, const size_t *dims,
     space_id = H5Screate_simple(rank1 + append_data, dims_copy, maxdims);
     delete[] maxdims;
 
-    /* For unlimited datasets, we need to specify the size of the
-       "chunks" in which the file data is allocated.  */
+    /* For unlimited (or compressed) datasets, we need to specify the
+       size of the "chunks" in which the file data is allocated.  */
     hid_t prop_id = H5Pcreate(H5P_DATASET_CREATE);
-    if (append_data) {
-      const int blocksize = 128;
-      // make a chunk at least blocksize elements for efficiency
-      dims_copy[rank1] = (blocksize + (N - 1)) / N;
-      H5Pset_chunk(prop_id, rank1 + 1, dims_copy);
-      dims_copy[rank1] = 1;
+    if (append_data || storage.chunked()) {
+      hsize_t *chunk_dims = new hsize_t[rank1 + append_data];
+      get_chunk_dims(storage, rank1, dims_copy, append_data, chunk_dims);
+      H5Pset_chunk(prop_id, rank1 + append_data, chunk_dims);
+      delete[] chunk_dims;
+#if defined(HAVE_MPI) && defined(HAVE_H5PSET_FAPL_MPIO)
+      // parallel HDF5 can only write compressed data collectively
+      if (!parallel)
+#endif
+	set_filters(prop_id, storage);
     }
 
     delete[] dims_copy;
@@ -728,6 +995,7 @@ void h5file::write_chunk(int rank,
 			 const size_t *chunk_start, const size_t *chunk_dims,
 			 realnum *data)
 {
+     wait_async_output();
      _write_chunk(HID(cur_id), get_extending(cur_dataname),
                   rank, chunk_start, chunk_dims, REALNUM_H5T, (void*) data);
 }
@@ -736,12 +1004,14 @@ void h5file::write_chunk(int rank,
 			 const size_t *chunk_start, const size_t *chunk_dims,
 			 size_t *data)
 {
+     wait_async_output();
      _write_chunk(HID(cur_id), get_extending(cur_dataname),
                   rank, chunk_start, chunk_dims, SIZE_T_H5T, (void*) data);
 }
 
 // collective call after completing all write_chunk calls
 void h5file::done_writing_chunks() {
+  wait_async_output();
   /* hackery: in order to not deadlock when writing extensible datasets
      with a non-parallel version of HDF5, we need to close the file
      and release the lock after writing extensible chunks  ...here,
@@ -752,6 +1022,115 @@ void h5file::done_writing_chunks() {
     prevent_deadlock(); // closes id
 }
 
+/* As in create_or_extend_data, but without creating or extending the
+   dataset: for the processes other than the master in
+   write_chunks_async. */
+void h5file::track_extending(const char *dataname, bool append_data)
+{
+  extending_s *cur = get_extending(dataname);
+  if (cur)
+    cur->dindex++;
+  else if (append_data) {
+    cur = new extending_s;
+    cur->dataname = new char[strlen(dataname) + 1];
+    strcpy(cur->dataname, dataname);
+    cur->dindex = 0;
+    cur->next = extending;
+    extending = cur;
+  }
+}
+
+bool h5file::gather_chunks() const
+{
+  return IF_EXCLUSIVE(parallel && count_processors() > 1 &&
+		      storage.compressed(), false);
+}
+
+void h5file::write_chunks_async(const char *dataname, int rank,
+				const size_t *dims,
+				bool append_data, bool single_precision,
+				int nchunks, const size_t *chunks,
+				const realnum *data)
+{
+  const int rank1 = rank > 0 ? rank : 1;
+  size_t nchunks_data = 2 * rank1 * nchunks, ndata = 0;
+  for (int i = 0; i < nchunks; ++i) {
+    size_t n = 1;
+    for (int j = 0; j < rank1; ++j) n *= chunks[(2*i + 1) * rank1 + j];
+    ndata += n;
+  }
+
+#ifdef HAVE_ASYNC_OUTPUT
+  // (a file with queued datasets on the master process is parallel)
+  const bool queued = am_master() && h5_output_queue::pending(this);
+  if (queued || parallel) {
+    if (!queued) close_id(); // the master process will create/open it
+    if (!am_master()) {
+      if (mode == WRITE) mode = READWRITE;
+      track_extending(dataname, append_data);
+    }
+
+    // get the sizes of the chunks of each process...
+    const int np = count_processors();
+    vector<size_t> sizes(2 * np);
+    sizes[0] = nchunks_data; sizes[1] = ndata;
+    for (int p = 1; p < np; ++p) {
+      size_t sz[2] = {nchunks_data, ndata};
+      send(p, 0, sz, 2);
+      sizes[2*p] = sz[0]; sizes[2*p+1] = sz[1];
+    }
+
+    // ...then wait for room in the queue, and get the chunks
+    h5_async_job *job = NULL;
+    if (am_master()) {
+      size_t ntot = 0, ntot_data = 0;
+      for (int p = 0; p < np; ++p) {
+	ntot += sizes[2*p];
+	ntot_data += sizes[2*p+1];
+      }
+      h5_output_queue::wait_budget(ntot_data * sizeof(realnum));
+      job = new h5_async_job;
+      job->file = this;
+      job->dataname = new char[strlen(dataname) + 1];
+      strcpy(job->dataname, dataname);
+      job->rank = rank;
+      job->append_data = append_data;
+      job->single_precision = single_precision;
+      job->dims.assign(dims, dims + rank);
+      job->chunks.resize(ntot);
+      job->data.resize(ntot_data);
+      if (nchunks_data) memcpy(&job->chunks[0], chunks, nchunks_data * sizeof(size_t));
+      if (ndata) memcpy(&job->data[0], data, ndata * sizeof(realnum));
+    }
+    size_t ichunks = nchunks_data, idata = ndata;
+    for (int p = 1; p < np; ++p) {
+      if (am_master()) {
+	if (sizes[2*p]) send(p, 0, &job->chunks[ichunks], int(sizes[2*p]));
+	if (sizes[2*p+1]) send(p, 0, &job->data[idata], int(sizes[2*p+1]));
+	ichunks += sizes[2*p];
+	idata += sizes[2*p+1];
+      }
+      else if (my_rank() == p) {
+	send(p, 0, const_cast<size_t *>(chunks), int(nchunks_data));
+	send(p, 0, const_cast<realnum *>(data), int(ndata));
+      }
+    }
+    if (job) h5_output_queue::queue(job);
+    return;
+  }
+#endif
+
+  create_or_extend_data(dataname, rank, dims, append_data, single_precision);
+  for (int i = 0; i < nchunks; ++i) {
+    const size_t *start = chunks + 2*i * rank1, *count = start + rank1;
+    write_chunk(rank, start, count, const_cast<realnum *>(data));
+    size_t n = 1;
+    for (int j = 0; j < rank1; ++j) n *= count[j];
+    data += n;
+  }
+  done_writing_chunks();
+}
+
 void h5file::write(const char *dataname, int rank, const size_t *dims,
 		   realnum *data, bool single_precision)
 {
@@ -770,6 +1149,9 @@ void h5file::write(const char *dataname, int rank, const size_t *dims,
 void h5file::write(const char *dataname, const char *data)
 {
 #ifdef HAVE_HDF5
+  /* open the file on all processes, in turn, as in create_or_extend_data
+     (e.g. if it was closed by write_chunks_async or prevent_deadlock) */
+  IF_EXCLUSIVE(if (parallel) get_id(), (void) 0);
   if (IF_EXCLUSIVE(am_master(), parallel || am_master())) {
     hid_t file_id = HID(get_id()), type_id, data_id, space_id;
 
@@ -872,6 +1254,7 @@ void h5file::read_chunk(int rank,
 			const size_t *chunk_start, const size_t *chunk_dims,
 			realnum *data)
 {
+     wait_async_output();
      _read_chunk(HID(cur_id), rank, chunk_start, chunk_dims, REALNUM_H5T, (void*) data);
 }
 
@@ -881,6 +1264,7 @@ void h5file::read_chunk(int rank,
 			const size_t *chunk_start, const size_t *chunk_dims,
 			size_t *data)
 {
+     wait_async_output();
      _read_chunk(HID(cur_id), rank, chunk_start, chunk_dims, SIZE_T_H5T, (void*) data);
 }
 
@@ -289,20 +289,100 @@ static inline int iabs(int i) { return (i < 0 ? -i : i); }
    intersect WHERE; we only use chunks that, untransformed, already
    intersect the grid_volume.  If SNAP_EMPTY_DIMS is true, then for empty
    (min = max) dimensions of WHERE, instead of interpolating, we
-   "snap" them to the nearest grid point.  */
+   "snap" them to the nearest grid point.
+
+   The chunkloop arguments for WHERE are computed once and stored in
+   a chunkloop_plan (see compute_chunkloop_plan below), which is cached
+   so that repeated loops over the same volume (e.g. flux planes or
+   array slices at every timestep) skip all of this computation.  */
+
+#define MAX_CHUNKLOOP_PLANS 32
 
 void fields::loop_in_chunks(field_chunkloop chunkloop, void *chunkloop_data,
 			    const volume &where,
 			    component cgrid,
 			    bool use_symmetry, bool snap_empty_dims)
 {
+  if (cgrid == Permeability) cgrid = Centered;
+
+  // look for a cached plan, moving it to the end of the cache
+  chunkloop_plan *plan = 0;
+  for (size_t i = chunkloop_plans.size(); i-- > 0; )
+    if (chunkloop_plans[i]->matches(where, cgrid, use_symmetry,
+				    snap_empty_dims)) {
+      plan = chunkloop_plans[i];
+      chunkloop_plans.erase(chunkloop_plans.begin() + i);
+      break;
+    }
+  if (!plan) {
+    if (chunkloop_plans.size() >= MAX_CHUNKLOOP_PLANS) {
+      delete chunkloop_plans[0];
+      chunkloop_plans.erase(chunkloop_plans.begin());
+    }
+    plan = new chunkloop_plan(where, cgrid, use_symmetry, snap_empty_dims);
+  }
+  chunkloop_plans.push_back(plan);
+  loop_in_chunks(chunkloop, chunkloop_data, *plan);
+}
+
+chunkloop_plan::chunkloop_plan(const volume &where_, component cgrid_,
+			       bool use_symmetry_, bool snap_empty_dims_)
+  : where(where_), cgrid(cgrid_ == Permeability ? Centered : cgrid_),
+    use_symmetry(use_symmetry_), snap_empty_dims(snap_empty_dims_), f(0) {
+  FOR_DIRECTIONS(d) boundaries[d] = None;
+}
+
+bool chunkloop_plan::matches(const volume &where_, component cgrid_,
+			     bool use_symmetry_, bool snap_empty_dims_) const {
+  return (where == where_
+	  && cgrid == (cgrid_ == Permeability ? Centered : cgrid_)
+	  && use_symmetry == use_symmetry_
+	  && snap_empty_dims == snap_empty_dims_);
+}
+
+/* Loop over the chunks according to PLAN, (re)computing the plan
+   first if it was not computed for the current chunks and boundary
+   conditions of these fields.  Only the Bloch phases are computed
+   here, so the plan remains valid if the Bloch wavevector changes. */
+void fields::loop_in_chunks(field_chunkloop chunkloop, void *chunkloop_data,
+			    chunkloop_plan &plan)
+{
+  bool valid = plan.f == this && plan.chunks.size() == size_t(num_chunks);
+  for (int i = 0; valid && i < num_chunks; ++i)
+    valid = plan.chunks[i] == chunks[i];
+  FOR_DIRECTIONS(d) valid = valid && plan.boundaries[d] == boundaries[High][d];
+  if (!valid) compute_chunkloop_plan(plan);
+
+  for (size_t n = 0; n < plan.calls.size(); ++n) {
+    const chunkloop_plan::chunkloop_call &c = plan.calls[n];
+    complex<double> ph = 1.0;
+    LOOP_OVER_DIRECTIONS(gv.dim, d)
+      if (c.ishift.in_direction(d))
+	ph *= pow(eikna[d], c.ishift.in_direction(d));
+    chunkloop(chunks[c.ichunk], c.ichunk, c.cgrid, c.is, c.ie,
+	      c.s0, c.s1, c.e0, c.e1, c.dV0, c.dV1,
+	      c.shift, ph, S, c.sn, chunkloop_data);
+  }
+}
+
+/* Compute the arguments of the chunkloop calls for plan.where etcetera,
+   as described above for loop_in_chunks. */
+void fields::compute_chunkloop_plan(chunkloop_plan &plan) const
+{
+  const volume &where = plan.where;
+  component cgrid = plan.cgrid;
+  bool use_symmetry = plan.use_symmetry, snap_empty_dims = plan.snap_empty_dims;
+
   if (coordinate_mismatch(gv.dim, cgrid))
     abort("Invalid fields::loop_in_chunks grid type %s for dimensions %s\n",
 	  component_name(cgrid), dimension_name(gv.dim));
   if (where.dim != gv.dim)
     abort("Invalid dimensions %d for WHERE in fields::loop_in_chunks", where.dim);
 
-  if (cgrid == Permeability) cgrid = Centered;
+  plan.f = this;
+  plan.chunks.assign(chunks, chunks + num_chunks);
+  FOR_DIRECTIONS(d) plan.boundaries[d] = boundaries[High][d];
+  plan.calls.clear();
 
   /*
     We handle looping on an arbitrary component grid by shifting
@@ -402,13 +482,11 @@ void fields::loop_in_chunks(field_chunkloop chunkloop, void *chunkloop_data,
     // loop over lattice shifts
     ivec ishift(min_ishift);
     do {
-      complex<double> ph = 1.0;
       vec shift(gv.dim, 0.0);
       ivec shifti(gv.dim, 0);
       LOOP_OVER_DIRECTIONS(gv.dim, d) {
 	shift.set_direction(d, L.in_direction(d) * ishift.in_direction(d));
 	shifti.set_direction(d, iL.in_direction(d) * ishift.in_direction(d));
-	ph *= pow(eikna[d], ishift.in_direction(d));
       }
 
       for (int i = 0; i < num_chunks; ++i) {
@@ -498,13 +576,14 @@ void fields::loop_in_chunks(field_chunkloop chunkloop, void *chunkloop_data,
 				- yee_c).in_direction(R));
 	  }
 
-	  chunkloop(chunks[i], i, cS,
-		    isc - iyee_cS, iec - iyee_cS,
-		    s0c, s1c, e0c, e1c,
-		    dV0, dV1,
-		    shifti, ph,
-		    S, sn,
-		    chunkloop_data);
+	  chunkloop_plan::chunkloop_call c;
+	  c.ichunk = i; c.cgrid = cS;
+	  c.is = isc - iyee_cS; c.ie = iec - iyee_cS;
+	  c.s0 = s0c; c.s1 = s1c; c.e0 = e0c; c.e1 = e1c;
+	  c.dV0 = dV0; c.dV1 = dV1;
+	  c.shift = shifti; c.ishift = ishift;
+	  c.sn = sn;
+	  plan.calls.push_back(c);
 	}
       }
 
@@ -121,6 +121,29 @@ public:
     (void) W; (void) dt; (void) gv; (void) data; }
   virtual void *copy_internal_data(void *data) const { (void)data; return 0; }
 
+  /* For checkpointing (fields::dump and fields::load), the state in
+     the internal data is described as num_internal_arrays() arrays,
+     each with nvals values per point of the c Yee grid.  internal_array
+     sets *c and *nvals for the n'th array and returns it (or NULL if it
+     is not allocated, e.g. if P_internal_data is NULL). */
+  virtual int num_internal_arrays() const { return 0; }
+  virtual realnum *internal_array(int n, void *P_internal_data,
+				  component *c, int *nvals) const {
+    (void) n; (void) P_internal_data; (void) c; (void) nvals; return 0; }
+
+  /* An internal array that is not stored as nvals consecutive values per
+     point of the chunk, e.g. one stored sparsely or level by level (for
+     which internal_array returns NULL), is instead copied to or from a
+     dense array a of nvals values per point (zero at points not stored) by
+     get/set_internal_array, which return false if it is not allocated.
+     (a may be NULL for get_internal_array, to check only this.) */
+  virtual bool get_internal_array(int n, void *P_internal_data,
+				  realnum *a) const {
+    (void) n; (void) P_internal_data; (void) a; return false; }
+  virtual bool set_internal_array(int n, void *P_internal_data,
+				  const realnum *a) const {
+    (void) n; (void) P_internal_data; (void) a; return false; }
+
   /* The following methods are used in boundaries.cpp to set up any
      extra communications that may be necessary at chunk boundaries
      for the internal data of a susceptibility's polarization
@@ -200,6 +223,13 @@ public:
   virtual void init_internal_data(realnum *W[NUM_FIELD_COMPONENTS][2],
 			  double dt, const grid_volume &gv, void *data) const;
   virtual void *copy_internal_data(void *data) const;
+  virtual int num_internal_arrays() const { return NUM_FIELD_COMPONENTS*2*2; }
+  virtual realnum *internal_array(int n, void *P_internal_data,
+				  component *c, int *nvals) const;
+  virtual bool get_internal_array(int n, void *P_internal_data,
+				  realnum *a) const;
+  virtual bool set_internal_array(int n, void *P_internal_data,
+				  const realnum *a) const;
 
   virtual int num_cinternal_notowned_needed(component c,
 					    void *P_internal_data) const;
@@ -210,6 +240,17 @@ public:
   virtual void dump_params(h5file *h5f, size_t *start);
   virtual int get_num_params() { return 4; }
 
+  // update_P and subtract_P for the n susceptibilities sus[k] with
+  // internal data data[k] (e.g. the poles of a Drude-Lorentz metal),
+  // in a single pass over the fields
+  static void update_P_fused(int n, const lorentzian_susceptibility *const *sus,
+			     void *const *data,
+			     realnum *W[NUM_FIELD_COMPONENTS][2],
+			     double dt, const grid_volume &gv);
+  static void subtract_P_fused(int n, const lorentzian_susceptibility *const *sus,
+			       void *const *data, field_type ft,
+			       realnum *f_minus_p[NUM_FIELD_COMPONENTS][2]);
+
 protected:
   double omega_0, gamma;
   bool no_omega_0_denominator;
@@ -265,6 +306,13 @@ public:
 				  void *data) const;
   virtual void *copy_internal_data(void *data) const;
   virtual void delete_internal_data(void *data) const;
+  virtual int num_internal_arrays() const { return 4*T*NUM_FIELD_COMPONENTS + 1; }
+  virtual realnum *internal_array(int n, void *P_internal_data,
+				  component *c, int *nvals) const;
+  virtual bool get_internal_array(int n, void *P_internal_data,
+				  realnum *a) const;
+  virtual bool set_internal_array(int n, void *P_internal_data,
+				  const realnum *a) const;
 
   virtual int num_cinternal_notowned_needed(component c,
 					    void *P_internal_data) const;
@@ -293,6 +341,38 @@ protected:
 
 class grace;
 
+/* How an h5file stores the datasets that it creates (h5file::set_storage).
+   The data is compressed with deflate (gzip) at deflate_level (1-9, or
+   0 for no compression), after the shuffle filter if shuffle is true
+   (which usually helps with floating-point data), and/or rounded to
+   within an absolute error max_error by the (lossy) scale-offset filter
+   if max_error > 0.  Compressed datasets are stored in chunks of
+   chunk_dims (one per dimension of the data, plus one for the extra
+   dimension of append_data), where 0 picks a size automatically;
+   setting chunk_dims also chunks uncompressed datasets.  (With parallel
+   HDF5, the data is chunked but not compressed.) */
+struct h5_storage {
+  h5_storage(int deflate_level_ = 0, bool shuffle_ = true,
+	     double max_error_ = 0) : deflate_level(deflate_level_),
+    shuffle(shuffle_), max_error(max_error_) {
+    for (int i = 0; i < 5; ++i) chunk_dims[i] = 0;
+  }
+  int deflate_level;
+  bool shuffle;
+  double max_error;
+  size_t chunk_dims[5];
+
+  void set_chunk_dim(int i, size_t n) {
+    if (i < 0 || i >= 5) abort("invalid chunk dimension %d", i);
+    chunk_dims[i] = n;
+  }
+  bool compressed() const { return deflate_level > 0 || max_error > 0; }
+  bool chunked() const {
+    for (int i = 0; i < 5; ++i) if (chunk_dims[i]) return true;
+    return compressed();
+  }
+};
+
 // h5file.cpp: HDF5 file I/O.  Most users, if they use this
 // class at all, will only use the constructor to open the file, and
 // will otherwise use the fields::output_hdf5 functions.
@@ -327,6 +407,18 @@ public:
        size_t *data);
   void done_writing_chunks();
 
+  /* As create_or_extend_data, followed by write_chunk for each of the
+     nchunks chunks of this process and done_writing_chunks, except that
+     (if Meep was compiled with threads) the data is only copied, and
+     written later by a background thread on the master process (see
+     flush_async_output).  chunks holds the chunk_start and then the
+     chunk_dims of each chunk (max(rank,1) values each), and data holds
+     their data in turn.  Like create_data, this must be called by
+     *all* processes. */
+  void write_chunks_async(const char *dataname, int rank, const size_t *dims,
+			  bool append_data, bool single_precision,
+			  int nchunks, const size_t *chunks, const realnum *data);
+
   void read_size(const char *dataname, int *rank, size_t *dims, int maxrank);
   void read_chunk(int rank, const size_t *chunk_start, const size_t *chunk_dims,
 		  realnum *data);
@@ -338,6 +430,16 @@ public:
 
   const char *file_name() const { return filename; }
 
+  // storage (compression etc.) of the datasets created from now on
+  void set_storage(const h5_storage &s) { storage = s; }
+  const h5_storage &get_storage() const { return storage; }
+  /* whether the chunks of all processes should be written by the master
+     process, via write_chunks_async (for compressed data with exclusive
+     access, where other processes would recompress shared HDF5 chunks) */
+  bool gather_chunks() const;
+  // wait for the write_chunks_async data of this file to be written
+  void wait_async_output(bool hdf5_calls = true);
+
   void prevent_deadlock(); // hackery for exclusive mode
   bool dataset_exists(const char *name);
 
@@ -345,6 +447,7 @@ private:
   access_mode mode;
   char *filename;
   bool parallel;
+  h5_storage storage;
 
   bool is_cur(const char *dataname);
   void unset_cur();
@@ -359,6 +462,11 @@ private:
   void *get_id(); // get current (file) id, opening/creating file if needed
   void close_id();
 
+  // asynchronous output (see h5file.cpp)
+  int async_pending; // number of queued write_chunks_async datasets
+  void track_extending(const char *dataname, bool append_data);
+  friend class h5_output_queue;
+
 public:
   /* linked list to keep track of which datasets we are extending...
      this is necessary so that create_or_extend_data can know whether
@@ -371,6 +479,17 @@ public:
   extending_s *get_extending(const char *dataname) const;
 };
 
+/* Asynchronous HDF5 output (h5file::write_chunks_async): the data
+   queued on the master process is limited to max_bytes (default 256MB);
+   beyond that, write_chunks_async waits for the queued data to be
+   written.  flush_async_output waits until all of the queued data is
+   written (collective), and delete_h5file_async deletes an h5file once
+   its queued data is written, without waiting for it. */
+void set_async_output_budget(size_t max_bytes);
+void flush_async_output();
+void delete_h5file_async(h5file *file);
+void stop_async_output(); // flushes and stops the thread (in ~initialize)
+
 typedef double (*pml_profile_func)(double u, void *func_data);
 
 #define DEFAULT_SUBPIXEL_TOL 1e-4
@@ -471,6 +590,7 @@ class structure_chunk {
   susceptibility *chiP[NUM_FIELD_TYPES]; // only E_stuff and H_stuff are used
 
   int refcount; // reference count of objects using this structure_chunk
+  double cost; // estimated timestepping cost (see cost_map)
 
   ~structure_chunk();
   structure_chunk(const grid_volume &gv,
@@ -577,6 +697,39 @@ boundary_region pml(double thickness,
 		    double Rasymptotic = 1e-15, double mean_stretch = 1.0);
 #define no_pml() boundary_region()
 
+/* Calibrated costs per pixel and timestep of the extra work that is done
+   at some pixels, relative to a cost of 1 for a pixel of isotropic,
+   non-dispersive material outside of the PML.  These are used to balance
+   the chunks (see cost_map); the defaults were measured with
+   tests/bench_cost.cpp. */
+struct chunk_cost_model {
+  double pml;            // per direction in which the pixel is in a PML
+  double anisotropic;    // per nonzero off-diagonal epsilon or mu element
+  double conductivity;   // per component with nonzero conductivity
+  double nonlinear;      // per nonzero chi2 or chi3 component
+  double susceptibility; // per dispersive polarization (e.g. Lorentzian)
+  double dft;            // per Fourier-transformed component and frequency
+  chunk_cost_model();
+};
+
+/* The estimated cost of timestepping each pixel of the cell, used by
+   structure::choose_chunkdivision to balance the chunks: 1 for every
+   pixel, plus the extra cost per pixel in each of a list of (possibly
+   overlapping) boxes.  The PML regions are added by the structure
+   itself; other regions (e.g. dispersive materials or DFT regions) can
+   be added before passing the map to the structure constructor. */
+class cost_map {
+public:
+  chunk_cost_model model;
+  std::vector<volume> boxes;
+  std::vector<double> costs; // extra cost per pixel in boxes[i]
+
+  void add(const volume &box, double cost_per_pixel);
+  double cost(const grid_volume &gv) const; // total cost of gv
+  // the costs of the n slices of gv normal to d, for n = gv.num_direction(d)
+  std::vector<double> slice_costs(const grid_volume &gv, direction d) const;
+};
+
 class structure {
  public:
   structure_chunk **chunks;
@@ -590,6 +743,7 @@ class structure {
   grid_volume *effort_volumes;
   double *effort;
   int num_effort_volumes;
+  cost_map costs; // the estimated costs used to balance the chunks
 
   ~structure();
   structure();
@@ -599,14 +753,16 @@ class structure {
 	    int num_chunks = 0, double Courant = 0.5,
 	    bool use_anisotropic_averaging=false,
 	    double tol=DEFAULT_SUBPIXEL_TOL,
-	    int maxeval=DEFAULT_SUBPIXEL_MAXEVAL);
+	    int maxeval=DEFAULT_SUBPIXEL_MAXEVAL,
+	    const cost_map *costs = NULL);
   structure(const grid_volume &gv, double eps(const vec &),
 	    const boundary_region &br = boundary_region(),
 	    const symmetry &s = meep::identity(),
 	    int num_chunks = 0, double Courant = 0.5,
 	    bool use_anisotropic_averaging=false,
 	    double tol=DEFAULT_SUBPIXEL_TOL,
-	    int maxeval=DEFAULT_SUBPIXEL_MAXEVAL);
+	    int maxeval=DEFAULT_SUBPIXEL_MAXEVAL,
+	    const cost_map *costs = NULL);
   structure(const structure *);
   structure(const structure &);
 
@@ -676,7 +832,8 @@ class structure {
   void add_to_effort_volumes(const grid_volume &new_effort_volume,
 			     double extra_effort);
   void choose_chunkdivision(const grid_volume &gv, int num_chunks,
-			     const boundary_region &br, const symmetry &s);
+			     const boundary_region &br, const symmetry &s,
+			     const cost_map *costs);
   void check_chunks();
   void changing_chunks();
   // Helper methods for dumping and loading susceptibilities
@@ -741,6 +898,8 @@ class src_time {
   virtual bool is_equal(const src_time &t) const { (void)t; return 1; }
   virtual std::complex<double> frequency() const { return 0.0; }
   virtual void set_frequency(std::complex<double> f) { (void) f; }
+  // frequency above which the spectrum is negligible (infinity if unknown)
+  virtual double max_frequency() const { return infinity; }
 
  private:
   double current_time;
@@ -762,6 +921,7 @@ class gaussian_src_time : public src_time {
   virtual bool is_equal(const src_time &t) const;
   virtual std::complex<double> frequency() const { return freq; }
   virtual void set_frequency(std::complex<double> f) { freq = real(f); }
+  virtual double max_frequency() const;
 
  private:
   double freq, width, peak_time, cutoff;
@@ -859,7 +1019,9 @@ public:
 	    const void *data_);
   ~dft_chunk();
 
-  void update_dft(double time);
+  void update_dft(double time, bool sample = true);
+  void flush_dft() const; // add any buffered timesteps to dft
+  void set_decimation(int stride, bool filter);
 
   void scale_dft(std::complex<double> scale);
 
@@ -876,8 +1038,8 @@ public:
 
   void operator-=(const dft_chunk &chunk);
 
-  // the frequencies to loop_in_chunks
-  double omega_min, domega;
+  // the angular frequencies to loop_in_chunks (not necessarily uniformly spaced)
+  std::vector<double> omega;
   int Nomega;
 
   component c; // component to DFT (possibly transformed by symmetry)
@@ -931,14 +1093,59 @@ public:
   ivec shift;
   symmetry S; int sn;
 
-  // cache of exp(iwt) * scale, of length Nomega
-  std::complex<realnum> *dft_phase;
+  /* update_dft buffers the fields of up to Nbatch timesteps, which are
+     added to dft all at once by flush_dft (so that the dft array is
+     read and written only once per Nbatch timesteps).  For buffered
+     timestep k, dft_phase[k*2*Nomega + ...] is exp(iwt) * scale as
+     (re,im) pairs, dft_phase_swapped is the same multiplied by i (for
+     complex fields), and fbuf[(idx_dft*Nbatch + k)*2 + cmp] are the
+     field values. */
+  int Nbatch;
+  mutable int nbuf; // number of buffered timesteps
+  int nbuf_cmp; // number of field components (1 or 2) in the buffer
+  realnum *dft_phase, *dft_phase_swapped, *fbuf;
+
+  /* exp(i omega t) at the last time, updated by the recurrence
+     exp(i omega (t+dt)) = exp(i omega t) * exp(i omega dt) and
+     recomputed from scratch every so often */
+  std::complex<double> *phase_cur, *phase_step;
+  double phase_time, dt;
+  int phase_count;
+
+  /* with decimation (fields::use_dft_decimation), the fields are only
+     added every dec_stride timesteps, each time multiplied by
+     phase_scale[i] = scale * dec_stride for frequency i.  With the
+     anti-aliasing filter, the fields of the intervening timesteps are
+     summed in fsum (a box filter), and phase_scale also divides out
+     the response of the filter. */
+  int dec_stride;
+  bool dec_filter;
+  std::complex<double> *phase_scale;
+  realnum *fsum;
 
   ptrdiff_t avg1, avg2; // index offsets for average to get epsilon grid
 
   int vc; // component descriptor from the original volume
+
+  int dft_index; // which fields::add_dft call created this (for fields::dump)
 };
 
+/* Frequency lists for the DFT monitors: Nfreq frequencies uniformly
+   spaced from freq_min to freq_max (inclusive), or Nfreq frequencies
+   in the same range concentrated near the resonances with the given
+   center frequencies and half-widths (e.g. the real parts and
+   magnitudes of the imaginary parts of the frequencies found by
+   harminv from a short run).  In the latter case, a fraction
+   uniform_fraction of the points is spread uniformly over the whole
+   range and the rest are divided equally among the resonances, with
+   a Lorentzian density around each one, so that narrow resonances are
+   resolved with many fewer frequencies than a uniform list. */
+std::vector<double> dft_freqs(double freq_min, double freq_max, int Nfreq);
+std::vector<double> adaptive_dft_freqs(double freq_min, double freq_max, int Nfreq,
+				       const std::vector<double> &peak_freqs,
+				       const std::vector<double> &peak_widths,
+				       double uniform_fraction = 0.25);
+
 void save_dft_hdf5(dft_chunk *dft_chunks, component c, h5file *file,
 		   const char *dprefix = 0);
 void load_dft_hdf5(dft_chunk *dft_chunks, component c, h5file *file,
@@ -956,6 +1163,11 @@ public:
 	   double fmin, double fmax, int Nf,
 	   const volume &where_, direction normal_direction_,
 	   bool use_symmetry_);
+  dft_flux(const component cE_, const component cH_,
+	   dft_chunk *E_, dft_chunk *H_,
+	   const std::vector<double> &freq_,
+	   const volume &where_, direction normal_direction_,
+	   bool use_symmetry_);
   dft_flux(const dft_flux &f);
 
   double *flux();
@@ -974,7 +1186,8 @@ public:
 
   void remove();
 
-  double freq_min, dfreq;
+  std::vector<double> freq; // the Nfreq frequencies
+  double freq_min, dfreq; // freq[i] = freq_min + i*dfreq, if uniformly spaced
   int Nfreq;
   dft_chunk *E, *H;
   component cE, cH;
@@ -988,6 +1201,8 @@ class dft_force {
 public:
   dft_force(dft_chunk *offdiag1_, dft_chunk *offdiag2_, dft_chunk *diag_,
 	    double fmin, double fmax, int Nf, const volume &where_);
+  dft_force(dft_chunk *offdiag1_, dft_chunk *offdiag2_, dft_chunk *diag_,
+	    const std::vector<double> &freq_, const volume &where_);
   dft_force(const dft_force &f);
 
   double *force();
@@ -1006,7 +1221,8 @@ public:
 
   void remove();
 
-  double freq_min, dfreq;
+  std::vector<double> freq; // the Nfreq frequencies
+  double freq_min, dfreq; // freq[i] = freq_min + i*dfreq, if uniformly spaced
   int Nfreq;
   dft_chunk *offdiag1, *offdiag2, *diag;
   volume where;
@@ -1020,6 +1236,8 @@ public:
   dft_near2far(dft_chunk *F,
                double fmin, double fmax, int Nf,
                double eps, double mu, const volume &where_);
+  dft_near2far(dft_chunk *F, const std::vector<double> &freq_,
+               double eps, double mu, const volume &where_);
   dft_near2far(const dft_near2far &f);
 
   /* return an array (Ex,Ey,Ez,Hx,Hy,Hz) x Nfreq of the far fields at x */
@@ -1031,9 +1249,27 @@ public:
      by other output routine to efficiently get far field on a grid of pts */
   void farfield_lowlevel(std::complex<double> *F, const vec &x);
 
-  /* output far fields on a grid to an HDF5 file */
+  /* like farfield, but for the npts points x[0..npts-1]: returns an
+     npts x Nfreq x 6 array, with a single reduction over processes; the
+     points are computed in parallel with OpenMP threads */
+  std::complex<double> *farfields(const vec *x, size_t npts);
+
+  /* like farfields, but without the reduction (as in farfield_lowlevel),
+     where F is a preallocated npts x Nfreq x 6 array */
+  void farfields_lowlevel(std::complex<double> *F, const vec *x, size_t npts);
+
+  /* like farfield_lowlevel, but for all the points of the grid with the
+     given resolution in where, as in save_farfields: EH is an
+     N x Nfreq x 6 array for the N grid points in row-major order.  If
+     tol > 0, uses a fast approximate method with a relative error of
+     about tol instead of the brute-force sum over the near-field points */
+  void farfield_grid_lowlevel(std::complex<double> *EH, const volume &where,
+                              double resolution, double tol = 0);
+
+  /* output far fields on a grid to an HDF5 file, approximated to
+     within about tol if tol > 0 (see farfield_grid_lowlevel) */
   void save_farfields(const char *fname, const char *prefix,
-                      const volume &where, double resolution);
+                      const volume &where, double resolution, double tol = 0);
 
   void save_hdf5(h5file *file, const char *dprefix = 0);
   void load_hdf5(h5file *file, const char *dprefix = 0);
@@ -1049,7 +1285,8 @@ public:
 
   void remove();
 
-  double freq_min, dfreq;
+  std::vector<double> freq; // the Nfreq frequencies
+  double freq_min, dfreq; // freq[i] = freq_min + i*dfreq, if uniformly spaced
   int Nfreq;
   dft_chunk *F;
   double eps, mu;
@@ -1085,12 +1322,14 @@ public:
 class dft_fields{
 public:
   dft_fields(dft_chunk *chunks, double freq_min, double freq_max, int Nfreq, const volume &where);
+  dft_fields(dft_chunk *chunks, const std::vector<double> &freq_, const volume &where);
 
   void scale_dfts(std::complex<double> scale);
 
   void remove();
 
-  double freq_min, dfreq;
+  std::vector<double> freq; // the Nfreq frequencies
+  double freq_min, dfreq; // freq[i] = freq_min + i*dfreq, if uniformly spaced
   int Nfreq;
   dft_chunk *chunks;
   volume where;
@@ -1098,6 +1337,17 @@ public:
 
 enum in_or_out { Incoming=0, Outgoing };
 enum connect_phase { CONNECT_PHASE = 0, CONNECT_NEGATE=1, CONNECT_COPY=2 };
+// a pair of chunks (one of them ours) that exchanges boundary data: the
+// data in comm_blocks[ft][pair], pair = j + i*num_chunks, is sent from
+// chunk j to chunk i, and is found at connections[ft][ip][io][start[ip]...]
+// of the chunk (j if io == Outgoing, i if io == Incoming)
+struct comm_pair {
+  int pair, chunk;
+  size_t start[CONNECT_COPY+1];
+};
+// which owned points of a chunk to timestep in step_db: STEP_INTERIOR
+// points do not depend on the not-owned fields (from other chunks)
+enum step_region { STEP_ALL = 0, STEP_INTERIOR, STEP_BOUNDARY };
 
 // data for each susceptibility
 typedef struct polarization_state_s {
@@ -1205,6 +1455,7 @@ class fields_chunk {
 
   // update_eh.cpp
   bool needs_W_prev(component c) const;
+  bool update_eh_needs_notowned(field_type ft) const;
   bool update_eh(field_type ft, bool skip_w_components = false);
 
   bool alloc_f(component c);
@@ -1234,7 +1485,7 @@ class fields_chunk {
   // step.cpp
   void phase_in_material(structure_chunk *s);
   void phase_material(int phasein_time);
-  bool step_db(field_type ft);
+  bool step_db(field_type ft, step_region region = STEP_ALL);
   void step_source(field_type ft, bool including_integrated);
   bool update_pols(field_type ft);
   void calc_sources(double time);
@@ -1246,7 +1497,7 @@ class fields_chunk {
   // boundaries.cpp
   void alloc_extra_connections(field_type, connect_phase, in_or_out, size_t);
   // dft.cpp
-  void update_dfts(double timeE, double timeH);
+  void update_dfts(double timeE, double timeH, bool sample = true);
 
   void changing_structure();
 };
@@ -1297,6 +1548,73 @@ class chunkloop_field_components {
   std::vector< std::complex<double> > values; // updated by update_values(idx)
  };
 
+/* In-situ reductions of array slices (fields::get_reduced_array_slice
+   and field_accumulator): the grid points of the slice are grouped into
+   blocks of stride[d] points along each direction d (1 by default,
+   i.e. no reduction along d, and 0 for all of the points along d,
+   i.e. a projection onto the other directions), and the values of the
+   field function in each block are combined into one value by op:
+   ReduceSample (the value at the first point of the block, i.e.
+   strided downsampling), ReduceSum, ReduceMean, ReduceMin, ReduceMax,
+   or ReduceRMS (the root-mean-square). */
+enum reduction_op { ReduceSample, ReduceSum, ReduceMean, ReduceMin, ReduceMax,
+		    ReduceRMS };
+
+struct field_reduction {
+  field_reduction(reduction_op op_ = ReduceMean, int stride_ = 1) : op(op_) {
+    FOR_DIRECTIONS(d) stride[d] = stride_;
+  }
+  reduction_op op;
+  int stride[5];
+  void set_stride(direction d, int s) { stride[d] = s; }
+};
+
+/* Which processes receive an array slice (fields::get_array_slice):
+   all of them (the default), only the master, or none, in which case
+   each process only computes the sub-block of the slice that covers
+   its own grid points (fields::get_local_array_slice_dimensions),
+   with no communication of the data. */
+enum slice_gather { GatherToAll, GatherToMaster, GatherNone };
+
+/* The arguments of all of the chunkloop calls by fields::loop_in_chunks
+   for a given volume (the chunk intersections, index ranges, integration
+   weights, and symmetry/lattice shifts), so that repeated loops over the
+   same volume can skip their computation.  The plan is computed the first
+   time it is used by fields::loop_in_chunks(chunkloop, data, plan), and
+   is recomputed if it is used with different fields or if the chunks
+   or boundary conditions of the fields have changed.  (loop_in_chunks
+   also keeps a cache of plans for the most recently used volumes.) */
+class chunkloop_plan {
+ public:
+  chunkloop_plan(const volume &where, component cgrid = Centered,
+		 bool use_symmetry = true, bool snap_empty_dims = false);
+  bool matches(const volume &where, component cgrid,
+	       bool use_symmetry, bool snap_empty_dims) const;
+  size_t size() const { return calls.size(); }
+
+ private:
+  friend class fields;
+  struct chunkloop_call {
+    int ichunk;
+    component cgrid;
+    ivec is, ie;
+    vec s0, s1, e0, e1;
+    double dV0, dV1;
+    ivec shift, ishift; // shift = ishift * lattice vectors (in grid units)
+    int sn;
+  };
+
+  volume where;
+  component cgrid;
+  bool use_symmetry, snap_empty_dims;
+
+  // the fields for which the calls were computed (NULL if not yet computed)
+  const fields *f;
+  std::vector<fields_chunk *> chunks;
+  boundary_condition boundaries[5];
+  std::vector<chunkloop_call> calls;
+};
+
 /***************************************************************/
 /* prototype for optional user-supplied function to provide an */
 /* initial estimate of the wavevector of mode #mode at         */
@@ -1304,6 +1622,20 @@ class chunkloop_field_components {
 /***************************************************************/
 typedef vec (*kpoint_func)(double freq, int mode, void *user_data);
 
+/* called by fields::solve_cw_sweep with the fields set to the solution
+   at the ifreq-th frequency */
+typedef void (*solve_cw_callback)(fields &f, int ifreq, bool converged,
+				  void *data);
+
+/* preconditioner for fields::solve_cw: called with the fields set to a
+   residual (with the sources off), it should replace the fields by an
+   approximation of their CW response at the given frequency, where
+   the residual acts as the current; time steps taken by it are undone
+   by solve_cw.  solve_cw_filter is a built-in preconditioner. */
+typedef void (*solve_cw_precond)(fields &f, std::complex<double> frequency,
+				 void *data);
+void solve_cw_filter(fields &f, std::complex<double> frequency, void *nsteps);
+
 class fields {
  public:
   int num_chunks;
@@ -1335,6 +1667,18 @@ class fields {
   boundary_condition boundaries[2][5];
   char *outdir;
   bool components_allocated;
+  // whether step() overlaps the MPI boundary communications with the
+  // timestepping of the chunk interiors (default true)
+  bool overlap_communications;
+  // whether to decimate the DFTs (see use_dft_decimation), and the
+  // stride to use (or 0 if it needs to be recomputed)
+  bool decimate_dfts, dft_anti_alias;
+  int dft_stride;
+  int dft_count; // number of add_dft calls so far (see dft_chunk::dft_index)
+  // whether output_hdf5 writes the data asynchronously (use_async_output)
+  bool async_output;
+  // storage of the datasets in the files from open_h5file
+  h5_storage output_storage;
 
   // fields.cpp methods:
   fields(structure *, double m=0, double beta=0,
@@ -1352,6 +1696,10 @@ class fields {
   // time.cpp
   double time_spent_on(time_sink);
   void print_times();
+  void print_load_balance();
+  // fields_dump.cpp
+  void dump(const char *filename);
+  void load(const char *filename);
   // boundaries.cpp
   void set_boundary(boundary_side,direction,boundary_condition);
   void use_bloch(direction d, double k) { use_bloch(d, (std::complex<double>) k); }
@@ -1406,6 +1754,14 @@ class fields {
 		      const char *prefix = NULL, bool timestamp = false);
   const char *h5file_name(const char *name,
 			  const char *prefix = NULL, bool timestamp = false);
+  /* With asynchronous output, output_hdf5 only computes the data and
+     queues it, to be written by a background thread while the timestep
+     continues, using at most max_bytes (if nonzero) of memory for the
+     queued data.  flush_output waits until it is all written. */
+  void use_async_output(bool enable = true, size_t max_bytes = 0);
+  void flush_output();
+  // compression etc. of the files created by open_h5file (and output_hdf5)
+  void set_output_storage(const h5_storage &storage);
 
   // array_slice.cpp methods
 
@@ -1415,31 +1771,47 @@ class fields {
   // and should be ignored by external callers.
   int get_array_slice_dimensions(const volume &where, size_t dims[3], void *data=0);
 
+  // the sub-block start[i] <= n < start[i]+count[i] (i < rank) of the
+  // array slice that contains the points of this process (count = 0
+  // if there are none), as computed by get_array_slice with GatherNone;
+  // returns the rank of the (full) slice.  Points of the sub-block
+  // that belong to other processes are zero.
+  int get_local_array_slice_dimensions(const volume &where,
+                                       size_t start[3], size_t count[3]);
+
   // given a subvolume, return a column-major array containing
   // the given function of the field components in that subvolume
   // if slice is non-null, it must be a user-allocated buffer
   // of the correct size.
   // otherwise, a new buffer is allocated and returned; it
   // must eventually be caller-deallocated via delete[].
+  // with GatherToMaster, NULL is returned on the other processes;
+  // with GatherNone, only the local sub-block is returned (NULL if
+  // this process has no points of the slice).
   double *get_array_slice(const volume &where,
                           std::vector<component> components,
                           field_rfunction rfun, void *fun_data,
-                          double *slice=0);
+                          double *slice=0,
+                          slice_gather gather=GatherToAll);
 
   std::complex<double> *get_complex_array_slice(const volume &where,
                                    std::vector<component> components,
                                    field_function fun,
                                    void *fun_data,
-                                   std::complex<double> *slice=0);
+                                   std::complex<double> *slice=0,
+                                   slice_gather gather=GatherToAll);
 
   // alternative entry points for when you have no field
   // function, i.e. you want just a single component or
   // derived component.)
-  double *get_array_slice(const volume &where, component c, double *slice=0);
-  double *get_array_slice(const volume &where, derived_component c, double *slice=0);
+  double *get_array_slice(const volume &where, component c, double *slice=0,
+                          slice_gather gather=GatherToAll);
+  double *get_array_slice(const volume &where, derived_component c, double *slice=0,
+                          slice_gather gather=GatherToAll);
   std::complex<double> *get_complex_array_slice(const volume &where,
                                                 component c,
-                                                std::complex<double> *slice=0);
+                                                std::complex<double> *slice=0,
+                                                slice_gather gather=GatherToAll);
 
   // master routine for all above entry points
   void *do_get_array_slice(const volume &where,
@@ -1447,7 +1819,27 @@ class fields {
                            field_function fun,
                            field_rfunction rfun,
                            void *fun_data,
-                           void *vslice);
+                           void *vslice,
+                           const field_reduction *reduce = 0,
+                           slice_gather gather = GatherToAll);
+
+  // reduced array slices (see field_reduction), computed on the
+  // processes that own the fields, so that only the reduced data
+  // is communicated.  dims are the dimensions of the reduced data;
+  // the rank is zero if it is a single value.  A NULL rfun gives
+  // the sum of the |f|^2 of the components (e.g. |E|^2).
+  int get_reduced_array_slice_dimensions(const volume &where,
+                                         const field_reduction &r,
+                                         size_t dims[3]);
+  double *get_reduced_array_slice(const volume &where,
+                                  const std::vector<component> &components,
+                                  field_rfunction rfun, void *fun_data,
+                                  const field_reduction &r,
+                                  double *slice=0);
+  double *get_reduced_array_slice(const volume &where, component c,
+                                  const field_reduction &r, double *slice=0);
+  double *get_reduced_array_slice(const volume &where, derived_component c,
+                                  const field_reduction &r, double *slice=0);
 
   // step.cpp methods:
   double last_step_output_wall_time;
@@ -1461,8 +1853,14 @@ class fields {
   inline double time() const { return t*dt; };
 
   // cw_fields.cpp:
-  bool solve_cw(double tol, int maxiters, std::complex<double> frequency, int L=2);
+  bool solve_cw(double tol, int maxiters, std::complex<double> frequency,
+		int L=2, solve_cw_precond precond=NULL, void *precond_data=NULL);
   bool solve_cw(double tol = 1e-8, int maxiters = 10000, int L=2);
+  bool solve_cw_sweep(double tol, int maxiters,
+		      const std::complex<double> *frequencies, int nfreq,
+		      solve_cw_callback solved, void *solved_data,
+		      int L=2, int batch=16,
+		      solve_cw_precond precond=NULL, void *precond_data=NULL);
 
   // sources.cpp:
   double last_source_time();
@@ -1531,6 +1929,8 @@ class fields {
 		      component cgrid = Centered,
 		      bool use_symmetry = true,
 		      bool snap_unit_dims = false);
+  void loop_in_chunks(field_chunkloop chunkloop, void *chunkloop_data,
+		      chunkloop_plan &plan);
 
   // integrate.cpp
   std::complex<double> integrate(int num_fields, const component *components,
@@ -1579,16 +1979,32 @@ class fields {
 		     bool sqrt_dV_and_interp_weights = false,
 		     std::complex<double> extra_weight = 1.0,
 		     bool use_centered_grid = true, int vc = 0);
+  dft_chunk *add_dft(component c, const volume &where,
+		     const std::vector<double> &freq,
+		     bool include_dV_and_interp_weights = true,
+		     std::complex<double> stored_weight = 1.0,
+                     dft_chunk *chunk_next = 0,
+		     bool sqrt_dV_and_interp_weights = false,
+		     std::complex<double> extra_weight = 1.0,
+		     bool use_centered_grid = true, int vc = 0);
   dft_chunk *add_dft_pt(component c, const vec &where,
 			double freq_min, double freq_max, int Nfreq);
   dft_chunk *add_dft(const volume_list *where,
 		     double freq_min, double freq_max, int Nfreq,
 		     bool include_dV = true);
+  dft_chunk *add_dft(const volume_list *where, const std::vector<double> &freq,
+		     bool include_dV = true);
   void update_dfts();
+  void use_dft_decimation(bool decimate = true, bool anti_alias = false);
+  int dft_decimation_stride();
   dft_flux add_dft_flux(const volume_list *where,
 			double freq_min, double freq_max, int Nfreq, bool use_symmetry=true);
+  dft_flux add_dft_flux(const volume_list *where,
+			const std::vector<double> &freq, bool use_symmetry=true);
   dft_flux add_dft_flux(direction d, const volume &where,
 			double freq_min, double freq_max, int Nfreq, bool use_symmetry=true);
+  dft_flux add_dft_flux(direction d, const volume &where,
+			const std::vector<double> &freq, bool use_symmetry=true);
   dft_flux add_dft_flux_box(const volume &where,
 			    double freq_min, double freq_max, int Nfreq);
   dft_flux add_dft_flux_plane(const volume &where,
@@ -1597,10 +2013,15 @@ class fields {
   // a "mode monitor" is just a dft_flux with symmetry reduction turned off.
   dft_flux add_mode_monitor(direction d, const volume &where,
                             double freq_min, double freq_max, int Nfreq);
+  dft_flux add_mode_monitor(direction d, const volume &where,
+                            const std::vector<double> &freq);
 
   dft_fields add_dft_fields(component *components, int num_components,
                             const volume where,
                             double freq_min, double freq_max, int Nfreq);
+  dft_fields add_dft_fields(component *components, int num_components,
+                            const volume where,
+                            const std::vector<double> &freq);
 
   /********************************************************/
   /* process_dft_component is an intermediate-level       */
@@ -1632,7 +2053,7 @@ class fields {
   void output_mode_fields(void *mode_data, dft_flux flux,
                           const char *HDF5FileName);
 
-  // get array of DFT field values
+  // get array of DFT field values (NULL if there are none)
   std::complex<double> *get_dft_array(dft_flux flux, component c, int num_freq,
                                       int *rank, int dims[3]);
   std::complex<double> *get_dft_array(dft_fields fdft, component c, int num_freq,
@@ -1652,10 +2073,14 @@ class fields {
   // stress.cpp
   dft_force add_dft_force(const volume_list *where,
 			  double freq_min, double freq_max, int Nfreq);
+  dft_force add_dft_force(const volume_list *where,
+			  const std::vector<double> &freq);
 
   // near2far.cpp
   dft_near2far add_dft_near2far(const volume_list *where,
                                 double freq_min, double freq_max, int Nfreq);
+  dft_near2far add_dft_near2far(const volume_list *where,
+                                const std::vector<double> &freq);
   // monitor.cpp
   double get_chi1inv(component, direction, const vec &loc) const;
   double get_inveps(component c, direction d, const vec &loc) const {
@@ -1726,6 +2151,8 @@ class fields {
   double times_spent[Other+1];
   // fields.cpp
   void figure_out_step_plan();
+  // dft.cpp
+  void update_dft_decimation();
   // time.cpp
   void am_now_working_on(time_sink);
   void finished_working();
@@ -1740,14 +2167,32 @@ class fields {
   bool locate_point_in_user_volume(ivec *, std::complex<double> *phase) const;
   void locate_volume_source_in_user_volume(const vec p1, const vec p2, vec newp1[8], vec newp2[8],
                                            std::complex<double> kphase[8], int &ncopies) const;
+  // the pairs with nonzero comm_size_tot that send from (Outgoing)
+  // or receive into (Incoming) one of our chunks
+  std::vector<comm_pair> comm_pairs[NUM_FIELD_TYPES][2];
+  void find_comm_pairs();
   // mympi.cpp
+  void *comm_requests[NUM_FIELD_TYPES]; // persistent MPI requests
+  int num_comm_requests[NUM_FIELD_TYPES];
+  void init_boundary_communications();
+  void free_boundary_communications();
   void boundary_communications(field_type);
+  void start_boundary_communications(field_type);
+  void finish_boundary_communications(field_type);
   // step.cpp
+  bool thread_over_chunks() const;
+  void start_boundaries(field_type);
+  void finish_boundaries(field_type);
+  // update_eh.cpp
+  bool update_eh_needs_notowned(field_type ft) const;
   void phase_material();
-  void step_db(field_type ft);
+  void step_db(field_type ft, step_region region = STEP_ALL);
   void step_source(field_type ft, bool including_integrated = false);
   void update_pols(field_type ft);
   void calc_sources(double tim);
+  // loop_in_chunks.cpp
+  std::vector<chunkloop_plan *> chunkloop_plans; // most recently used last
+  void compute_chunkloop_plan(chunkloop_plan &plan) const;
 public:
   // monitor.cpp
   std::complex<double> get_field(component c, const ivec &iloc) const;
@@ -1780,6 +2225,43 @@ class flux_vol {
   double cur_flux, cur_flux_half;
 };
 
+/* Accumulates a reduced array slice (fields::get_reduced_array_slice) of
+   a field function over time: each update() computes the reduced slice
+   at the current time, and combines it with the previous ones by time_op
+   (ReduceSum, ReduceMean, ReduceMin, ReduceMax, or ReduceRMS), e.g. the
+   time-averaged |E|^2 for the Ex, Ey, Ez components with the default
+   rfun.  Only the accumulated data (n values, with the given rank and
+   dims) is stored; get and output_hdf5 return/write the result. */
+class field_accumulator {
+ public:
+  field_accumulator(fields *f, const volume &where,
+                    const std::vector<component> &components,
+                    const field_reduction &r, reduction_op time_op,
+                    field_rfunction rfun = 0, void *fun_data = 0);
+  ~field_accumulator();
+
+  void update(); // collective
+  void reset();
+  double *get(double *slice = 0); // new array if slice is NULL
+  void output_hdf5(h5file *file, const char *dataname,
+                   bool single_precision = false);
+
+  int rank;
+  size_t dims[3];
+  size_t n; // number of values
+  int num_updates;
+
+ private:
+  fields *f;
+  volume where;
+  std::vector<component> components;
+  field_reduction r;
+  reduction_op time_op;
+  field_rfunction rfun;
+  void *fun_data;
+  double *cur, *acc;
+};
+
 // The following is a utility function to parse the executable name use it
 // to come up with a directory name, avoiding overwriting any existing
 // directory, unless the source file hasn't changed.
@@ -1820,6 +2302,12 @@ double uniform_random(double a, double b); // uniform random in [a,b]
 double gaussian_random(double mean, double stddev); // normal random with given mean and stddev
 int random_int(int a, int b); // uniform random in [a,b)
 
+// explicit SIMD instruction sets for time-stepping kernels (step_simd.cpp)
+enum simd_level { SIMD_NONE = 0, SIMD_AVX2, SIMD_AVX512 };
+simd_level get_simd_level(); // instruction set used, chosen from the CPU at runtime
+void set_simd_level(simd_level max_level); // limit the instruction set (e.g. to SIMD_NONE)
+const char *simd_level_name(simd_level level);
+
 // Bessel function (in initialize.cpp)
 double BesselJ(int m, double kr);
 
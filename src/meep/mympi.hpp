@@ -52,7 +52,14 @@ bool am_really_master();
 inline int am_master() { return my_rank() == 0; }
 bool with_mpi();
 
+// number of OpenMP threads used within each process (1 without OpenMP),
+// normally set by the OMP_NUM_THREADS environment variable
+int count_threads();
+void set_num_threads(int nthreads);
+
 void send(int from, int to, double *data, int size=1);
+void send(int from, int to, float *data, int size=1);
+void send(int from, int to, size_t *data, int size=1);
 void broadcast(int from, double *data, int size);
 void broadcast(int from, char *data, int size);
 void broadcast(int from, int *data, int size);
@@ -65,15 +72,16 @@ bool broadcast(int from, bool);
 double max_to_master(double); // Only returns the correct value to proc 0.
 double max_to_all(double);
 int max_to_all(int);
+void max_to_all(const double *in, double *out, int size); // in may == out
 float sum_to_master(float); // Only returns the correct value to proc 0.
 double sum_to_master(double); // Only returns the correct value to proc 0.
 double sum_to_all(double);
-void sum_to_all(const double *in, double *out, int size);
+void sum_to_all(const double *in, double *out, int size); // in may == out
 void sum_to_master(const float *in, float *out, int size);
 void sum_to_master(const double *in, double *out, int size);
 void sum_to_all(const float *in, double *out, int size);
 void sum_to_all(const std::complex<float> *in, std::complex<double> *out, int size);
-void sum_to_all(const std::complex<double> *in, std::complex<double> *out, int size);
+void sum_to_all(const std::complex<double> *in, std::complex<double> *out, int size); // in may == out
 void sum_to_master(const std::complex<float> *in, std::complex<float> *out, int size);
 void sum_to_master(const std::complex<double> *in, std::complex<double> *out, int size);
 long double sum_to_all(long double);
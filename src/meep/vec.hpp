@@ -216,6 +216,84 @@ component first_field_component(field_type ft);
 	loop_ibound++) \
      S1LOOP_OVER_IVECS(gv, loop_notowned_is, loop_notowned_ie, idx)
 
+// The following PLOOP_* and PS1LOOP_* macros work identically to the
+// LOOP_* and S1LOOP_* macros above, except that (when Meep is compiled
+// with OpenMP) the iterations of the two outer loops are divided among
+// threads.  The loop body must therefore not carry data dependencies
+// between iterations nor write to shared variables (other than the
+// array element idx), and must not "break" out of the loop.  (The
+// outermost for statement just declares the loop constants, and
+// executes exactly once.)
+
+#ifdef _OPENMP
+#  define PLOOP_OMP _Pragma("omp parallel for collapse(2) schedule(static)")
+#else
+#  define PLOOP_OMP
+#endif
+
+// loop over indices idx from is to ie (inclusive) in gv
+#define PLOOP_OVER_IVECS(gv, is, ie, idx) \
+  for (ptrdiff_t loop_is1 = (is).yucky_val(0), \
+           loop_is2 = (is).yucky_val(1), \
+           loop_is3 = (is).yucky_val(2), \
+           loop_n1 = ((ie).yucky_val(0) - loop_is1) / 2 + 1, \
+           loop_n2 = ((ie).yucky_val(1) - loop_is2) / 2 + 1, \
+           loop_n3 = ((ie).yucky_val(2) - loop_is3) / 2 + 1, \
+           loop_d1 = (gv).yucky_direction(0), \
+           loop_d2 = (gv).yucky_direction(1), \
+           loop_d3 = (gv).yucky_direction(2), \
+	   loop_s1 = (gv).stride((meep::direction) loop_d1),		\
+	   loop_s2 = (gv).stride((meep::direction) loop_d2),		\
+	   loop_s3 = (gv).stride((meep::direction) loop_d3),		\
+           idx0 = (is - (gv).little_corner()).yucky_val(0) / 2 * loop_s1 \
+                + (is - (gv).little_corner()).yucky_val(1) / 2 * loop_s2 \
+                + (is - (gv).little_corner()).yucky_val(2) / 2 * loop_s3,\
+           loop_once = 1; loop_once; loop_once = 0) PLOOP_OMP \
+    for (ptrdiff_t loop_i1 = 0; loop_i1 < loop_n1; loop_i1++) \
+      for (ptrdiff_t loop_i2 = 0; loop_i2 < loop_n2; loop_i2++) \
+        for (ptrdiff_t idx = idx0 + loop_i1*loop_s1 + loop_i2*loop_s2, \
+             loop_i3 = 0; loop_i3 < loop_n3; loop_i3++, idx+=loop_s3)
+
+#define PLOOP_OVER_VOL(gv, c, idx) \
+  PLOOP_OVER_IVECS(gv, (gv).little_corner() + (gv).iyee_shift(c), (gv).big_corner() + (gv).iyee_shift(c), idx)
+
+#define PLOOP_OVER_VOL_OWNED(gv, c, idx) \
+  PLOOP_OVER_IVECS(gv, (gv).little_owned_corner(c), (gv).big_corner(), idx)
+
+#define PLOOP_OVER_VOL_OWNED0(gv, c, idx) \
+  PLOOP_OVER_IVECS(gv, (gv).little_owned_corner0(c), (gv).big_corner(), idx)
+
+// loop over indices idx from is to ie (inclusive) in gv
+#define PS1LOOP_OVER_IVECS(gv, is, ie, idx) \
+  for (ptrdiff_t loop_is1 = (is).yucky_val(0), \
+           loop_is2 = (is).yucky_val(1), \
+           loop_is3 = (is).yucky_val(2), \
+           loop_n1 = ((ie).yucky_val(0) - loop_is1) / 2 + 1, \
+           loop_n2 = ((ie).yucky_val(1) - loop_is2) / 2 + 1, \
+           loop_n3 = ((ie).yucky_val(2) - loop_is3) / 2 + 1, \
+           loop_d1 = (gv).yucky_direction(0), \
+           loop_d2 = (gv).yucky_direction(1), \
+	   loop_s1 = (gv).stride((meep::direction) loop_d1),	\
+	   loop_s2 = (gv).stride((meep::direction) loop_d2),	\
+           loop_s3 = 1, \
+           idx0 = (is - (gv).little_corner()).yucky_val(0) / 2 * loop_s1 \
+                + (is - (gv).little_corner()).yucky_val(1) / 2 * loop_s2 \
+                + (is - (gv).little_corner()).yucky_val(2) / 2 * loop_s3,\
+           loop_once = 1; loop_once; loop_once = 0) PLOOP_OMP \
+    for (ptrdiff_t loop_i1 = 0; loop_i1 < loop_n1; loop_i1++) \
+      for (ptrdiff_t loop_i2 = 0; loop_i2 < loop_n2; loop_i2++) _Pragma(IVDEP) \
+        for (ptrdiff_t idx = idx0 + loop_i1*loop_s1 + loop_i2*loop_s2, \
+             loop_i3 = 0; loop_i3 < loop_n3; loop_i3++, idx++)
+
+#define PS1LOOP_OVER_VOL(gv, c, idx) \
+  PS1LOOP_OVER_IVECS(gv, (gv).little_corner() + (gv).iyee_shift(c), (gv).big_corner() + (gv).iyee_shift(c), idx)
+
+#define PS1LOOP_OVER_VOL_OWNED(gv, c, idx) \
+  PS1LOOP_OVER_IVECS(gv, (gv).little_owned_corner(c), (gv).big_corner(), idx)
+
+#define PS1LOOP_OVER_VOL_OWNED0(gv, c, idx) \
+  PS1LOOP_OVER_IVECS(gv, (gv).little_owned_corner0(c), (gv).big_corner(), idx)
+
 #define IVEC_LOOP_AT_BOUNDARY 					\
  ((loop_s1 != 0 && (loop_i1 == 0 || loop_i1 == loop_n1-1)) ||	\
   (loop_s2 != 0 && (loop_i2 == 0 || loop_i2 == loop_n2-1)) ||	\
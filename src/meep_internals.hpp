@@ -50,41 +50,78 @@ class src_vol {
  public:
   src_vol(component cc, src_time *st, size_t n, ptrdiff_t *ind, std::complex<double> *amps);
   src_vol(const src_vol &sv);
-  ~src_vol() { delete next; delete[] index; delete[] A;}
+  ~src_vol() { delete next; delete[] amp_re; delete[] amp_im; delete[] run_amp; }
 
   src_time *t;
-  ptrdiff_t *index; // list of locations of sources in grid (indices)
-  size_t npts; // number of points in list
+  size_t npts; // number of points
   component c; // field component the source applies to
-  std::complex<double> *A; // list of amplitudes
 
-  std::complex<double> dipole(size_t j) { return A[j] * t->dipole(); }
-  std::complex<double> current(size_t j) { return A[j] * t->current(); }
+  /* The points are stored compactly as runs of equally spaced grid
+     indices (in increasing order): point m of run k has the index
+     runs[k].start + m * runs[k].stride.  Its amplitude is
+     run_amp[k] * amp[q], where amp = amp_re + i*amp_im (amp_im is NULL
+     if the amplitudes are real).  If the amplitudes are separable,
+     i.e. all runs have the same length and their amplitudes are
+     multiples run_amp[k] of the same profile, then q = m; otherwise
+     run_amp is NULL (i.e. 1) and q = (number of points in runs < k) + m. */
+  struct index_run {
+    ptrdiff_t start, stride;
+    size_t count;
+  };
+  std::vector<index_run> runs;
+  realnum *amp_re, *amp_im;
+  std::complex<double> *run_amp;
+
+  // the indices and amplitudes of the points, in arrays of length npts
+  void get_points(ptrdiff_t *index, std::complex<double> *A) const;
+  size_t memory_used() const; // bytes used for the points
+
   void update(double time, double dt) { t->update(time, dt); }
 
-  bool operator==(const src_vol &sv) const {
-    // note: don't compare sv.A, since this is used to see if we can just
-    // add one source's amplitudes to another in src_vol::add_to
-    return sv.npts==npts && sv.c==c && sv.t==t &&
-           memcmp(sv.index, index, npts*sizeof(ptrdiff_t))==0;
-  }
+  /* fr[i] -= real(A[j] * s * w[i]) and fi[i] -= imag(A[j] * s * w[i])
+     for each point j with index i, where w and/or fi may be NULL */
+  void subtract_from(realnum *fr, realnum *fi, std::complex<double> s,
+		     const realnum *w = NULL) const;
+  // the sum of conj(A[j]) * (fr[i] + i*fi[i]), where fi may be NULL,
+  // and the sum of |A[j]| in abs_sum
+  std::complex<double> overlap(const realnum *fr, const realnum *fi,
+			       double &abs_sum) const;
 
   src_vol *add_to(src_vol *others);
   src_vol *next;
+
+ private:
+  void compress(size_t n, const ptrdiff_t *index, const std::complex<double> *A);
 };
 
+// susceptibility.cpp: update_P and subtract_P for all of the polarizations
+// in the list pol, fusing the updates of the Lorentzian susceptibilities
+void update_polarizations(polarization_state *pol,
+			  realnum *W[NUM_FIELD_COMPONENTS][2],
+			  realnum *W_prev[NUM_FIELD_COMPONENTS][2],
+			  double dt, const grid_volume &gv);
+void subtract_polarizations(polarization_state *pol, field_type ft,
+			    realnum *f_minus_p[NUM_FIELD_COMPONENTS][2]);
+
 const int num_bandpts = 32;
 
 symmetry r_to_minus_r_symmetry(int m);
 
 #define MIN_OUTPUT_TIME 4.0 // output no more often than this many seconds
 
+// dft.cpp:
+const int DFT_BATCH = 8; // max. timesteps buffered by dft_chunk::update_dft
+const int DFT_PHASE_RESYNC = 1024; // timesteps between exact exp(iwt) evals
+// spacing of uniformly spaced frequencies, or 0 if they are not uniform
+double dft_freqs_spacing(const std::vector<double> &freq);
+
 
 // functions in step_generic.cpp:
 
-void step_curl(realnum *f, component c, const realnum *g1, const realnum *g2,
+void step_curl(realnum *f, const realnum *g1, const realnum *g2,
 	       ptrdiff_t s1, ptrdiff_t s2, // strides for g1/g2 shift
-	       const grid_volume &gv, double dtdx,
+	       const grid_volume &gv, const ivec &is, const ivec &ie,
+	       double dtdx,
 	       direction dsig, const double *sig, const double *kap, const double *siginv,
 	       realnum *fu, direction dsigu, const double *sigu, const double *kapu, const double *siginvu,
 	       double dt, const realnum *cnd, const realnum *cndinv,
@@ -97,17 +134,19 @@ void step_update_EDHB(realnum *f, component fc, const grid_volume &gv,
 		      const realnum *chi2, const realnum *chi3,
 		      realnum *fw, direction dsigw, const double *sigw, const double *kapw);
 
-void step_beta(realnum *f, component c, const realnum *g,
-	       const grid_volume &gv, double betadt,
+void step_beta(realnum *f, const realnum *g,
+	       const grid_volume &gv, const ivec &is, const ivec &ie,
+	       double betadt,
 	       direction dsig, const double *siginv,
 	       realnum *fu, direction dsigu, const double *siginvu,
 	       const realnum *cndinv, realnum *fcnd);
 
 // functions in step_generic_stride1.cpp, generated from step_generic.cpp:
 
-void step_curl_stride1(realnum *f, component c, const realnum *g1, const realnum *g2,
+void step_curl_stride1(realnum *f, const realnum *g1, const realnum *g2,
 	       ptrdiff_t s1, ptrdiff_t s2, // strides for g1/g2 shift
-	       const grid_volume &gv, double dtdx,
+	       const grid_volume &gv, const ivec &is, const ivec &ie,
+	       double dtdx,
 	       direction dsig, const double *sig, const double *kap, const double *siginv,
 	       realnum *fu, direction dsigu, const double *sigu, const double *kapu, const double *siginvu,
 	       double dt, const realnum *cnd, const realnum *cndinv,
@@ -120,36 +159,67 @@ void step_update_EDHB_stride1(realnum *f, component fc, const grid_volume &gv,
 		      const realnum *chi2, const realnum *chi3,
 		      realnum *fw, direction dsigw, const double *sigw, const double *kapw);
 
-void step_beta_stride1(realnum *f, component c, const realnum *g,
-		       const grid_volume &gv, double betadt,
+void step_beta_stride1(realnum *f, const realnum *g,
+		       const grid_volume &gv, const ivec &is, const ivec &ie,
+		       double betadt,
 		       direction dsig, const double *siginv,
 		       realnum *fu, direction dsigu, const double *siginvu,
 		       const realnum *cndinv, realnum *fcnd);
 
+// functions in step_simd.cpp: explicitly vectorized versions of common
+// special cases of the stride-1 functions above, which return false
+// (doing nothing) for the cases they do not handle
+
+bool step_curl_simd(realnum *f, const realnum *g1, const realnum *g2,
+		    ptrdiff_t s1, ptrdiff_t s2, // strides for g1/g2 shift
+		    const grid_volume &gv, const ivec &is, const ivec &ie,
+		    double dtdx,
+		    direction dsig, const double *sig, const double *kap, const double *siginv,
+		    realnum *fu, direction dsigu, const double *sigu, const double *kapu, const double *siginvu,
+		    double dt, const realnum *cnd, const realnum *cndinv,
+		    realnum *fcnd);
+
+bool step_update_EDHB_simd(realnum *f, component fc, const grid_volume &gv,
+			   const realnum *g, const realnum *g1, const realnum *g2,
+			   const realnum *u, const realnum *u1, const realnum *u2,
+			   ptrdiff_t s, ptrdiff_t s1, ptrdiff_t s2,
+			   const realnum *chi2, const realnum *chi3,
+			   realnum *fw, direction dsigw, const double *sigw, const double *kapw);
+
+// the accumulation loop of dft_chunk::flush_dft (see dft.cpp)
+bool dft_accumulate_simd(realnum *dft, const realnum *fbuf,
+			 const realnum *phase, const realnum *phase_swapped,
+			 size_t N, int Nbatch, int nbuf, bool cmplx,
+			 ptrdiff_t N2);
+
 /* macro wrappers around time-stepping functions: for performance reasons,
    if the inner loop is stride-1 then we use the stride-1 versions,
    which allow gcc (and possibly other compilers) to do additional
    optimizations, especially loop vectorization */
 
-#define STEP_CURL(f, c, g1, g2, s1, s2, gv, dtdx, dsig, sig, kap, siginv, fu, dsigu, sigu, kapu, siginvu, dt, cnd, cndinv, fcnd) do { \
-  if (LOOPS_ARE_STRIDE1(gv))						\
-    step_curl_stride1(f, c, g1, g2, s1, s2, gv, dtdx, dsig, sig, kap, siginv, fu, dsigu, sigu, kapu, siginvu, dt, cnd, cndinv, fcnd); \
+#define STEP_CURL(f, g1, g2, s1, s2, gv, is, ie, dtdx, dsig, sig, kap, siginv, fu, dsigu, sigu, kapu, siginvu, dt, cnd, cndinv, fcnd) do { \
+  if (LOOPS_ARE_STRIDE1(gv)) {						\
+    if (!step_curl_simd(f, g1, g2, s1, s2, gv, is, ie, dtdx, dsig, sig, kap, siginv, fu, dsigu, sigu, kapu, siginvu, dt, cnd, cndinv, fcnd)) \
+      step_curl_stride1(f, g1, g2, s1, s2, gv, is, ie, dtdx, dsig, sig, kap, siginv, fu, dsigu, sigu, kapu, siginvu, dt, cnd, cndinv, fcnd); \
+  }									\
   else									\
-    step_curl(f, c, g1, g2, s1, s2, gv, dtdx, dsig, sig, kap, siginv, fu, dsigu, sigu, kapu, siginvu, dt, cnd, cndinv, fcnd); \
+    step_curl(f, g1, g2, s1, s2, gv, is, ie, dtdx, dsig, sig, kap, siginv, fu, dsigu, sigu, kapu, siginvu, dt, cnd, cndinv, fcnd); \
 } while (0)
 
 #define STEP_UPDATE_EDHB(f, fc, gv, g, g1, g2, u, u1, u2, s, s1, s2, chi2, chi3, fw, dsigw, sigw, kapw) do { \
-  if (LOOPS_ARE_STRIDE1(gv))						\
-    step_update_EDHB_stride1(f, fc, gv, g, g1, g2, u, u1, u2, s, s1, s2, chi2, chi3, fw, dsigw, sigw, kapw); \
+  if (LOOPS_ARE_STRIDE1(gv)) {						\
+    if (!step_update_EDHB_simd(f, fc, gv, g, g1, g2, u, u1, u2, s, s1, s2, chi2, chi3, fw, dsigw, sigw, kapw)) \
+      step_update_EDHB_stride1(f, fc, gv, g, g1, g2, u, u1, u2, s, s1, s2, chi2, chi3, fw, dsigw, sigw, kapw); \
+  }									\
   else									\
     step_update_EDHB(f, fc, gv, g, g1, g2, u, u1, u2, s, s1, s2, chi2, chi3, fw, dsigw, sigw, kapw); \
 } while (0)
 
-#define STEP_BETA(f, c, g, gv, betadt, dsig, siginv, fu, dsigu, siginvu, cndinv, fcnd) do {	\
+#define STEP_BETA(f, g, gv, is, ie, betadt, dsig, siginv, fu, dsigu, siginvu, cndinv, fcnd) do {	\
   if (LOOPS_ARE_STRIDE1(gv))						\
-    step_beta_stride1(f, c,g, gv, betadt, dsig, siginv, fu, dsigu, siginvu, cndinv, fcnd);	\
+    step_beta_stride1(f, g, gv, is, ie, betadt, dsig, siginv, fu, dsigu, siginvu, cndinv, fcnd);	\
   else									\
-    step_beta(f, c,g, gv, betadt, dsig, siginv, fu, dsigu, siginvu, cndinv, fcnd);		\
+    step_beta(f, g, gv, is, ie, betadt, dsig, siginv, fu, dsigu, siginvu, cndinv, fcnd);		\
 } while (0)
 
 } // namespace meep
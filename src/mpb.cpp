@@ -643,8 +643,6 @@ void fields::get_eigenmode_coefficients(dft_flux flux,
                                         double *vgrp, kpoint_func user_kpoint_func,
                                         void *user_kpoint_data, vec *kpoints, vec *kdom_list)
 {
-  double freq_min      = flux.freq_min;
-  double dfreq         = flux.dfreq;
   int num_freqs        = flux.Nfreq;
   direction d          = flux.normal_direction;
   bool match_frequency = true;
@@ -665,7 +663,7 @@ void fields::get_eigenmode_coefficients(dft_flux flux,
       /*- call mpb to compute the eigenmode --------------------------*/
       /*--------------------------------------------------------------*/
       int band_num = bands[nb];
-      double freq  = freq_min + nf*dfreq;
+      double freq  = flux.freq[nf];
       double kdom[3];
       if (user_kpoint_func) kpoint = user_kpoint_func(freq, band_num, user_kpoint_data);
       void *mode_data
@@ -23,6 +23,8 @@
 #include "meep_internals.hpp"
 #include "config.h"
 
+using namespace std;
+
 namespace meep {
 
 multilevel_susceptibility::multilevel_susceptibility(int theL, int theT,
@@ -119,8 +121,7 @@ typedef struct {
   realnum *GammaInv; // inv(1 + Gamma * dt / 2)
   realnumP *P[NUM_FIELD_COMPONENTS][2]; // P[c][cmp][transition][i]
   realnumP *P_prev[NUM_FIELD_COMPONENTS][2];
-  realnum *N; // ntot x L array of centered grid populations N[i*L + level]
-  realnum *Ntmp; // temporary length L array of levels, used in updating
+  realnum *N; // L x ntot array of centered grid populations N[level*ntot + i]
   realnum data[1];
 } multilevel_data;
 
@@ -130,7 +131,7 @@ void *multilevel_susceptibility::new_internal_data(
   size_t num = 0; // number of P components
   FOR_COMPONENTS(c) DOCMP2 if (needs_P(c, cmp, W)) num += 2 * gv.ntot();
   size_t sz = sizeof(multilevel_data)
-    + sizeof(realnum) * (L*L + L + gv.ntot()*L + num*T - 1);
+    + sizeof(realnum) * (L*L + gv.ntot()*L + num*T - 1);
   multilevel_data *d = (multilevel_data *) malloc(sz);
   memset(d, 0, sz);
   d->sz_data = sz;
@@ -147,7 +148,7 @@ void multilevel_susceptibility::init_internal_data(
   size_t ntot = d->ntot = gv.ntot();
 
   /* d->data points to a big block of data that holds GammaInv, P,
-     P_prev, Ntmp, and N.  We also initialize a bunch of convenience
+     P_prev, and N.  We also initialize a bunch of convenience
      pointer in d to point to the corresponding data in d->data, so
      that we don't have to remember in other functions how d->data is
      laid out. */
@@ -172,13 +173,12 @@ void multilevel_susceptibility::init_internal_data(
     }
   }
 
-  d->Ntmp = P;
-  d->N = P + L; // the last L*ntot block of the data
+  d->N = P; // the last L*ntot block of the data
 
   // initial populations
-  for (size_t i = 0; i < ntot; ++i)
-    for (int l = 0; l < L; ++l)
-      d->N[i*L + l] = N0[l];
+  for (int l = 0; l < L; ++l)
+    for (size_t i = 0; i < ntot; ++i)
+      d->N[l*ntot + i] = N0[l];
 }
 
 void multilevel_susceptibility::delete_internal_data(void *data) const {
@@ -211,11 +211,51 @@ void *multilevel_susceptibility::copy_internal_data(void *data) const {
       P_prev += 2*ntot;
     }
   }
-  dnew->Ntmp = P;
-  dnew->N = P + L;
+  dnew->N = P;
   return (void*) dnew;
 }
 
+/* arrays n < 4*T*NUM_FIELD_COMPONENTS are P (n even) or P_prev (n odd)
+   for transition t = (n/2)%T, cmp = (n/(2*T))%2, and c = n/(4*T); the
+   last array holds the L populations N at each centered-grid point
+   (which are stored level by level, so they are only accessible via
+   get/set_internal_array) */
+realnum *multilevel_susceptibility::internal_array(int n, void *P_internal_data,
+						   component *c, int *nvals) const {
+  multilevel_data *d = (multilevel_data *) P_internal_data;
+  if (n == 4*T*NUM_FIELD_COMPONENTS) {
+    *c = Centered;
+    *nvals = L;
+    return 0;
+  }
+  *c = component(n / (4*T));
+  *nvals = 1;
+  const int t = (n / 2) % T, cmp = (n / (2*T)) % 2;
+  if (!d || !d->P[*c][cmp]) return 0;
+  return n % 2 ? d->P_prev[*c][cmp][t] : d->P[*c][cmp][t];
+}
+
+bool multilevel_susceptibility::get_internal_array(int n, void *P_internal_data,
+						   realnum *a) const {
+  multilevel_data *d = (multilevel_data *) P_internal_data;
+  if (n != 4*T*NUM_FIELD_COMPONENTS || !d) return false;
+  if (a)
+    for (size_t i = 0; i < d->ntot; ++i)
+      for (int l = 0; l < L; ++l)
+	a[i*L + l] = d->N[l*d->ntot + i];
+  return true;
+}
+
+bool multilevel_susceptibility::set_internal_array(int n, void *P_internal_data,
+						   const realnum *a) const {
+  multilevel_data *d = (multilevel_data *) P_internal_data;
+  if (n != 4*T*NUM_FIELD_COMPONENTS || !d) return false;
+  for (size_t i = 0; i < d->ntot; ++i)
+    for (int l = 0; l < L; ++l)
+      d->N[l*d->ntot + i] = a[i*L + l];
+  return true;
+}
+
 int multilevel_susceptibility::num_cinternal_notowned_needed(component c,
 				   void *P_internal_data) const {
   multilevel_data *d = (multilevel_data *) P_internal_data;
@@ -249,68 +289,93 @@ void multilevel_susceptibility::update_P
     cdot[idot++] = c;
   }
 
-  // update N from W and P
-  realnum *GammaInv = d->GammaInv;
-  realnum *Ntmp = d->Ntmp;
-  LOOP_OVER_VOL_OWNED(gv, Centered, i) {
-    realnum *N = d->N + i*L; // N at current point, to update
-
+  /* update N from W and P, for a row of n3 centered-grid points at a
+     time (along the last, contiguous, dimension).  The points of a row
+     are processed together, one level or transition at a time, so
+     that the loops over the points vectorize, accumulating in the
+     row buffers Ntmp (L x n3), E8 (3 x 2 x n3: E*8 for each
+     polarization component and cmp) and EdP32 and EPave64 (for one
+     transition); the arithmetic at each point is unchanged. */
+  ivec is(gv.little_owned_corner(Centered)), ie(gv.big_corner());
+  const direction d3 = gv.yucky_direction(2);
+  ptrdiff_t n3 = 1;
+  if (gv.stride(d3) == 1) {
+    n3 = (ie.in_direction(d3) - is.in_direction(d3)) / 2 + 1;
+    ie.set_direction(d3, is.in_direction(d3));
+  }
+  const size_t ntot = d->ntot;
+  const int ndot = idot;
+  vector<double> Gamma1(L*L); // I - Gamma * dt/2
+  for (int l1 = 0; l1 < L; ++l1)
+    for (int l2 = 0; l2 < L; ++l2)
+      Gamma1[l1*L+l2] = (l1 == l2) - Gamma[l1*L+l2]*dt2;
+  vector<realnum> Ntmp(L*n3), Nnew(n3);
+  vector<double> E8(6*n3), EdP32(n3), EPave64(n3);
+  const realnum *GammaInv = d->GammaInv;
+  LOOP_OVER_IVECS(gv, is, ie, i0) {
     // Ntmp = (I - Gamma * dt/2) * N
     for (int l1 = 0; l1 < L; ++l1) {
-      Ntmp[l1] = 0;
+      realnum *nt = &Ntmp[l1*n3];
+      for (ptrdiff_t j = 0; j < n3; ++j) nt[j] = 0;
       for (int l2 = 0; l2 < L; ++l2) {
-	Ntmp[l1] += ((l1 == l2) - Gamma[l1*L+l2]*dt2) * N[l2];
+	const double g = Gamma1[l1*L+l2];
+	const realnum *N = d->N + l2*ntot + i0;
+	for (ptrdiff_t j = 0; j < n3; ++j) nt[j] += g * N[j];
       }
     }
 
-    // compute E*8 at point i
-    double E8[3][2];
-    for (idot = 0; idot < 3 && cdot[idot] != Dielectric; ++idot) {
-      realnum *w = W[cdot[idot]][0], *wp = W_prev[cdot[idot]][0];
-      E8[idot][0] = w[i]+w[i+o1[idot]]+w[i+o2[idot]]+w[i+o1[idot]+o2[idot]]
-	+ wp[i]+wp[i+o1[idot]]+wp[i+o2[idot]]+wp[i+o1[idot]+o2[idot]];
-      if (W[cdot[idot]][1]) {
-	w = W[cdot[idot]][1]; wp = W_prev[cdot[idot]][1];
-	E8[idot][1] = w[i]+w[i+o1[idot]]+w[i+o2[idot]]+w[i+o1[idot]+o2[idot]]
-	  + wp[i]+wp[i+o1[idot]]+wp[i+o2[idot]]+wp[i+o1[idot]+o2[idot]];
+    // compute E*8 at each point
+    for (idot = 0; idot < ndot; ++idot) DOCMP2 {
+      double *e8 = &E8[(2*idot + cmp)*n3];
+      if (W[cdot[idot]][cmp]) {
+	const realnum *w = W[cdot[idot]][cmp] + i0, *wp = W_prev[cdot[idot]][cmp] + i0;
+	const ptrdiff_t a1 = o1[idot], a2 = o2[idot];
+	for (ptrdiff_t j = 0; j < n3; ++j)
+	  e8[j] = w[j]+w[j+a1]+w[j+a2]+w[j+a1+a2]
+	    + wp[j]+wp[j+a1]+wp[j+a2]+wp[j+a1+a2];
       }
       else
-	E8[idot][1] = 0;
+	for (ptrdiff_t j = 0; j < n3; ++j) e8[j] = 0;
     }
 
     // Ntmp = Ntmp + alpha * E * dP
     for (int t = 0; t < T; ++t) {
-      // compute 32 * E * dP and 64 * E * P at point i
-      double EdP32 = 0;
-      double EPave64 = 0;
-      double gperpdt = gamma[t]*pi*dt;
-      for (idot = 0; idot < 3 && cdot[idot] != Dielectric; ++idot) {
-	realnum *p = d->P[cdot[idot]][0][t], *pp = d->P_prev[cdot[idot]][0][t];
-	realnum dP = p[i]+p[i+o1[idot]]+p[i+o2[idot]]+p[i+o1[idot]+o2[idot]]
-	  - (pp[i]+pp[i+o1[idot]]+pp[i+o2[idot]]+pp[i+o1[idot]+o2[idot]]);
-	realnum Pave2 = p[i]+p[i+o1[idot]]+p[i+o2[idot]]+p[i+o1[idot]+o2[idot]]
-	  + (pp[i]+pp[i+o1[idot]]+pp[i+o2[idot]]+pp[i+o1[idot]+o2[idot]]);
-	EdP32 += dP * E8[idot][0];
-	EPave64 += Pave2 * E8[idot][0];
-	if (d->P[cdot[idot]][1]) {
-	  p = d->P[cdot[idot]][1][t]; pp = d->P_prev[cdot[idot]][1][t];
-	  dP = p[i]+p[i+o1[idot]]+p[i+o2[idot]]+p[i+o1[idot]+o2[idot]]
-	    - (pp[i]+pp[i+o1[idot]]+pp[i+o2[idot]]+pp[i+o1[idot]+o2[idot]]);
-	  Pave2 = p[i]+p[i+o1[idot]]+p[i+o2[idot]]+p[i+o1[idot]+o2[idot]]
-	    + (pp[i]+pp[i+o1[idot]]+pp[i+o2[idot]]+pp[i+o1[idot]+o2[idot]]);
-	  EdP32 += dP * E8[idot][1];
-	  EPave64 += Pave2 * E8[idot][1];
+      // compute 32 * E * dP and 64 * E * P at each point
+      const double gperpdt = gamma[t]*pi*dt;
+      for (ptrdiff_t j = 0; j < n3; ++j) EdP32[j] = EPave64[j] = 0;
+      for (idot = 0; idot < ndot; ++idot) DOCMP2 if (d->P[cdot[idot]][cmp]) {
+	const realnum *p = d->P[cdot[idot]][cmp][t] + i0;
+	const realnum *pp = d->P_prev[cdot[idot]][cmp][t] + i0;
+	const double *e8 = &E8[(2*idot + cmp)*n3];
+	const ptrdiff_t a1 = o1[idot], a2 = o2[idot];
+	for (ptrdiff_t j = 0; j < n3; ++j) {
+	  realnum dP = p[j]+p[j+a1]+p[j+a2]+p[j+a1+a2]
+	    - (pp[j]+pp[j+a1]+pp[j+a2]+pp[j+a1+a2]);
+	  realnum Pave2 = p[j]+p[j+a1]+p[j+a2]+p[j+a1+a2]
+	    + (pp[j]+pp[j+a1]+pp[j+a2]+pp[j+a1+a2]);
+	  EdP32[j] += dP * e8[j];
+	  EPave64[j] += Pave2 * e8[j];
 	}
       }
-      EdP32 *= 0.03125; /* divide by 32 */
-      EPave64 *= 0.015625; /* divide by 64 (extra factor of 1/2 is from P_current + P_previous) */ 
-      for (int l = 0; l < L; ++l) Ntmp[l] += alpha[l*T+t]*EdP32 + alpha[l*T+t]*gperpdt*EPave64;
+      for (int l = 0; l < L; ++l) {
+	const double a = alpha[l*T+t];
+	realnum *nt = &Ntmp[l*n3];
+	for (ptrdiff_t j = 0; j < n3; ++j)
+	  nt[j] += a*(EdP32[j] * 0.03125) /* divide by 32 */
+	    + a*gperpdt*(EPave64[j] * 0.015625); /* divide by 64 (extra factor of 1/2 is from P_current + P_previous) */
+      }
     }
 
     // N = GammaInv * Ntmp
     for (int l1 = 0; l1 < L; ++l1) {
-      N[l1] = 0;
-      for (int l2 = 0; l2 < L; ++l2) N[l1] += GammaInv[l1*L+l2] * Ntmp[l2];
+      for (ptrdiff_t j = 0; j < n3; ++j) Nnew[j] = 0;
+      for (int l2 = 0; l2 < L; ++l2) {
+	const realnum g = GammaInv[l1*L+l2];
+	const realnum *nt = &Ntmp[l2*n3];
+	for (ptrdiff_t j = 0; j < n3; ++j) Nnew[j] += g * nt[j];
+      }
+      realnum *N = d->N + l1*ntot + i0;
+      for (ptrdiff_t j = 0; j < n3; ++j) N[j] = Nnew[j];
     }
   }
 
@@ -338,8 +403,7 @@ void multilevel_susceptibility::update_P
 
 	ptrdiff_t o1, o2;
 	gv.cent2yee_offsets(c, o1, o2);
-	o1 *= L; o2 *= L;
-	const realnum *N = d->N;
+	const realnum *Np = d->N + lp*ntot, *Nm = d->N + lm*ntot;
 
 	// directions/strides for offdiagonal terms, similar to update_eh
 	const direction d = component_direction(c);
@@ -356,12 +420,11 @@ void multilevel_susceptibility::update_P
 	  abort("nondiagonal saturable gain is not yet supported");
 	}
 	else { // isotropic
-	  LOOP_OVER_VOL_OWNED(gv, c, i) {
+	  PLOOP_OVER_VOL_OWNED(gv, c, i) {
 	    realnum pcur = p[i];
-	    const realnum *Ni = N + i*L;
 	    // dNi is population inversion for this transition
-	    double dNi = 0.25 * (Ni[lp]+Ni[lp+o1]+Ni[lp+o2]+Ni[lp+o1+o2]
-				 -Ni[lm]-Ni[lm+o1]-Ni[lm+o2]-Ni[lm+o1+o2]);
+	    double dNi = 0.25 * (Np[i]+Np[i+o1]+Np[i+o2]+Np[i+o1+o2]
+				 -Nm[i]-Nm[i+o1]-Nm[i+o2]-Nm[i+o1+o2]);
 	    p[i] = gamma1inv * (pcur * (2 - omega0dtsqrCorrected) 
 				- gamma1 * pp[i]
 				- dtsqr * (st * s[i] * w[i]) * dNi);
@@ -19,6 +19,8 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include <algorithm>
+
 #include "meep.hpp"
 #include "config.h"
 
@@ -32,6 +34,10 @@
 #  include <mpi.h>
 #endif
 
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
 #ifdef IGNORE_SIGFPE
 #  include <signal.h>
 #endif
@@ -79,7 +85,15 @@ bool quiet = false; // defined in meep.h
 
 initialize::initialize(int &argc, char** &argv) {
 #ifdef HAVE_MPI
+#  ifdef _OPENMP
+  // only the master thread makes MPI calls (outside of parallel regions)
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+  if (provided < MPI_THREAD_FUNNELED && omp_get_max_threads() > 1)
+    abort("MPI does not support multithreaded processes (MPI_THREAD_FUNNELED)");
+#  else
   MPI_Init(&argc, &argv);
+#  endif
   int major, minor;
   MPI_Get_version(&major, &minor);
   if (!quiet) master_printf("Using MPI version %d.%d, %d processes\n",
@@ -93,11 +107,16 @@ initialize::initialize(int &argc, char** &argv) {
 #endif
 #ifdef IGNORE_SIGFPE
   signal(SIGFPE, SIG_IGN);
+#endif
+#ifdef _OPENMP
+  if (!quiet) master_printf("Using %d OpenMP threads per process\n",
+			    count_threads());
 #endif
   t_start = wall_time();
 }
 
 initialize::~initialize() {
+  stop_async_output(); // finish writing any asynchronous output
   if (!quiet) master_printf("\nElapsed run time = %g s\n", elapsed_time());
 #ifdef HAVE_MPI
   end_divide_parallel();
@@ -146,6 +165,39 @@ void send(int from, int to, double *data, int size) {
 #endif
 }
 
+void send(int from, int to, float *data, int size) {
+#ifdef HAVE_MPI
+  if (from == to) return;
+  if (size == 0) return;
+  const int me = my_rank();
+  if (from == me) MPI_Send(data, size, MPI_FLOAT, to, 1, mycomm);
+  MPI_Status stat;
+  if (to == me) MPI_Recv(data, size, MPI_FLOAT, from, 1, mycomm, &stat);
+#else
+  UNUSED(from);
+  UNUSED(to);
+  UNUSED(data);
+  UNUSED(size);
+#endif
+}
+
+void send(int from, int to, size_t *data, int size) {
+#ifdef HAVE_MPI
+  if (from == to) return;
+  if (size == 0) return;
+  const int me = my_rank();
+  MPI_Datatype t = sizeof(size_t)==4?MPI_UNSIGNED:MPI_UNSIGNED_LONG_LONG;
+  if (from == me) MPI_Send(data, size, t, to, 1, mycomm);
+  MPI_Status stat;
+  if (to == me) MPI_Recv(data, size, t, from, 1, mycomm, &stat);
+#else
+  UNUSED(from);
+  UNUSED(to);
+  UNUSED(data);
+  UNUSED(size);
+#endif
+}
+
 #if MEEP_SINGLE
 void broadcast(int from, realnum *data, int size) {
 #ifdef HAVE_MPI
@@ -269,6 +321,15 @@ int max_to_all(int in) {
   return out;
 }
 
+void max_to_all(const double *in, double *out, int size) {
+#ifdef HAVE_MPI
+  MPI_Allreduce(in == out ? MPI_IN_PLACE : (void*) in, out, size,
+                MPI_DOUBLE,MPI_MAX,mycomm);
+#else
+  if (in != out) memcpy(out, in, sizeof(double) * size);
+#endif
+}
+
 ivec max_to_all(const ivec &pt) {
   int in[5], out[5];
   for (int i=0; i<5; ++i) in[i] = out[i] = pt.in_direction(direction(i));
@@ -306,9 +367,10 @@ double sum_to_all(double in) {
 
 void sum_to_all(const double *in, double *out, int size) {
 #ifdef HAVE_MPI
-  MPI_Allreduce((void*) in, out, size, MPI_DOUBLE,MPI_SUM,mycomm);
+  MPI_Allreduce(in == out ? MPI_IN_PLACE : (void*) in, out, size,
+                MPI_DOUBLE,MPI_SUM,mycomm);
 #else
-  memcpy(out, in, sizeof(double) * size);
+  if (in != out) memcpy(out, in, sizeof(double) * size);
 #endif
 }
 
@@ -503,6 +565,22 @@ int count_processors() {
 #endif
 }
 
+int count_threads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+void set_num_threads(int nthreads) {
+#ifdef _OPENMP
+  if (nthreads > 0) omp_set_num_threads(nthreads);
+#else
+  UNUSED(nthreads);
+#endif
+}
+
 bool with_mpi() {
 #ifdef HAVE_MPI
   return true;
@@ -512,50 +590,97 @@ bool with_mpi() {
 }
 
 void fields::boundary_communications(field_type ft) {
-  // Communicate the data around!
-#if 0 // This is the blocking version, which should always be safe!
-  for (int noti=0;noti<num_chunks;noti++)
-    for (int j=0;j<num_chunks;j++) {
-      const int i = (noti+j)%num_chunks;
-      const int pair = j+i*num_chunks;
-      DOCMP {
-        send(chunks[j]->n_proc(), chunks[i]->n_proc(),
-             comm_blocks[ft][pair], comm_size_tot(ft,pair));
-      }
-    }
+  start_boundary_communications(ft);
+  finish_boundary_communications(ft);
+}
+
+#ifdef HAVE_MPI
+static bool comm_pair_less(const comm_pair &a, const comm_pair &b) {
+  return a.pair < b.pair;
+}
 #endif
+
+/* Set up persistent MPI requests for the sends and receives of the
+   comm_blocks (which must not be reallocated until
+   free_boundary_communications is called), so that each timestep only
+   needs to start them and wait for them.  This is called by
+   connect_chunks after the comm_pairs are found. */
+void fields::init_boundary_communications() {
 #ifdef HAVE_MPI
-  const int maxreq = num_chunks*num_chunks;
-  MPI_Request *reqs = new MPI_Request[maxreq];
-  MPI_Status *stats = new MPI_Status[maxreq];
-  int reqnum = 0;
-  int *tagto = new int[count_processors()];
-  for (int i=0;i<count_processors();i++) tagto[i] = 0;
-  for (int noti=0;noti<num_chunks;noti++)
-    for (int j=0;j<num_chunks;j++) {
-      const int i = (noti+j)%num_chunks;
-      const int pair = j+i*num_chunks;
+  /* the tags of the messages to/from each process are numbered in the
+     order of the pair index, which is the same for both processes */
+  std::vector<comm_pair> pairs;
+  FOR_FIELD_TYPES(ft) {
+    pairs.clear();
+    for (size_t k = 0; k < comm_pairs[ft][Outgoing].size(); ++k)
+      if (!chunks[comm_pairs[ft][Outgoing][k].pair / num_chunks]->is_mine())
+      	pairs.push_back(comm_pairs[ft][Outgoing][k]);
+    for (size_t k = 0; k < comm_pairs[ft][Incoming].size(); ++k)
+      if (!chunks[comm_pairs[ft][Incoming][k].pair % num_chunks]->is_mine())
+      	pairs.push_back(comm_pairs[ft][Incoming][k]);
+    std::sort(pairs.begin(), pairs.end(), comm_pair_less);
+
+    MPI_Request *reqs = new MPI_Request[pairs.size()];
+    std::vector<int> tagto(count_processors(), 0);
+    for (size_t k = 0; k < pairs.size(); ++k) {
+      const int pair = pairs[k].pair;
+      const int i = pair / num_chunks, j = pair % num_chunks;
       const size_t comm_size = comm_size_tot(ft,pair);
-      if (comm_size > 0) {
-        if (comm_size > 2147483647) // MPI uses int for size to send/recv
-          abort("communications size too big for MPI");
-      	if (chunks[j]->is_mine() && !chunks[i]->is_mine())
-      	  MPI_Isend(comm_blocks[ft][pair], (int) comm_size,
-      		    MPI_REALNUM, chunks[i]->n_proc(),
-      		    tagto[chunks[i]->n_proc()]++,
-      		    mycomm, &reqs[reqnum++]);
-      	if (chunks[i]->is_mine() && !chunks[j]->is_mine())
-      	  MPI_Irecv(comm_blocks[ft][pair], (int) comm_size,
-      		    MPI_REALNUM, chunks[j]->n_proc(),
-      		    tagto[chunks[j]->n_proc()]++,
-      		    mycomm, &reqs[reqnum++]);
+      if (comm_size > 2147483647) // MPI uses int for size to send/recv
+      	abort("communications size too big for MPI");
+      if (chunks[j]->is_mine()) {
+      	const int to = chunks[i]->n_proc();
+      	MPI_Send_init(comm_blocks[ft][pair], (int) comm_size,
+      		      MPI_REALNUM, to, tagto[to]++, mycomm, &reqs[k]);
+      }
+      else {
+      	const int from = chunks[j]->n_proc();
+      	MPI_Recv_init(comm_blocks[ft][pair], (int) comm_size,
+      		      MPI_REALNUM, from, tagto[from]++, mycomm, &reqs[k]);
       }
     }
-  delete[] tagto;
-  if (reqnum > maxreq) abort("Too many requests!!!\n");
-  if (reqnum > 0) MPI_Waitall(reqnum, reqs, stats);
-  delete[] reqs;
-  delete[] stats;
+    comm_requests[ft] = (void *) reqs;
+    num_comm_requests[ft] = (int) pairs.size();
+  }
+#endif
+}
+
+void fields::free_boundary_communications() {
+#ifdef HAVE_MPI
+  int finalized = 0;
+  MPI_Finalized(&finalized);
+  FOR_FIELD_TYPES(ft) {
+    MPI_Request *reqs = (MPI_Request *) comm_requests[ft];
+    if (!finalized)
+      for (int k = 0; k < num_comm_requests[ft]; ++k)
+      	MPI_Request_free(&reqs[k]);
+    delete[] reqs;
+    comm_requests[ft] = NULL;
+    num_comm_requests[ft] = 0;
+  }
+#endif
+}
+
+/* Start the sends and receives of the comm_blocks for field type ft;
+   the communications are completed (and the comm_blocks may be used
+   again) only after finish_boundary_communications(ft).  In between,
+   the caller can do computations that do not touch the comm_blocks or
+   the not-owned fields of type ft. */
+void fields::start_boundary_communications(field_type ft) {
+#ifdef HAVE_MPI
+  if (num_comm_requests[ft] > 0)
+    MPI_Startall(num_comm_requests[ft], (MPI_Request *) comm_requests[ft]);
+#else
+  (void) ft; // unused
+#endif
+}
+
+// wait for the communications started by start_boundary_communications(ft)
+void fields::finish_boundary_communications(field_type ft) {
+#ifdef HAVE_MPI
+  if (num_comm_requests[ft] > 0)
+    MPI_Waitall(num_comm_requests[ft], (MPI_Request *) comm_requests[ft],
+      		MPI_STATUSES_IGNORE);
 #else
   (void) ft; // unused
 #endif
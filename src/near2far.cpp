@@ -20,7 +20,11 @@
    compute the fields on a "far" surface via the homogeneous-medium Green's
    function in 2d or 3d. */
 
+#include <algorithm>
+#include <vector>
+
 #include <meep.hpp>
+#include "meep_internals.hpp"
 #include <assert.h>
 #include "config.h"
 
@@ -32,15 +36,24 @@ dft_near2far::dft_near2far(dft_chunk *F_,
                            double fmin, double fmax, int Nf,
                            double eps_, double mu_,
                            const volume &where_):
- Nfreq(Nf), F(F_), eps(eps_), mu(mu_), where(where_)
+ freq(dft_freqs(fmin, fmax, Nf)), Nfreq(Nf), F(F_), eps(eps_), mu(mu_), where(where_)
 {
   if (Nf <= 1) fmin = fmax = (fmin + fmax) * 0.5;
   freq_min = fmin;
   dfreq = Nf <= 1 ? 0.0 : (fmax - fmin) / (Nf - 1);
 }
 
+dft_near2far::dft_near2far(dft_chunk *F_, const vector<double> &freq_,
+                           double eps_, double mu_,
+                           const volume &where_):
+ freq(freq_), Nfreq(freq_.size()), F(F_), eps(eps_), mu(mu_), where(where_)
+{
+  freq_min = freq.empty() ? 0.0 : freq[0];
+  dfreq = dft_freqs_spacing(freq);
+}
+
 dft_near2far::dft_near2far(const dft_near2far &f):
- freq_min(f.freq_min), dfreq(f.dfreq), Nfreq(f.Nfreq), 
+ freq(f.freq), freq_min(f.freq_min), dfreq(f.dfreq), Nfreq(f.Nfreq), 
  F(f.F), eps(f.eps), mu(f.mu), where(f.where)
 { }
 
@@ -239,18 +252,23 @@ void green2d(std::complex<double> *EH, const vec &x,
     }
 }
 
-void dft_near2far::farfield_lowlevel(std::complex<double> *EH, const vec &x)
-{
-    if (x.dim != D3 && x.dim != D2)
-        abort("only 2d or 3d far-field computation is supported");
-    greenfunc green = x.dim == D2 ? green2d : green3d;
-
-    std::complex<double> EH6[6];
-    for (int i = 0; i < 6 * Nfreq; ++i)
-        EH[i] = 0.0;
-
+/* A near-field point, i.e. an equivalent current source for the far
+   fields, with its Nfreq DFT amplitudes. */
+struct farfield_source {
+    vec x0;
+    component c0;
+    const complex<realnum> *dft;
+};
+
+/* gather all of the (local) near-field points of the chunks F into src,
+   returning the largest resolution of the chunks */
+static double farfield_sources(dft_chunk *F, int Nfreq,
+                               vector<farfield_source> &src) {
+    double res = 0;
     for (dft_chunk *f = F; f; f = f->next_in_dft) {
         assert(Nfreq == f->Nomega);
+        f->flush_dft();
+        res = max(res, f->fc->gv.a);
 
         component c0 = component(f->vc); /* equivalent source component */
 
@@ -258,35 +276,69 @@ void dft_near2far::farfield_lowlevel(std::complex<double> *EH, const vec &x)
         size_t idx_dft = 0;
         LOOP_OVER_IVECS(f->fc->gv, f->is, f->ie, idx) {
             IVEC_LOOP_LOC(f->fc->gv, x0);
-            x0 = f->S.transform(x0, f->sn) + rshift;
-            for (int i = 0; i < Nfreq; ++i) {
-                double freq = freq_min + i*dfreq;
-                green(EH6, x, freq, eps, mu, x0, c0, f->dft[Nfreq*idx_dft+i]);
-                for (int j = 0; j < 6; ++j) EH[i*6 + j] += EH6[j];
-            }
+            farfield_source s = { f->S.transform(x0, f->sn) + rshift, c0,
+                                  f->dft + Nfreq*idx_dft };
+            src.push_back(s);
             idx_dft++;
         }
     }
+    return res;
 }
 
-std::complex<double> *dft_near2far::farfield(const vec &x) {
+void dft_near2far::farfields_lowlevel(std::complex<double> *EH,
+                                      const vec *x, size_t npts)
+{
+    if (npts == 0) return;
+    if (x[0].dim != D3 && x[0].dim != D2)
+        abort("only 2d or 3d far-field computation is supported");
+    greenfunc green = x[0].dim == D2 ? green2d : green3d;
+
+    vector<farfield_source> src;
+    farfield_sources(F, Nfreq, src);
+
+    /* the points are independent, so they are computed in parallel */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 4) if (npts > 1)
+#endif
+    for (ptrdiff_t ix = 0; ix < ptrdiff_t(npts); ++ix) {
+        std::complex<double> EH6[6], *EHx = EH + ix * 6 * Nfreq;
+        for (int i = 0; i < 6 * Nfreq; ++i)
+            EHx[i] = 0.0;
+        for (size_t j = 0; j < src.size(); ++j)
+            for (int i = 0; i < Nfreq; ++i) {
+                green(EH6, x[ix], freq[i], eps, mu, src[j].x0, src[j].c0,
+                      src[j].dft[i]);
+                for (int k = 0; k < 6; ++k) EHx[i*6 + k] += EH6[k];
+            }
+    }
+}
+
+void dft_near2far::farfield_lowlevel(std::complex<double> *EH, const vec &x)
+{
+    farfields_lowlevel(EH, &x, 1);
+}
+
+std::complex<double> *dft_near2far::farfields(const vec *x, size_t npts) {
     std::complex<double> *EH, *EH_local;
-    EH_local = new std::complex<double>[6 * Nfreq];
-    farfield_lowlevel(EH_local, x);
-    EH = new std::complex<double>[6 * Nfreq];
-    sum_to_all(EH_local, EH, 6 * Nfreq);
+    EH_local = new std::complex<double>[6 * Nfreq * npts];
+    farfields_lowlevel(EH_local, x, npts);
+    EH = new std::complex<double>[6 * Nfreq * npts];
+    sum_to_all(EH_local, EH, 6 * Nfreq * npts);
     delete[] EH_local;
     return EH;
 }
 
-void dft_near2far::save_farfields(const char *fname, const char *prefix,
-                                  const volume &where, double resolution) {
-    /* compute output grid size etc. */
-    size_t dims[4] = {1,1,1,1};
-    double dx[3] = {0,0,0};
-    direction dirs[3] = {X,Y,Z};
+std::complex<double> *dft_near2far::farfield(const vec &x) {
+    return farfields(&x, 1);
+}
+
+/* compute the far-field grid for where and resolution, as in
+   save_farfields: returns the rank, and sets dims[0..2] (1 beyond the
+   rank), the grid spacing dx, and the directions dirs of the grid */
+static int farfield_grid(const volume &where, double resolution,
+                         size_t dims[3], double dx[3], direction dirs[3]) {
     int rank = 0;
-    size_t N = 1;
+    for (int r = 0; r < 3; ++r) { dims[r] = 1; dx[r] = 0; dirs[r] = direction(r); }
     LOOP_OVER_DIRECTIONS(where.dim, d) {
         dims[rank] = int(floor(where.in_direction(d) * resolution));
         if (dims[rank] <= 1) {
@@ -295,9 +347,259 @@ void dft_near2far::save_farfields(const char *fname, const char *prefix,
         }
         else
             dx[rank] = where.in_direction(d) / (dims[rank] - 1);
-        N *= dims[rank];
         dirs[rank++] = d;
     }
+    return rank;
+}
+
+static vec farfield_grid_point(const volume &where, int rank,
+                               const double dx[3], const direction dirs[3],
+                               size_t i0, size_t i1, size_t i2) {
+    vec x(where.dim);
+    size_t i[3] = {i0, i1, i2};
+    for (int r = 0; r < rank; ++r)
+        x.set_direction(dirs[r], where.in_direction_min(dirs[r]) + i[r]*dx[r]);
+    return x;
+}
+
+/* Cubic (4-point) Lagrange interpolation along one direction of the
+   far-field grid, from a coarse subset of about n/m of the n grid
+   points (including both ends) to all n points. */
+struct farfield_interp {
+    vector<size_t> nodes; // grid indices of the coarse points
+    vector<size_t> start; // first of the q coarse points used for grid index i
+    vector<double> w; // the q weights for grid index i are w[i*q..i*q+q-1]
+    size_t q;
+
+    farfield_interp(size_t n, size_t m) {
+        size_t nc = n <= 4 || m <= 1 ? n - 1 : (n - 2 + m) / m; // # intervals
+        if (nc < 3) nc = std::min(n - 1, size_t(3));
+        for (size_t k = 0; k <= nc; ++k)
+            nodes.push_back(nc ? (2*k*(n-1) + nc) / (2*nc) : 0);
+        q = std::min(nodes.size(), size_t(4));
+        start.resize(n);
+        w.resize(n * q);
+        size_t k = 0;
+        for (size_t i = 0; i < n; ++i) {
+            while (k + 1 < nc && nodes[k+1] <= i) ++k;
+            size_t s = k > 0 ? k - 1 : 0;
+            if (s + q > nodes.size()) s = nodes.size() - q;
+            start[i] = s;
+            for (size_t j = 0; j < q; ++j) {
+                double wj = 1;
+                for (size_t l = 0; l < q; ++l)
+                    if (l != j)
+                        wj *= (double(i) - double(nodes[s+l]))
+                            / (double(nodes[s+j]) - double(nodes[s+l]));
+                w[i*q + j] = wj;
+            }
+        }
+    }
+
+    bool identity() const { return nodes.size() == start.size(); }
+
+    /* interpolate the array A, of shape (n[0],n[1],n[2]) x 6, along
+       axis d from the coarse points to all points, storing the result
+       in B and updating n[d] */
+    void apply(const vector<complex<double> > &A, vector<complex<double> > &B,
+               size_t n[3], int d) const {
+        size_t outer = 1, inner = 6;
+        for (int r = 0; r < d; ++r) outer *= n[r];
+        for (int r = d + 1; r < 3; ++r) inner *= n[r];
+        const size_t nin = n[d], nout = start.size();
+        B.assign(outer * nout * inner, 0.0);
+        for (size_t o = 0; o < outer; ++o)
+            for (size_t i = 0; i < nout; ++i) {
+                complex<double> *b = &B[(o*nout + i) * inner];
+                for (size_t j = 0; j < q; ++j) {
+                    const complex<double> *a = &A[(o*nin + start[i]+j) * inner];
+                    const double wj = w[i*q + j];
+                    for (size_t l = 0; l < inner; ++l) b[l] += wj * a[l];
+                }
+            }
+        n[d] = nout;
+    }
+};
+
+/* 4-point Lagrange interpolation of exp(i*phi*t) between nodes spaced
+   by 1 in t has a relative error of at most about 0.0234*phi^4. */
+#define FARFIELD_INTERP_ERR 0.0234
+
+void dft_near2far::farfield_grid_lowlevel(std::complex<double> *EH,
+                                          const volume &where,
+                                          double resolution, double tol)
+{
+    if (where.dim != D3 && where.dim != D2)
+        abort("only 2d or 3d far-field computation is supported");
+    greenfunc green = where.dim == D2 ? green2d : green3d;
+
+    size_t dims[3];
+    double dx[3];
+    direction dirs[3];
+    const int rank = farfield_grid(where, resolution, dims, dx, dirs);
+    const size_t N = dims[0] * dims[1] * dims[2];
+    vector<vec> pts;
+    pts.reserve(N);
+    for (size_t i0 = 0; i0 < dims[0]; ++i0)
+        for (size_t i1 = 0; i1 < dims[1]; ++i1)
+            for (size_t i2 = 0; i2 < dims[2]; ++i2)
+                pts.push_back(farfield_grid_point(where, rank, dx, dirs,
+                                                  i0, i1, i2));
+
+    if (tol <= 0) { // brute-force summation over all near-field points
+        farfields_lowlevel(EH, &pts[0], N);
+        return;
+    }
+    for (size_t i = 0; i < N * 6 * Nfreq; ++i)
+        EH[i] = 0.0;
+
+    /* Otherwise, the near-field points are grouped into clusters, about a
+       wavelength wide, of (typically) many points.  For a cluster of
+       radius a centered at c, the far fields times |x-c|^p exp(-ik|x-c|)
+       (with p = 1 in 3d or 1/2 in 2d, the decay rate of the Green's
+       function) are smooth functions of x away from the cluster: they
+       change by a phase of at most ka/(|x-c|-a) per unit distance, plus
+       slowly varying amplitude terms.  So, for each cluster far enough
+       from the far-field grid, the fields are summed directly only on a
+       coarse subgrid and are then interpolated to the whole grid.  The
+       subgrid spacing is chosen so that the interpolation error is about
+       tol.  Any other clusters are summed directly on the whole grid. */
+
+    double fmax = 0;
+    for (int i = 0; i < Nfreq; ++i) fmax = max(fmax, fabs(freq[i]));
+    const double n = sqrt(eps*mu), kmax = 2*pi*fmax*n;
+
+    vector<farfield_source> src;
+    const double res_near = farfield_sources(F, Nfreq, src);
+    if (src.empty()) return;
+
+    /* sort the near-field points into cubes of (at least) a wavelength */
+    const double B = max(fmax > 0 ? 1 / (fmax*n) : 0.0, 8 / res_near);
+    vector<pair<long long, size_t> > keys(src.size());
+    for (size_t j = 0; j < src.size(); ++j) {
+        long long key = 0;
+        LOOP_OVER_DIRECTIONS(where.dim, d)
+            key = (key << 20) + (long long) floor(src[j].x0.in_direction(d) / B)
+                + (1 << 19);
+        keys[j] = make_pair(key, j);
+    }
+    sort(keys.begin(), keys.end());
+
+    /* bounding box of the far-field grid */
+    vec gmin(where.dim), gmax(where.dim);
+    for (int r = 0; r < rank; ++r) {
+        gmin.set_direction(dirs[r], where.in_direction_min(dirs[r]));
+        gmax.set_direction(dirs[r], where.in_direction_min(dirs[r])
+                           + (dims[r] - 1) * dx[r]);
+    }
+
+    const double p = where.dim == D2 ? 0.5 : 1.0;
+    const double phimax = pow(tol / (rank * FARFIELD_INTERP_ERR), 0.25);
+    vector<double> rc(N);
+    vector<complex<double> > U, A, A2;
+
+    for (size_t j0 = 0, j1; j0 < keys.size(); j0 = j1) {
+        for (j1 = j0 + 1; j1 < keys.size() && keys[j1].first == keys[j0].first; ++j1)
+            ;
+        const size_t nc = j1 - j0;
+
+        /* cluster center c, radius a, and distance R from the grid */
+        vec cmin = src[keys[j0].second].x0, cmax = cmin;
+        for (size_t j = j0; j < j1; ++j)
+            LOOP_OVER_DIRECTIONS(where.dim, d) {
+                double xd = src[keys[j].second].x0.in_direction(d);
+                cmin.set_direction(d, min(cmin.in_direction(d), xd));
+                cmax.set_direction(d, max(cmax.in_direction(d), xd));
+            }
+        const vec c = (cmin + cmax) * 0.5;
+        double a = 0;
+        for (size_t j = j0; j < j1; ++j)
+            a = max(a, abs(src[keys[j].second].x0 - c));
+        vec cg = c;
+        for (int r = 0; r < rank; ++r)
+            cg.set_direction(dirs[r], max(gmin.in_direction(dirs[r]),
+                                          min(gmax.in_direction(dirs[r]),
+                                              c.in_direction(dirs[r]))));
+        const double R = abs(c - cg);
+
+        /* choose the subgrid, if any */
+        size_t nsub = 1, m[3] = {1,1,1};
+        if (R > 2*a) {
+            const double H = phimax * (R - a) / (kmax * a + 1);
+            for (int r = 0; r < rank; ++r)
+                if (dx[r] > 0) m[r] = size_t(max(1.0, floor(H / dx[r])));
+        }
+        farfield_interp I0(dims[0], m[0]), I1(dims[1], m[1]), I2(dims[2], m[2]);
+        nsub = I0.nodes.size() * I1.nodes.size() * I2.nodes.size();
+        const bool interp = nsub < N && nc * nsub + 4 * N < nc * N;
+
+        /* direct summation over the whole grid, or else on the subgrid */
+        vector<vec> xsub;
+        if (interp)
+            for (size_t k0 = 0; k0 < I0.nodes.size(); ++k0)
+                for (size_t k1 = 0; k1 < I1.nodes.size(); ++k1)
+                    for (size_t k2 = 0; k2 < I2.nodes.size(); ++k2)
+                        xsub.push_back(pts[(I0.nodes[k0] * dims[1] + I1.nodes[k1])
+                                           * dims[2] + I2.nodes[k2]]);
+        const vec *x = interp ? &xsub[0] : &pts[0];
+        const size_t nx = interp ? nsub : N;
+        if (interp) U.assign(nsub * Nfreq * 6, 0.0);
+        complex<double> *Ux0 = interp ? &U[0] : EH;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 4) if (nx * nc > 1024)
+#endif
+        for (ptrdiff_t ix = 0; ix < ptrdiff_t(nx); ++ix) {
+            complex<double> EH6[6], *Ux = Ux0 + ix * Nfreq * 6;
+            for (size_t j = j0; j < j1; ++j) {
+                const farfield_source &s = src[keys[j].second];
+                for (int i = 0; i < Nfreq; ++i) {
+                    green(EH6, x[ix], freq[i], eps, mu, s.x0, s.c0, s.dft[i]);
+                    for (int k = 0; k < 6; ++k) Ux[i*6 + k] += EH6[k];
+                }
+            }
+        }
+        if (!interp) continue;
+
+        vector<double> rsub(nsub);
+        for (size_t isub = 0; isub < nsub; ++isub)
+            rsub[isub] = abs(xsub[isub] - c);
+        for (size_t idx = 0; idx < N; ++idx)
+            rc[idx] = abs(pts[idx] - c);
+
+        /* remove the phase and decay, interpolate, and restore them */
+        for (int i = 0; i < Nfreq; ++i) {
+            const double k = 2*pi*freq[i]*n;
+            A.resize(nsub * 6);
+            for (size_t isub = 0; isub < nsub; ++isub) {
+                complex<double> ph = polar(pow(rsub[isub], p), -k*rsub[isub]);
+                for (int l = 0; l < 6; ++l)
+                    A[isub*6 + l] = U[(isub*Nfreq + i)*6 + l] * ph;
+            }
+            size_t nA[3] = {I0.nodes.size(), I1.nodes.size(), I2.nodes.size()};
+            if (!I2.identity()) { I2.apply(A, A2, nA, 2); A.swap(A2); }
+            if (!I1.identity()) { I1.apply(A, A2, nA, 1); A.swap(A2); }
+            if (!I0.identity()) { I0.apply(A, A2, nA, 0); A.swap(A2); }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (N > 1024)
+#endif
+            for (ptrdiff_t idx = 0; idx < ptrdiff_t(N); ++idx) {
+                complex<double> ph = polar(pow(rc[idx], -p), k*rc[idx]);
+                for (int l = 0; l < 6; ++l)
+                    EH[(idx*Nfreq + i)*6 + l] += A[idx*6 + l] * ph;
+            }
+        }
+    }
+}
+
+void dft_near2far::save_farfields(const char *fname, const char *prefix,
+                                  const volume &where, double resolution,
+                                  double tol) {
+    /* compute output grid size etc. */
+    size_t dims[4] = {1,1,1,1};
+    double dx[3];
+    direction dirs[3];
+    int rank = farfield_grid(where, resolution, dims, dx, dirs);
+    size_t N = dims[0] * dims[1] * dims[2];
 
     if (N * Nfreq < 1) return; /* nothing to output */
 
@@ -305,30 +607,17 @@ void dft_near2far::save_farfields(const char *fname, const char *prefix,
     realnum *EH = new realnum[6*2*N*Nfreq];
     realnum *EH_ = new realnum[6*2*N*Nfreq]; // temp array for sum_to_master
 
-    /* fields for farfield_lowlevel for a single output point x */
-    std::complex<double> *EH1 = new std::complex<double>[6*Nfreq];
-
-    vec x(where.dim);
-    for (size_t i0 = 0; i0 < dims[0]; ++i0) {
-        x.set_direction(dirs[0], where.in_direction_min(dirs[0]) + i0*dx[0]);
-        for (size_t i1 = 0; i1 < dims[1]; ++i1) {
-            x.set_direction(dirs[1],
-                            where.in_direction_min(dirs[1]) + i1*dx[1]);
-            for (size_t i2 = 0; i2 < dims[2]; ++i2) {
-                x.set_direction(dirs[2],
-                                where.in_direction_min(dirs[2]) + i2*dx[2]);
-                farfield_lowlevel(EH1, x);
-                ptrdiff_t idx = (i0 * dims[1] + i1) * dims[2] + i2;
-                for (int i = 0; i < Nfreq; ++i)
-                    for (int k = 0; k < 6; ++k) {
-                        EH_[((k * 2 + 0) * N + idx) * Nfreq + i] =
-                            real(EH1[i * 6 + k]);
-                        EH_[((k * 2 + 1) * N + idx) * Nfreq + i] =
-                            imag(EH1[i * 6 + k]);
-                    }
+    /* N x Nfreq x 6 fields from farfield_grid_lowlevel */
+    std::complex<double> *EH1 = new std::complex<double>[N*6*Nfreq];
+    farfield_grid_lowlevel(EH1, where, resolution, tol);
+    for (size_t idx = 0; idx < N; ++idx)
+        for (int i = 0; i < Nfreq; ++i)
+            for (int k = 0; k < 6; ++k) {
+                EH_[((k * 2 + 0) * N + idx) * Nfreq + i] =
+                    real(EH1[(idx * Nfreq + i) * 6 + k]);
+                EH_[((k * 2 + 1) * N + idx) * Nfreq + i] =
+                    imag(EH1[(idx * Nfreq + i) * 6 + k]);
             }
-        }
-    }
 
     delete[] EH1;
     sum_to_master(EH_, EH, 6*2*N*Nfreq);
@@ -366,6 +655,11 @@ static double approxeq(double a, double b) { return fabs(a - b) < 0.5e-11 * (fab
 
 dft_near2far fields::add_dft_near2far(const volume_list *where,
 				double freq_min, double freq_max, int Nfreq){
+  return add_dft_near2far(where, dft_freqs(freq_min, freq_max, Nfreq));
+}
+
+dft_near2far fields::add_dft_near2far(const volume_list *where,
+				const vector<double> &freq){
   dft_chunk *F = 0; /* E and H chunks*/
   double eps = 0, mu = 0;
   volume everywhere = where->v;
@@ -409,13 +703,13 @@ dft_near2far fields::add_dft_near2far(const volume_list *where,
               double s = j == 0 ? 1 : -1; /* sign of n x c */
               if (is_electric(c)) s = -s;
 
-              F = add_dft(c, w->v, freq_min, freq_max, Nfreq,
+              F = add_dft(c, w->v, freq,
                           true, s*w->weight, F, false, 1.0, false, c0);
           }
       }
   }
 
-  return dft_near2far(F, freq_min, freq_max, Nfreq, eps, mu, everywhere);
+  return dft_near2far(F, freq, eps, mu, everywhere);
 }
 
 } // namespace meep
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include <complex>
+#include <algorithm>
 
 #include "meep.hpp"
 #include "meep_internals.hpp"
@@ -100,6 +101,15 @@ complex<double> gaussian_src_time::dipole(double time) const
   return exp(-tt*tt / (2*width*width)) * polar(1.0, -2*pi*freq*tt) * amp;
 }
 
+/* the spectrum of the Gaussian (times the truncation at the cutoff)
+   falls off as exp(-(2*pi*(f-freq)*width)^2/2), so it is as small as
+   the error from the truncation itself for |f - freq| beyond
+   cutoff / (2*pi*width^2) */
+double gaussian_src_time::max_frequency() const
+{
+  return fabs(freq) + cutoff / (2*pi*width*width);
+}
+
 bool gaussian_src_time::is_equal(const src_time &t) const
 {
      const gaussian_src_time *tp = dynamic_cast<const gaussian_src_time*>(&t);
@@ -156,25 +166,68 @@ bool custom_src_time::is_equal(const src_time &t) const
 
 /*********************************************************************/
 
+/* The source points are stored compactly (see the src_vol class),
+   as runs of equally spaced grid indices instead of an index per point,
+   and with the amplitudes in realnum precision, without imaginary
+   parts if they are real, and factored into a per-run amplitude times
+   a single profile if they are separable.  For a plane source (e.g. an
+   eigenmode source), the runs are the lines of points along the last
+   (contiguous) dimension of the chunk, and for separable amplitudes
+   (e.g. a uniform or Gaussian plane source) the amplitude storage is
+   only proportional to the number of lines plus their length.  The
+   runs also allow subtract_from to inject the sources into the fields
+   with tight, vectorizable loops over the spans of the field arrays. */
+
+static bool index_less(const pair<ptrdiff_t, complex<double> > &a,
+		       const pair<ptrdiff_t, complex<double> > &b) {
+  return a.first < b.first;
+}
+
 src_vol::src_vol(component cc, src_time *st, size_t n, ptrdiff_t *ind, complex<double> *amps) {
   c = cc;
   if (is_D(c)) c = direction_component(Ex, component_direction(c));
   if (is_B(c)) c = direction_component(Hx, component_direction(c));
   t = st; next = NULL;
-  npts = n;
-  index = ind;
-  A = amps;
+  amp_re = amp_im = NULL; run_amp = NULL;
+
+  bool sorted = true;
+  for (size_t j = 1; j < n && sorted; j++) sorted = ind[j-1] < ind[j];
+  if (!sorted) { // sort by index, adding the amplitudes of repeated indices
+    vector< pair<ptrdiff_t, complex<double> > > pts(n);
+    for (size_t j = 0; j < n; j++) pts[j] = make_pair(ind[j], amps[j]);
+    stable_sort(pts.begin(), pts.end(), index_less);
+    size_t m = 0;
+    for (size_t j = 0; j < n; j++)
+      if (m > 0 && ind[m-1] == pts[j].first)
+	amps[m-1] += pts[j].second;
+      else {
+	ind[m] = pts[j].first;
+	amps[m++] = pts[j].second;
+      }
+    n = m;
+  }
+
+  compress(n, ind, amps);
+  delete[] ind;
+  delete[] amps;
 }
 
 src_vol::src_vol(const src_vol &sv) {
   c = sv.c;
   t = sv.t;
   npts = sv.npts;
-  index = new ptrdiff_t[npts];
-  A = new complex<double>[npts];
-  for (size_t j=0; j<npts; j++) {
-    index[j] = sv.index[j];
-    A[j] = sv.A[j];
+  runs = sv.runs;
+  size_t namp = sv.run_amp ? (runs.empty() ? 0 : runs[0].count) : npts;
+  amp_re = new realnum[namp];
+  amp_im = sv.amp_im ? new realnum[namp] : NULL;
+  for (size_t q = 0; q < namp; q++) {
+    amp_re[q] = sv.amp_re[q];
+    if (amp_im) amp_im[q] = sv.amp_im[q];
+  }
+  run_amp = NULL;
+  if (sv.run_amp) {
+    run_amp = new complex<double>[runs.size()];
+    for (size_t k = 0; k < runs.size(); k++) run_amp[k] = sv.run_amp[k];
   }
   if (sv.next)
     next = new src_vol(*sv.next);
@@ -182,18 +235,121 @@ src_vol::src_vol(const src_vol &sv) {
     next = NULL;
 }
 
+/* Set the points to the N (sorted) indices INDEX with amplitudes A. */
+void src_vol::compress(size_t n, const ptrdiff_t *index, const complex<double> *A) {
+  delete[] amp_re; delete[] amp_im; delete[] run_amp;
+  npts = n;
+
+  runs.clear();
+  for (size_t j = 0; j < n; ) {
+    index_run r;
+    r.start = index[j];
+    r.stride = j + 1 < n ? index[j+1] - index[j] : 1;
+    r.count = 1;
+    while (j + r.count < n
+	   && index[j + r.count] == r.start + ptrdiff_t(r.count) * r.stride)
+      ++r.count;
+    runs.push_back(r);
+    j += r.count;
+  }
+
+  /* Check whether the amplitudes are separable, i.e. whether each run
+     is a multiple (to within roundoff) of the run with the largest
+     amplitude, normalized by its largest amplitude. */
+  bool separable = runs.size() > 1 && runs[0].count > 1;
+  for (size_t k = 1; k < runs.size() && separable; k++)
+    separable = runs[k].count == runs[0].count;
+  size_t count = separable ? runs[0].count : 0;
+  double Amax = 0;
+  size_t jmax = 0;
+  for (size_t j = 0; j < n; j++)
+    if (abs(A[j]) > Amax) { Amax = abs(A[j]); jmax = j; }
+  separable = separable && Amax > 0;
+  const size_t k0 = separable ? jmax / count : 0, m0 = jmax - k0 * count;
+  vector< complex<double> > u;
+  if (separable) {
+    u.resize(runs.size());
+    for (size_t k = 0; k < runs.size(); k++) u[k] = A[k*count + m0] / Amax;
+    for (size_t k = 0; k < runs.size() && separable; k++)
+      for (size_t m = 0; m < count && separable; m++) {
+	const complex<double> a = A[k*count + m];
+	const double err = abs(a - u[k] * (A[k0*count + m] * (Amax / A[jmax])));
+	separable = err <= 1e-14 * Amax + 1e-12 * abs(a);
+      }
+  }
+
+  /* the profile of separable amplitudes is A[k0*count + m] / phase, which
+     is real (to within roundoff) if the run k0 has a constant phase */
+  const complex<double> phase = separable ? A[jmax] / Amax : 1.0;
+  const size_t namp = separable ? count : n;
+  const complex<double> *amp = separable ? A + k0*count : A;
+  bool real_amps = true;
+  for (size_t q = 0; q < namp && real_amps; q++)
+    real_amps = fabs(imag(amp[q] / phase)) <= 1e-15 * abs(amp[q]);
+  amp_re = new realnum[namp];
+  amp_im = real_amps ? NULL : new realnum[namp];
+  for (size_t q = 0; q < namp; q++) {
+    const complex<double> a = amp[q] / phase;
+    amp_re[q] = real(a);
+    if (amp_im) amp_im[q] = imag(a);
+  }
+  run_amp = NULL;
+  if (separable) {
+    run_amp = new complex<double>[runs.size()];
+    for (size_t k = 0; k < runs.size(); k++) run_amp[k] = u[k];
+  }
+}
+
+void src_vol::get_points(ptrdiff_t *index, complex<double> *A) const {
+  size_t j = 0;
+  for (size_t k = 0; k < runs.size(); k++)
+    for (size_t m = 0; m < runs[k].count; m++, j++) {
+      const size_t q = run_amp ? m : j;
+      index[j] = runs[k].start + ptrdiff_t(m) * runs[k].stride;
+      A[j] = complex<double>(amp_re[q], amp_im ? amp_im[q] : 0.0);
+      if (run_amp) A[j] *= run_amp[k];
+    }
+}
+
+size_t src_vol::memory_used() const {
+  size_t namp = run_amp ? runs[0].count : npts;
+  return (runs.size() * (sizeof(index_run) + (run_amp ? sizeof(complex<double>) : 0))
+	  + namp * sizeof(realnum) * (amp_im ? 2 : 1));
+}
+
+/* Add this to the list of sources OTHERS.  Sources with the same
+   component and time dependence are merged into a single src_vol
+   (whose points are the union of their points), in which case this
+   src_vol is deleted, so that each time-dependence is applied in a
+   single pass over the fields. */
 src_vol *src_vol::add_to(src_vol *others) {
   if (others) {
-    if (*this == *others) {
-      if (npts != others->npts)
-        abort("Cannot add grid_volume sources with different number of points\n");
-      /* Compare all of the indices...if this ever becomes too slow,
-	 we can just compare the first and last indices. */
-      for (size_t j=0; j<npts; j++) {
-        if (others->index[j] != index[j])
-          abort("Different indices\n");
-        others->A[j] += A[j];
+    if (others->c == c && others->t == t) {
+      // merge the (sorted) points, adding the amplitudes
+      ptrdiff_t *ind1 = new ptrdiff_t[npts], *ind2 = new ptrdiff_t[others->npts];
+      complex<double> *A1 = new complex<double>[npts];
+      complex<double> *A2 = new complex<double>[others->npts];
+      get_points(ind1, A1);
+      others->get_points(ind2, A2);
+      ptrdiff_t *ind = new ptrdiff_t[npts + others->npts];
+      complex<double> *A = new complex<double>[npts + others->npts];
+      size_t n = 0, j = 0, k = 0;
+      while (j < npts || k < others->npts) {
+	if (k == others->npts || (j < npts && ind1[j] < ind2[k])) {
+	  ind[n] = ind1[j]; A[n++] = A1[j++];
+	}
+	else if (j == npts || ind2[k] < ind1[j]) {
+	  ind[n] = ind2[k]; A[n++] = A2[k++];
+	}
+	else {
+	  ind[n] = ind1[j];
+	  A[n++] = A1[j++] + A2[k++];
+	}
       }
+      others->compress(n, ind, A);
+      delete[] A; delete[] ind; delete[] A2; delete[] A1;
+      delete[] ind2; delete[] ind1;
+      delete this;
     }
     else
       others->next = add_to(others->next);
@@ -205,6 +361,71 @@ src_vol *src_vol::add_to(src_vol *others) {
   }
 }
 
+/* subtract real/imag(A * s * w) from f0/f1 at n points spaced by st,
+   where A = ar + i*ai (and ai, w, and/or f1 may be NULL) */
+static inline void subtract_run(realnum *f0, realnum *f1,
+				const realnum *ar, const realnum *ai,
+				const realnum *w, double sr, double si,
+				size_t n, ptrdiff_t st) {
+  if (ai && w) {
+    for (size_t j = 0; j < n; j++)
+      f0[j*st] -= (ar[j] * sr - ai[j] * si) * w[j*st];
+    if (f1) for (size_t j = 0; j < n; j++)
+      f1[j*st] -= (ar[j] * si + ai[j] * sr) * w[j*st];
+  }
+  else if (ai) {
+    for (size_t j = 0; j < n; j++)
+      f0[j*st] -= ar[j] * sr - ai[j] * si;
+    if (f1) for (size_t j = 0; j < n; j++)
+      f1[j*st] -= ar[j] * si + ai[j] * sr;
+  }
+  else if (w) {
+    for (size_t j = 0; j < n; j++)
+      f0[j*st] -= ar[j] * sr * w[j*st];
+    if (f1) for (size_t j = 0; j < n; j++)
+      f1[j*st] -= ar[j] * si * w[j*st];
+  }
+  else {
+    for (size_t j = 0; j < n; j++)
+      f0[j*st] -= ar[j] * sr;
+    if (f1) for (size_t j = 0; j < n; j++)
+      f1[j*st] -= ar[j] * si;
+  }
+}
+
+void src_vol::subtract_from(realnum *fr, realnum *fi, complex<double> s,
+			    const realnum *w) const {
+  size_t q = 0;
+  for (size_t k = 0; k < runs.size(); k++) {
+    const index_run &r = runs[k];
+    const complex<double> sk = run_amp ? s * run_amp[k] : s;
+    const realnum *ar = amp_re + q, *ai = amp_im ? amp_im + q : NULL;
+    realnum *f0 = fr + r.start, *f1 = fi ? fi + r.start : NULL;
+    const realnum *wk = w ? w + r.start : NULL;
+    if (r.stride == 1) // so that the compiler can vectorize this case
+      subtract_run(f0, f1, ar, ai, wk, real(sk), imag(sk), r.count, 1);
+    else
+      subtract_run(f0, f1, ar, ai, wk, real(sk), imag(sk), r.count, r.stride);
+    if (!run_amp) q += r.count;
+  }
+}
+
+complex<double> src_vol::overlap(const realnum *fr, const realnum *fi,
+				 double &abs_sum) const {
+  complex<double> sum = 0;
+  size_t j = 0;
+  for (size_t k = 0; k < runs.size(); k++)
+    for (size_t m = 0; m < runs[k].count; m++, j++) {
+      const size_t q = run_amp ? m : j;
+      const ptrdiff_t i = runs[k].start + ptrdiff_t(m) * runs[k].stride;
+      complex<double> A(amp_re[q], amp_im ? amp_im[q] : 0.0);
+      if (run_amp) A *= run_amp[k];
+      sum += complex<double>(fr[i], fi ? fi[i] : 0.0) * conj(A);
+      abs_sum += abs(A);
+    }
+  return sum;
+}
+
 /*********************************************************************/
 
 // THIS VARIANT IS FOR BACKWARDS COMPATIBILITY, and is DEPRECATED:
@@ -445,6 +666,7 @@ void fields::add_volume_source(component c, const src_time &src,
     if (where.in_direction(d) == 0.0 && !nosize_direction(d)) // delta-fun
       data.amp *= gv.a; // correct units for J delta-function amplitude
   sources = src.add_to(sources, &data.src);
+  dft_stride = 0; // the DFT decimation may depend on the new source
   data.center = (where.get_min_corner() + where.get_max_corner()) * 0.5;
   loop_in_chunks(src_vol_chunkloop, (void *) &data, where, c, false);
   require_component(c);
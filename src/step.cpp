@@ -59,25 +59,63 @@ void fields::step() {
   // update cached conductivity-inverse array, if needed
   for (int i=0;i<num_chunks;i++) chunks[i]->s->update_condinv();
 
+  /* With MPI, we overlap the boundary communications with the
+     computations that do not need the communicated fields: the B and D
+     communications with update_eh (unless it needs the not-owned B/D,
+     which is decided by each process separately since it does not
+     change the order of the collective operations), and the H
+     communications with the timestepping of the chunk interiors in
+     step_db(D_stuff).  The latter is not possible in cylindrical
+     coordinates (where the D update integrates over r) or with the
+     flux_vol monitors (which need the communicated H fields). */
+  const bool overlap = overlap_communications && count_processors() > 1
+    && gv.dim != Dcyl && !fluxes;
+
   calc_sources(time()); // for B sources
   step_db(B_stuff);
   step_source(B_stuff);
-  step_boundaries(B_stuff);
-  calc_sources(time() + 0.5*dt); // for integrated H sources
-  update_eh(H_stuff);
+  if (overlap && !update_eh_needs_notowned(H_stuff)) {
+    start_boundaries(B_stuff);
+    calc_sources(time() + 0.5*dt); // for integrated H sources
+    update_eh(H_stuff);
+    finish_boundaries(B_stuff);
+  }
+  else {
+    step_boundaries(B_stuff);
+    calc_sources(time() + 0.5*dt); // for integrated H sources
+    update_eh(H_stuff);
+  }
   step_boundaries(WH_stuff);
   update_pols(H_stuff);
   step_boundaries(PH_stuff);
-  step_boundaries(H_stuff);
 
-  if (fluxes) fluxes->update_half();
+  if (overlap) {
+    start_boundaries(H_stuff);
+    calc_sources(time() + 0.5*dt); // for D sources
+    step_db(D_stuff, STEP_INTERIOR);
+    finish_boundaries(H_stuff);
+    step_db(D_stuff, STEP_BOUNDARY);
+  }
+  else {
+    step_boundaries(H_stuff);
+
+    if (fluxes) fluxes->update_half();
 
-  calc_sources(time() + 0.5*dt); // for D sources
-  step_db(D_stuff);
+    calc_sources(time() + 0.5*dt); // for D sources
+    step_db(D_stuff);
+  }
   step_source(D_stuff);
-  step_boundaries(D_stuff);
-  calc_sources(time() + dt); // for integrated E sources
-  update_eh(E_stuff);
+  if (overlap && !update_eh_needs_notowned(E_stuff)) {
+    start_boundaries(D_stuff);
+    calc_sources(time() + dt); // for integrated E sources
+    update_eh(E_stuff);
+    finish_boundaries(D_stuff);
+  }
+  else {
+    step_boundaries(D_stuff);
+    calc_sources(time() + dt); // for integrated E sources
+    update_eh(E_stuff);
+  }
   step_boundaries(WE_stuff);
   update_pols(E_stuff);
   step_boundaries(PE_stuff);
@@ -95,6 +133,21 @@ void fields::step() {
   }
 }
 
+/* With OpenMP, the owned chunks of a process can be timestepped by
+   different threads (each thread then runs the loops inside its chunk
+   serially), or the chunks can be processed one at a time with the
+   loops inside each chunk divided among the threads (see the PLOOP
+   macros).  We thread over chunks only if there are enough owned
+   chunks to keep all of the threads busy. */
+bool fields::thread_over_chunks() const {
+  const int nthreads = count_threads();
+  if (nthreads <= 1) return false;
+  int nmine = 0;
+  for (int i=0;i<num_chunks;i++)
+    if (chunks[i]->is_mine()) ++nmine;
+  return nmine >= nthreads;
+}
+
 double fields_chunk::peek_field(component c, const vec &where) {
   double w[8];
   ivec ilocs[8];
@@ -138,71 +191,102 @@ void fields_chunk::phase_material(int phasein_time) {
 }
 
 void fields::step_boundaries(field_type ft) {
+  start_boundaries(ft);
+  finish_boundaries(ft);
+}
+
+/* The boundary communications for field type ft are split into two
+   phases, so that the computations that do not depend on the not-owned
+   fields of type ft can be done while the messages are in flight (see
+   fields::step).  start_boundaries zeroes the metal boundaries, copies
+   the outgoing data to the comm_blocks and starts the communications,
+   and finish_boundaries waits for them to complete and copies the
+   incoming data to the not-owned fields. */
+void fields::start_boundaries(field_type ft) {
   connect_chunks(); // re-connect if !chunk_connections_valid
 
   am_now_working_on(MpiTime);
 
   // Do the metals first!
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (thread_over_chunks())
+#endif
   for (int i=0;i<num_chunks;i++)
     if (chunks[i]->is_mine()) chunks[i]->zero_metal(ft);
 
   /* Note that the copying of data to/from buffers is order-sensitive,
-     and must be kept consistent with the code in boundaries.cpp.
-     In particular, we require that boundaries.cpp set up the connections
-     array so that all of the connections for process i come before all
-     of the connections for process i' for i < i'  */
+     and must be kept consistent with the code in boundaries.cpp: the
+     connections of each chunk pair start at comm_pair::start (see
+     fields::find_comm_pairs). */
 
   // First copy outgoing data to buffers...
-  for (int j=0;j<num_chunks;j++)
-    if (chunks[j]->is_mine()) {
-      int wh[3] = {0,0,0};
-      for (int i=0;i<num_chunks;i++) {
-      	const int pair = j+i*num_chunks;
-      	size_t n0 = 0;
-      	for (int ip=0;ip<3;ip++) {
-      	  for (size_t n=0;n<comm_sizes[ft][ip][pair];n++)
-      	    comm_blocks[ft][pair][n0 + n] =
-      	      *(chunks[j]->connections[ft][ip][Outgoing][wh[ip]++]);
-      	  n0 += comm_sizes[ft][ip][pair];
-      	}
-      }
+  const std::vector<comm_pair> &out = comm_pairs[ft][Outgoing];
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (thread_over_chunks())
+#endif
+  for (size_t k=0;k<out.size();k++) {
+    const int pair = out[k].pair;
+    realnum **conn[3];
+    for (int ip=0;ip<3;ip++)
+      conn[ip] = chunks[out[k].chunk]->connections[ft][ip][Outgoing]
+	+ out[k].start[ip];
+    size_t n0 = 0;
+    for (int ip=0;ip<3;ip++) {
+      for (size_t n=0;n<comm_sizes[ft][ip][pair];n++)
+	comm_blocks[ft][pair][n0 + n] = *(conn[ip][n]);
+      n0 += comm_sizes[ft][ip][pair];
     }
+  }
+
+  start_boundary_communications(ft);
 
-  boundary_communications(ft);
+  finished_working();
+}
+
+void fields::finish_boundaries(field_type ft) {
+  am_now_working_on(MpiTime);
+
+  finish_boundary_communications(ft);
 
   // Finally, copy incoming data to the fields themselves, multiplying phases:
-  for (int i=0;i<num_chunks;i++)
-    if (chunks[i]->is_mine()) {
-      int wh[3] = {0,0,0};
-      for (int j=0;j<num_chunks;j++) {
-        const int pair = j+i*num_chunks;
-      	connect_phase ip = CONNECT_PHASE;
-        for (size_t n = 0; n < comm_sizes[ft][ip][pair]; n += 2, wh[ip] += 2) {
-          const double phr = real(chunks[i]->connection_phases[ft][wh[ip]/2]);
-          const double phi = imag(chunks[i]->connection_phases[ft][wh[ip]/2]);
-          *(chunks[i]->connections[ft][ip][Incoming][wh[ip]]) =
-            phr*comm_blocks[ft][pair][n] - phi*comm_blocks[ft][pair][n+1];
-          *(chunks[i]->connections[ft][ip][Incoming][wh[ip]+1]) =
-            phr*comm_blocks[ft][pair][n+1] + phi*comm_blocks[ft][pair][n];
-        }
-      	size_t n0 = comm_sizes[ft][ip][pair];
-      	ip = CONNECT_NEGATE;
-        for (size_t n = 0; n < comm_sizes[ft][ip][pair]; ++n)
-          *(chunks[i]->connections[ft][ip][Incoming][wh[ip]++])
-      	    = -comm_blocks[ft][pair][n0 + n];
-      	n0 += comm_sizes[ft][ip][pair];
-      	ip = CONNECT_COPY;
-        for (size_t n = 0; n < comm_sizes[ft][ip][pair]; ++n)
-          *(chunks[i]->connections[ft][ip][Incoming][wh[ip]++])
-      	    = comm_blocks[ft][pair][n0 + n];
-      }
+  const std::vector<comm_pair> &in = comm_pairs[ft][Incoming];
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (thread_over_chunks())
+#endif
+  for (size_t k=0;k<in.size();k++) {
+    fields_chunk *fc = chunks[in[k].chunk];
+    const int pair = in[k].pair;
+    const realnum *block = comm_blocks[ft][pair];
+    connect_phase ip = CONNECT_PHASE;
+    size_t wh = in[k].start[ip];
+    for (size_t n = 0; n < comm_sizes[ft][ip][pair]; n += 2, wh += 2) {
+      const double phr = real(fc->connection_phases[ft][wh/2]);
+      const double phi = imag(fc->connection_phases[ft][wh/2]);
+      *(fc->connections[ft][ip][Incoming][wh]) =
+	phr*block[n] - phi*block[n+1];
+      *(fc->connections[ft][ip][Incoming][wh+1]) =
+	phr*block[n+1] + phi*block[n];
     }
+    size_t n0 = comm_sizes[ft][ip][pair];
+    ip = CONNECT_NEGATE;
+    wh = in[k].start[ip];
+    for (size_t n = 0; n < comm_sizes[ft][ip][pair]; ++n)
+      *(fc->connections[ft][ip][Incoming][wh++]) = -block[n0 + n];
+    n0 += comm_sizes[ft][ip][pair];
+    ip = CONNECT_COPY;
+    wh = in[k].start[ip];
+    for (size_t n = 0; n < comm_sizes[ft][ip][pair]; ++n)
+      *(fc->connections[ft][ip][Incoming][wh++]) = block[n0 + n];
+  }
 
   finished_working();
 }
 
 void fields::step_source(field_type ft, bool including_integrated) {
   if (ft != D_stuff && ft != B_stuff) abort("only step_source(D/B) is okay");
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (thread_over_chunks())
+#endif
   for (int i=0;i<num_chunks;i++)
     if (chunks[i]->is_mine())
       chunks[i]->step_source(ft, including_integrated);
@@ -215,22 +299,9 @@ void fields_chunk::step_source(field_type ft, bool including_integrated) {
     const realnum *cndinv = s->condinv[c][component_direction(sv->c)];
     if ((including_integrated || !sv->t->is_integrated)	&& f[c][0]
 	&& ((ft == D_stuff && is_electric(sv->c))
-	    || (ft == B_stuff && is_magnetic(sv->c)))) {
-      if (cndinv)
-	for (size_t j=0; j<sv->npts; j++) {
-	  const ptrdiff_t i = sv->index[j];
-	  const complex<double> A = sv->current(j) * dt * double(cndinv[i]);
-	  f[c][0][i] -= real(A);
-	  if (!is_real) f[c][1][i] -= imag(A);
-	}
-      else
-	for (size_t j=0; j<sv->npts; j++) {
-	  const complex<double> A = sv->current(j) * dt;
-	  const ptrdiff_t i = sv->index[j];
-	  f[c][0][i] -= real(A);
-	  if (!is_real) f[c][1][i] -= imag(A);
-	}
-    }
+	    || (ft == B_stuff && is_magnetic(sv->c))))
+      sv->subtract_from(f[c][0], is_real ? NULL : f[c][1],
+			sv->t->current() * dt, cndinv);
   }
 }
 
@@ -29,21 +29,85 @@ using namespace std;
 
 namespace meep {
 
-void fields::step_db(field_type ft) {
+void fields::step_db(field_type ft, step_region region) {
+  bool allocated = false;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (thread_over_chunks()) reduction(||:allocated)
+#endif
   for (int i=0;i<num_chunks;i++)
     if (chunks[i]->is_mine())
-      if (chunks[i]->step_db(ft))
-      	chunk_connections_valid = false;
+      if (chunks[i]->step_db(ft, region))
+      	allocated = true;
+  if (allocated) chunk_connections_valid = false;
 
-  /* synchronize to avoid deadlocks in connect_the_chunks */
-  chunk_connections_valid = and_to_all(chunk_connections_valid);
+  /* synchronize to avoid deadlocks in connect_the_chunks (only once
+     if the interior and boundary regions are stepped separately) */
+  if (region != STEP_INTERIOR)
+    chunk_connections_valid = and_to_all(chunk_connections_valid);
 }
 
-bool fields_chunk::step_db(field_type ft) {
+/* Compute the boxes (from is[i] to ie[i], inclusive) of owned points
+   of component c to be updated for the given region, and return the
+   number of boxes (at most 3).  Relative to gv.little_corner(), the
+   owned points lie in (0, 2n] in each direction, and the curl
+   stencils reach one ivec unit (half a pixel) in each direction, so
+   the STEP_INTERIOR points (which do not depend on the not-owned
+   fields) are those in [2, 2n-1].  STEP_BOUNDARY is the rest of the
+   owned points, split into (at most) one slab per direction. */
+static int owned_boxes(const grid_volume &gv, component c,
+		       step_region region, ivec *is, ivec *ie) {
+  ivec lo(gv.little_owned_corner0(c)), hi(gv.big_corner());
+  if (region == STEP_ALL) {
+    is[0] = lo; ie[0] = hi;
+    return 1;
+  }
+
+  ivec ilo(lo), ihi(hi);
+  bool empty = false;
+  LOOP_OVER_DIRECTIONS(gv.dim, d) {
+    if (lo.in_direction(d) - gv.little_corner().in_direction(d) < 2)
+      ilo.set_direction(d, lo.in_direction(d) + 2);
+    ihi.set_direction(d, hi.in_direction(d) - 1);
+    if (ilo.in_direction(d) > ihi.in_direction(d)) empty = true;
+  }
+  if (region == STEP_INTERIOR) {
+    if (empty) return 0;
+    is[0] = ilo; ie[0] = ihi;
+    return 1;
+  }
+  if (empty) { // no interior, so the whole chunk is boundary
+    is[0] = lo; ie[0] = hi;
+    return 1;
+  }
+  int n = 0;
+  LOOP_OVER_DIRECTIONS(gv.dim, d) {
+    if (ilo.in_direction(d) > lo.in_direction(d)) { // low slab
+      is[n] = lo; ie[n] = hi;
+      ie[n].set_direction(d, ilo.in_direction(d) - 1);
+      lo.set_direction(d, ilo.in_direction(d));
+      ++n;
+    }
+    const int last = lo.in_direction(d)
+      + 2 * ((hi.in_direction(d) - lo.in_direction(d)) / 2);
+    if (last > ihi.in_direction(d)) { // high slab
+      is[n] = lo; ie[n] = hi;
+      is[n].set_direction(d, last);
+      hi.set_direction(d, ihi.in_direction(d));
+      ++n;
+    }
+  }
+  return n;
+}
+
+bool fields_chunk::step_db(field_type ft, step_region region) {
   bool allocated_u = false;
 
   if (ft != B_stuff && ft != D_stuff)
     abort("bug - step_db should only be called for B or D");
+  if (region != STEP_ALL && gv.dim == Dcyl)
+    abort("bug - step_db regions are not supported in cylindrical coordinates");
+
+  ivec is[3], ie[3];
 
   DOCMP FOR_FT_COMPONENTS(ft, cc)
     if (f[cc][cmp]) {
@@ -117,11 +181,14 @@ bool fields_chunk::step_db(field_type ft) {
       default: abort("bug - non-cylindrical field component in Dcyl");
       }
 
-      STEP_CURL(the_f, cc, f_p, f_m, stride_p, stride_m, gv, Courant,
-		dsig, s->sig[dsig], s->kap[dsig], s->siginv[dsig],
-		f_u[cc][cmp], dsigu, s->sig[dsigu], s->kap[dsigu], s->siginv[dsigu],
-		dt,
-		s->conductivity[cc][d_c], s->condinv[cc][d_c],f_cond[cc][cmp]);
+      const int nbox = owned_boxes(gv, cc, region, is, ie);
+      for (int ib = 0; ib < nbox; ++ib)
+	STEP_CURL(the_f, f_p, f_m, stride_p, stride_m,
+		  gv, is[ib], ie[ib], Courant,
+		  dsig, s->sig[dsig], s->kap[dsig], s->siginv[dsig],
+		  f_u[cc][cmp], dsigu, s->sig[dsigu], s->kap[dsigu], s->siginv[dsigu],
+		  dt,
+		  s->conductivity[cc][d_c], s->condinv[cc][d_c],f_cond[cc][cmp]);
     }
 
   /* In 2d with beta != 0, add beta terms.  This is a trick to model
@@ -150,10 +217,12 @@ bool fields_chunk::step_db(field_type ft) {
     const direction dsigu = s->sigsize[dsigu0] > 1 ? dsigu0 : NO_DIRECTION;
     const double betadt = 2 * pi * beta * dt * (d_c == X ? +1 : -1)
       * (f[c_g][1-cmp] ? (ft == D_stuff ? -1 : +1) * (2*cmp-1) : 1);
-    STEP_BETA(the_f, cc, g, gv, betadt,
-	      dsig, s->siginv[dsig],
-	      f_u[cc][cmp], dsigu, s->siginv[dsigu],
-	      s->condinv[cc][d_c], f_cond[cc][cmp]);
+    const int nbox = owned_boxes(gv, cc, region, is, ie);
+    for (int ib = 0; ib < nbox; ++ib)
+      STEP_BETA(the_f, g, gv, is[ib], ie[ib], betadt,
+		dsig, s->siginv[dsig],
+		f_u[cc][cmp], dsigu, s->siginv[dsigu],
+		s->condinv[cc][d_c], f_cond[cc][cmp]);
   }
 
   // in cylindrical coordinates, we now have to add the i*m/r terms... */
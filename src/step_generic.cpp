@@ -58,10 +58,16 @@ namespace meep {
    in which case f solves:
        df/dt = dfu/dt - sigma_u * f
    and fu replaces f in the equations above (fu += dt curl g etcetera).
+
+   The update is performed for the grid points from is to ie
+   (inclusive), which is normally the whole owned region from
+   gv.little_owned_corner0(c) to gv.big_corner() of the component c
+   of f, but may be a sub-box of it (see fields_chunk::step_db).
 */
-void step_curl(RPR f, component c, const RPR g1, const RPR g2,
+void step_curl(RPR f, const RPR g1, const RPR g2,
 	       ptrdiff_t s1, ptrdiff_t s2, // strides for g1/g2 shift
-	       const grid_volume &gv, double dtdx,
+	       const grid_volume &gv, const ivec &is, const ivec &ie,
+	       double dtdx,
 	       direction dsig, const DPR sig, const DPR kap, const DPR siginv,
 	       RPR fu, direction dsigu, const DPR sigu, const DPR kapu, const DPR siginvu,
 	       double dt,
@@ -85,33 +91,33 @@ void step_curl(RPR f, component c, const RPR g1, const RPR g2,
       if (cnd) {
     	double dt2 = dt * 0.5;
     	if (g2) {
-    	  LOOP_OVER_VOL_OWNED0(gv, c, i)
+    	  PLOOP_OVER_IVECS(gv, is, ie, i)
     	    f[i] = ((1 - dt2 * cnd[i]) * f[i] -
     		    dtdx * (g1[i+s1] - g1[i] + g2[i] - g2[i+s2])) * cndinv[i];
     	}
     	else {
-    	  LOOP_OVER_VOL_OWNED0(gv, c, i)
+    	  PLOOP_OVER_IVECS(gv, is, ie, i)
     	    f[i] = ((1 - dt2 * cnd[i]) * f[i]
     		    - dtdx * (g1[i+s1] - g1[i])) * cndinv[i];
     	}
       }
       else { // no conductivity
     	if (g2) {
-    	  LOOP_OVER_VOL_OWNED0(gv, c, i)
+    	  PLOOP_OVER_IVECS(gv, is, ie, i)
     	    f[i] -= dtdx * (g1[i+s1] - g1[i] + g2[i] - g2[i+s2]);
     	}
     	else {
-    	  LOOP_OVER_VOL_OWNED0(gv, c, i)
+    	  PLOOP_OVER_IVECS(gv, is, ie, i)
     	    f[i] -= dtdx * (g1[i+s1] - g1[i]);
     	}
       }
     }
     else { // fu update, no PML in f update
-      KSTRIDE_DEF(dsigu, ku, gv.little_owned_corner0(c));
+      KSTRIDE_DEF(dsigu, ku, is);
       if (cnd) {
     	double dt2 = dt * 0.5;
     	if (g2) {
-    	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+    	  PLOOP_OVER_IVECS(gv, is, ie, i) {
     	    DEF_ku; double fprev = fu[i];
     	    fu[i] = ((1 - dt2 * cnd[i]) * fprev -
     		    dtdx * (g1[i+s1] - g1[i] + g2[i] - g2[i+s2])) * cndinv[i];
@@ -119,7 +125,7 @@ void step_curl(RPR f, component c, const RPR g1, const RPR g2,
     	  }
     	}
     	else {
-    	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+    	  PLOOP_OVER_IVECS(gv, is, ie, i) {
     	    DEF_ku; double fprev = fu[i];
     	    fu[i] = ((1 - dt2 * cnd[i]) * fprev
     		    - dtdx * (g1[i+s1] - g1[i])) * cndinv[i];
@@ -129,14 +135,14 @@ void step_curl(RPR f, component c, const RPR g1, const RPR g2,
       }
       else { // no conductivity
     	if (g2) {
-    	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+    	  PLOOP_OVER_IVECS(gv, is, ie, i) {
     	    DEF_ku; double fprev = fu[i];
     	    fu[i] -= dtdx * (g1[i+s1] - g1[i] + g2[i] - g2[i+s2]);
     	    f[i] = siginvu[ku] * ((kapu[ku] - sigu[ku]) * f[i] + fu[i] - fprev);
     	  }
     	}
     	else {
-    	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+    	  PLOOP_OVER_IVECS(gv, is, ie, i) {
     	    DEF_ku; double fprev = fu[i];
     	    fu[i] -= dtdx * (g1[i+s1] - g1[i]);
     	    f[i] = siginvu[ku] * ((kapu[ku] - sigu[ku]) * f[i] + fu[i] - fprev);
@@ -146,12 +152,12 @@ void step_curl(RPR f, component c, const RPR g1, const RPR g2,
     }
   }
   else { /* PML in f update */
-    KSTRIDE_DEF(dsig, k, gv.little_owned_corner0(c));
+    KSTRIDE_DEF(dsig, k, is);
     if (dsigu == NO_DIRECTION) { // no fu update
       if (cnd) {
 	double dt2 = dt * 0.5;
 	if (g2) {
-	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	  PLOOP_OVER_IVECS(gv, is, ie, i) {
 	    DEF_k;
 	    realnum fcnd_prev = fcnd[i];
 	    fcnd[i] = ((1 - dt2 * cnd[i]) * fcnd[i] -
@@ -160,7 +166,7 @@ void step_curl(RPR f, component c, const RPR g1, const RPR g2,
 	  }
 	}
 	else {
-	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	  PLOOP_OVER_IVECS(gv, is, ie, i) {
 	    DEF_k;
 	    realnum fcnd_prev = fcnd[i];
 	    fcnd[i] = ((1 - dt2 * cnd[i]) * fcnd[i] -
@@ -171,14 +177,14 @@ void step_curl(RPR f, component c, const RPR g1, const RPR g2,
       }
       else { // no conductivity (other than PML conductivity)
 	if (g2) {
-	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	  PLOOP_OVER_IVECS(gv, is, ie, i) {
 	    DEF_k;
 	    f[i] = ((kap[k] - sig[k]) * f[i] -
 		    dtdx * (g1[i+s1] - g1[i] + g2[i] - g2[i+s2])) * siginv[k];
 	  }
 	}
 	else {
-	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	  PLOOP_OVER_IVECS(gv, is, ie, i) {
 	    DEF_k;
 	    f[i] = ((kap[k] - sig[k]) * f[i] - dtdx * (g1[i+s1]-g1[i])) * siginv[k];
 	  }
@@ -186,12 +192,12 @@ void step_curl(RPR f, component c, const RPR g1, const RPR g2,
       }
     }
     else { // fu update + PML in f update
-      KSTRIDE_DEF(dsigu, ku, gv.little_owned_corner0(c));
+      KSTRIDE_DEF(dsigu, ku, is);
       if (cnd) {
 	double dt2 = dt * 0.5;
 	if (g2) {
 	  //////////////////// MOST GENERAL CASE //////////////////////
-	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	  PLOOP_OVER_IVECS(gv, is, ie, i) {
 	    DEF_k; DEF_ku; double fprev = fu[i];
 	    realnum fcnd_prev = fcnd[i];
 	    fcnd[i] = ((1 - dt2 * cnd[i]) * fcnd[i] -
@@ -202,7 +208,7 @@ void step_curl(RPR f, component c, const RPR g1, const RPR g2,
 	  /////////////////////////////////////////////////////////////
 	}
 	else {
-	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	  PLOOP_OVER_IVECS(gv, is, ie, i) {
 	    DEF_k; DEF_ku; double fprev = fu[i];
 	    realnum fcnd_prev = fcnd[i];
 	    fcnd[i] = ((1 - dt2 * cnd[i]) * fcnd[i] -
@@ -214,7 +220,7 @@ void step_curl(RPR f, component c, const RPR g1, const RPR g2,
       }
       else { // no conductivity (other than PML conductivity)
 	if (g2) {
-	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	  PLOOP_OVER_IVECS(gv, is, ie, i) {
 	    DEF_k; DEF_ku; double fprev = fu[i];
 	    fu[i] = ((kap[k] - sig[k]) * fu[i] -
 		    dtdx * (g1[i+s1] - g1[i] + g2[i] - g2[i+s2])) * siginv[k];
@@ -222,7 +228,7 @@ void step_curl(RPR f, component c, const RPR g1, const RPR g2,
 	  }
 	}
 	else {
-	  LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	  PLOOP_OVER_IVECS(gv, is, ie, i) {
 	    DEF_k; DEF_ku; double fprev = fu[i];
 	    fu[i] = ((kap[k] - sig[k]) * fu[i] - dtdx * (g1[i+s1]-g1[i])) * siginv[k];
 	    f[i] = siginvu[ku] * ((kapu[ku] - sigu[ku]) * f[i] + fu[i] - fprev);
@@ -236,21 +242,23 @@ void step_curl(RPR f, component c, const RPR g1, const RPR g2,
 /* field-update equation f += betadt * g (plus variants for conductivity
    and/or PML).  This is used in 2d calculations to add an exp(i beta z)
    time dependence, which gives an additional i \beta \hat{z} \times
-   cross-product in the curl equations. */
-void step_beta(RPR f, component c, const RPR g,
-	       const grid_volume &gv, double betadt,
+   cross-product in the curl equations.  As in step_curl, the update
+   is performed for the grid points from is to ie. */
+void step_beta(RPR f, const RPR g,
+	       const grid_volume &gv, const ivec &is, const ivec &ie,
+	       double betadt,
 	       direction dsig, const DPR siginv,
 	       RPR fu, direction dsigu, const DPR siginvu,
 	       const RPR cndinv, RPR fcnd)
 {
   if (!g) return;
   if (dsig != NO_DIRECTION) { // PML in f update
-    KSTRIDE_DEF(dsig, k, gv.little_owned_corner0(c));
+    KSTRIDE_DEF(dsig, k, is);
     if (dsigu != NO_DIRECTION) { // PML in f + fu
-      KSTRIDE_DEF(dsigu, ku, gv.little_owned_corner0(c));
+      KSTRIDE_DEF(dsigu, ku, is);
       if (cndinv) { // conductivity + PML
 	//////////////////// MOST GENERAL CASE //////////////////////
-	LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	PLOOP_OVER_IVECS(gv, is, ie, i) {
 	  DEF_k; DEF_ku; double df;
 	  double dfcnd = betadt * g[i] * cndinv[i];
 	  fcnd[i] += dfcnd;
@@ -260,7 +268,7 @@ void step_beta(RPR f, component c, const RPR g,
 	/////////////////////////////////////////////////////////////
       }
       else { // PML only
-	LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	PLOOP_OVER_IVECS(gv, is, ie, i) {
 	  DEF_k; DEF_ku; double df;
 	  fu[i] += (df = betadt * g[i] * siginv[k]);
 	  f[i] += siginvu[ku] * df;
@@ -269,7 +277,7 @@ void step_beta(RPR f, component c, const RPR g,
     }
     else { // PML in f, no fu
       if (cndinv) { // conductivity + PML
-	LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	PLOOP_OVER_IVECS(gv, is, ie, i) {
 	  DEF_k;
 	  double dfcnd = betadt * g[i] * cndinv[i];
 	  fcnd[i] += dfcnd;
@@ -277,7 +285,7 @@ void step_beta(RPR f, component c, const RPR g,
 	}
       }
       else { // PML only
-	LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	PLOOP_OVER_IVECS(gv, is, ie, i) {
 	  DEF_k;
 	  f[i] += betadt * g[i] * siginv[k];
 	}
@@ -286,16 +294,16 @@ void step_beta(RPR f, component c, const RPR g,
   }
   else { // no PML in f update
     if (dsigu != NO_DIRECTION) { // fu, no PML in f
-      KSTRIDE_DEF(dsigu, ku, gv.little_owned_corner0(c));
+      KSTRIDE_DEF(dsigu, ku, is);
       if (cndinv) { // conductivity, no PML
-	LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	PLOOP_OVER_IVECS(gv, is, ie, i) {
 	  DEF_ku; double df;
 	  fu[i] += (df = betadt * g[i] * cndinv[i]);
 	  f[i] += siginvu[ku] * df;
 	}
       }
       else { // no conductivity or PML
-	LOOP_OVER_VOL_OWNED0(gv, c, i) {
+	PLOOP_OVER_IVECS(gv, is, ie, i) {
 	  DEF_ku; double df;
 	  fu[i] += (df = betadt * g[i]);
 	  f[i] += siginvu[ku] * df;
@@ -304,11 +312,11 @@ void step_beta(RPR f, component c, const RPR g,
     }
     else { // no PML, no fu
       if (cndinv) { // conductivity, no PML
-	LOOP_OVER_VOL_OWNED0(gv, c, i)
+	PLOOP_OVER_IVECS(gv, is, ie, i)
 	  f[i] += betadt * g[i] * cndinv[i];
       }
       else { // no conductivity or PML
-	LOOP_OVER_VOL_OWNED0(gv, c, i)
+	PLOOP_OVER_IVECS(gv, is, ie, i)
 	  f[i] += betadt * g[i];
       }
     }
@@ -375,7 +383,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
     if (u1 && u2) { // 3x3 off-diagonal u
       if (chi3) {
 	//////////////////// MOST GENERAL CASE //////////////////////
-	LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	  double g1s = g1[i]+g1[i+s]+g1[i-s1]+g1[i+(s-s1)];
 	  double g2s = g2[i]+g2[i+s]+g2[i-s2]+g2[i+(s-s2)];
 	  double gs = g[i]; double us = u[i];
@@ -388,7 +396,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
 	/////////////////////////////////////////////////////////////
       }
       else {
-	LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	  double gs = g[i]; double us = u[i];
 	  DEF_kw; double fwprev = fw[i], kapwkw = kapw[kw], sigwkw = sigw[kw];
 	  fw[i] = (gs * us + OFFDIAG(u1,g1,s1) + OFFDIAG(u2,g2,s2));
@@ -398,7 +406,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
     }
     else if (u1) { // 2x2 off-diagonal u
       if (chi3) {
-	LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	  double g1s = g1[i]+g1[i+s]+g1[i-s1]+g1[i+(s-s1)];
 	  double gs = g[i]; double us = u[i];
 	  DEF_kw; double fwprev = fw[i], kapwkw = kapw[kw], sigwkw = sigw[kw];
@@ -409,7 +417,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
 	}
       }
       else {
-	LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	  double gs = g[i]; double us = u[i];
 	  DEF_kw; double fwprev = fw[i], kapwkw = kapw[kw], sigwkw = sigw[kw];
 	  fw[i] = (gs * us + OFFDIAG(u1,g1,s1));
@@ -423,7 +431,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
     else { // diagonal u
       if (chi3) {
 	if (g1 && g2) {
-	  LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	  PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	    double g1s = g1[i]+g1[i+s]+g1[i-s1]+g1[i+(s-s1)];
 	    double g2s = g2[i]+g2[i+s]+g2[i-s2]+g2[i+(s-s2)];
 	    double gs = g[i]; double us = u[i];
@@ -434,7 +442,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
 	  }
 	}
 	else if (g1) {
-	  LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	  PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	    double g1s = g1[i]+g1[i+s]+g1[i-s1]+g1[i+(s-s1)];
 	    double gs = g[i]; double us = u[i];
 	    DEF_kw; double fwprev = fw[i], kapwkw = kapw[kw], sigwkw = sigw[kw];
@@ -447,7 +455,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
 	  abort("bug - didn't swap off-diagonal terms!?");
 	}
 	else {
-	  LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	  PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	    double gs = g[i]; double us = u[i];
 	    DEF_kw; double fwprev = fw[i], kapwkw = kapw[kw], sigwkw = sigw[kw];
 	    fw[i] = (gs*us)*calc_nonlinear_u(gs*gs, gs,us, chi2[i],chi3[i]);
@@ -456,7 +464,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
 	}
       }
       else if (u) {
-	LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	  double gs = g[i]; double us = u[i];
 	  DEF_kw; double fwprev = fw[i], kapwkw = kapw[kw], sigwkw = sigw[kw];
 	  fw[i] = (gs * us);
@@ -464,7 +472,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
 	}
       }
       else {
-	LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	  DEF_kw; double fwprev = fw[i], kapwkw = kapw[kw], sigwkw = sigw[kw];
 	  fw[i] = g[i];
 	  f[i] += (kapwkw + sigwkw) * fw[i] - (kapwkw - sigwkw) * fwprev;
@@ -475,7 +483,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
   else { /////////////// no PML (no fw) ///////////////////
     if (u1 && u2) { // 3x3 off-diagonal u
       if (chi3) {
-	LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	  double g1s = g1[i]+g1[i+s]+g1[i-s1]+g1[i+(s-s1)];
 	  double g2s = g2[i]+g2[i+s]+g2[i-s2]+g2[i+(s-s2)];
 	  double gs = g[i]; double us = u[i];
@@ -485,7 +493,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
 	}
       }
       else {
-	LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	  double gs = g[i]; double us = u[i];
 	  f[i] = (gs * us + OFFDIAG(u1,g1,s1) + OFFDIAG(u2,g2,s2));
 	}
@@ -493,7 +501,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
     }
     else if (u1) { // 2x2 off-diagonal u
       if (chi3) {
-	LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	  double g1s = g1[i]+g1[i+s]+g1[i-s1]+g1[i+(s-s1)];
 	  double gs = g[i]; double us = u[i];
 	  f[i] = (gs * us + OFFDIAG(u1,g1,s1))
@@ -502,7 +510,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
 	}
       }
       else {
-	LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	  double gs = g[i]; double us = u[i];
 	  f[i] = (gs * us + OFFDIAG(u1,g1,s1));
 	}
@@ -514,7 +522,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
     else { // diagonal u
       if (chi3) {
 	if (g1 && g2) {
-	  LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	  PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	    double g1s = g1[i]+g1[i+s]+g1[i-s1]+g1[i+(s-s1)];
 	    double g2s = g2[i]+g2[i+s]+g2[i-s2]+g2[i+(s-s2)];
 	    double gs = g[i]; double us = u[i];
@@ -523,7 +531,7 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
 	  }
 	}
 	else if (g1) {
-	  LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	  PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	    double g1s = g1[i]+g1[i+s]+g1[i-s1]+g1[i+(s-s1)];
 	    double gs = g[i]; double us = u[i];
 	    f[i] = (gs*us)*calc_nonlinear_u(gs*gs + 0.0625*(g1s*g1s),
@@ -534,20 +542,20 @@ void step_update_EDHB(RPR f, component fc, const grid_volume &gv,
 	  abort("bug - didn't swap off-diagonal terms!?");
 	}
 	else {
-	  LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	  PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	    double gs = g[i]; double us = u[i];
 	    f[i] = (gs*us)*calc_nonlinear_u(gs*gs, gs,us, chi2[i],chi3[i]);
 	  }
 	}
       }
       else if (u) {
-	LOOP_OVER_VOL_OWNED(gv, fc, i) {
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) {
 	  double gs = g[i]; double us = u[i];
 	  f[i] = (gs * us);
 	}
       }
       else
-	LOOP_OVER_VOL_OWNED(gv, fc, i) f[i] = g[i];
+	PLOOP_OVER_VOL_OWNED(gv, fc, i) f[i] = g[i];
     }
   }
 }
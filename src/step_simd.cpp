@@ -0,0 +1,259 @@
+/* Copyright (C) 2005-2015 Massachusetts Institute of Technology
+%
+%  This program is free software; you can redistribute it and/or modify
+%  it under the terms of the GNU General Public License as published by
+%  the Free Software Foundation; either version 2, or (at your option)
+%  any later version.
+%
+%  This program is distributed in the hope that it will be useful,
+%  but WITHOUT ANY WARRANTY; without even the implied warranty of
+%  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+%  GNU General Public License for more details.
+%
+%  You should have received a copy of the GNU General Public License
+%  along with this program; if not, write to the Free Software Foundation,
+%  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#include <vector>
+
+#include "meep.hpp"
+#include "meep_internals.hpp"
+#include "config.h"
+
+/* Explicitly vectorized versions of the most common special cases of
+   step_curl and step_update_EDHB (from step_generic.cpp) for stride-1
+   loops: the non-PML cases and the cases with PML in a single
+   direction, without conductivity, off-diagonal u, or nonlinearity.
+
+   The kernels (step_simd_kernels.hpp) are compiled separately for
+   AVX2 and for AVX-512, and the widest instruction set supported by
+   the CPU is chosen at runtime, so that a single Meep binary works on
+   any x86 machine.  In all other cases (or with other compilers and
+   CPUs), the step_*_simd functions return false and the caller falls
+   back to the (auto-vectorized) step_*_stride1 functions.  The DFT
+   accumulation of dft_chunk::flush_dft is also done here. */
+
+#if defined(__GNUC__) && __GNUC__ >= 5 && !defined(__clang__) \
+  && !defined(__INTEL_COMPILER) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_SIMD_KERNELS 1
+#endif
+
+using namespace std;
+
+namespace meep {
+
+/* Geometry of a stride-1 LOOP_OVER_IVECS loop (see vec.hpp), along
+   with the PML coefficients (if any) needed by the kernels.  The PML
+   coefficients ca[m] and cb[m] are indexed by m = loop_i<kloop>, the
+   index of the loop in the PML direction, or by m = 0 if kloop == 0
+   (the PML direction is not one of the loop directions). */
+struct simd_loop {
+  ptrdiff_t n1, n2, n3, s1, s2, idx0;
+  int kloop;
+  const realnum *ca, *cb;
+};
+
+#ifdef HAVE_SIMD_KERNELS
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define SIMD_NAMESPACE simd_avx2
+#define SIMD_VBYTES 32
+#include "step_simd_kernels.hpp"
+#undef SIMD_VBYTES
+#undef SIMD_NAMESPACE
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,fma")
+#define SIMD_NAMESPACE simd_avx512
+#define SIMD_VBYTES 64
+#include "step_simd_kernels.hpp"
+#undef SIMD_VBYTES
+#undef SIMD_NAMESPACE
+#pragma GCC pop_options
+
+#endif // HAVE_SIMD_KERNELS
+
+static simd_level detect_simd_level() {
+#ifdef HAVE_SIMD_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return SIMD_AVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return SIMD_AVX2;
+#endif
+  return SIMD_NONE;
+}
+
+static simd_level max_simd_level = SIMD_AVX512;
+
+simd_level get_simd_level() {
+  static const simd_level cpu_level = detect_simd_level();
+  return cpu_level < max_simd_level ? cpu_level : max_simd_level;
+}
+
+void set_simd_level(simd_level max_level) { max_simd_level = max_level; }
+
+const char *simd_level_name(simd_level level) {
+  switch (level) {
+  case SIMD_AVX512: return "avx512";
+  case SIMD_AVX2: return "avx2";
+  default: return "none";
+  }
+}
+
+// set the loop geometry exactly as in S1LOOP_OVER_IVECS(gv, is, ie, idx)
+static void init_simd_loop(simd_loop &L, const grid_volume &gv,
+                           const ivec &is, const ivec &ie) {
+  L.n1 = (ie.yucky_val(0) - is.yucky_val(0)) / 2 + 1;
+  L.n2 = (ie.yucky_val(1) - is.yucky_val(1)) / 2 + 1;
+  L.n3 = (ie.yucky_val(2) - is.yucky_val(2)) / 2 + 1;
+  L.s1 = gv.stride(gv.yucky_direction(0));
+  L.s2 = gv.stride(gv.yucky_direction(1));
+  ivec is0 = is - gv.little_corner();
+  L.idx0 = is0.yucky_val(0) / 2 * L.s1 + is0.yucky_val(1) / 2 * L.s2
+    + is0.yucky_val(2) / 2;
+  L.kloop = 0;
+  L.ca = L.cb = NULL;
+}
+
+/* Find the loop over the PML direction dsig and return the starting
+   index k0 into the PML arrays: the PML array index for coefficient m
+   is k0 + 2*m, exactly as with KSTRIDE_DEF(dsig, k, corner) in
+   step_generic.cpp.  simd_pml_count gives the number of coefficients. */
+static int simd_pml_start(simd_loop &L, const grid_volume &gv,
+                          direction dsig, const ivec &corner) {
+  L.kloop = 0;
+  for (int j = 0; j < 3; ++j)
+    if (gv.yucky_direction(j) == dsig) L.kloop = j + 1;
+  return corner.in_direction(dsig) - gv.little_corner().in_direction(dsig);
+}
+
+static ptrdiff_t simd_pml_count(const simd_loop &L) {
+  return L.kloop == 1 ? L.n1 : (L.kloop == 2 ? L.n2 : (L.kloop == 3 ? L.n3 : 1));
+}
+
+static bool simd_step_curl(simd_level level, realnum *f,
+                           const realnum *g1, const realnum *g2,
+                           ptrdiff_t s1, ptrdiff_t s2, realnum dtdx,
+                           const simd_loop &L) {
+  switch (level) {
+#ifdef HAVE_SIMD_KERNELS
+  case SIMD_AVX512: simd_avx512::step_curl(f, g1, g2, s1, s2, dtdx, L); return true;
+  case SIMD_AVX2: simd_avx2::step_curl(f, g1, g2, s1, s2, dtdx, L); return true;
+#endif
+  default: return false;
+  }
+}
+
+static bool simd_step_update_EDHB(simd_level level, realnum *f, realnum *fw,
+                                  const realnum *g, const realnum *u,
+                                  const simd_loop &L) {
+  switch (level) {
+#ifdef HAVE_SIMD_KERNELS
+  case SIMD_AVX512: simd_avx512::step_update_EDHB(f, fw, g, u, L); return true;
+  case SIMD_AVX2: simd_avx2::step_update_EDHB(f, fw, g, u, L); return true;
+#endif
+  default: return false;
+  }
+}
+
+/* Same arguments as step_curl in step_generic.cpp; returns false
+   (without doing anything) for cases that are not handled here. */
+bool step_curl_simd(realnum *f, const realnum *g1, const realnum *g2,
+		    ptrdiff_t s1, ptrdiff_t s2,
+		    const grid_volume &gv, const ivec &is, const ivec &ie,
+		    double dtdx,
+		    direction dsig, const double *sig, const double *kap, const double *siginv,
+		    realnum *fu, direction dsigu, const double *sigu, const double *kapu, const double *siginvu,
+		    double dt, const realnum *cnd, const realnum *cndinv, realnum *fcnd)
+{
+  (void) fu; (void) sigu; (void) kapu; (void) siginvu; (void) dt;
+  (void) cndinv; (void) fcnd;
+  const simd_level level = get_simd_level();
+  if (level == SIMD_NONE || dsigu != NO_DIRECTION || cnd) return false;
+
+  if (!g1) { // swap g1 and g2
+    g1 = g2; g2 = NULL;
+    ptrdiff_t s = s1; s1 = s2; s2 = s;
+    dtdx = -dtdx; // need to flip derivative sign
+  }
+
+  simd_loop L;
+  init_simd_loop(L, gv, is, ie);
+  vector<realnum> ca, cb;
+  if (dsig != NO_DIRECTION) {
+    const int k0 = simd_pml_start(L, gv, dsig, is);
+    const ptrdiff_t nk = simd_pml_count(L);
+    ca.resize(nk); cb.resize(nk);
+    for (ptrdiff_t m = 0; m < nk; ++m) {
+      ca[m] = kap[k0 + 2*m] - sig[k0 + 2*m];
+      cb[m] = siginv[k0 + 2*m];
+    }
+    L.ca = &ca[0]; L.cb = &cb[0];
+  }
+  return simd_step_curl(level, f, g1, g2, s1, s2, dtdx, L);
+}
+
+/* Same arguments as step_update_EDHB in step_generic.cpp; returns false
+   (without doing anything) for cases that are not handled here. */
+bool step_update_EDHB_simd(realnum *f, component fc, const grid_volume &gv,
+			   const realnum *g, const realnum *g1, const realnum *g2,
+			   const realnum *u, const realnum *u1, const realnum *u2,
+			   ptrdiff_t s, ptrdiff_t s1, ptrdiff_t s2,
+			   const realnum *chi2, const realnum *chi3,
+			   realnum *fw, direction dsigw, const double *sigw, const double *kapw)
+{
+  (void) g1; (void) g2; (void) s; (void) s1; (void) s2; (void) chi2;
+  if (!f) return true;
+  const simd_level level = get_simd_level();
+  // g1 and g2 are only used with off-diagonal u or with chi3
+  if (level == SIMD_NONE || u1 || u2 || chi3) return false;
+
+  simd_loop L;
+  init_simd_loop(L, gv, gv.little_owned_corner(fc), gv.big_corner());
+  vector<realnum> ca, cb;
+  if (dsigw != NO_DIRECTION) {
+    /* note that, as in step_update_EDHB, the PML index is computed
+       relative to little_owned_corner0 even though the loop starts
+       at little_owned_corner */
+    const int k0 = simd_pml_start(L, gv, dsigw, gv.little_owned_corner0(fc));
+    const ptrdiff_t nk = simd_pml_count(L);
+    ca.resize(nk); cb.resize(nk);
+    for (ptrdiff_t m = 0; m < nk; ++m) {
+      ca[m] = kapw[k0 + 2*m] + sigw[k0 + 2*m];
+      cb[m] = kapw[k0 + 2*m] - sigw[k0 + 2*m];
+    }
+    L.ca = &ca[0]; L.cb = &cb[0];
+  }
+  return simd_step_update_EDHB(level, f, fw, g, u, L);
+}
+
+/* Same arguments as the accumulation loop in dft_chunk::flush_dft;
+   returns false (without doing anything) without SIMD support. */
+bool dft_accumulate_simd(realnum *dft, const realnum *fbuf,
+			 const realnum *phase, const realnum *phase_swapped,
+			 size_t N, int Nbatch, int nbuf, bool cmplx,
+			 ptrdiff_t N2)
+{
+  switch (get_simd_level()) {
+#ifdef HAVE_SIMD_KERNELS
+  case SIMD_AVX512:
+    simd_avx512::dft_accumulate(dft, fbuf, phase, phase_swapped, N, Nbatch,
+				nbuf, cmplx, N2);
+    return true;
+  case SIMD_AVX2:
+    simd_avx2::dft_accumulate(dft, fbuf, phase, phase_swapped, N, Nbatch,
+			      nbuf, cmplx, N2);
+    return true;
+#endif
+  default:
+    (void) dft; (void) fbuf; (void) phase; (void) phase_swapped; (void) N;
+    (void) Nbatch; (void) nbuf; (void) cmplx; (void) N2;
+    return false;
+  }
+}
+
+} // namespace meep
@@ -0,0 +1,238 @@
+/* Copyright (C) 2005-2015 Massachusetts Institute of Technology
+%
+%  This program is free software; you can redistribute it and/or modify
+%  it under the terms of the GNU General Public License as published by
+%  the Free Software Foundation; either version 2, or (at your option)
+%  any later version.
+%
+%  This program is distributed in the hope that it will be useful,
+%  but WITHOUT ANY WARRANTY; without even the implied warranty of
+%  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+%  GNU General Public License for more details.
+%
+%  You should have received a copy of the GNU General Public License
+%  along with this program; if not, write to the Free Software Foundation,
+%  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* Inner-loop kernels for step_simd.cpp.  This file is not a normal
+   header: it is #included by step_simd.cpp once per instruction set,
+   inside a "#pragma GCC target" region, with SIMD_NAMESPACE (the
+   namespace to put the kernels in) and SIMD_VBYTES (the vector width
+   in bytes) defined.
+
+   The kernels are written with gcc's vector extensions, which work
+   for both float and double realnum.  Each row kernel handles one
+   stride-1 row of the grid (the innermost loop of LOOP_OVER_IVECS),
+   with a scalar loop for the leftover elements at the end of the row.
+   The arithmetic is done in the same order as in step_generic.cpp. */
+
+namespace SIMD_NAMESPACE {
+
+typedef realnum vreal __attribute__((vector_size(SIMD_VBYTES),
+                                     aligned(sizeof(realnum)), __may_alias__));
+const ptrdiff_t VN = SIMD_VBYTES / sizeof(realnum);
+
+#define VLOAD(p) (*(const vreal *) (p))
+#define VSTORE(p, v) (*(vreal *) (p) = (v))
+#define VSPLAT(x) ((x) + (vreal) {})
+
+/* f -= dtdx * curl g for one row; with PML == 1 (coefficients a and b
+   constant along the row) or PML == 2 (coefficients ca[i] and cb[i]),
+   f = (a * f - dtdx * curl g) * b instead, where a = kap - sig and
+   b = siginv. */
+template<bool G2, int PML>
+static inline void curl_row(realnum * __restrict f,
+                            const realnum * __restrict g1,
+                            const realnum * __restrict g2,
+                            ptrdiff_t s1, ptrdiff_t s2, ptrdiff_t n,
+                            realnum dtdx, realnum a, realnum b,
+                            const realnum * __restrict ca,
+                            const realnum * __restrict cb) {
+  const vreal vdtdx = VSPLAT(dtdx), va = VSPLAT(a), vb = VSPLAT(b);
+  ptrdiff_t i = 0;
+  for (; i + VN <= n; i += VN) {
+    vreal c = VLOAD(g1 + (i+s1)) - VLOAD(g1 + i);
+    if (G2) c = c + VLOAD(g2 + i) - VLOAD(g2 + (i+s2));
+    if (PML == 0)
+      VSTORE(f + i, VLOAD(f + i) - vdtdx * c);
+    else if (PML == 1)
+      VSTORE(f + i, (va * VLOAD(f + i) - vdtdx * c) * vb);
+    else
+      VSTORE(f + i, (VLOAD(ca + i) * VLOAD(f + i) - vdtdx * c) * VLOAD(cb + i));
+  }
+  for (; i < n; ++i) {
+    realnum c = g1[i+s1] - g1[i];
+    if (G2) c = c + g2[i] - g2[i+s2];
+    if (PML == 0)
+      f[i] -= dtdx * c;
+    else if (PML == 1)
+      f[i] = (a * f[i] - dtdx * c) * b;
+    else
+      f[i] = (ca[i] * f[i] - dtdx * c) * cb[i];
+  }
+}
+
+/* f = u * g (or f = g if !U) for one row; with PML, the auxiliary
+   field fw is set to u * g instead, and f += a * fw - b * fwprev,
+   where a = kapw + sigw and b = kapw - sigw (constant along the row
+   for PML == 1, or given by ca[i] and cb[i] for PML == 2). */
+template<bool U, int PML>
+static inline void update_row(realnum * __restrict f,
+                              realnum * __restrict fw,
+                              const realnum * __restrict g,
+                              const realnum * __restrict u, ptrdiff_t n,
+                              realnum a, realnum b,
+                              const realnum * __restrict ca,
+                              const realnum * __restrict cb) {
+  const vreal va = VSPLAT(a), vb = VSPLAT(b);
+  ptrdiff_t i = 0;
+  for (; i + VN <= n; i += VN) {
+    vreal gu = U ? VLOAD(g + i) * VLOAD(u + i) : VLOAD(g + i);
+    if (PML == 0)
+      VSTORE(f + i, gu);
+    else {
+      vreal fwprev = VLOAD(fw + i);
+      VSTORE(fw + i, gu);
+      if (PML == 1)
+        VSTORE(f + i, VLOAD(f + i) + (va * gu - vb * fwprev));
+      else
+        VSTORE(f + i, VLOAD(f + i) + (VLOAD(ca + i) * gu
+                                      - VLOAD(cb + i) * fwprev));
+    }
+  }
+  for (; i < n; ++i) {
+    realnum gu = U ? g[i] * u[i] : g[i];
+    if (PML == 0)
+      f[i] = gu;
+    else {
+      realnum fwprev = fw[i];
+      fw[i] = gu;
+      if (PML == 1)
+        f[i] += a * gu - b * fwprev;
+      else
+        f[i] += ca[i] * gu - cb[i] * fwprev;
+    }
+  }
+}
+
+/* d[j] += p[k*n2+j] * fr[k] (+ ps[k*n2+j] * fi[k] if CMPLX) for the
+   buffered timesteps k = 0..nb-1 (in order), for one point of
+   dft_chunk::flush_dft, where fr[k] and fi[k] are fb[2*k] and
+   fb[2*k+1].  The partial sums are kept in registers, so that d is
+   only loaded and stored once. */
+template<bool CMPLX>
+static inline void dft_row(realnum * __restrict d,
+                           const realnum * __restrict p,
+                           const realnum * __restrict ps,
+                           const realnum * __restrict fb,
+                           int nb, ptrdiff_t n2) {
+  ptrdiff_t j = 0;
+  for (; j + VN <= n2; j += VN) {
+    vreal acc = VLOAD(d + j);
+    for (int k = 0; k < nb; ++k) {
+      if (CMPLX)
+        acc = acc + (VLOAD(p + (k*n2 + j)) * VSPLAT(fb[2*k])
+                     + VLOAD(ps + (k*n2 + j)) * VSPLAT(fb[2*k+1]));
+      else
+        acc = acc + VLOAD(p + (k*n2 + j)) * VSPLAT(fb[2*k]);
+    }
+    VSTORE(d + j, acc);
+  }
+  for (; j < n2; ++j) {
+    realnum acc = d[j];
+    for (int k = 0; k < nb; ++k) {
+      if (CMPLX)
+        acc = acc + (p[k*n2 + j] * fb[2*k] + ps[k*n2 + j] * fb[2*k+1]);
+      else
+        acc = acc + p[k*n2 + j] * fb[2*k];
+    }
+    d[j] = acc;
+  }
+}
+
+// index of the PML coefficients for row (i1,i2), for PML == 1
+#define SIMD_ROW_K(L, i1, i2) ((L).kloop == 1 ? (i1) : ((L).kloop == 2 ? (i2) : 0))
+
+template<bool G2, int PML>
+static void curl_loop(realnum *f, const realnum *g1, const realnum *g2,
+                      ptrdiff_t s1, ptrdiff_t s2, realnum dtdx,
+                      const simd_loop &L) {
+  PLOOP_OMP
+  for (ptrdiff_t i1 = 0; i1 < L.n1; ++i1)
+    for (ptrdiff_t i2 = 0; i2 < L.n2; ++i2) {
+      ptrdiff_t idx = L.idx0 + i1*L.s1 + i2*L.s2, k = SIMD_ROW_K(L, i1, i2);
+      curl_row<G2,PML>(f + idx, g1 + idx, G2 ? g2 + idx : g2, s1, s2, L.n3,
+                       dtdx, PML == 1 ? L.ca[k] : 0, PML == 1 ? L.cb[k] : 0,
+                       L.ca, L.cb);
+    }
+}
+
+template<bool U, int PML>
+static void update_loop(realnum *f, realnum *fw, const realnum *g,
+                        const realnum *u, const simd_loop &L) {
+  PLOOP_OMP
+  for (ptrdiff_t i1 = 0; i1 < L.n1; ++i1)
+    for (ptrdiff_t i2 = 0; i2 < L.n2; ++i2) {
+      ptrdiff_t idx = L.idx0 + i1*L.s1 + i2*L.s2, k = SIMD_ROW_K(L, i1, i2);
+      update_row<U,PML>(f + idx, PML ? fw + idx : fw, g + idx,
+                        U ? u + idx : u, L.n3,
+                        PML == 1 ? L.ca[k] : 0, PML == 1 ? L.cb[k] : 0,
+                        L.ca, L.cb);
+    }
+}
+
+void step_curl(realnum *f, const realnum *g1, const realnum *g2,
+               ptrdiff_t s1, ptrdiff_t s2, realnum dtdx,
+               const simd_loop &L) {
+  const int pml = !L.ca ? 0 : (L.kloop == 3 ? 2 : 1);
+  if (g2) {
+    if (pml == 0) curl_loop<true,0>(f, g1, g2, s1, s2, dtdx, L);
+    else if (pml == 1) curl_loop<true,1>(f, g1, g2, s1, s2, dtdx, L);
+    else curl_loop<true,2>(f, g1, g2, s1, s2, dtdx, L);
+  }
+  else {
+    if (pml == 0) curl_loop<false,0>(f, g1, g2, s1, s2, dtdx, L);
+    else if (pml == 1) curl_loop<false,1>(f, g1, g2, s1, s2, dtdx, L);
+    else curl_loop<false,2>(f, g1, g2, s1, s2, dtdx, L);
+  }
+}
+
+void step_update_EDHB(realnum *f, realnum *fw, const realnum *g,
+                      const realnum *u, const simd_loop &L) {
+  const int pml = !L.ca ? 0 : (L.kloop == 3 ? 2 : 1);
+  if (u) {
+    if (pml == 0) update_loop<true,0>(f, fw, g, u, L);
+    else if (pml == 1) update_loop<true,1>(f, fw, g, u, L);
+    else update_loop<true,2>(f, fw, g, u, L);
+  }
+  else {
+    if (pml == 0) update_loop<false,0>(f, fw, g, u, L);
+    else if (pml == 1) update_loop<false,1>(f, fw, g, u, L);
+    else update_loop<false,2>(f, fw, g, u, L);
+  }
+}
+
+void dft_accumulate(realnum *dft, const realnum *fbuf,
+                    const realnum *phase, const realnum *phase_swapped,
+                    ptrdiff_t N, int Nbatch, int nb, bool cmplx,
+                    ptrdiff_t n2) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (N * n2 * nb >= 131072)
+#endif
+  for (ptrdiff_t n = 0; n < N; ++n) {
+    if (cmplx)
+      dft_row<true>(dft + n*n2, phase, phase_swapped, fbuf + n*Nbatch*2,
+                    nb, n2);
+    else
+      dft_row<false>(dft + n*n2, phase, phase_swapped, fbuf + n*Nbatch*2,
+                     nb, n2);
+  }
+}
+
+#undef SIMD_ROW_K
+#undef VSPLAT
+#undef VSTORE
+#undef VLOAD
+
+} // namespace SIMD_NAMESPACE
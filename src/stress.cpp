@@ -19,6 +19,7 @@
    stress tensor of the Fourier-transformed fields */
 
 #include <meep.hpp>
+#include "meep_internals.hpp"
 
 using namespace std;
 
@@ -31,13 +32,24 @@ dft_force::dft_force(dft_chunk *offdiag1_, dft_chunk *offdiag2_, dft_chunk *diag
   freq_min = fmin;
   Nfreq = Nf;
   dfreq = Nf <= 1 ? 0.0 : (fmax - fmin) / (Nf - 1);
+  freq = dft_freqs(fmin, fmax, Nf);
   offdiag1 = offdiag1_; offdiag2 = offdiag2_; diag = diag_;
   //where = new volume(where_.get_min_corner(), where_.get_max_corner());
 }
 
+dft_force::dft_force(dft_chunk *offdiag1_, dft_chunk *offdiag2_, dft_chunk *diag_,
+                     const vector<double> &freq_, const volume &where_) : where(where_)
+{
+  freq = freq_;
+  freq_min = freq.empty() ? 0.0 : freq[0];
+  Nfreq = freq.size();
+  dfreq = dft_freqs_spacing(freq);
+  offdiag1 = offdiag1_; offdiag2 = offdiag2_; diag = diag_;
+}
+
 dft_force::dft_force(const dft_force &f): where(f.where)
 {
-  freq_min = f.freq_min; Nfreq = f.Nfreq; dfreq = f.dfreq;
+  freq = f.freq; freq_min = f.freq_min; Nfreq = f.Nfreq; dfreq = f.dfreq;
   offdiag1 = f.offdiag1; offdiag2 = f.offdiag2; diag = f.diag;
   //where = new volume(f.where->get_min_corner(), f.where->get_max_corner());
 }
@@ -74,6 +86,8 @@ static void stress_sum(int Nfreq, double *F,
        curF1 = curF1->next_in_dft, curF2 = curF2->next_in_dft) {
     complex<realnum> extra_weight(real(curF1->extra_weight),
 				  imag(curF1->extra_weight));
+    curF1->flush_dft();
+    curF2->flush_dft();
     for (size_t k = 0; k < curF1->N; ++k)
       for (int i = 0; i < Nfreq; ++i)
       	F[i] += real(extra_weight * curF1->dft[k*Nfreq + i]
@@ -135,6 +149,11 @@ void dft_force::scale_dfts(complex<double> scale) {
    Ex, Ey, ... or Sx, ...)  rather than pseudovectors (like Hx, ...). */
 dft_force fields::add_dft_force(const volume_list *where_,
 				double freq_min, double freq_max, int Nfreq){
+  return add_dft_force(where_, dft_freqs(freq_min, freq_max, Nfreq));
+}
+
+dft_force fields::add_dft_force(const volume_list *where_,
+				const vector<double> &freq){
   dft_chunk *offdiag1 = 0, *offdiag2 = 0, *diag = 0;
 
   volume_list *where = S.reduce(where_);
@@ -151,33 +170,33 @@ dft_force fields::add_dft_force(const volume_list *where_,
 
     if (fd != nd) { // off-diagaonal stress-tensor terms
       offdiag1 = add_dft(direction_component(Ex, fd),
-			 where->v, freq_min, freq_max, Nfreq,
+			 where->v, freq,
 			 true, where->weight, offdiag1);
       offdiag2 = add_dft(direction_component(Ex, nd),
-			 where->v, freq_min, freq_max, Nfreq,
+			 where->v, freq,
 			 false, 1.0, offdiag2);
       offdiag1 = add_dft(direction_component(Hx, fd),
-			 where->v, freq_min, freq_max, Nfreq,
+			 where->v, freq,
 			 true, where->weight, offdiag1);
       offdiag2 = add_dft(direction_component(Hx, nd),
-			 where->v, freq_min, freq_max, Nfreq,
+			 where->v, freq,
 			 false, 1.0, offdiag2);
     }
     else  // diagonal stress-tensor terms
       LOOP_OVER_FIELD_DIRECTIONS(gv.dim, d) {
 	complex<double> weight1 = where->weight * (d == fd ? +0.5 : -0.5);
 	diag = add_dft(direction_component(Ex, d),
-		       where->v, freq_min, freq_max, Nfreq,
+		       where->v, freq,
 		       true, 1.0, diag, true, weight1, false);
 	diag = add_dft(direction_component(Hx, d),
-		       where->v, freq_min, freq_max, Nfreq,
+		       where->v, freq,
 		       true, 1.0, diag, true, weight1, false);
       }
     everywhere = everywhere | where->v;
   }
 
   delete where_save;
-  return dft_force(offdiag1, offdiag2, diag, freq_min, freq_max, Nfreq, everywhere);
+  return dft_force(offdiag1, offdiag2, diag, freq, everywhere);
 }
 
 } // namespace meep
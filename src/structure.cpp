@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <vector>
 
 #include "meep.hpp"
 #include "meep_internals.hpp"
@@ -46,13 +47,13 @@ structure::structure(const grid_volume &thegv, material_function &eps,
 		     const boundary_region &br,
 		     const symmetry &s,
 		     int num, double Courant, bool use_anisotropic_averaging,
-		     double tol, int maxeval) :
+		     double tol, int maxeval, const cost_map *costs) :
   Courant(Courant), v(D1) // Aaack, this is very hokey.
 {
   outdir = ".";
   shared_chunks = false;
   if (!br.check_ok(thegv)) abort("invalid boundary absorbers for this grid_volume");
-  choose_chunkdivision(thegv, num, br, s);
+  choose_chunkdivision(thegv, num, br, s, costs);
   set_materials(eps, use_anisotropic_averaging, tol, maxeval);
 }
 
@@ -60,23 +61,144 @@ structure::structure(const grid_volume &thegv, double eps(const vec &),
 		     const boundary_region &br,
 		     const symmetry &s,
 		     int num, double Courant, bool use_anisotropic_averaging,
-		     double tol, int maxeval) :
+		     double tol, int maxeval, const cost_map *costs) :
   Courant(Courant), v(D1) // Aaack, this is very hokey.
 {
   outdir = ".";
   shared_chunks = false;
   if (!br.check_ok(thegv)) abort("invalid boundary absorbers for this grid_volume");
-  choose_chunkdivision(thegv, num, br, s);
+  choose_chunkdivision(thegv, num, br, s, costs);
   if (eps) {
     simple_material_function epsilon(eps);
     set_materials(epsilon, use_anisotropic_averaging, tol, maxeval);
   }
 }
 
+/* The default extra costs per pixel, relative to a vacuum pixel,
+   rounded from the measurements of tests/bench_cost.cpp on a single
+   core (3d, double precision, AVX2).  The pml cost is per PML
+   direction, the dft cost is per component and frequency, and the
+   susceptibility cost is per susceptibility. */
+chunk_cost_model::chunk_cost_model() :
+  pml(0.7), anisotropic(0.2),
+  conductivity(0.15), nonlinear(0.25),
+  susceptibility(1.0), dft(0.1) {}
+
+void cost_map::add(const volume &box, double cost_per_pixel) {
+  if (cost_per_pixel == 0) return;
+  boxes.push_back(box);
+  costs.push_back(cost_per_pixel);
+}
+
+/* The range [*i0, *i1) of the pixels i = 0..n-1 of gv in direction d
+   that overlap box, where pixel i is [lo + i/a, lo + (i+1)/a]; a box of
+   zero (or less than one pixel) width still overlaps one pixel. */
+static void box_pixel_range(const grid_volume &gv, const volume &box,
+                            direction d, int *i0, int *i1) {
+  const int n = gv.num_direction(d);
+  const double lo = gv.surroundings().in_direction_min(d);
+  const double x0 = (box.in_direction_min(d) - lo) * gv.a;
+  const double x1 = (box.in_direction_max(d) - lo) * gv.a;
+  int j0 = int(floor(x0 + 1e-6)), j1 = int(ceil(x1 - 1e-6));
+  if (j1 <= j0) j1 = j0 + 1;
+  *i0 = max(j0, 0);
+  *i1 = min(j1, n);
+}
+
+double cost_map::cost(const grid_volume &gv) const {
+  double total = gv.nowned_min();
+  for (size_t j = 0; j < boxes.size(); ++j) {
+    double pixels = 1;
+    LOOP_OVER_DIRECTIONS(gv.dim, d) {
+      int i0, i1;
+      box_pixel_range(gv, boxes[j], d, &i0, &i1);
+      pixels *= max(i1 - i0, 0);
+    }
+    total += costs[j] * pixels;
+  }
+  return total;
+}
+
+vector<double> cost_map::slice_costs(const grid_volume &gv, direction d) const {
+  const int n = gv.num_direction(d);
+  // difference array: the cost of slice i is the sum of dc[0..i]
+  vector<double> dc(n + 1, 0.0);
+  dc[0] = gv.nowned_min() / n;
+  for (size_t j = 0; j < boxes.size(); ++j) {
+    double pixels = 1; // pixels of boxes[j] in each slice
+    int k0 = 0, k1 = 0;
+    LOOP_OVER_DIRECTIONS(gv.dim, dd) {
+      int i0, i1;
+      box_pixel_range(gv, boxes[j], dd, &i0, &i1);
+      if (dd == d) { k0 = i0; k1 = i1; }
+      else pixels *= max(i1 - i0, 0);
+    }
+    if (k1 > k0 && pixels > 0) {
+      dc[k0] += costs[j] * pixels;
+      dc[k1] -= costs[j] * pixels;
+    }
+  }
+  vector<double> c(n);
+  double sum = 0;
+  for (int i = 0; i < n; ++i) c[i] = (sum += dc[i]);
+  return c;
+}
+
+/* Recursive bisection of gv into n parts of (nearly) equal cost: gv is
+   cut along its longest direction so that the cost of each half is in
+   proportion to the number of parts it will be divided into.  This is
+   like grid_volume::split_by_effort, but computes all the parts at once,
+   and finds the cut from the prefix sums of the slice costs. */
+static void split_by_cost(const grid_volume &gv, int n, const cost_map &costs,
+                          vector<grid_volume> &parts) {
+  if (n == 1) { parts.push_back(gv); return; }
+  if (size_t(n) > gv.nowned_min())
+    abort("Cannot split %zd grid points into %d parts\n", gv.nowned_min(), n);
+
+  int biglen = 0;
+  direction splitdir = NO_DIRECTION;
+  LOOP_OVER_DIRECTIONS(gv.dim, d)
+    if (gv.num_direction(d) > biglen) { biglen = gv.num_direction(d); splitdir = d; }
+
+  const int n_low = n / 2, n_high = n - n_low;
+  const size_t slice_points = gv.nowned_min() / biglen;
+  const vector<double> c = costs.slice_costs(gv, splitdir);
+  double total = 0;
+  for (int i = 0; i < biglen; ++i) total += c[i];
+
+  int best_split_point = 0;
+  double best_split_measure = infinity, left = 0;
+  for (int split_point = 1; split_point < biglen; ++split_point) {
+    left += c[split_point - 1];
+    // each half must have at least as many points as parts
+    if (split_point * slice_points < size_t(n_low)
+        || (biglen - split_point) * slice_points < size_t(n_high))
+      continue;
+    double split_measure = max(left / n_low, (total - left) / n_high);
+    if (split_measure < best_split_measure) {
+      best_split_measure = split_measure;
+      best_split_point = split_point;
+    }
+  }
+  if (best_split_point == 0) { // fall back to the geometric split
+    for (int which = 0; which < n; ++which)
+      parts.push_back(gv.split(n, which));
+    return;
+  }
+
+  grid_volume v_low = gv, v_high = gv;
+  v_low.set_num_direction(splitdir, best_split_point);
+  v_high.set_num_direction(splitdir, biglen - best_split_point);
+  v_high.shift_origin(splitdir, best_split_point * 2);
+  split_by_cost(v_low, n_low, costs, parts);
+  split_by_cost(v_high, n_high, costs, parts);
+}
+
 void structure::choose_chunkdivision(const grid_volume &thegv,
 				     int desired_num_chunks,
 				     const boundary_region &br,
-				     const symmetry &s) {
+				     const symmetry &s,
+				     const cost_map *costs_) {
   user_volume = thegv;
   if (desired_num_chunks == 0)
     desired_num_chunks = count_processors();
@@ -121,7 +243,8 @@ void structure::choose_chunkdivision(const grid_volume &thegv,
       if (break_this[d]) gv = gv.pad((direction)d);
   }
 
-  // initialize effort volumes
+  // initialize effort volumes and costs
+  costs = costs_ ? *costs_ : cost_map();
   num_effort_volumes = 1;
   effort_volumes = new grid_volume[num_effort_volumes];
   effort_volumes[0] = gv;
@@ -131,17 +254,19 @@ void structure::choose_chunkdivision(const grid_volume &thegv,
   // Next, add effort volumes for PML boundary regions:
   br.apply(this);
 
-  // Finally, create the chunks:
+  // Finally, create the chunks, balanced by cost and then further
+  // divided along the PML boundaries:
+  vector<grid_volume> parts;
+  split_by_cost(gv, desired_num_chunks, costs, parts);
   num_chunks = 0;
   chunks = new structure_chunk_ptr[desired_num_chunks * num_effort_volumes];
   for (int i = 0; i < desired_num_chunks; i++) {
     const int proc = i * count_processors() / desired_num_chunks;
-    grid_volume vi = gv.split_by_effort(desired_num_chunks, i,
-                                  num_effort_volumes, effort_volumes, effort);
     for (int j = 0; j < num_effort_volumes; j++) {
       grid_volume vc;
-      if (vi.intersect_with(effort_volumes[j], &vc)) {
+      if (parts[i].intersect_with(effort_volumes[j], &vc)) {
       	chunks[num_chunks] = new structure_chunk(vc, v, Courant, proc);
+      	chunks[num_chunks]->cost = costs.cost(vc);
       	br.apply(this, chunks[num_chunks++]);
       }
     }
@@ -303,6 +428,7 @@ structure::structure(const structure *s) : v(s->v) {
     effort_volumes[i] = s->effort_volumes[i];
     effort[i] = s->effort[i];
   }
+  costs = s->costs;
   a = s->a;
   Courant = s->Courant;
   dt = s->dt;
@@ -326,6 +452,7 @@ structure::structure(const structure &s) : v(s.v) {
     effort_volumes[i] = s.effort_volumes[i];
     effort[i] = s.effort[i];
   }
+  costs = s.costs;
   a = s.a;
   Courant = s.Courant;
   dt = s.dt;
@@ -502,7 +629,8 @@ void structure::use_pml(direction d, boundary_side b, double dx) {
 			       - gv.little_corner().in_direction(d)) / 2;
   if (b == Low && v_to_user_shift != 0)
     pml_volume.set_num_direction(d, pml_volume.num_direction(d) + v_to_user_shift);
-  add_to_effort_volumes(pml_volume, 0.60); // FIXME: manual value for pml effort
+  add_to_effort_volumes(pml_volume, costs.model.pml);
+  costs.add(pml_volume.surroundings(), costs.model.pml);
 }
 
 bool structure::has_chi(component c, direction d) const {
@@ -685,6 +813,7 @@ void structure_chunk::update_condinv() {
 
 structure_chunk::structure_chunk(const structure_chunk *o) : v(o->v) {
   refcount = 1;
+  cost = o->cost;
 
   FOR_FIELD_TYPES(ft) {
     {
@@ -876,6 +1005,7 @@ structure_chunk::structure_chunk(const grid_volume &thegv,
 				 double Courant, int pr)
   : Courant(Courant), v(thegv.surroundings() & vol_limit) {
   refcount = 1;
+  cost = thegv.nowned_min();
   pml_fmin = 0.2;
   FOR_FIELD_TYPES(ft) { chiP[ft] = NULL; }
   gv = thegv;
@@ -28,6 +28,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <typeinfo>
 #include "meep.hpp"
 #include "meep_internals.hpp"
 
@@ -65,7 +66,9 @@ void susceptibility::delete_internal_data(void *data) const {
    simplifies communication in boundaries.cpp, because we can be sure that
    one chunk has a P then any chunk it borders has the same P, so we don't
    have to worry about communicating with something that doesn't exist.
-   TODO: reduce memory usage (bookkeeping seem much harder, though).
+   (The Lorentzian susceptibilities reduce the waste by storing P only
+   where sigma is nonzero and at the chunk boundaries, when possible;
+   see lorentzian_layout.)
 */
 bool susceptibility::needs_P(component c, int cmp,
 			     realnum *W[NUM_FIELD_COMPONENTS][2])
@@ -90,22 +93,133 @@ bool susceptibility::needs_W_notowned(component c,
   return false;
 }
 
+// a run of n consecutive indices start..start+n-1 of the chunk's grid,
+// stored at pos..pos+n-1 of a sparsely stored P
+typedef struct {
+  size_t start, n, pos;
+} lorentzian_run;
+
+/* If sparse[c], P[c] and P_prev[c] are stored only at the npts[c] points
+   of the nruns[c] runs[c], and are updated (by update_P) only at the
+   points of the nupd[c] runs upd[c]; otherwise they are stored for all
+   ntot points of the chunk.  The runs follow the P arrays in data. */
 typedef struct {
   size_t sz_data;
   size_t ntot;
   realnum *P[NUM_FIELD_COMPONENTS][2];
   realnum *P_prev[NUM_FIELD_COMPONENTS][2];
+  bool sparse[NUM_FIELD_COMPONENTS];
+  size_t npts[NUM_FIELD_COMPONENTS];
+  size_t nruns[NUM_FIELD_COMPONENTS], nupd[NUM_FIELD_COMPONENTS];
+  lorentzian_run *runs[NUM_FIELD_COMPONENTS], *upd[NUM_FIELD_COMPONENTS];
+  realnum zero; // the (never written) value of P at the points not stored
   realnum data[1];
 } lorentzian_data;
 
+/* The points at which a sparse P[c] is stored: the notowned points
+   (which are communicated between chunks, even if sigma is zero there
+   in this chunk) and the owned points where sigma s is nonzero (which
+   are the points where P is updated, the others remaining zero).
+   Returns the number of points, setting the numbers of runs (and the
+   runs, if non-NULL). */
+static size_t sparse_runs(const realnum *s, const grid_volume &gv,
+			  component c, size_t *nruns, size_t *nupd,
+			  lorentzian_run *runs, lorentzian_run *upd) {
+  const size_t ntot = gv.ntot();
+  vector<char> mask(ntot, 0);
+  LOOP_OVER_VOL_NOTOWNED(gv, c, i) mask[i] = 1;
+  if (s) LOOP_OVER_VOL_OWNED(gv, c, i) if (s[i] != 0) mask[i] = 2;
+  size_t npts = 0;
+  *nruns = *nupd = 0;
+  for (size_t i = 0; i < ntot; ++i) if (mask[i]) {
+    if (i == 0 || !mask[i-1]) {
+      if (runs) { runs[*nruns].start = i; runs[*nruns].n = 0;
+	          runs[*nruns].pos = npts; }
+      ++*nruns;
+    }
+    if (runs) runs[*nruns - 1].n++;
+    if (mask[i] == 2) {
+      if (i == 0 || mask[i-1] != 2) {
+	if (upd) { upd[*nupd].start = i; upd[*nupd].n = 0;
+	           upd[*nupd].pos = npts; }
+	++*nupd;
+      }
+      if (upd) upd[*nupd - 1].n++;
+    }
+    ++npts;
+  }
+  return npts;
+}
+
+/* Return the size of the lorentzian_data for sus, initializing its
+   P pointers and runs if d is non-NULL.  P[c] is stored sparsely if
+   it is coupled only to W[c] (no offdiagonal sigma, so that P is zero
+   wherever sigma[c] is zero), and if that at least halves its storage,
+   e.g. for a thin metal film in a large cell (or a chunk that does not
+   contain the medium at all, see needs_P). */
+static size_t lorentzian_layout(const susceptibility *sus,
+				realnum *W[NUM_FIELD_COMPONENTS][2],
+				const grid_volume &gv, lorentzian_data *d) {
+  const size_t ntot = gv.ntot();
+  size_t npts[NUM_FIELD_COMPONENTS], nruns[NUM_FIELD_COMPONENTS],
+    nupd[NUM_FIELD_COMPONENTS];
+  size_t num = 0, numruns = 0;
+  FOR_COMPONENTS(c) {
+    npts[c] = nruns[c] = nupd[c] = 0;
+    if (!sus->needs_P(c, 0, W) && !sus->needs_P(c, 1, W)) continue;
+    npts[c] = ntot;
+    const direction dc = component_direction(c);
+    bool isotropic = true;
+    FOR_DIRECTIONS(dd)
+      if (dd != dc && !sus->trivial_sigma[c][dd]) isotropic = false;
+    if (isotropic) {
+      const size_t n = sparse_runs(sus->sigma[c][dc], gv, c,
+				   &nruns[c], &nupd[c], NULL, NULL);
+      if (n && 2 * n <= ntot)
+	npts[c] = n;
+      else
+	nruns[c] = nupd[c] = 0;
+    }
+    DOCMP2 if (sus->needs_P(c, cmp, W)) num += 2 * npts[c];
+    numruns += nruns[c] + nupd[c];
+  }
+  // the runs follow the P data, aligned for size_t
+  size_t sz = sizeof(lorentzian_data) + sizeof(realnum) * num;
+  sz = (sz + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t);
+  const size_t sz_runs = sz;
+  sz += sizeof(lorentzian_run) * numruns;
+  if (!d) return sz;
+
+  d->ntot = ntot;
+  realnum *P = d->data;
+  lorentzian_run *runs = (lorentzian_run *) ((char *) d + sz_runs);
+  FOR_COMPONENTS(c) if (npts[c]) {
+    d->npts[c] = npts[c];
+    if (nruns[c]) {
+      d->sparse[c] = true;
+      d->nruns[c] = nruns[c];
+      d->nupd[c] = nupd[c];
+      d->runs[c] = runs;
+      d->upd[c] = runs + nruns[c];
+      runs += nruns[c] + nupd[c];
+      sparse_runs(sus->sigma[c][component_direction(c)], gv, c,
+		  &nruns[c], &nupd[c], d->runs[c], d->upd[c]);
+    }
+    DOCMP2 if (sus->needs_P(c, cmp, W)) {
+      d->P[c][cmp] = P;
+      d->P_prev[c][cmp] = P + npts[c];
+      P += 2 * npts[c];
+    }
+  }
+  return sz;
+}
+
 // for Lorentzian susc. the internal data is just a backup of P from
 // the previous timestep.
 void *lorentzian_susceptibility::new_internal_data(
 			 realnum *W[NUM_FIELD_COMPONENTS][2],
 			 const grid_volume &gv) const {
-  int num = 0;
-  FOR_COMPONENTS(c) DOCMP2 if (needs_P(c, cmp, W)) num += 2 * gv.ntot();
-  size_t sz = sizeof(lorentzian_data) + sizeof(realnum) * (num - 1);
+  size_t sz = lorentzian_layout(this, W, gv, NULL);
   lorentzian_data *d = (lorentzian_data *) malloc(sz);
   d->sz_data = sz;
   return (void*) d;
@@ -119,15 +233,12 @@ void lorentzian_susceptibility::init_internal_data(
   size_t sz_data = d->sz_data;
   memset(d, 0, sz_data);
   d->sz_data = sz_data;
-  size_t ntot = d->ntot = gv.ntot();
-  realnum *P = d->data;
-  realnum *P_prev = d->data + ntot;
-  FOR_COMPONENTS(c) DOCMP2 if (needs_P(c, cmp, W)) {
-    d->P[c][cmp] = P;
-    d->P_prev[c][cmp] = P_prev;
-    P += 2*ntot;
-    P_prev += 2*ntot;
-  }
+  lorentzian_layout(this, W, gv, d);
+}
+
+// the pointer p into d, moved to the same place in the copy dnew of d
+template <class T> static T *relocate(T *p, const void *d, void *dnew) {
+  return p ? (T *) ((char *) dnew + ((const char *) p - (const char *) d)) : p;
 }
 
 void *lorentzian_susceptibility::copy_internal_data(void *data) const {
@@ -135,18 +246,68 @@ void *lorentzian_susceptibility::copy_internal_data(void *data) const {
   if (!d) return 0;
   lorentzian_data *dnew = (lorentzian_data *) malloc(d->sz_data);
   memcpy(dnew, d, d->sz_data);
-  size_t ntot = d->ntot;
-  realnum *P = dnew->data;
-  realnum *P_prev = dnew->data + ntot;
-  FOR_COMPONENTS(c) DOCMP2 if (d->P[c][cmp]) {
-    dnew->P[c][cmp] = P;
-    dnew->P_prev[c][cmp] = P_prev;
-    P += 2*ntot;
-    P_prev += 2*ntot;
+  FOR_COMPONENTS(c) {
+    DOCMP2 {
+      dnew->P[c][cmp] = relocate(d->P[c][cmp], d, dnew);
+      dnew->P_prev[c][cmp] = relocate(d->P_prev[c][cmp], d, dnew);
+    }
+    dnew->runs[c] = relocate(d->runs[c], d, dnew);
+    dnew->upd[c] = relocate(d->upd[c], d, dnew);
   }
   return (void*) dnew;
 }
 
+// array n is P (n even) or P_prev (n odd) for c = n/4 and cmp = (n/2)%2
+realnum *lorentzian_susceptibility::internal_array(int n, void *P_internal_data,
+						   component *c, int *nvals) const {
+  lorentzian_data *d = (lorentzian_data *) P_internal_data;
+  *c = component(n / 4);
+  *nvals = 1;
+  if (!d || d->sparse[*c]) return 0;
+  const int cmp = (n / 2) % 2;
+  return n % 2 ? d->P_prev[*c][cmp] : d->P[*c][cmp];
+}
+
+bool lorentzian_susceptibility::get_internal_array(int n, void *P_internal_data,
+						   realnum *a) const {
+  lorentzian_data *d = (lorentzian_data *) P_internal_data;
+  if (!d) return false;
+  const component c = component(n / 4);
+  const int cmp = (n / 2) % 2;
+  const realnum *p = n % 2 ? d->P_prev[c][cmp] : d->P[c][cmp];
+  if (!p) return false;
+  if (!a) return true;
+  if (!d->sparse[c]) {
+    memcpy(a, p, sizeof(realnum) * d->ntot);
+    return true;
+  }
+  memset(a, 0, sizeof(realnum) * d->ntot);
+  for (size_t k = 0; k < d->nruns[c]; ++k) {
+    const lorentzian_run &r = d->runs[c][k];
+    memcpy(a + r.start, p + r.pos, sizeof(realnum) * r.n);
+  }
+  return true;
+}
+
+bool lorentzian_susceptibility::set_internal_array(int n, void *P_internal_data,
+						   const realnum *a) const {
+  lorentzian_data *d = (lorentzian_data *) P_internal_data;
+  if (!d) return false;
+  const component c = component(n / 4);
+  const int cmp = (n / 2) % 2;
+  realnum *p = n % 2 ? d->P_prev[c][cmp] : d->P[c][cmp];
+  if (!p) return false;
+  if (!d->sparse[c]) {
+    memcpy(p, a, sizeof(realnum) * d->ntot);
+    return true;
+  }
+  for (size_t k = 0; k < d->nruns[c]; ++k) {
+    const lorentzian_run &r = d->runs[c][k];
+    memcpy(p + r.pos, a + r.start, sizeof(realnum) * r.n);
+  }
+  return true;
+}
+
 /* Return true if the discretized Lorentzian ODE is intrinsically unstable,
    i.e. if it corresponds to a filter with a pole z outside the unit circle.
    Note that the pole satisfies the quadratic equation:
@@ -162,6 +323,22 @@ static bool lorentzian_unstable(double omega_0, double gamma, double dt) {
   return b*b > c && 2*b*b - c + 2*fabs(b)*sqrt(b*b - c) > 1;
 }
 
+// update the n points p[j*st] of an isotropic Lorentzian polarization
+static inline void lorentzian_row(realnum *p, realnum *pp, const realnum *s,
+				  const realnum *w, ptrdiff_t n, ptrdiff_t st,
+				  double gamma1inv, double gamma1,
+				  double omega0dtsqr, double omega0dtsqr_denom) {
+  _Pragma(IVDEP)
+  for (ptrdiff_t j = 0; j < n; ++j) {
+    const ptrdiff_t i = j * st;
+    realnum pcur = p[i];
+    p[i] = gamma1inv * (pcur * (2 - omega0dtsqr_denom)
+			- gamma1 * pp[i]
+			+ omega0dtsqr * (s[i] * w[i]));
+    pp[i] = pcur;
+  }
+}
+
 #define SWAP(t,a,b) { t SWAP_temp = a; a = b; b = SWAP_temp; }
 
   // stable averaging of offdiagonal components
@@ -183,7 +360,19 @@ void lorentzian_susceptibility::update_P
 
   FOR_COMPONENTS(c) DOCMP2 if (d->P[c][cmp]) {
     const realnum *w = W[c][cmp], *s = sigma[c][component_direction(c)];
-    if (w && s) {
+    if (w && s && d->sparse[c]) { // isotropic, only at the points with sigma
+      realnum *p = d->P[c][cmp], *pp = d->P_prev[c][cmp];
+      const lorentzian_run *upd = d->upd[c];
+      const ptrdiff_t nupd = d->nupd[c];
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16) if (nupd > 64)
+#endif
+      for (ptrdiff_t k = 0; k < nupd; ++k)
+	lorentzian_row(p + upd[k].pos, pp + upd[k].pos, s + upd[k].start,
+		       w + upd[k].start, upd[k].n, 1, gamma1inv, gamma1,
+		       omega0dtsqr, omega0dtsqr_denom);
+    }
+    else if (w && s) {
       realnum *p = d->P[c][cmp], *pp = d->P_prev[c][cmp];
 
       // directions/strides for offdiagonal terms, similar to update_eh
@@ -208,7 +397,7 @@ void lorentzian_susceptibility::update_P
 	SWAP(const realnum *, s1, s2);
       }
       if (s1 && s2) { // 3x3 anisotropic
-	LOOP_OVER_VOL_OWNED(gv, c, i) {
+	PLOOP_OVER_VOL_OWNED(gv, c, i) {
 	  realnum pcur = p[i];
 	  p[i] = gamma1inv * (pcur * (2 - omega0dtsqr_denom)
 			      - gamma1 * pp[i]
@@ -219,7 +408,7 @@ void lorentzian_susceptibility::update_P
 	}
       }
       else if (s1) { // 2x2 anisotropic
-	LOOP_OVER_VOL_OWNED(gv, c, i) {
+	PLOOP_OVER_VOL_OWNED(gv, c, i) {
 	  realnum pcur = p[i];
 	  p[i] = gamma1inv * (pcur * (2 - omega0dtsqr_denom)
 			      - gamma1 * pp[i]
@@ -229,7 +418,7 @@ void lorentzian_susceptibility::update_P
 	}
       }
       else { // isotropic
-	LOOP_OVER_VOL_OWNED(gv, c, i) {
+	PLOOP_OVER_VOL_OWNED(gv, c, i) {
 	  realnum pcur = p[i];
 	  p[i] = gamma1inv * (pcur * (2 - omega0dtsqr_denom)
 			      - gamma1 * pp[i]
@@ -241,6 +430,162 @@ void lorentzian_susceptibility::update_P
   }
 }
 
+/* Fused timestepping of several Lorentzian polarizations, e.g. the
+   poles of a Drude-Lorentz fit of a metal.  Rather than making one pass
+   over the grid per pole (each re-reading W from memory), we loop once
+   over the rows of the grid (along the last, contiguous, dimension),
+   updating the P of every pole in each row while the row of W stays in
+   cache.  Similarly, the P of all the poles are subtracted from each
+   block of f_minus_p while it stays in cache.  The arithmetic (and its
+   order) is the same as in update_P and subtract_P.  The polarizations
+   must be stored densely (see lorentzian_layout). */
+
+void lorentzian_susceptibility::update_P_fused(int n,
+		     const lorentzian_susceptibility *const *sus,
+		     void *const *data,
+		     realnum *W[NUM_FIELD_COMPONENTS][2],
+		     double dt, const grid_volume &gv) {
+  // the fused loop only handles the isotropic case (diagonal sigma)
+  bool isotropic = true;
+  for (int k = 0; k < n; ++k) {
+    const lorentzian_data *d = (const lorentzian_data *) data[k];
+    FOR_COMPONENTS(c) DOCMP2 if (d->P[c][cmp] && W[c][cmp])
+      for (int m = 1; m <= 2; ++m) {
+	const direction dm = cycle_direction(gv.dim, component_direction(c), m);
+	if (sus[k]->sigma[c][dm] && W[direction_component(c, dm)][cmp])
+	  isotropic = false;
+      }
+  }
+  if (!isotropic) {
+    for (int k = 0; k < n; ++k) sus[k]->update_P(W, NULL, dt, gv, data[k]);
+    return;
+  }
+
+  vector<double> gamma1inv(n), gamma1(n), omega0dtsqr(n), omega0dtsqr_denom(n);
+  for (int k = 0; k < n; ++k) {
+    const double omega2pi = 2*pi*sus[k]->omega_0, g2pi = sus[k]->gamma*2*pi;
+    omega0dtsqr[k] = omega2pi * omega2pi * dt * dt;
+    gamma1inv[k] = 1 / (1 + g2pi*dt/2);
+    gamma1[k] = (1 - g2pi*dt/2);
+    omega0dtsqr_denom[k] = sus[k]->no_omega_0_denominator ? 0 : omega0dtsqr[k];
+  }
+
+  vector<int> poles(n);
+  vector<realnum *> p(n), pp(n);
+  vector<const realnum *> s(n);
+  FOR_COMPONENTS(c) DOCMP2 if (W[c][cmp]) {
+    const realnum *w = W[c][cmp];
+    int np = 0; // number of poles with P[c][cmp] and sigma
+    for (int k = 0; k < n; ++k) {
+      const lorentzian_data *d = (const lorentzian_data *) data[k];
+      if (d->P[c][cmp] && sus[k]->sigma[c][component_direction(c)]) {
+	poles[np] = k;
+	p[np] = d->P[c][cmp];
+	pp[np] = d->P_prev[c][cmp];
+	s[np++] = sus[k]->sigma[c][component_direction(c)];
+      }
+    }
+    if (!np) continue;
+
+    // loop over the first point i0 of each row of n3 points
+    ivec is(gv.little_owned_corner(c)), ie(gv.big_corner());
+    const direction d3 = gv.yucky_direction(2);
+    const ptrdiff_t n3 = (ie.in_direction(d3) - is.in_direction(d3)) / 2 + 1;
+    const ptrdiff_t s3 = gv.stride(d3);
+    ie.set_direction(d3, is.in_direction(d3));
+    PLOOP_OVER_IVECS(gv, is, ie, i0) {
+      for (int j = 0; j < np; ++j) {
+	const int k = poles[j];
+	if (s3 == 1) // so that the compiler can vectorize this case
+	  lorentzian_row(p[j] + i0, pp[j] + i0, s[j] + i0, w + i0, n3, 1,
+			 gamma1inv[k], gamma1[k],
+			 omega0dtsqr[k], omega0dtsqr_denom[k]);
+	else
+	  lorentzian_row(p[j] + i0, pp[j] + i0, s[j] + i0, w + i0, n3, s3,
+			 gamma1inv[k], gamma1[k],
+			 omega0dtsqr[k], omega0dtsqr_denom[k]);
+      }
+    }
+  }
+}
+
+void lorentzian_susceptibility::subtract_P_fused(int n,
+		       const lorentzian_susceptibility *const *sus,
+		       void *const *data,
+		       field_type ft,
+		       realnum *f_minus_p[NUM_FIELD_COMPONENTS][2]) {
+  (void) sus; // unused
+  field_type ft2 = ft == E_stuff ? D_stuff : B_stuff; // for sources etc.
+  const size_t ntot = ((const lorentzian_data *) data[0])->ntot;
+  const size_t block = 1024;
+  vector<const realnum *> p(n);
+  FOR_FT_COMPONENTS(ft, ec) DOCMP2 {
+    realnum *fmp = f_minus_p[field_type_component(ft2, ec)][cmp];
+    if (!fmp) continue;
+    int np = 0;
+    for (int k = 0; k < n; ++k) {
+      const lorentzian_data *d = (const lorentzian_data *) data[k];
+      if (d->P[ec][cmp]) p[np++] = d->P[ec][cmp];
+    }
+    for (size_t i0 = 0; np && i0 < ntot; i0 += block) {
+      const size_t i1 = i0 + block < ntot ? i0 + block : ntot;
+      for (int j = 0; j < np; ++j) {
+	const realnum *pj = p[j];
+	for (size_t i = i0; i < i1; ++i) fmp[i] -= pj[i];
+      }
+    }
+  }
+}
+
+// whether s is a plain lorentzian_susceptibility (not a subclass)
+// whose polarizations in this chunk are all stored densely
+static bool fusable(const susceptibility *s, void *data) {
+  if (typeid(*s) != typeid(lorentzian_susceptibility)) return false;
+  const lorentzian_data *d = (const lorentzian_data *) data;
+  FOR_COMPONENTS(c) if (d->sparse[c]) return false;
+  return true;
+}
+
+void update_polarizations(polarization_state *pol,
+			  realnum *W[NUM_FIELD_COMPONENTS][2],
+			  realnum *W_prev[NUM_FIELD_COMPONENTS][2],
+			  double dt, const grid_volume &gv) {
+  vector<const lorentzian_susceptibility *> sus;
+  vector<void *> data;
+  for (polarization_state *p = pol; p; p = p->next)
+    if (p->data && fusable(p->s, p->data)) {
+      sus.push_back((const lorentzian_susceptibility *) p->s);
+      data.push_back(p->data);
+    }
+    else
+      p->s->update_P(W, W_prev, dt, gv, p->data);
+  if (sus.size() == 1)
+    sus[0]->update_P(W, W_prev, dt, gv, data[0]);
+  else if (sus.size() > 1)
+    lorentzian_susceptibility::update_P_fused(int(sus.size()), &sus[0],
+					      &data[0], W, dt, gv);
+}
+
+void subtract_polarizations(polarization_state *pol, field_type ft,
+			    realnum *f_minus_p[NUM_FIELD_COMPONENTS][2]) {
+  vector<const lorentzian_susceptibility *> sus;
+  vector<void *> data;
+  for (polarization_state *p = pol; p; p = p->next)
+    if (p->data) {
+      if (fusable(p->s, p->data)) {
+	sus.push_back((const lorentzian_susceptibility *) p->s);
+	data.push_back(p->data);
+      }
+      else
+	p->s->subtract_P(ft, f_minus_p, p->data);
+    }
+  if (sus.size() == 1)
+    sus[0]->subtract_P(ft, f_minus_p, data[0]);
+  else if (sus.size() > 1)
+    lorentzian_susceptibility::subtract_P_fused(int(sus.size()), &sus[0],
+						&data[0], ft, f_minus_p);
+}
+
 void lorentzian_susceptibility::subtract_P(field_type ft,
 					   realnum *f_minus_p[NUM_FIELD_COMPONENTS][2],
 					   void *P_internal_data) const {
@@ -252,7 +597,15 @@ void lorentzian_susceptibility::subtract_P(field_type ft,
     if (f_minus_p[dc][cmp]) {
       realnum *p = d->P[ec][cmp];
       realnum *fmp = f_minus_p[dc][cmp];
-      for (size_t i = 0; i < ntot; ++i) fmp[i] -= p[i];
+      if (d->sparse[ec])
+	for (size_t k = 0; k < d->nruns[ec]; ++k) {
+	  const lorentzian_run &r = d->runs[ec][k];
+	  realnum *fmpr = fmp + r.start;
+	  const realnum *pr = p + r.pos;
+	  for (size_t i = 0; i < r.n; ++i) fmpr[i] -= pr[i];
+	}
+      else
+	for (size_t i = 0; i < ntot; ++i) fmp[i] -= p[i];
     }
   }
 }
@@ -271,7 +624,21 @@ realnum *lorentzian_susceptibility::cinternal_notowned_ptr(
   (void) inotowned; // always = 0
   if (!d || !d->P[c][cmp])
     return NULL;
-  return d->P[c][cmp] + n;
+  if (!d->sparse[c])
+    return d->P[c][cmp] + n;
+
+  /* find the run containing n; the notowned points are always stored,
+     and P is zero at the owned points that are not (which are only
+     read by the communication, never written). */
+  const lorentzian_run *runs = d->runs[c];
+  size_t lo = 0, hi = d->nruns[c];
+  while (hi - lo > 1) {
+    const size_t mid = (lo + hi) / 2;
+    if (runs[mid].start <= size_t(n)) lo = mid; else hi = mid;
+  }
+  if (size_t(n) >= runs[lo].start && size_t(n) < runs[lo].start + runs[lo].n)
+    return d->P[c][cmp] + runs[lo].pos + (n - runs[lo].start);
+  return &d->zero;
 }
 
 void lorentzian_susceptibility::dump_params(h5file *h5f, size_t *start) {
@@ -298,8 +665,19 @@ void noisy_lorentzian_susceptibility::update_P
     const realnum *s = sigma[c][component_direction(c)];
     if (s) {
       realnum *p = d->P[c][cmp];
-      LOOP_OVER_VOL_OWNED(gv, c, i)
-	p[i] += gaussian_random(0, amp * sqrt(s[i]));
+      // the random-number generator is shared by all threads
+#ifdef _OPENMP
+#pragma omp critical(meep_random)
+#endif
+      if (d->sparse[c]) // only at the points with sigma, where P is stored
+	for (size_t k = 0; k < d->nupd[c]; ++k) {
+	  const lorentzian_run &r = d->upd[c][k];
+	  for (size_t j = 0; j < r.n; ++j)
+	    p[r.pos + j] += gaussian_random(0, amp * sqrt(s[r.start + j]));
+	}
+      else
+	LOOP_OVER_VOL_OWNED(gv, c, i)
+	  p[i] += gaussian_random(0, amp * sqrt(s[i]));
       // for uniform random numbers, use uniform_random(-1,1) * amp * sqrt(s[i])
       // for gaussian random numbers, use gaussian_random(0, amp * sqrt(s[i]))
     }
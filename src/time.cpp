@@ -71,4 +71,37 @@ void fields::print_times() {
   master_printf("\n");
 }
 
+/* Print, for each process, the estimated cost of its chunks (from the
+   cost_map that was used to divide the structure into chunks) and the
+   time that it has spent on computation (excluding communication,
+   which includes waiting for the other processes), relative to the
+   mean over all processes. */
+void fields::print_load_balance() {
+  const int np = count_processors();
+  double *local = new double[2*np], *all = new double[2*np];
+  for (int i = 0; i < 2*np; ++i) local[i] = 0;
+  for (int i = 0; i < num_chunks; ++i)
+    if (chunks[i]->is_mine()) local[2*my_rank()] += chunks[i]->s->cost;
+  local[2*my_rank()+1] = times_spent[Stepping] + times_spent[Boundaries]
+    + times_spent[FourierTransforming];
+  sum_to_all(local, all, 2*np);
+
+  double mean[2] = {0,0}, maxval[2] = {0,0};
+  for (int p = 0; p < np; ++p)
+    for (int j = 0; j < 2; ++j) {
+      mean[j] += all[2*p+j] / np;
+      if (all[2*p+j] > maxval[j]) maxval[j] = all[2*p+j];
+    }
+  master_printf("\nLoad balance (estimated cost and computation time):\n");
+  for (int p = 0; p < np; ++p)
+    master_printf("    process %d: %g (%+0.1f%%), %g s (%+0.1f%%)\n", p,
+                  all[2*p], mean[0] ? (all[2*p] / mean[0] - 1) * 100 : 0.0,
+                  all[2*p+1], mean[1] ? (all[2*p+1] / mean[1] - 1) * 100 : 0.0);
+  master_printf("    max/mean: %g estimated, %g measured\n\n",
+                mean[0] ? maxval[0] / mean[0] : 1.0,
+                mean[1] ? maxval[1] / mean[1] : 1.0);
+  delete[] all;
+  delete[] local;
+}
+
 } // namespace meep
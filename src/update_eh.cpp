@@ -26,10 +26,15 @@ namespace meep {
 
 void fields::update_eh(field_type ft, bool skip_w_components) {
   if (ft != E_stuff && ft != H_stuff) abort("update_eh only works with E/H");
+  bool allocated = false;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (thread_over_chunks()) reduction(||:allocated)
+#endif
   for (int i=0;i<num_chunks;i++)
     if (chunks[i]->is_mine())
       if (chunks[i]->update_eh(ft, skip_w_components))
-      	chunk_connections_valid = false; // E/H allocated - reconnect chunks
+      	allocated = true;
+  if (allocated) chunk_connections_valid = false; // E/H allocated - reconnect chunks
 
   /* synchronize to avoid deadlocks if one process decides it needs
      to allocate E or H ... */
@@ -43,6 +48,29 @@ bool fields_chunk::needs_W_prev(component c) const
   return false;
 }
 
+/* Whether update_eh(ft) needs the D or B fields (for ft = E or H
+   respectively) at not-owned points, which are only valid after the
+   boundary communications; this is the case only for off-diagonal
+   chi1inv and for nonlinear materials, where the update at each point
+   averages the other components of D/B over the neighboring points. */
+bool fields::update_eh_needs_notowned(field_type ft) const {
+  for (int i=0;i<num_chunks;i++)
+    if (chunks[i]->is_mine() && chunks[i]->update_eh_needs_notowned(ft))
+      return true;
+  return false;
+}
+
+bool fields_chunk::update_eh_needs_notowned(field_type ft) const {
+  FOR_FT_COMPONENTS(ft, ec) if (f[ec][0]) {
+    const direction d_ec = component_direction(ec);
+    if (s->chi3[ec]
+	|| s->chi1inv[ec][cycle_direction(gv.dim, d_ec, 1)]
+	|| s->chi1inv[ec][cycle_direction(gv.dim, d_ec, 2)])
+      return true;
+  }
+  return false;
+}
+
 bool fields_chunk::update_eh(field_type ft, bool skip_w_components) {
   field_type ft2 = ft == E_stuff ? D_stuff : B_stuff; // for sources etc.
   bool allocated_eh = false;
@@ -96,9 +124,7 @@ bool fields_chunk::update_eh(field_type ft, bool skip_w_components) {
     }
   }
 
-  for (polarization_state *p = pol[ft]; p; p = p->next)
-    if (p->data)
-      p->s->subtract_P(ft, f_minus_p, p->data);
+  subtract_polarizations(pol[ft], ft, f_minus_p);
 
   //////////////////////////////////////////////////////////////////////////
   // Next, subtract time-integrated sources (i.e. polarizations, not currents)
@@ -107,13 +133,8 @@ bool fields_chunk::update_eh(field_type ft, bool skip_w_components) {
     for (src_vol *sv = sources[ft2]; sv; sv = sv->next) {
       if (sv->t->is_integrated && f[sv->c][0] && ft == type(sv->c)) {
       	component c = field_type_component(ft2, sv->c);
-      	for (size_t j = 0; j < sv->npts; ++j) {
-      	  const complex<double> A = sv->dipole(j);
-      	  DOCMP {
-      	    f_minus_p[c][cmp][sv->index[j]] -=
-      	      (cmp) ? imag(A) :  real(A);
-      	  }
-      	}
+      	sv->subtract_from(f_minus_p[c][0], is_real ? NULL : f_minus_p[c][1],
+      			  sv->t->dipole());
       }
     }
   }
@@ -28,10 +28,15 @@ using namespace std;
 namespace meep {
 
 void fields::update_pols(field_type ft) {
+  bool allocated = false;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (thread_over_chunks()) reduction(||:allocated)
+#endif
   for (int i=0;i<num_chunks;i++)
     if (chunks[i]->is_mine())
       if (chunks[i]->update_pols(ft))
-      	chunk_connections_valid = false;
+      	allocated = true;
+  if (allocated) chunk_connections_valid = false;
 
   /* synchronize to avoid deadlocks if one process decides it needs
      to allocate E or H ... */
@@ -54,11 +59,11 @@ bool fields_chunk::update_pols(field_type ft) {
 	allocated_fields = true;
       }
     }
-
-    // Finally, timestep the polarizations:
-    p->s->update_P(w, f_w_prev, dt, gv, p->data);
   }
 
+  // Finally, timestep the polarizations:
+  update_polarizations(pol[ft], w, f_w_prev, dt, gv);
+
   return allocated_fields;
 }
 
@@ -260,6 +260,40 @@ bench bench_3d(const double xmax, const double ymax, const double zmax,
   return b;
 }
 
+/* 3D with a flux plane at Nfreq frequencies, which should only take a
+   small fraction of the time (printed below) for the DFT accumulation
+   even for many frequencies, and even less with decimated DFTs */
+bench bench_3d_flux(const double xmax, const double ymax, const double zmax,
+                    int Nfreq, double eps(const vec &), bool decimate = false) {
+  const double a = 10.0;
+  const double gridpts = a*a*a*xmax*ymax*zmax;
+  const double ttot = 5.0 + 1e5/gridpts;
+
+  grid_volume gv = vol3d(xmax,ymax,zmax,a);
+  structure s(gv, eps);
+  fields f(&s);
+  f.add_point_source(Ez, 0.8, 0.6, 0.0, 4.0, vec(xmax*.5, ymax*.5, zmax*.25));
+  dft_flux flux = f.add_dft_flux_plane(volume(vec(0, 0, zmax*.75),
+                                              vec(xmax, ymax, zmax*.75)),
+                                       0.5, 1.0, Nfreq);
+  f.use_dft_decimation(decimate);
+
+  const double tend = f.time() + ttot;
+  const double tdft = f.time_spent_on(FourierTransforming);
+  double start = wall_time();
+  while (f.time() < tend) f.step();
+  bench b;
+  b.time = (wall_time() - start);
+  b.gridsteps = ttot*a*2*gridpts;
+  master_printf("bench:, 3D flux %d freqs (DFT stride %d): %0.1f%% of time in DFTs\n",
+                Nfreq, f.dft_decimation_stride(),
+                (f.time_spent_on(FourierTransforming) - tdft) * 100 / b.time);
+  double *F = flux.flux(); // make sure all of the DFT data is used
+  delete[] F;
+  //f.print_times();
+  return b;
+}
+
 int main(int argc, char **argv) {
   initialize mpi(argc, argv);
   quiet = true;
@@ -287,6 +321,10 @@ int main(int argc, char **argv) {
   showbench("3D 3x3x3 ", bench_3d(3.0, 3.0, 3.0, one));
   showbench("3D 10x3x0", bench_3d_periodic(10.0, 3.0, 0.0, one));
   showbench("3D 0x3x10", bench_3d_periodic(0.0, 3.0, 10.0, one));
+  showbench("3D flux 3x3x3 10 freqs", bench_3d_flux(3.0, 3.0, 3.0, 10, one));
+  showbench("3D flux 3x3x3 200 freqs", bench_3d_flux(3.0, 3.0, 3.0, 200, one));
+  showbench("3D flux 3x3x3 200 freqs decimated",
+            bench_3d_flux(3.0, 3.0, 3.0, 200, one, true));
 
   showbench("2D 6x4 ", bench_2d(6.0, 4.0, one));
   showbench("2D 12x12 ", bench_2d(12.0, 12.0, one));
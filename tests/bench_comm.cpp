@@ -0,0 +1,67 @@
+/* Copyright (C) 2005-2015 Massachusetts Institute of Technology
+%
+%  This program is free software; you can redistribute it and/or modify
+%  it under the terms of the GNU General Public License as published by
+%  the Free Software Foundation; either version 2, or (at your option)
+%  any later version.
+%
+%  This program is distributed in the hope that it will be useful,
+%  but WITHOUT ANY WARRANTY; without even the implied warranty of
+%  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+%  GNU General Public License for more details.
+%
+%  You should have received a copy of the GNU General Public License
+%  along with this program; if not, write to the Free Software Foundation,
+%  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* Scaling benchmark of the per-timestep overhead of the boundary
+   communications (fields::step_boundaries) as the number of chunks
+   grows, for a fixed grid.  The work done per step is the same for
+   any number of chunks (apart from the extra boundary points), so the
+   "communicating" time per step should only grow in proportion to the
+   total number of boundary points, not with the square of the number
+   of chunks.
+
+   Usage: bench_comm [max_chunks] (default 1024); under MPI, the chunks
+   are divided among the processes as usual. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <meep.hpp>
+using namespace meep;
+
+double one(const vec &) { return 1.0; }
+
+static void bench_comm(const grid_volume &gv, int num_chunks, int nsteps) {
+  structure s(gv, one, no_pml(), identity(), num_chunks);
+  fields f(&s);
+  f.add_point_source(Ez, 0.8, 0.6, 0.0, 4.0, gv.center(), 1.0);
+
+  // the first step connects the chunks, which is not included below
+  f.step();
+  const double comm0 = f.time_spent_on(MpiTime);
+  const double start = wall_time();
+  for (int i = 0; i < nsteps; ++i) f.step();
+  const double tstep = (wall_time() - start) / nsteps;
+  const double tcomm = (f.time_spent_on(MpiTime) - comm0) / nsteps;
+  master_printf("scaling:, %d chunks, %g s/step, %g s/step communicating"
+		", %0.0f%% communicating\n", num_chunks, tstep, tcomm,
+		tcomm * 100 / tstep);
+}
+
+int main(int argc, char **argv) {
+  initialize mpi(argc, argv);
+  quiet = true;
+  const int max_chunks = argc > 1 ? atoi(argv[1]) : 1024;
+  master_printf("Benchmarking boundary communications (%d processes)...\n",
+		count_processors());
+
+  const grid_volume gv = vol2d(32.0, 32.0, 10.0);
+  for (int num_chunks = count_processors(); num_chunks <= max_chunks;
+       num_chunks *= 4)
+    bench_comm(gv, num_chunks, 20);
+
+  return 0;
+}
@@ -0,0 +1,150 @@
+/* Copyright (C) 2005-2015 Massachusetts Institute of Technology
+%
+%  This program is free software; you can redistribute it and/or modify
+%  it under the terms of the GNU General Public License as published by
+%  the Free Software Foundation; either version 2, or (at your option)
+%  any later version.
+%
+%  This program is distributed in the hope that it will be useful,
+%  but WITHOUT ANY WARRANTY; without even the implied warranty of
+%  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+%  GNU General Public License for more details.
+%
+%  You should have received a copy of the GNU General Public License
+%  along with this program; if not, write to the Free Software Foundation,
+%  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* Calibration of the per-pixel cost model (chunk_cost_model) used to
+   balance the chunks: measures the time per step and pixel of a 3d
+   cell filled with each kind of extra work (PML, anisotropy, etc.),
+   relative to vacuum, and prints the resulting coefficients next to
+   the defaults.  Also checks that the chunks of a structure are
+   balanced by their estimated costs.
+
+   Usage: bench_cost [resolution] (default 10); under MPI, the measured
+   costs include the communication between the processes. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <meep.hpp>
+using namespace meep;
+
+double one(const vec &) { return 1.0; }
+
+const double L = 3.0; // size of the cell
+const double Lpml = 0.4 * L; // PML thickness (on both sides)
+
+/* material with off-diagonal (xy, xz and yz) epsilon everywhere */
+class anisotropic_material : public material_function {
+public:
+  virtual void eff_chi1inv_row(component c, double chi1inv_row[3],
+                               const volume &v, double tol, int maxeval) {
+    (void) v; (void) tol; (void) maxeval;
+    chi1inv_row[0] = chi1inv_row[1] = chi1inv_row[2] = 0.1;
+    chi1inv_row[component_index(c)] = 0.5;
+  }
+};
+
+enum cost_kind { VACUUM, PML_1, PML_2, ANISOTROPIC, CONDUCTIVITY,
+                 NONLINEAR, SUSCEPTIBILITY, DFT };
+
+// time per step of a 3d cell with extra work of the given kind everywhere
+static double step_time(cost_kind kind, double res, int nsteps) {
+  const grid_volume gv = vol3d(L, L, L, res);
+  anisotropic_material aniso;
+  simple_material_function vacuum(one);
+  const boundary_region br =
+    kind == PML_1 ? pml(Lpml, X) :
+    (kind == PML_2 ? pml(Lpml, X) + pml(Lpml, Y) : boundary_region());
+  structure s(gv, kind == ANISOTROPIC ? (material_function &) aniso : vacuum,
+              br, identity(), 1, 0.5, kind == ANISOTROPIC);
+  if (kind == CONDUCTIVITY) {
+    s.set_conductivity(Dx, one);
+    s.set_conductivity(Dy, one);
+    s.set_conductivity(Dz, one);
+  }
+  if (kind == NONLINEAR) s.set_chi3(one);
+  if (kind == SUSCEPTIBILITY)
+    s.add_susceptibility(one, E_stuff, lorentzian_susceptibility(1.0, 0.1));
+  fields f(&s);
+  f.add_point_source(Ez, 0.8, 0.6, 0.0, 4.0, gv.center(), 1.0);
+  if (kind == DFT) {
+    component c[3] = {Ex, Ey, Ez};
+    f.add_dft_fields(c, 3, gv.surroundings(), 0.5, 1.0, 10);
+  }
+  f.step(); // allocate the fields etc.
+  double tbest = infinity;
+  for (int rep = 0; rep < 3; ++rep) {
+    double start = wall_time();
+    for (int i = 0; i < nsteps; ++i) f.step();
+    const double t = (wall_time() - start) / nsteps;
+    if (t < tbest) tbest = t;
+  }
+  return tbest;
+}
+
+/* check that a structure with a dispersive region and a DFT region,
+   divided into n chunks, is balanced according to the estimated costs */
+static void check_balance(double res, int n) {
+  const grid_volume gv = vol3d(4.0, 4.0, 2.0, res);
+  cost_map costs;
+  costs.add(volume(vec(0.5, 0.5, 0), vec(2.0, 3.5, 2.0)),
+            2 * costs.model.susceptibility);
+  costs.add(volume(vec(0, 3.0, 0), vec(4.0, 3.0, 2.0)), 20 * costs.model.dft);
+  structure s(gv, one, no_pml(), identity(), n, 0.5, false,
+              DEFAULT_SUBPIXEL_TOL, DEFAULT_SUBPIXEL_MAXEVAL, &costs);
+  structure s0(gv, one, no_pml(), identity(), n);
+  if (s.num_chunks != n || s0.num_chunks != n) abort("unexpected chunks");
+
+  double cmax = 0, ctot = 0, cmax0 = 0, ctot0 = 0;
+  for (int i = 0; i < n; ++i) {
+    const double c = s.chunks[i]->cost, c0 = costs.cost(s0.chunks[i]->gv);
+    if (c > cmax) cmax = c;
+    if (c0 > cmax0) cmax0 = c0;
+    ctot += c; ctot0 += c0;
+  }
+  const double imbalance = cmax * n / ctot, imbalance0 = cmax0 * n / ctot0;
+  master_printf("balance:, %d chunks, max/mean cost %g with the cost map,"
+                " %g without\n", n, imbalance, imbalance0);
+  if (imbalance > 1.1 || imbalance > imbalance0)
+    abort("chunks are not balanced by cost (%g vs. %g)", imbalance, imbalance0);
+
+  fields f(&s);
+  f.add_point_source(Ez, 0.8, 0.6, 0.0, 4.0, gv.center(), 1.0);
+  for (int i = 0; i < 5; ++i) f.step();
+  f.print_load_balance();
+}
+
+int main(int argc, char **argv) {
+  initialize mpi(argc, argv);
+  quiet = true;
+  const double res = argc > 1 ? atof(argv[1]) : 10;
+
+  check_balance(res, 4);
+  check_balance(res, 7);
+
+  master_printf("Calibrating the chunk cost model (resolution %g)...\n", res);
+  const int nsteps = 10;
+  const double t0 = step_time(VACUUM, res, nsteps);
+  const chunk_cost_model model;
+  struct { cost_kind kind; const char *name; double per_pixel, dflt; } k[] = {
+    { PML_1, "pml", 2*Lpml/L, model.pml },
+    { PML_2, "pml (2 directions)", 4*Lpml/L, model.pml },
+    { ANISOTROPIC, "anisotropic", 3, model.anisotropic },
+    { CONDUCTIVITY, "conductivity", 3, model.conductivity },
+    { NONLINEAR, "nonlinear", 3, model.nonlinear },
+    { SUSCEPTIBILITY, "susceptibility", 1, model.susceptibility },
+    { DFT, "dft", 30, model.dft },
+  };
+  master_printf("cost:, vacuum, %g s/step\n", t0);
+  for (size_t i = 0; i < sizeof(k) / sizeof(k[0]); ++i) {
+    const double t = step_time(k[i].kind, res, nsteps);
+    master_printf("cost:, %s, %g s/step, measured %g (default %g) per pixel\n",
+                  k[i].name, t, (t / t0 - 1) / k[i].per_pixel, k[i].dflt);
+  }
+
+  return 0;
+}
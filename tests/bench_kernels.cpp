@@ -0,0 +1,468 @@
+/* Copyright (C) 2005-2015 Massachusetts Institute of Technology
+%
+%  This program is free software; you can redistribute it and/or modify
+%  it under the terms of the GNU General Public License as published by
+%  the Free Software Foundation; either version 2, or (at your option)
+%  any later version.
+%
+%  This program is distributed in the hope that it will be useful,
+%  but WITHOUT ANY WARRANTY; without even the implied warranty of
+%  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+%  GNU General Public License for more details.
+%
+%  You should have received a copy of the GNU General Public License
+%  along with this program; if not, write to the Free Software Foundation,
+%  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* Memory-bandwidth benchmarks of the time-stepping kernels.  The
+   kernels are memory-bound (they mostly just stream field arrays
+   through memory), so the figure of merit is the achieved bandwidth
+   compared to the STREAM "triad" bandwidth of the machine.  Also
+   checks that the explicit-SIMD kernels (step_simd.cpp) agree with
+   the generic ones. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <meep.hpp>
+#include "meep_internals.hpp"
+#include "config.h"
+using namespace meep;
+using namespace std;
+
+/* Bandwidth (bytes/s) of the STREAM triad a[i] = b[i] + q*c[i], where
+   (as in STREAM) each array is counted once per iteration. */
+double stream_triad(ptrdiff_t n) {
+  realnum *a = new realnum[n], *b = new realnum[n], *c = new realnum[n];
+  for (ptrdiff_t i = 0; i < n; ++i) { a[i] = 0; b[i] = 1; c[i] = 2; }
+  double tbest = 1e100;
+  for (int rep = 0; rep < 10; ++rep) {
+    const realnum q = 3.0 + rep;
+    double start = wall_time();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (ptrdiff_t i = 0; i < n; ++i) a[i] = b[i] + q * c[i];
+    tbest = min(tbest, wall_time() - start);
+  }
+  if (a[n/2] != 1 + 12 * 2) abort("bug in STREAM triad");
+  delete[] a; delete[] b; delete[] c;
+  return 3 * sizeof(realnum) * double(n) / tbest;
+}
+
+struct kernel_arrays {
+  ptrdiff_t n;
+  realnum *f, *g1, *g2, *u, *fw;
+  double *sig, *kap, *siginv;
+
+  kernel_arrays(const grid_volume &gv) {
+    // pad the arrays so that g[i+s] is valid at the upper boundary
+    n = gv.ntot() + gv.stride(X) + gv.stride(Y) + 1;
+    f = new realnum[n]; g1 = new realnum[n]; g2 = new realnum[n];
+    u = new realnum[n]; fw = new realnum[n];
+    const ptrdiff_t nsig = 2 * max(gv.nx(), max(gv.ny(), gv.nz())) + 2;
+    sig = new double[nsig]; kap = new double[nsig]; siginv = new double[nsig];
+    for (ptrdiff_t k = 0; k < nsig; ++k) {
+      sig[k] = 0.01 * (k % 7); kap[k] = 1 + 0.1 * (k % 3);
+      siginv[k] = 1 / (kap[k] + sig[k]);
+    }
+    reset();
+  }
+  ~kernel_arrays() {
+    delete[] f; delete[] g1; delete[] g2; delete[] u; delete[] fw;
+    delete[] sig; delete[] kap; delete[] siginv;
+  }
+  void reset() {
+    for (ptrdiff_t i = 0; i < n; ++i) {
+      f[i] = 0.01 * (i % 101); g1[i] = 0.02 * (i % 37); g2[i] = 0.03 * (i % 23);
+      u[i] = 1 + 0.1 * (i % 5); fw[i] = 0.04 * (i % 11);
+    }
+  }
+};
+
+// one step_curl and one step_update_EDHB, optionally with PML in dsig
+static void step_kernels(const grid_volume &gv, kernel_arrays &A,
+                         direction dsig, double *tcurl, double *tupdate) {
+  double start = wall_time();
+  STEP_CURL(A.f, A.g1, A.g2, gv.stride(X), gv.stride(Y),
+            gv, gv.little_owned_corner0(Bz), gv.big_corner(), 0.5,
+            dsig, A.sig, A.kap, A.siginv,
+            NULL, NO_DIRECTION, NULL, NULL, NULL, 0.5, NULL, NULL, NULL);
+  *tcurl = min(*tcurl, wall_time() - start);
+  start = wall_time();
+  STEP_UPDATE_EDHB(A.g2, Hz, gv, A.f, NULL, NULL, A.u, NULL, NULL, 0, 0, 0,
+                   NULL, NULL, dsig == NO_DIRECTION ? NULL : A.fw,
+                   dsig, A.sig, A.kap);
+  *tupdate = min(*tupdate, wall_time() - start);
+}
+
+// check that the SIMD kernels give the same results as the generic ones
+static void check_kernels(const grid_volume &gv, direction dsig) {
+  kernel_arrays A(gv), B(gv);
+  double t1 = 1e100, t2 = 1e100;
+  const simd_level cpu_level = get_simd_level();
+  set_simd_level(SIMD_NONE);
+  for (int i = 0; i < 3; ++i) step_kernels(gv, A, dsig, &t1, &t2);
+  set_simd_level(cpu_level);
+  for (int i = 0; i < 3; ++i) step_kernels(gv, B, dsig, &t1, &t2);
+  double maxdiff = 0, maxval = 0;
+  for (ptrdiff_t i = 0; i < A.n; ++i) {
+    maxdiff = max(maxdiff, max(fabs(A.f[i] - B.f[i]),
+                               max(fabs(A.g2[i] - B.g2[i]),
+                                   fabs(A.fw[i] - B.fw[i]))));
+    maxval = max(maxval, fabs(A.f[i]));
+  }
+  if (maxdiff > (sizeof(realnum) == 4 ? 1e-5 : 1e-12) * maxval)
+    abort("simd %s kernels disagree with generic kernels (%g vs. %g)",
+          simd_level_name(cpu_level), maxdiff, maxval);
+}
+
+/* Achieved bandwidth of step_curl and step_update_EDHB on a 3d grid,
+   for each SIMD instruction set supported by the CPU, with and
+   without PML in one direction.  Each array that is read or written
+   is counted once per grid point, as in STREAM. */
+void bench_kernels(const grid_volume &gv, double stream_bw) {
+  kernel_arrays A(gv);
+  const double npts = gv.nowned(Bz);
+  const simd_level cpu_level = get_simd_level();
+
+  for (int level = SIMD_NONE; level <= cpu_level; ++level) {
+    set_simd_level(simd_level(level));
+    for (int pml = 0; pml <= 1; ++pml) {
+      double tcurl = 1e100, tupdate = 1e100;
+      A.reset();
+      for (int rep = 0; rep < 5; ++rep)
+        step_kernels(gv, A, pml ? X : NO_DIRECTION, &tcurl, &tupdate);
+      // curl: read f, g1, g2 and write f; update: read g, u, (fw, f)
+      // and write f, (fw)
+      const double bcurl = 4 * sizeof(realnum) * npts / tcurl;
+      const double bupdate = (pml ? 6 : 3) * sizeof(realnum) * npts / tupdate;
+      master_printf("bandwidth:, step_curl%s (simd %s), %g GB/s, %0.0f%% of STREAM\n",
+                    pml ? " PML" : "", simd_level_name(simd_level(level)),
+                    bcurl * 1e-9, bcurl * 100 / stream_bw);
+      master_printf("bandwidth:, step_update_EDHB%s (simd %s), %g GB/s, %0.0f%% of STREAM\n",
+                    pml ? " PML" : "", simd_level_name(simd_level(level)),
+                    bupdate * 1e-9, bupdate * 100 / stream_bw);
+    }
+  }
+  set_simd_level(cpu_level);
+}
+
+static complex<double> uniform_amp(int ix, int iz, int nx, int nz) {
+  // boundary integration weights, as for a uniform plane source
+  return (ix == 0 || ix == nx-1 ? 0.3 : 1.0) * (iz == 0 || iz == nz-1 ? 0.7 : 1.0);
+}
+static complex<double> gaussian_amp(int ix, int iz, int nx, int nz) {
+  double x = ix - 0.5*nx, z = iz - 0.4*nz;
+  return complex<double>(0.3, -0.5) * exp(-(x*x + z*z) / (0.1*nx*nz));
+}
+static complex<double> mode_amp(int ix, int iz, int nx, int nz) {
+  return cos(3.0 * ix * iz / (nx * nz)) + (ix + iz < nz ? 0.1 : 0.0);
+}
+static complex<double> random_amp(int ix, int iz, int nx, int nz) {
+  (void) ix; (void) iz; (void) nx; (void) nz;
+  return complex<double>(rand() * 2.0 / RAND_MAX - 1, rand() * 2.0 / RAND_MAX - 1);
+}
+
+/* Check the compact storage of the points of a src_vol (index runs,
+   and separable and/or real amplitudes) for a plane of nx by nz points
+   in an array with stride sx along x, and src_vol::subtract_from,
+   against the points it was constructed from. */
+static void check_src_vol(const char *name, int nx, int nz, ptrdiff_t sx,
+			  complex<double> amp(int, int, int, int),
+			  bool separable, bool real_amps) {
+  const size_t n = size_t(nx) * nz;
+  const ptrdiff_t ntot = 3 + nx * sx;
+  ptrdiff_t *index = new ptrdiff_t[n], *index0 = new ptrdiff_t[n];
+  complex<double> *A = new complex<double>[n], *A0 = new complex<double>[n];
+  for (int ix = 0, j = 0; ix < nx; ++ix)
+    for (int iz = 0; iz < nz; ++iz, ++j) {
+      index[j] = index0[j] = 3 + ix * sx + iz;
+      A[j] = A0[j] = amp(ix, iz, nx, nz);
+    }
+  gaussian_src_time src(1.0, 1.0);
+  src_vol sv(Ex, &src, n, index, A); // deletes index and A
+
+  if (sv.npts != n || (sv.run_amp != NULL) != separable
+      || (sv.amp_im == NULL) != real_amps)
+    abort("wrong src_vol storage for %s amplitudes", name);
+  sv.get_points(index = new ptrdiff_t[n], A = new complex<double>[n]);
+  double maxdiff = 0, maxval = 0;
+  for (size_t j = 0; j < n; ++j) {
+    if (index[j] != index0[j]) abort("wrong src_vol index for %s", name);
+    maxdiff = max(maxdiff, abs(A[j] - A0[j]));
+    maxval = max(maxval, abs(A0[j]));
+  }
+
+  realnum *f[2], *f0[2], *w = new realnum[ntot];
+  for (int cmp = 0; cmp < 2; ++cmp) {
+    f[cmp] = new realnum[ntot]; f0[cmp] = new realnum[ntot];
+    for (ptrdiff_t i = 0; i < ntot; ++i) f[cmp][i] = f0[cmp][i] = cmp + i * 1e-3;
+  }
+  for (ptrdiff_t i = 0; i < ntot; ++i) w[i] = 1.0 + (i % 7) * 0.1;
+  const complex<double> s(0.7, -0.2);
+  sv.subtract_from(f[0], f[1], s, w);
+  for (size_t j = 0; j < n; ++j) {
+    const complex<double> a = A0[j] * s * double(w[index0[j]]);
+    f0[0][index0[j]] -= real(a);
+    f0[1][index0[j]] -= imag(a);
+  }
+  double maxfdiff = 0;
+  for (int cmp = 0; cmp < 2; ++cmp)
+    for (ptrdiff_t i = 0; i < ntot; ++i)
+      maxfdiff = max(maxfdiff, fabs(f[cmp][i] - f0[cmp][i]));
+  const double tol = sizeof(realnum) == 4 ? 1e-6 : 1e-13;
+  if (maxdiff > tol * maxval || maxfdiff > 4 * tol * (1 + maxval))
+    abort("src_vol %s amplitudes differ by %g, fields by %g", name,
+	  maxdiff, maxfdiff);
+  master_printf("src_vol %s amplitudes: %zu runs, %g bytes/point "
+		"(vs. %zu bytes/point uncompressed)\n", name, sv.runs.size(),
+		double(sv.memory_used()) / n,
+		sizeof(ptrdiff_t) + sizeof(complex<double>));
+
+  for (int cmp = 0; cmp < 2; ++cmp) { delete[] f[cmp]; delete[] f0[cmp]; }
+  delete[] w; delete[] A; delete[] index; delete[] A0; delete[] index0;
+}
+
+/* Reference point-by-point update of the populations N (L interleaved
+   values per centered-grid point) and the polarizations P[c][t] of a
+   multilevel atom with a diagonal sigma = 1, for real fields; this is
+   how multilevel_susceptibility::update_P updated them before it
+   processed the points in batches. */
+struct multilevel_ref {
+  int L, T;
+  const realnum *Gamma, *alpha, *omega, *gamma, *sigmat;
+  realnum *GammaInv; // inv(1 + Gamma * dt / 2)
+  realnum *N, *Ntmp, *P[NUM_FIELD_COMPONENTS][2]; // [c][0 or 1 for P_prev]
+
+  void update(realnum *W[NUM_FIELD_COMPONENTS][2],
+	      realnum *W_prev[NUM_FIELD_COMPONENTS][2],
+	      double dt, const grid_volume &gv) {
+    const double dt2 = 0.5 * dt;
+    component cdot[3];
+    ptrdiff_t o1[3], o2[3];
+    int ndot = 0;
+    FOR_ELECTRIC_COMPONENTS(c) if (P[c][0]) {
+      gv.yee2cent_offsets(c, o1[ndot], o2[ndot]);
+      cdot[ndot++] = c;
+    }
+    LOOP_OVER_VOL_OWNED(gv, Centered, i) {
+      realnum *Ni = N + i*L;
+      for (int l1 = 0; l1 < L; ++l1) {
+	Ntmp[l1] = 0;
+	for (int l2 = 0; l2 < L; ++l2)
+	  Ntmp[l1] += ((l1 == l2) - Gamma[l1*L+l2]*dt2) * Ni[l2];
+      }
+      double E8[3];
+      for (int k = 0; k < ndot; ++k) {
+	const realnum *w = W[cdot[k]][0], *wp = W_prev[cdot[k]][0];
+	E8[k] = w[i]+w[i+o1[k]]+w[i+o2[k]]+w[i+o1[k]+o2[k]]
+	  + wp[i]+wp[i+o1[k]]+wp[i+o2[k]]+wp[i+o1[k]+o2[k]];
+      }
+      for (int t = 0; t < T; ++t) {
+	double EdP32 = 0, EPave64 = 0;
+	const double gperpdt = gamma[t]*pi*dt;
+	for (int k = 0; k < ndot; ++k) {
+	  const realnum *p = P[cdot[k]][0] + t*gv.ntot();
+	  const realnum *pp = P[cdot[k]][1] + t*gv.ntot();
+	  const ptrdiff_t a = o1[k], b = o2[k];
+	  realnum dP = p[i]+p[i+a]+p[i+b]+p[i+a+b]
+	    - (pp[i]+pp[i+a]+pp[i+b]+pp[i+a+b]);
+	  realnum Pave2 = p[i]+p[i+a]+p[i+b]+p[i+a+b]
+	    + (pp[i]+pp[i+a]+pp[i+b]+pp[i+a+b]);
+	  EdP32 += dP * E8[k];
+	  EPave64 += Pave2 * E8[k];
+	}
+	EdP32 *= 0.03125;
+	EPave64 *= 0.015625;
+	for (int l = 0; l < L; ++l)
+	  Ntmp[l] += alpha[l*T+t]*EdP32 + alpha[l*T+t]*gperpdt*EPave64;
+      }
+      for (int l1 = 0; l1 < L; ++l1) {
+	Ni[l1] = 0;
+	for (int l2 = 0; l2 < L; ++l2) Ni[l1] += GammaInv[l1*L+l2] * Ntmp[l2];
+      }
+    }
+
+    for (int t = 0; t < T; ++t) {
+      const double omega2pi = 2*pi*omega[t], g2pi = gamma[t]*2*pi, gperp = gamma[t]*pi;
+      const double omega0dtsqrCorrected = omega2pi*omega2pi*dt*dt + gperp*gperp*dt*dt;
+      const double gamma1inv = 1 / (1 + g2pi*dt2), gamma1 = (1 - g2pi*dt2);
+      int lp = -1, lm = -1;
+      for (int l = 0; l < L; ++l) {
+	if (alpha[l*T + t] > 0) lp = l;
+	if (alpha[l*T + t] < 0) lm = l;
+      }
+      for (int k = 0; k < ndot; ++k) {
+	const component c = cdot[k];
+	const realnum *w = W[c][0];
+	const double st = sigmat[5*t + component_direction(c)];
+	realnum *p = P[c][0] + t*gv.ntot(), *pp = P[c][1] + t*gv.ntot();
+	ptrdiff_t a, b;
+	gv.cent2yee_offsets(c, a, b);
+	a *= L; b *= L;
+	LOOP_OVER_VOL_OWNED(gv, c, i) {
+	  realnum pcur = p[i];
+	  const realnum *Ni = N + i*L;
+	  double dNi = 0.25 * (Ni[lp]+Ni[lp+a]+Ni[lp+b]+Ni[lp+a+b]
+			       -Ni[lm]-Ni[lm+a]-Ni[lm+b]-Ni[lm+a+b]);
+	  p[i] = gamma1inv * (pcur * (2 - omega0dtsqrCorrected)
+			      - gamma1 * pp[i]
+			      - dt*dt * (st * w[i]) * dNi);
+	  pp[i] = pcur;
+	}
+      }
+    }
+  }
+};
+
+/* Time multilevel_susceptibility::update_P for a 4-level laser medium
+   (pumped from level 0 to 3, lasing from 2 to 1) filling a 3d cell,
+   driven by an oscillating field, against the reference point-by-point
+   update, and check that they agree. */
+static void bench_multilevel(const grid_volume &gv) {
+  const int L = 4, T = 2;
+  const realnum Rp = 0.05, r32 = 2.0, r21 = 0.01, r10 = 2.0;
+  // dN/dt = -Gamma N: rates Rp (0 -> 3), r32, r21 and r10
+  const realnum Gamma[L*L] = { Rp,   -r10, 0,    0,
+			       0,    r10,  -r21, 0,
+			       0,    0,    r21,  -r32,
+			       -Rp,  0,    0,    r32 };
+  const realnum N0[L] = {1.0, 0, 0, 0};
+  const realnum alpha[L*T] = { -1, 0,   0, -1,   0, 1,   1, 0 };
+  const realnum omega[T] = {1.6, 0.9}, gamma[T] = {0.3, 0.05};
+  const realnum sigmat[T*5] = { 0.2, 0.2, 0.2, 0, 0,   1.5, 1.5, 1.5, 0, 0 };
+  const double dt = 0.5 / gv.a;
+  const size_t ntot = gv.ntot();
+
+  multilevel_susceptibility sus(L, T, Gamma, N0, alpha, omega, gamma, sigmat);
+  realnum *W[NUM_FIELD_COMPONENTS][2], *W_prev[NUM_FIELD_COMPONENTS][2];
+  multilevel_ref ref = {L, T, Gamma, alpha, omega, gamma, sigmat,
+			new realnum[L*L], new realnum[ntot*L], new realnum[L],
+			{{NULL}}};
+  FOR_COMPONENTS(c) DOCMP2 {
+    W[c][cmp] = W_prev[c][cmp] = NULL;
+    ref.P[c][cmp] = NULL;
+  }
+  FOR_ELECTRIC_COMPONENTS(c) if (gv.has_field(c)) {
+    const direction d = component_direction(c);
+    sus.sigma[c][d] = new realnum[ntot];
+    sus.trivial_sigma[c][d] = false;
+    for (size_t i = 0; i < ntot; ++i) sus.sigma[c][d][i] = 1;
+    W[c][0] = new realnum[ntot];
+    W_prev[c][0] = new realnum[ntot];
+    for (size_t i = 0; i < ntot; ++i) W[c][0][i] = 0;
+    for (int k = 0; k < 2; ++k) {
+      ref.P[c][k] = new realnum[ntot*T];
+      for (size_t i = 0; i < ntot*T; ++i) ref.P[c][k][i] = 0;
+    }
+  }
+  for (size_t i = 0; i < ntot; ++i)
+    for (int l = 0; l < L; ++l) ref.N[i*L + l] = N0[l];
+
+  // GammaInv by Gauss-Jordan elimination (I + Gamma*dt/2 is diagonally dominant)
+  double M[L][2*L];
+  for (int i = 0; i < L; ++i)
+    for (int j = 0; j < L; ++j) {
+      M[i][j] = (i == j) + Gamma[i*L+j] * dt/2;
+      M[i][L+j] = i == j;
+    }
+  for (int i = 0; i < L; ++i) {
+    const double piv = M[i][i];
+    for (int j = 0; j < 2*L; ++j) M[i][j] /= piv;
+    for (int k = 0; k < L; ++k) if (k != i) {
+      const double f = M[k][i];
+      for (int j = 0; j < 2*L; ++j) M[k][j] -= f * M[i][j];
+    }
+  }
+  for (int i = 0; i < L; ++i)
+    for (int j = 0; j < L; ++j) ref.GammaInv[i*L+j] = realnum(M[i][L+j]);
+
+  void *data = sus.new_internal_data(W, gv);
+  sus.init_internal_data(W, dt, gv, data);
+
+  const int nsteps = 20;
+  double tbatch = 0, tref = 0;
+  for (int step = 0; step < nsteps; ++step) {
+    FOR_ELECTRIC_COMPONENTS(c) if (W[c][0]) {
+      for (size_t i = 0; i < ntot; ++i) {
+	W_prev[c][0][i] = W[c][0][i];
+	W[c][0][i] = 3 * cos(1.6 * 2*pi * step * dt + 0.01 * (i % 97) + c);
+      }
+    }
+    double start = wall_time();
+    sus.update_P(W, W_prev, dt, gv, data);
+    tbatch += wall_time() - start;
+    start = wall_time();
+    ref.update(W, W_prev, dt, gv);
+    tref += wall_time() - start;
+  }
+
+  // compare populations and polarizations
+  double maxdiff = 0, maxval = 0;
+  realnum *N = new realnum[ntot*L];
+  if (!sus.get_internal_array(4*T*NUM_FIELD_COMPONENTS, data, N))
+    abort("multilevel populations not allocated");
+  for (size_t i = 0; i < ntot*L; ++i) {
+    maxdiff = max(maxdiff, double(fabs(N[i] - ref.N[i])));
+    maxval = max(maxval, double(fabs(ref.N[i])));
+  }
+  double maxpdiff = 0, maxpval = 0;
+  FOR_ELECTRIC_COMPONENTS(c) if (ref.P[c][0])
+    for (int t = 0; t < T; ++t)
+      for (int k = 0; k < 2; ++k) {
+	component cc; int nvals;
+	const realnum *p = sus.internal_array(c*4*T + 2*t + k, data, &cc, &nvals);
+	for (size_t i = 0; i < ntot; ++i) {
+	  maxpdiff = max(maxpdiff, double(fabs(p[i] - ref.P[c][k][t*ntot + i])));
+	  maxpval = max(maxpval, double(fabs(ref.P[c][k][t*ntot + i])));
+	}
+      }
+  const double tol = sizeof(realnum) == 4 ? 1e-5 : 1e-12;
+  if (maxdiff > tol * maxval || maxpdiff > tol * maxpval || maxpval == 0)
+    abort("multilevel update disagrees with reference: N by %g (of %g), "
+	  "P by %g (of %g)", maxdiff, maxval, maxpdiff, maxpval);
+  master_printf("multilevel update_P (%d levels, %d transitions): "
+		"%g ns/point, vs. %g ns/point point-by-point (%0.1fx)\n",
+		L, T, tbatch * 1e9 / (nsteps * gv.nowned(Centered)),
+		tref * 1e9 / (nsteps * gv.nowned(Centered)), tref / tbatch);
+
+  sus.delete_internal_data(data);
+  delete[] N;
+  FOR_COMPONENTS(c) {
+    delete[] W[c][0]; delete[] W_prev[c][0];
+    delete[] ref.P[c][0]; delete[] ref.P[c][1];
+  }
+  delete[] ref.GammaInv; delete[] ref.N; delete[] ref.Ntmp;
+}
+
+int main(int argc, char **argv) {
+  initialize mpi(argc, argv);
+  quiet = true;
+  master_printf("Benchmarking kernels (simd %s)...\n",
+                simd_level_name(get_simd_level()));
+
+  // small grids, with row lengths that are not multiples of the vector size
+  check_kernels(vol3d(1.3, 0.7, 1.1, 10.0), NO_DIRECTION);
+  check_kernels(vol3d(1.3, 0.7, 1.1, 10.0), X);
+  check_kernels(vol3d(1.3, 0.7, 1.1, 10.0), Y);
+  check_kernels(vol3d(1.3, 0.7, 1.1, 10.0), Z);
+
+  check_src_vol("uniform", 60, 50, 57, uniform_amp, true, true);
+  check_src_vol("gaussian", 60, 50, 57, gaussian_amp, true, true);
+  check_src_vol("mode", 60, 50, 50, mode_amp, false, true);
+  check_src_vol("random", 60, 50, 57, random_amp, false, false);
+  check_src_vol("strided", 60, 1, 57, gaussian_amp, false, false);
+
+  const double stream_bw = stream_triad(ptrdiff_t(1) << 23);
+  master_printf("bandwidth:, STREAM triad, %g GB/s\n", stream_bw * 1e-9);
+  bench_kernels(vol3d(12.8, 12.8, 12.8, 10.0), stream_bw);
+
+#ifdef HAVE_LAPACK
+  bench_multilevel(vol3d(2.0, 2.0, 2.0, 20.0));
+#endif
+
+  return 0;
+}
@@ -0,0 +1,157 @@
+/* Copyright (C) 2005-2015 Massachusetts Institute of Technology
+%
+%  This program is free software; you can redistribute it and/or modify
+%  it under the terms of the GNU General Public License as published by
+%  the Free Software Foundation; either version 2, or (at your option)
+%  any later version.
+%
+%  This program is distributed in the hope that it will be useful,
+%  but WITHOUT ANY WARRANTY; without even the implied warranty of
+%  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+%  GNU General Public License for more details.
+%
+%  You should have received a copy of the GNU General Public License
+%  along with this program; if not, write to the Free Software Foundation,
+%  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* Check that fields::dump and fields::load restart a run exactly
+   (fields, PML and conductivity auxiliary fields, polarizations and
+   DFTs), including with a different number of chunks. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <meep.hpp>
+#include "config.h"
+using namespace meep;
+using namespace std;
+
+const double xsize = 3.0, ysize = 4.0, a = 10.0;
+const double tol = sizeof(realnum) == sizeof(float) ? 1e-4 : 1e-10;
+
+double eps(const vec &p) { return p.y() < 1.5 ? 2.25 : 1.0; }
+double disk(const vec &p) {
+  return abs(p - vec(xsize/2, 2.5)) < 0.5 ? 1.0 : 0.0;
+}
+double cond(const vec &p) { return p.y() > 3.0 ? 0.5 : 0.0; }
+double strip(const vec &p) { return fabs(p.y() - 1.6) < 0.2 ? 1.0 : 0.0; }
+
+/* the fields of the cell with the given number of chunks, set up with
+   the same sources and DFTs (and optionally a multilevel atom) */
+static fields *make_fields(structure *&s, bool mirrorx, int num_chunks,
+			   bool use_real, bool decimate, bool multilevel,
+			   dft_flux **flux) {
+  const grid_volume gv = vol2d(xsize, ysize, a);
+  s = new structure(gv, eps, pml(0.5, Y), mirrorx ? mirror(X, gv) : identity(),
+		    num_chunks);
+  s->add_susceptibility(disk, E_stuff, lorentzian_susceptibility(1.1, 0.1));
+#ifdef HAVE_LAPACK
+  if (multilevel) { // populations are stored level by level
+    const realnum Gamma[4] = { 0, -0.1, 0, 0.1 }, N0[2] = { 0.7, 0.3 };
+    const realnum alpha[2] = { -1, 1 }, omega[1] = { 0.9 }, gamma[1] = { 0.2 };
+    const realnum sigmat[5] = { 0.5, 0.5, 0.5, 0, 0 };
+    s->add_susceptibility(strip, E_stuff,
+			  multilevel_susceptibility(2, 1, Gamma, N0, alpha,
+						    omega, gamma, sigmat));
+  }
+#else
+  (void) multilevel;
+#endif
+  s->set_conductivity(Dz, cond);
+  fields *f = new fields(s);
+  f->use_bloch(X, use_real ? 0.0 : 0.3);
+  if (use_real) f->use_real_fields();
+  if (decimate) f->use_dft_decimation(true, true);
+  f->add_point_source(Ez, 0.8, 1.0, 0.0, 4.0, vec(xsize/2, 1.0), 1.0);
+  flux[0] = new dft_flux(f->add_dft_flux_plane(volume(vec(0, 2.0),
+							vec(xsize, 2.0)),
+					 0.5, 1.1, 7));
+  flux[1] = new dft_flux(f->add_dft_flux_plane(volume(vec(0.7, 3.2),
+							vec(xsize, 3.2)),
+					 0.5, 1.1, 7));
+  return f;
+}
+
+// values to compare: fields at a few points, and the fluxes
+static void get_values(fields &f, dft_flux **flux, double *v) {
+  int n = 0;
+  for (int i = 0; i < 4; ++i) {
+    const complex<double> ez = f.get_field(Ez, vec(0.35 + 0.7*i, 0.6 + 0.9*i));
+    const complex<double> hx = f.get_field(Hx, vec(0.35 + 0.7*i, 0.6 + 0.9*i));
+    v[n++] = real(ez); v[n++] = imag(ez); v[n++] = real(hx); v[n++] = imag(hx);
+  }
+  for (int j = 0; j < 2; ++j) {
+    double *fl = flux[j]->flux();
+    for (int i = 0; i < 7; ++i) v[n++] = fl[i];
+    delete[] fl;
+  }
+}
+
+const int NVALS = 4*4 + 2*7;
+
+static bool check_dump_load(bool mirrorx, int chunks1, int chunks2,
+			    bool use_real, bool decimate, bool multilevel,
+			    const char *name) {
+  master_printf("Checking %s...\n", name);
+  const char *fname = "dump_load.h5";
+  structure *s1, *s2;
+  dft_flux *flux1[2], *flux2[2];
+  fields *f1 = make_fields(s1, mirrorx, chunks1, use_real, decimate, multilevel,
+			     flux1);
+  while (f1->time() < 5.0) f1->step();
+  f1->dump(fname);
+  while (f1->time() < 10.0) f1->step();
+  double v1[NVALS];
+  get_values(*f1, flux1, v1);
+
+  fields *f2 = make_fields(s2, mirrorx, chunks2, use_real, decimate, multilevel,
+			     flux2);
+  f2->load(fname);
+  if (f2->time() != 5.0) abort("wrong time %g after load", f2->time());
+  while (f2->time() < 10.0) f2->step();
+  double v2[NVALS];
+  get_values(*f2, flux2, v2);
+
+  double vmax = 0, err = 0;
+  for (int i = 0; i < NVALS; ++i) {
+    if (fabs(v1[i]) > vmax) vmax = fabs(v1[i]);
+    if (fabs(v1[i] - v2[i]) > err) err = fabs(v1[i] - v2[i]);
+  }
+  master_printf("  max error %g (max value %g)\n", err, vmax);
+  bool ok = vmax > 0 && err <= tol * vmax;
+  if (!ok)
+    for (int i = 0; i < NVALS; ++i)
+      master_printf("  value %d: %g vs. %g\n", i, v1[i], v2[i]);
+
+  for (int j = 0; j < 2; ++j) {
+    flux1[j]->remove(); delete flux1[j];
+    flux2[j]->remove(); delete flux2[j];
+  }
+  delete f2; delete s2;
+  delete f1; delete s1;
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  initialize mpi(argc, argv);
+  quiet = true;
+#ifdef HAVE_HDF5
+  if (!check_dump_load(false, 2, 5, false, false, false, "complex fields, 2 -> 5 chunks"))
+    abort("error in complex fields, 2 -> 5 chunks");
+  if (!check_dump_load(false, 6, 4, true, false, false, "real fields, 6 -> 4 chunks"))
+    abort("error in real fields, 6 -> 4 chunks");
+  if (!check_dump_load(true, 3, 2, true, true, false,
+		       "mirror symmetry, decimated DFTs, 3 -> 2 chunks"))
+    abort("error in mirror symmetry, decimated DFTs, 3 -> 2 chunks");
+#ifdef HAVE_LAPACK
+  // the populations are not communicated between chunks, so a multilevel
+  // run depends on the chunking; restart with the same number of chunks
+  if (!check_dump_load(false, 3, 3, false, false, true,
+		       "multilevel atom, 3 -> 3 chunks"))
+    abort("error in multilevel atom, 3 -> 3 chunks");
+#endif
+#endif
+  return 0;
+}
@@ -308,6 +308,99 @@ int flux_cyl(const double rmax, const double zmax,
   return 1;
 }
 
+/* check that a flux spectrum at an explicit, non-uniform list of
+   frequencies agrees with the same frequencies of a uniform spectrum,
+   and that the adaptive frequencies are concentrated at the peak */
+int flux_freq_list(const double zmax, double eps(const vec &)) {
+  const double a = 10.0;
+
+  master_printf("\nFlux frequency list test...\n");
+
+  grid_volume gv = volone(zmax,a);
+  structure s(gv, eps, pml(zmax/6));
+
+  fields f(&s);
+  f.use_real_fields();
+  f.add_point_source(Ex, 0.25, 3.5, 0.0, 8.0, vec(zmax/6+0.3), 1.0);
+
+  volume where(vec(zmax*2.0/3.0), vec(zmax*2.0/3.0));
+  double fmin = 0.2, fmax = 0.3;
+  int Nfreq = 11;
+  dft_flux flux1 = f.add_dft_flux_plane(where, fmin, fmax, Nfreq);
+  std::vector<double> freq;
+  freq.push_back(flux1.freq[7]);
+  freq.push_back(flux1.freq[2]);
+  freq.push_back(flux1.freq[3]);
+  dft_flux flux2 = f.add_dft_flux(Z, where, freq);
+  if (flux2.Nfreq != 3 || flux2.dfreq != 0) return 0;
+
+  while (f.time() < 200) f.step();
+
+  double *fl1 = flux1.flux();
+  double *fl2 = flux2.flux();
+  const int idx[3] = {7, 2, 3};
+  for (int i = 0; i < 3; ++i) {
+    master_printf("  flux(%g) = %g vs. %g\n", freq[i], fl1[idx[i]], fl2[i]);
+    if (!compare(fl2[i], fl1[idx[i]], 1e-12, 0, "Flux at listed frequency"))
+      return 0;
+  }
+  delete[] fl2; delete[] fl1;
+
+  // a resonance at 0.251 with half-width 1e-4
+  std::vector<double> peak_freqs(1, 0.251), peak_widths(1, 1e-4);
+  std::vector<double> afreq = adaptive_dft_freqs(fmin, fmax, 40, peak_freqs,
+						 peak_widths, 0.25);
+  if (afreq.size() != 40 || afreq[0] != fmin || afreq[39] != fmax) return 0;
+  int npeak = 0;
+  for (int i = 0; i < 40; ++i) {
+    if (i > 0 && afreq[i] <= afreq[i-1]) return 0;
+    if (fabs(afreq[i] - 0.251) < 1e-3) ++npeak;
+  }
+  master_printf("  %d of 40 adaptive frequencies within 1e-3 of the peak\n",
+		npeak);
+  return npeak >= 20; // vs. <= 1 for uniform frequencies
+}
+
+/* check that the DFTs decimated by fields::use_dft_decimation (with and
+   without the anti-aliasing filter) agree with the full DFTs */
+int flux_decimation(const double xmax, const double ymax,
+		    double eps(const vec &)) {
+  const double a = 8.0;
+
+  master_printf("\nFlux decimation test...\n");
+
+  grid_volume gv = voltwo(xmax,ymax,a);
+  structure s(gv, eps, pml(0.5));
+  volume box(vec(xmax/6-0.4, ymax/6-0.2), vec(xmax/6+0.6, ymax/6+0.8));
+  double fmin = 0.15, fmax = 0.35;
+  int Nfreq = 21;
+
+  double *fl[3];
+  for (int dec = 0; dec < 3; ++dec) {
+    fields f(&s);
+    f.use_real_fields();
+    f.add_point_source(Ez, 0.25, 0.2, 0., 5., vec(xmax/6+0.1, ymax/6+0.3), 1.);
+    dft_flux flux = f.add_dft_flux_box(box, fmin, fmax, Nfreq);
+    if (dec) f.use_dft_decimation(true, dec == 2);
+    while (f.time() < f.last_source_time() + 50) f.step();
+    master_printf("  DFT decimation stride %d%s\n", f.dft_decimation_stride(),
+		  dec == 2 ? " with anti-aliasing" : "");
+    if (dec && f.dft_decimation_stride() < 4) return 0;
+    fl[dec] = flux.flux();
+  }
+
+  double flmax = 0;
+  for (int i = 0; i < Nfreq; ++i) flmax = max(flmax, fabs(fl[0][i]));
+  for (int i = 0; i < Nfreq; ++i) {
+    master_printf("  flux(%g) = %g vs. %g, %g\n", fmin + i * (fmax-fmin)/(Nfreq-1),
+		  fl[0][i], fl[1][i], fl[2][i]);
+    if (fabs(fl[1][i] - fl[0][i]) > 1e-4 * flmax
+	|| fabs(fl[2][i] - fl[0][i]) > 1e-4 * flmax) return 0;
+  }
+  for (int dec = 0; dec < 3; ++dec) delete[] fl[dec];
+  return 1;
+}
+
 void attempt(const char *name, int allright) {
   if (allright) master_printf("Passed %s\n", name);
   else abort("Failed %s!\n", name);
@@ -337,6 +430,12 @@ int main(int argc, char **argv) {
   width = 5.0;
   attempt("Flux cylindrical 5", flux_cyl(20.0, 10.0, bump2, 1));
 
+  width = 20.0;
+  attempt("Flux frequency list", flux_freq_list(100.0, bump));
+
+  width = 5.0;
+  attempt("Flux decimation", flux_decimation(10.0, 10.0, bump2));
+
   return 0;
 }
 
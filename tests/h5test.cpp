@@ -79,10 +79,11 @@ bool check_2d(double eps(const vec &), double a, int splitting, symfunc Sf,
 	      component src_c, int file_c,
 	      volume file_gv,
 	      bool real_fields, int expected_rank,
-	      const char *name) {
+	      const char *name, bool async = false) {
   const grid_volume gv = vol2d(xsize, ysize, a);
   structure s(gv, eps, no_pml(), Sf(gv), splitting);
   fields f(&s);
+  if (async) f.use_async_output(true, 4096);
 
   f.use_bloch(X, real_fields ? 0.0 : kx);
   f.use_bloch(Y, real_fields ? 0.0 : ky);
@@ -317,10 +318,11 @@ bool check_2d_monitor(double eps(const vec &),
 		      component src_c, int file_c,
 		      const vec &pt,
 		      bool real_fields,
-		      const char *name) {
+		      const char *name, bool async = false) {
   const grid_volume gv = vol2d(xsize, ysize, a);
   structure s(gv, eps, no_pml(), Sf(gv), splitting);
   fields f(&s);
+  if (async) f.use_async_output(true, 4096);
 
   if (real_fields) f.use_real_fields();
   f.add_point_source(src_c, 0.3, 2.0, 0.0, 1.0, gv.center(), 1.0, 1);
@@ -397,6 +399,90 @@ bool check_2d_monitor(double eps(const vec &),
   return 1;
 }
 
+/* Check that the output with deflate (and scale-offset, if max_error > 0)
+   compression, in chunks, reads back as the uncompressed output (to
+   within max_error), and (unless parallel HDF5 doesn't compress it)
+   that it is smaller. */
+bool check_compression(double a, int splitting, double max_error,
+		       const char *name) {
+  const grid_volume gv = vol2d(xsize, ysize, a);
+  structure s(gv, funky_eps_2d, no_pml(), identity(), splitting);
+  fields f(&s);
+  f.use_real_fields();
+  f.add_point_source(Ez, 0.3, 2.0, 0.0, 1.0, gv.center(), 1.0, 1);
+  while (f.time() <= 3.0 && !interrupt)
+    f.step();
+
+  h5file *file[2];
+  char fname[2][1024];
+  for (int i = 0; i < 2; ++i) {
+    h5_storage storage(i ? 9 : 0, true, i ? max_error : 0);
+    if (i) storage.set_chunk_dim(0, 32);
+    f.set_output_storage(storage);
+    snprintf(fname[i], 1024, "%s%s", name, i ? "" : "_uncompressed");
+    file[i] = f.open_h5file(fname[i]);
+    strcpy(fname[i], file[i]->file_name());
+  }
+  for (int n = 0; n < 3; ++n) {
+    for (int i = 0; i < 2; ++i) {
+      f.output_hdf5(Ez, gv.surroundings(), file[i]);
+      f.output_hdf5(Hx, gv.surroundings(), file[i], true);
+    }
+    f.step();
+  }
+  f.set_output_storage(h5_storage());
+  for (int i = 0; i < 2; ++i) delete file[i];
+  all_wait();
+
+  double err_max = 0;
+  const char *datanames[2] = {"ez", "hx"};
+  for (int j = 0; j < 2; ++j) {
+    realnum *data[2];
+    int rank[2];
+    size_t dims[2][3] = {{1,1,1},{1,1,1}};
+    for (int i = 0; i < 2; ++i) {
+      h5file in(fname[i], h5file::READONLY);
+      data[i] = in.read(datanames[j], &rank[i], dims[i], 3);
+      if (!data[i]) abort("failed to read dataset %s:%s", fname[i], datanames[j]);
+    }
+    if (rank[0] != rank[1] || rank[0] != 2 + j)
+      abort("incorrect rank of %s:%s", name, datanames[j]);
+    size_t N = 1;
+    for (int k = 0; k < rank[0]; ++k) {
+      if (dims[0][k] != dims[1][k])
+	abort("incorrect size of %s:%s", name, datanames[j]);
+      N *= dims[0][k];
+    }
+    for (size_t k = 0; k < N; ++k) {
+      const double err = fabs(data[1][k] - data[0][k]);
+      if (err > max_error * (1 + 1e-6))
+	abort("error %g in %s:%s at %zd", err, name, datanames[j], k);
+      if (err > err_max) err_max = err;
+    }
+    delete[] data[1];
+    delete[] data[0];
+  }
+
+#if !(defined(HAVE_MPI) && defined(HAVE_H5PSET_FAPL_MPIO))
+  if (am_master()) {
+    long size[2];
+    for (int i = 0; i < 2; ++i) {
+      FILE *fp = fopen(fname[i], "rb");
+      if (!fp) abort("cannot open %s", fname[i]);
+      fseek(fp, 0, SEEK_END);
+      size[i] = ftell(fp);
+      fclose(fp);
+    }
+    master_printf("  %ld bytes compressed, %ld uncompressed\n",
+		  size[1], size[0]);
+    if (size[1] >= size[0]) abort("compression did not reduce %s", name);
+  }
+#endif
+
+  master_printf("Passed %s, err=%g\n", name, err_max);
+  return true;
+}
+
 int main(int argc, char **argv)
 {
   const double a = 10.0;
@@ -469,6 +555,32 @@ int main(int argc, char **argv)
 	      return 1;
 	  }
 
+  /* asynchronous output, with a small memory budget so that the output
+     has to wait for the queued data to be written */
+  for (int iS = 0; iS < 5; iS += 3)
+    for (int use_real = 1; use_real >= 0; --use_real) {
+      char name[1024];
+      snprintf(name, 1024, "check_2d_async_tm_%s_3_plane_ez%s",
+	       Sf2_name[iS], use_real ? "_r" : "");
+      master_printf("Checking %s...\n", name);
+      if (!check_2d(funky_eps_2d, a, 3, Sf2[iS], Sf2_kx[iS], Sf2_ky[iS],
+		    Ez, Ez, gv_2d[0], use_real, gv_2d_rank[0], name, true))
+	return 1;
+      snprintf(name, 1024, "check_2d_async_monitor_tm_%s_3_ez%s",
+	       Sf2_name[iS], use_real ? "_r" : "");
+      master_printf("Checking %s...\n", name);
+      if (!check_2d_monitor(funky_eps_2d, a, 3, Sf2[iS], Ez, Ez,
+			    vec(pad1,pad2), use_real, name, true))
+	return 1;
+    }
+
+  master_printf("Checking check_compression_deflate...\n");
+  if (!check_compression(4*a, 3, 0, "check_compression_deflate"))
+    return 1;
+  master_printf("Checking check_compression_scaleoffset...\n");
+  if (!check_compression(4*a, 1, 1e-4, "check_compression_scaleoffset"))
+    return 1;
+
   volume gv_3d[4] = {
        volume(vec(pad1,pad2,pad3), vec(xsize-pad2,ysize-pad1,zsize-pad3)),
        volume(vec(pad1,pad2,pad3), vec(xsize-pad2,ysize-pad1,pad3)),
@@ -72,6 +72,27 @@ static complex<double> linear_integrand(const complex<double> *fields,
 	  );
 }
 
+/* checksum of the chunkloop arguments, for comparing loops over
+   different chunkloop_plan objects */
+static void checksum_chunkloop(fields_chunk *fc, int ichunk, component cgrid,
+			       ivec is, ivec ie,
+			       vec s0, vec s1, vec e0, vec e1,
+			       double dV0, double dV1,
+			       ivec shift, complex<double> shift_phase,
+			       const symmetry &S, int sn,
+			       void *sum_)
+{
+  complex<double> *sum = (complex<double> *) sum_;
+  (void) fc; (void) S;
+  double w = ichunk + 3*cgrid + 5*sn + dV0 + dV1;
+  LOOP_OVER_DIRECTIONS(is.dim, d)
+    w += (d + 1) * (is.in_direction(d) + 3*ie.in_direction(d)
+		    + 7*shift.in_direction(d) + s0.in_direction(d)
+		    + 2*s1.in_direction(d) + 4*e0.in_direction(d)
+		    + 8*e1.in_direction(d));
+  *sum += w * shift_phase;
+}
+
 /* integrals of 1 and x, respectively, from a to b, or 1 and x if a==b: */
 static double integral1(double a, double b, direction d)
 {
@@ -216,6 +237,11 @@ void check_integral(fields &f,
   if (fabs(sum - correct_integral(v, d)) > 1e-9 * fabs(sum))
     abort("FAILED: %0.16g instead of %0.16g\n",
 	  (double) sum, correct_integral(v, d));
+  // the same integral again, using the cached chunkloop_plan for v
+  double sum2 = real(f.integrate(0, 0, linear_integrand, (void *) &d, v));
+  if (sum2 != sum)
+    abort("FAILED: %0.16g instead of %0.16g with cached plan\n",
+	  sum2, sum);
   master_printf("...PASSED.\n");
 }
 
@@ -260,6 +286,21 @@ void check_splitsym(const grid_volume &gv, int splitting,
       d.ax = d.axy = d.axz = d.axyz = 0;
     check_integral(f, d, v, cgrid);
   }
+
+  // a chunkloop_plan must still be valid after changing the Bloch phases
+  volume v(random_gv(gv.dim));
+  chunkloop_plan plan(v);
+  complex<double> sum0 = 0, sum = 0, sum_new = 0;
+  f.loop_in_chunks(checksum_chunkloop, (void *) &sum0, plan);
+  f.use_bloch(one_vec(gv.dim) * 0.3);
+  f.loop_in_chunks(checksum_chunkloop, (void *) &sum, plan);
+  chunkloop_plan new_plan(v);
+  f.loop_in_chunks(checksum_chunkloop, (void *) &sum_new, new_plan);
+  if (abs(sum - sum_new) > 1e-12 * abs(sum_new) || plan.size() != new_plan.size())
+    abort("FAILED: chunkloop_plan checksum %g%+gi instead of %g%+gi\n",
+	  real(sum), imag(sum), real(sum_new), imag(sum_new));
+  master_printf("chunkloop_plan checksum %g%+gi (%g%+gi with k=0)...PASSED.\n",
+		real(sum), imag(sum), real(sum0), imag(sum0));
 }
 
 // check LOOP_OVER_VOL and LOOP_OVER_VOL_OWNED macros
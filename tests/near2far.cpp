@@ -137,6 +137,55 @@ int check_2d_3d(ndim dim, const double xmax, double a, component c0) {
           }
   }
 
+  /* compare the batched far fields with the single-point far fields */
+  {
+    const int N = 50;
+    vec x[N];
+    for (int i = 0; i < N; ++i) {
+      double s = xmax + 0.1*i;
+      x[i] = dim == D2 ? vec(s, -0.7*s) : vec(-0.2*s, s, 0.5*s);
+    }
+    complex<double> *EHs = n2f.farfields(x, N);
+    double diff = 0.0, dot = 0.0;
+    for (int i = 0; i < N; ++i) {
+      complex<double> *EH1 = n2f.farfield(x[i]);
+      for (int k = 0; k < 6; ++k) {
+        diff += norm(EHs[i*6 + k] - EH1[k]);
+        dot += norm(EH1[k]);
+      }
+      delete[] EH1;
+    }
+    delete[] EHs;
+    master_printf("  BATCHED FARFIELDS: relerr = %g\n", sqrt(diff / dot));
+    if (diff > 1e-24 * dot) return 0;
+  }
+
+  /* compare the fast far-field grid computation with the brute-force sum,
+     on a grid far from the near surface */
+  if (c0 == Ez) {
+    const double tol = 1e-3, R = 15 * xmax, W = 30, res = 1;
+    volume where = dim == D2 ? volume(vec(-W/2,R), vec(W/2,R+W/2))
+      : volume(vec(-W/2,-W/2,R), vec(W/2,W/2,R));
+    const size_t N = dim == D2 ? size_t(W*res) * size_t(W/2*res)
+      : size_t(W*res) * size_t(W*res);
+    complex<double> *EH0 = new complex<double>[N*6], *EH = new complex<double>[N*6];
+    double t0 = wall_time();
+    n2f.farfield_grid_lowlevel(EH0, where, res);
+    double t1 = wall_time();
+    n2f.farfield_grid_lowlevel(EH, where, res, tol);
+    double t2 = wall_time();
+    double diff = 0.0, dot = 0.0;
+    for (size_t i = 0; i < N*6; ++i) {
+      diff += norm(EH[i] - EH0[i]);
+      dot += norm(EH0[i]);
+    }
+    delete[] EH; delete[] EH0;
+    double relerr = sqrt(sum_to_all(diff) / sum_to_all(dot));
+    master_printf("  FAST FARFIELD: %zu points, tol %g: relerr = %g, "
+                  "%g s vs. %g s brute force\n", N, tol, relerr, t2-t1, t1-t0);
+    if (relerr > tol) return 0;
+  }
+
   return 1;
 }
 
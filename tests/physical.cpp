@@ -95,6 +95,64 @@ int radiating_3D(const double xmax) {
   return 1;
 }
 
+static void sweep_point(fields &f, int ifreq, bool converged, void *data) {
+  if (!converged) abort("solve_cw_sweep failed to converge at %d\n", ifreq);
+  complex<double> *amps = (complex<double> *) data;
+  amps[ifreq] = f.get_field(Ez, vec(5.0, 1.5));
+}
+
+int sweep_2D(const double xmax) {
+  const double a = 10.0;
+  const double ymax = 3.0;
+  const int nfreq = 6;
+  // not in increasing order, to check that the results are not permuted
+  const complex<double> freqs[nfreq] = {0.3, 0.26, 0.28, 0.32, 0.34, 0.36};
+
+  grid_volume gv = voltwo(xmax,ymax,a);
+  structure s(gv, one, pml(ymax/3));
+
+  complex<double> amps[nfreq];
+  {
+    fields f(&s);
+    f.add_point_source(Ez, continuous_src_time(0.3), vec(xmax/2 - 2.0, ymax/2));
+    if (!f.solve_cw_sweep(1e-6, 10000, freqs, nfreq, sweep_point, amps))
+      return 0;
+  }
+
+  for (int i = 0; i < nfreq; ++i) {
+    fields f(&s);
+    f.add_point_source(Ez, continuous_src_time(0.3), vec(xmax/2 - 2.0, ymax/2));
+    f.solve_cw(1e-6, 10000, freqs[i]);
+    complex<double> amp = f.get_field(Ez, vec(5.0, 1.5));
+    master_printf("frequency %g: sweep (%g %g) vs. solve_cw (%g %g)\n",
+		  real(freqs[i]), real(amps[i]), imag(amps[i]),
+		  real(amp), imag(amp));
+    if (abs(amps[i] - amp) > 1e-4 * abs(amp)) return 0;
+  }
+  return 1;
+}
+
+int precond_2D(const double xmax) {
+  const double a = 10.0;
+  const double ymax = 3.0;
+
+  grid_volume gv = voltwo(xmax,ymax,a);
+  structure s(gv, one, pml(ymax/3));
+
+  complex<double> amps[2];
+  for (int i = 0; i < 2; ++i) {
+    fields f(&s);
+    f.add_point_source(Ez, continuous_src_time(0.3), vec(xmax/2 - 2.0, ymax/2));
+    int nsteps = 20;
+    if (!f.solve_cw(1e-6, 10000, 0.3, 2, i ? solve_cw_filter : NULL, &nsteps))
+      return 0;
+    amps[i] = f.get_field(Ez, vec(5.0, 1.5));
+  }
+  master_printf("solve_cw (%g %g) vs. preconditioned (%g %g)\n",
+		real(amps[0]), imag(amps[0]), real(amps[1]), imag(amps[1]));
+  return abs(amps[1] - amps[0]) <= 1e-4 * abs(amps[0]);
+}
+
 void attempt(const char *name, int allright) {
   if (allright) master_printf("Passed %s\n", name);
   else abort("Failed %s!\n", name);
@@ -107,5 +165,7 @@ int main(int argc, char **argv) {
 
   attempt("radiating source should decay spatially as 1/sqrt(r) in 2D.", radiating_2D(8.0));
   attempt("radiating source should decay spatially as 1/r in 3D.", radiating_3D(7.0));
+  attempt("solve_cw_sweep should match solve_cw at each frequency.", sweep_2D(8.0));
+  attempt("preconditioned solve_cw should match solve_cw.", precond_2D(8.0));
   return 0;
 }
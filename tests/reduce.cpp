@@ -0,0 +1,218 @@
+/* Copyright (C) 2005-2015 Massachusetts Institute of Technology
+%
+%  This program is free software; you can redistribute it and/or modify
+%  it under the terms of the GNU General Public License as published by
+%  the Free Software Foundation; either version 2, or (at your option)
+%  any later version.
+%
+%  This program is distributed in the hope that it will be useful,
+%  but WITHOUT ANY WARRANTY; without even the implied warranty of
+%  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+%  GNU General Public License for more details.
+%
+%  You should have received a copy of the GNU General Public License
+%  along with this program; if not, write to the Free Software Foundation,
+%  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* Check the in-situ reductions of array slices (get_reduced_array_slice
+   and field_accumulator) against reductions of the full array slices,
+   and the array slices gathered to the master or to no process. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <meep.hpp>
+using namespace meep;
+using namespace std;
+
+const double xsize = 3.0, ysize = 4.0, a = 10.0;
+
+double eps(const vec &p) { return p.y() < 1.5 ? 2.25 : 1.0; }
+
+/* reduce the n0 x n1 array full by op over blocks of s0 x s1 points
+   (0 = all points), as documented for field_reduction */
+static double *reduce_full(const double *full, size_t n0, size_t n1,
+			   int s0, int s1, reduction_op op,
+			   size_t &r0, size_t &r1) {
+  size_t b0 = s0 <= 0 || size_t(s0) > n0 ? n0 : s0;
+  size_t b1 = s1 <= 0 || size_t(s1) > n1 ? n1 : s1;
+  r0 = (n0 + b0 - 1) / b0; r1 = (n1 + b1 - 1) / b1;
+  double *r = new double[r0 * r1];
+  for (size_t i0 = 0; i0 < r0; ++i0)
+    for (size_t i1 = 0; i1 < r1; ++i1) {
+      double v = op == ReduceMin ? infinity : (op == ReduceMax ? -infinity : 0);
+      size_t count = 0;
+      for (size_t j0 = i0*b0; j0 < n0 && j0 < (i0+1)*b0; ++j0)
+	for (size_t j1 = i1*b1; j1 < n1 && j1 < (i1+1)*b1; ++j1, ++count) {
+	  double f = full[j0*n1 + j1];
+	  switch (op) {
+	  case ReduceSample: if (count == 0) v = f; break;
+	  case ReduceSum: case ReduceMean: v += f; break;
+	  case ReduceRMS: v += f*f; break;
+	  case ReduceMin: if (f < v) v = f; break;
+	  case ReduceMax: if (f > v) v = f; break;
+	  }
+	}
+      if (op == ReduceMean) v /= count;
+      if (op == ReduceRMS) v = sqrt(v / count);
+      r[i0*r1 + i1] = v;
+    }
+  return r;
+}
+
+static bool compare(const double *r1, const double *r2, size_t n,
+		    const char *name) {
+  double vmax = 0, err = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (fabs(r1[i]) > vmax) vmax = fabs(r1[i]);
+    if (fabs(r1[i] - r2[i]) > err) err = fabs(r1[i] - r2[i]);
+  }
+  master_printf("  %s: max error %g (max value %g)\n", name, err, vmax);
+  return vmax > 0 && err <= 1e-12 * vmax;
+}
+
+static bool check_reductions(fields &f, const volume &where, int s0, int s1) {
+  size_t dims[3];
+  int rank = f.get_array_slice_dimensions(where, dims);
+  if (rank != 2) abort("expected a 2d slice");
+  double *full = f.get_array_slice(where, Ez);
+
+  const reduction_op ops[] = { ReduceSample, ReduceSum, ReduceMean,
+			       ReduceMin, ReduceMax, ReduceRMS };
+  const char *names[] = { "sample", "sum", "mean", "min", "max", "rms" };
+  bool ok = true;
+  for (int k = 0; k < 6; ++k) {
+    field_reduction r(ops[k]);
+    r.set_stride(X, s0);
+    r.set_stride(Y, s1);
+    size_t r0, r1, rdims[3];
+    double *expected = reduce_full(full, dims[0], dims[1], s0, s1, ops[k],
+				   r0, r1);
+    int rrank = f.get_reduced_array_slice_dimensions(where, r, rdims);
+    if (rrank != (r0 > 1) + (r1 > 1)
+	|| (r0 > 1 && rdims[0] != r0)
+	|| (r1 > 1 && rdims[rrank-1] != r1))
+      abort("wrong reduced dimensions for %s", names[k]);
+    double *reduced = f.get_reduced_array_slice(where, Ez, r);
+    ok = compare(expected, reduced, r0 * r1, names[k]) && ok;
+    delete[] reduced;
+    delete[] expected;
+  }
+  delete[] full;
+  return ok;
+}
+
+/* time-average of |E|^2 + |H|^2, downsampled by 4 along x */
+static bool check_accumulator(fields &f, const volume &where) {
+  std::vector<component> cs;
+  cs.push_back(Ez); cs.push_back(Hx); cs.push_back(Hy);
+  field_reduction r(ReduceSample);
+  r.set_stride(X, 4);
+  field_accumulator acc(&f, where, cs, r, ReduceMean);
+
+  size_t dims[3];
+  f.get_array_slice_dimensions(where, dims);
+  size_t n = dims[0] * dims[1];
+  double *sum = new double[n];
+  for (size_t i = 0; i < n; ++i) sum[i] = 0;
+  const int nsteps = 20;
+  for (int t = 0; t < nsteps; ++t) {
+    f.step();
+    acc.update();
+    for (int i = 0; i < 3; ++i) {
+      double *fi = f.get_array_slice(where, cs[i]);
+      for (size_t j = 0; j < n; ++j) sum[j] += fi[j] * fi[j];
+      delete[] fi;
+    }
+  }
+  for (size_t j = 0; j < n; ++j) sum[j] /= nsteps;
+
+  size_t r0, r1;
+  double *expected = reduce_full(sum, dims[0], dims[1], 4, 1, ReduceSample,
+				 r0, r1);
+  if (acc.n != r0 * r1 || acc.num_updates != nsteps)
+    abort("wrong field_accumulator size");
+  double *mean = acc.get();
+  bool ok = compare(expected, mean, acc.n, "time-averaged |E|^2 + |H|^2");
+  delete[] mean;
+  delete[] expected;
+  delete[] sum;
+  return ok;
+}
+
+/* GatherToMaster and GatherNone slices vs. the slice on all processes */
+static bool check_gather(fields &f, const volume &where) {
+  size_t dims[3];
+  int rank = f.get_array_slice_dimensions(where, dims);
+  size_t n = 1, gdims[3] = {1, 1, 1};
+  for (int i = 0; i < rank; ++i) n *= (gdims[i] = dims[i]);
+  double *full = f.get_array_slice(where, Ez);
+  complex<double> *zfull = f.get_complex_array_slice(where, Hx);
+
+  bool ok = true;
+  double *master = f.get_array_slice(where, Ez, 0, GatherToMaster);
+  complex<double> *zmaster = f.get_complex_array_slice(where, Hx, 0,
+						       GatherToMaster);
+  if (am_master()) {
+    for (size_t i = 0; i < n; ++i)
+      ok = ok && master[i] == full[i] && zmaster[i] == zfull[i];
+    delete[] master;
+    delete[] zmaster;
+  }
+  else
+    ok = !master && !zmaster;
+  ok = and_to_all(ok);
+  master_printf("  gathered to the master: %s\n", ok ? "ok" : "wrong");
+
+  // each point of the slice is in the local block of exactly one process
+  size_t start[3], count[3];
+  f.get_local_array_slice_dimensions(where, start, count);
+  double *local = f.get_array_slice(where, Ez, 0, GatherNone);
+  size_t nlocal = count[0] * count[1] * count[2];
+  if ((nlocal == 0) != (local == 0)) abort("wrong local slice");
+  double *sum = new double[n];
+  for (size_t i = 0; i < n; ++i) sum[i] = 0;
+  for (size_t j0 = 0, j = 0; j0 < count[0]; ++j0)
+    for (size_t j1 = 0; j1 < count[1]; ++j1)
+      for (size_t j2 = 0; j2 < count[2]; ++j2, ++j)
+	sum[((start[0] + j0) * gdims[1] + start[1] + j1) * gdims[2]
+	    + start[2] + j2] += local[j];
+  sum_to_all(sum, sum, n);
+  bool lok = true;
+  for (size_t i = 0; i < n; ++i) lok = lok && fabs(sum[i] - full[i]) <= 1e-14 * fabs(full[i]);
+  master_printf("  local blocks (%zu of %zu points on the master): %s\n",
+		nlocal, n, lok ? "ok" : "wrong");
+  delete[] sum;
+  delete[] local;
+  delete[] zfull;
+  delete[] full;
+  return ok && lok;
+}
+
+int main(int argc, char **argv) {
+  initialize mpi(argc, argv);
+  quiet = true;
+  const grid_volume gv = vol2d(xsize, ysize, a);
+  structure s(gv, eps, pml(0.5, Y), mirror(X, gv), 3);
+  fields f(&s);
+  f.use_real_fields();
+  f.add_point_source(Ez, 0.8, 1.0, 0.0, 4.0, vec(xsize/2, 1.0), 1.0);
+  while (f.time() < 5.0) f.step();
+
+  const volume whole(vec(0, 0), vec(xsize, ysize));
+  const volume part(vec(0.25, 0.8), vec(2.35, 3.3));
+  master_printf("Checking reductions of the whole cell...\n");
+  if (!check_reductions(f, whole, 3, 5)) abort("error in reductions");
+  master_printf("Checking projections of part of the cell...\n");
+  if (!check_reductions(f, part, 0, 2)) abort("error in projections");
+  if (!check_reductions(f, part, 4, 0)) abort("error in projections");
+  if (!check_reductions(f, part, 0, 0)) abort("error in projections");
+  master_printf("Checking gathering of array slices...\n");
+  if (!check_gather(f, whole)) abort("error in gathering the whole cell");
+  if (!check_gather(f, part)) abort("error in gathering part of the cell");
+  master_printf("Checking field_accumulator...\n");
+  if (!check_accumulator(f, part)) abort("error in field_accumulator");
+  return 0;
+}
@@ -331,6 +331,135 @@ int test_pml_te(double eps(const vec &), int splitting, const char *mydirname) {
   return 1;
 }
 
+/* Sources with the same time dependence in adjoining volumes, which
+   are merged into a single src_vol, must be equivalent to a single
+   source in the union of the volumes (since the integration weights
+   are additive). */
+int test_sources(double eps(const vec &), int splitting, const char *mydirname) {
+  double a = 10.0;
+  double ttot = 10.0;
+
+  grid_volume gv = voltwo(3.0, 2.0, a);
+  structure s(gv, eps, no_pml(), identity(), splitting);
+  s.set_output_directory(mydirname);
+
+  master_printf("Merged sources test using %d chunks...\n", splitting);
+  gaussian_src_time src(0.8, 0.6);
+  fields f(&s);
+  f.add_volume_source(Ez, src, volume(vec(0.5,0.63), vec(1.27,0.63)), 1.0);
+  f.add_volume_source(Ez, src, volume(vec(1.27,0.63), vec(2.2,0.63)), 1.0);
+  f.add_volume_source(Hz, src, volume(vec(2.04,0.3), vec(2.04,1.1)),
+		      complex<double>(0.3,0.5));
+  f.add_volume_source(Hz, src, volume(vec(2.04,1.1), vec(2.04,1.7)),
+		      complex<double>(0.3,0.5));
+  fields f1(&s);
+  f1.add_volume_source(Ez, src, volume(vec(0.5,0.63), vec(2.2,0.63)), 1.0);
+  f1.add_volume_source(Hz, src, volume(vec(2.04,0.3), vec(2.04,1.7)),
+		       complex<double>(0.3,0.5));
+  while (f.time() < ttot) {
+    f.step();
+    f1.step();
+    if (!compare_point(f, f1, vec(0.5  , 0.01))) return 0;
+    if (!compare_point(f, f1, vec(1.27 , 0.63))) return 0;
+    if (!compare_point(f, f1, vec(2.04 , 1.1 ))) return 0;
+  }
+  return 1;
+}
+
+double left_half(const vec &pt) { return pt.x() < 1.5 ? 0.8 : 0.0; }
+double stripe(const vec &pt) { return fabs(pt.y() - 1.0) < 0.3 ? 0.5 : 0.0; }
+
+/* A medium with several Lorentz and Drude poles, whose polarizations are
+   timestepped together by the fused multi-pole update, must give the
+   same fields as the same poles as (noiseless) noisy Lorentzian
+   susceptibilities, which are timestepped one at a time. */
+int test_poles(int splitting, const char *mydirname) {
+  double a = 10.0;
+  double ttot = 12.0;
+
+  grid_volume gv = voltwo(3.0, 2.0, a);
+  structure s(gv, targets, no_pml(), identity(), splitting);
+  structure s1(gv, targets, no_pml(), identity(), splitting);
+  s.set_output_directory(mydirname);
+  s1.set_output_directory(mydirname);
+
+  const double omega0[4] = {0.3, 0.8, 1.3, 1.0}, gamma[4] = {0.1, 0.2, 0.5, 0.1};
+  double (*sigma[4])(const vec &) = {one, left_half, stripe, left_half};
+  for (int k = 0; k < 4; ++k) {
+    const bool drude = k == 3;
+    s.add_susceptibility(sigma[k], E_stuff,
+			 lorentzian_susceptibility(omega0[k], gamma[k], drude));
+    s1.add_susceptibility(sigma[k], E_stuff,
+			  noisy_lorentzian_susceptibility(0.0, omega0[k],
+							  gamma[k], drude));
+  }
+
+  master_printf("Multi-pole dispersion test using %d chunks...\n", splitting);
+  // the noisy susceptibilities initialize the random numbers, which
+  // involves communication, only on the processes that own chunks
+  set_random_seed(1);
+  fields f(&s);
+  f.add_point_source(Hz, 0.7, 2.5, 0.0, 4.0, vec(0.3,0.5), 1.0);
+  f.add_point_source(Ez, 0.8, 0.6, 0.0, 4.0, vec(1.299,0.401), 1.0);
+  fields f1(&s1);
+  f1.add_point_source(Hz, 0.7, 2.5, 0.0, 4.0, vec(0.3,0.5), 1.0);
+  f1.add_point_source(Ez, 0.8, 0.6, 0.0, 4.0, vec(1.299,0.401), 1.0);
+  while (f.time() < ttot) {
+    f.step();
+    f1.step();
+    if (!compare_point(f, f1, vec(0.5  , 0.01))) return 0;
+    if (!compare_point(f, f1, vec(0.46 , 0.33))) return 0;
+    if (!compare_point(f, f1, vec(1.0  , 1.0 ))) return 0;
+  }
+  if (!compare(f.field_energy(), f1.field_energy(), "   total energy"))
+    return 0;
+  return 1;
+}
+
+double film(const vec &pt) { return fabs(pt.y() - 1.0) < 0.15 ? 1.0 : 0.0; }
+double film_background(const vec &pt) { return film(pt) + 1e-30; }
+
+/* A thin dispersive film, whose polarizations are stored only near the
+   film (and at the chunk boundaries), must give the same fields as the
+   same film with a negligible sigma everywhere else, for which the
+   polarizations are stored over the whole cell. */
+int test_sparse_pol(int splitting, const char *mydirname) {
+  double a = 10.0;
+  double ttot = 12.0;
+
+  grid_volume gv = voltwo(3.0, 2.0, a);
+  structure s(gv, targets, no_pml(), identity(), splitting);
+  structure s1(gv, targets, no_pml(), identity(), splitting);
+  s.set_output_directory(mydirname);
+  s1.set_output_directory(mydirname);
+  s.add_susceptibility(film, E_stuff, lorentzian_susceptibility(1.1, 0.1));
+  s.add_susceptibility(film, H_stuff, lorentzian_susceptibility(0.5, 0.2, true));
+  s1.add_susceptibility(film_background, E_stuff,
+			lorentzian_susceptibility(1.1, 0.1));
+  s1.add_susceptibility(film_background, H_stuff,
+			lorentzian_susceptibility(0.5, 0.2, true));
+
+  master_printf("Sparse polarization test using %d chunks...\n", splitting);
+  fields f(&s);
+  fields f1(&s1);
+  f.use_bloch(vec(0.1, 0.3));
+  f1.use_bloch(vec(0.1, 0.3));
+  f.add_point_source(Hz, 0.7, 2.5, 0.0, 4.0, vec(0.3,0.95), 1.0);
+  f.add_point_source(Ez, 0.8, 0.6, 0.0, 4.0, vec(1.299,1.4), 1.0);
+  f1.add_point_source(Hz, 0.7, 2.5, 0.0, 4.0, vec(0.3,0.95), 1.0);
+  f1.add_point_source(Ez, 0.8, 0.6, 0.0, 4.0, vec(1.299,1.4), 1.0);
+  while (f.time() < ttot) {
+    f.step();
+    f1.step();
+    if (!compare_point(f, f1, vec(0.5  , 0.01))) return 0;
+    if (!compare_point(f, f1, vec(0.46 , 1.03))) return 0;
+    if (!compare_point(f, f1, vec(2.9  , 1.1 ))) return 0;
+  }
+  if (!compare(f.field_energy(), f1.field_energy(), "   total energy"))
+    return 0;
+  return 1;
+}
+
 int main(int argc, char **argv) {
   initialize mpi(argc, argv);
   quiet = true;
@@ -367,5 +496,15 @@ int main(int argc, char **argv) {
     if (!test_periodic_tm(one, s, mydirname))
       abort("error in test_periodic_tm vacuum\n");
 
+  for (int s=1;s<4;s++)
+    if (!test_sources(targets, s, mydirname))
+      abort("error in test_sources targets\n");
+
+  for (int s=1;s<4;s++)
+    if (!test_poles(s, mydirname)) abort("error in test_poles\n");
+
+  for (int s=1;s<4;s++)
+    if (!test_sparse_pol(s, mydirname)) abort("error in test_sparse_pol\n");
+
   return 0;
 }